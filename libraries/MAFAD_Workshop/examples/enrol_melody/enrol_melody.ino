@@ -0,0 +1,138 @@
+// Teach the robot a new melody in a few seconds, no training needed.
+// Press the button, then play your melody 3 times with a short pause in between
+// (a phone, a piano, a second robot). The led ring shows how many takes were heard.
+// From then on the robot recognises the melody, also after a restart: it is kept in flash.
+// Hold the button for 2 seconds to forget all melodies that were taught.
+//
+// The melody detector hears hello_there as well, so try teaching it that one: it says no,
+// it knows it already.
+
+#include <Bounce2.h>
+
+// Include the AI Workshop libraries
+#include <ai-workshop-main.h>
+#include <ai-workshop-mic.h>
+#include <ai-workshop-ws2812.h>
+#include <ai-workshop-pitches.h>
+#include <ai-workshop-melody.h>
+#include <ai-workshop-enrol.h>
+
+// Microphone pins
+#define MIC_SCK_PIN 1   // clockPin
+#define MIC_WS_PIN 7    // wordSelectPin
+#define MIC_SD_PIN 10   // channelSelectPin
+
+#define BUTTON_PIN 17   // button pin
+#define LEDRING_PIN 43  // ledring data pin
+#define NUM_LEDS 8      // the ledring uses 8 leds
+
+uint32_t randomness = 0;
+
+const MelodyNote hello_there[] = {
+    {NOTE_C3, 60}, {NOTE_C4, 60}, {0, 30}, {NOTE_D3, 60}, {NOTE_D4, 60}, {0, 30},
+    {NOTE_DS3, 60}, {NOTE_DS4, 60}, {0, 30}, {NOTE_F3, 60}, {NOTE_F4, 60}, {0, 30},
+    {NOTE_G3, 60}, {NOTE_G4, 60}, {0, 30}, {NOTE_GS3, 60}, {NOTE_GS4, 60}, {0, 30},
+    {NOTE_AS3, 60}, {NOTE_AS4, 60}, {0, 30}, {NOTE_C4, 60}, {NOTE_C5, 60}};
+
+Color leds[NUM_LEDS];
+WS2812 ledRing;
+Bounce2::Button Button1 = Bounce2::Button();
+
+i2sMic mic;
+MelodyDetector melodies;
+MelodyEnroller enroller;
+
+int taught = 0;   // for the names: melody_1, melody_2, ...
+
+void showTakes(uint8_t takes, Color color)
+{
+    for (int i = 0; i < NUM_LEDS; i++) leds[i] = i < takes ? color : Color(0, 0, 0);
+    ledRing.update();
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    Serial.println("--------------------");
+    Serial.println("* Enrol Melody *");
+
+    pinMode(LEDRING_PIN, OUTPUT);
+    ledRing.init(LEDRING_PIN, leds, NUM_LEDS);
+    ledRing.clear();
+    ledRing.update();
+
+    Button1.attach(BUTTON_PIN, INPUT_PULLDOWN);
+    Button1.interval(10);
+    Button1.setPressedState(HIGH);
+
+    melodies.begin();
+    melodies.addMelody("hello_there", hello_there, sizeof(hello_there) / sizeof(hello_there[0]));
+    enroller.begin(melodies);
+    taught = enroller.size();
+    for (uint8_t i = 0; i < enroller.size(); i++) Serial.printf("I know %s\n", enroller.name(i));
+
+    mic.setup(MIC_SCK_PIN, MIC_WS_PIN, MIC_SD_PIN);
+    melodies.attach(mic);
+    mic.startStream(DMA_BUFFER_SIZE);
+
+    Serial.println("Press the button and play a melody 3 times.");
+}
+
+void loop()
+{
+    Button1.update();
+    if (Button1.released())
+    {
+        if (Button1.previousDuration() >= 2000)
+        {
+            enroller.forgetAll();
+            taught = 0;
+            Serial.println("Forgot all melodies that were taught.");
+        }
+        else
+        {
+            char name[ENROL_NAME_SIZE];
+            snprintf(name, sizeof(name), "melody_%d", taught + 1);
+            enroller.start(name);
+            Serial.printf("Play %s 3 times...\n", name);
+        }
+    }
+
+    // the stream is only read for the detector here
+    if (mic.isStreamReady()) mic.consumeStream();
+
+    static uint8_t lastTakes = 0;
+    EnrolState state = enroller.update();
+    if (state == EnrolState::Waiting || state == EnrolState::Playing)
+    {
+        uint8_t takes = enroller.takesHeard();
+        if (takes != lastTakes) Serial.printf("take %u heard\n", takes);
+        lastTakes = takes;
+        showTakes(takes, Color(0, 0, 40));
+    }
+    else if (state == EnrolState::Complete || state == EnrolState::Failed)
+    {
+        if (state == EnrolState::Complete)
+        {
+            taught++;
+            Serial.println("Got it! Play it again and I will recognise it.");
+            enroller.printStats();
+        }
+        showTakes(NUM_LEDS, state == EnrolState::Complete ? Color(0, 40, 0) : Color(40, 0, 0));
+        delay(500);
+        ledRing.clear();
+        ledRing.update();
+        enroller.cancel();   // back to Idle
+        lastTakes = 0;
+    }
+
+    MelodyMatch match;
+    while (melodies.getMatch(match))
+    {
+        Serial.printf("heard %s (cost %.2f)\n", match.name, match.cost);
+        showTakes(NUM_LEDS, Color(40, 40, 0));
+        delay(200);
+        ledRing.clear();
+        ledRing.update();
+    }
+}
@@ -0,0 +1,198 @@
+// Compare the Edge Impulse model with the Goertzel melody detector on recordings.
+// Put recordings made with record_dataset in /master on the SD card
+// (hello_there.MAFAD000001.wav, ...). Every file is replayed through both
+// detectors; we print what each one heard, the accuracy and the CPU time.
+//
+// The melody detector knows the melodies from their notes (the same as in
+// record_dataset), it does not need any training.
+
+// Include the model from Edge Impulse
+#define EIDSP_QUANTIZE_FILTERBANK   0
+#include <MAFAD_Classifier_inferencing.h>
+
+// Include the AI Workshop libraries
+#include <ai-workshop-main.h>
+#include <ai-workshop-pitches.h>
+#include <ai-workshop-sdcard.h>
+#include <ai-workshop-melody.h>
+
+#define SDCARD_CS_PIN 6 // sdcard chip select pin
+#define RECORDINGS "/master"
+
+#define EI_THRESHOLD 0.6f   // smoothed score the model needs to count as a detection
+
+// The melodies from record_dataset
+const MelodyNote hello_there[] = {
+    {NOTE_C3, 60}, {NOTE_C4, 60}, {0, 30}, {NOTE_D3, 60}, {NOTE_D4, 60}, {0, 30},
+    {NOTE_DS3, 60}, {NOTE_DS4, 60}, {0, 30}, {NOTE_F3, 60}, {NOTE_F4, 60}, {0, 30},
+    {NOTE_G3, 60}, {NOTE_G4, 60}, {0, 30}, {NOTE_GS3, 60}, {NOTE_GS4, 60}, {0, 30},
+    {NOTE_AS3, 60}, {NOTE_AS4, 60}, {0, 30}, {NOTE_C4, 60}, {NOTE_C5, 60}};
+
+MelodyNote i_love_cake[100];
+
+const MelodyNote get_bonus[] = {
+    {NOTE_C4, 30}, {NOTE_DS4, 30}, {NOTE_G4, 30}, {NOTE_C4, 30}, {NOTE_DS4, 30}, {NOTE_G4, 30},
+    {NOTE_C4, 30}, {NOTE_DS4, 30}, {NOTE_G4, 30}, {0, 30}, {NOTE_C2, 90}, {0, 30},
+    {NOTE_C4, 30}, {NOTE_DS4, 30}, {NOTE_G4, 30}, {NOTE_C4, 30}, {NOTE_DS4, 30}, {NOTE_G4, 30},
+    {NOTE_C4, 30}, {NOTE_DS4, 30}, {NOTE_G4, 30}, {0, 30}, {NOTE_C2, 90}, {0, 30},
+    {NOTE_C5, 30}, {NOTE_AS4, 30}, {NOTE_G5, 30}, {NOTE_C5, 30}, {NOTE_AS4, 30}, {NOTE_G5, 30},
+    {NOTE_C5, 30}, {NOTE_AS4, 30}, {NOTE_G5, 30}, {NOTE_C5, 30}, {NOTE_AS4, 30}, {NOTE_G5, 30},
+    {NOTE_C5, 30}, {NOTE_AS4, 30}, {NOTE_G5, 30}, {NOTE_C5, 30}, {NOTE_AS4, 30}, {NOTE_G5, 30},
+    {NOTE_C5, 30}, {NOTE_AS4, 30}, {NOTE_G5, 30}, {NOTE_C5, 30}, {NOTE_AS4, 30}, {NOTE_G5, 30}};
+
+// Create the sd card and melody detector objects
+SDCard sdCard;
+MelodyDetector melodies;
+
+// one slice of audio for the model
+int16_t samples[EI_CLASSIFIER_SLICE_SIZE];
+
+int files = 0;
+int eiCorrect = 0;
+int melodyCorrect = 0;
+uint64_t eiTimeUs = 0;
+uint64_t melodyTimeUs = 0;
+uint64_t audioUs = 0;
+
+int getSliceData(size_t offset, size_t length, float* out_ptr)
+{
+    return numpy::int16_to_float(&samples[offset], out_ptr, length);
+}
+
+// The label is the start of the file name: hello_there.MAFAD000001.wav
+String labelOf(const char* name)
+{
+    char label[32];
+    snprintf(label, sizeof(label), "%s", name);
+    char* dot = strchr(label, '.');
+    if (dot) *dot = 0;
+    return String(label);
+}
+
+bool isMelody(const String& label)
+{
+    return label == "hello_there" || label == "i_love_cake" || label == "get_bonus";
+}
+
+void testFile(File& file)
+{
+    // the recordings are 16 bit mono at 20 kHz; newer ones have a LIST/INFO chunk after the samples
+    uint8_t header[256];
+    size_t headerBytes = file.read(header, sizeof(header));
+    WavInfo info;
+    if (!parseWavHeader(header, headerBytes, info) || info.channels != 1 || info.sampleRate != SAMPLE_RATE ||
+        !file.seek(info.dataOffset)) {
+        return;
+    }
+    uint32_t remaining = wavDataBytes(info, file.size());
+
+    String truth = labelOf(file.name());
+    float summed[EI_CLASSIFIER_LABEL_COUNT] = {0};
+    float eiBest = 0.0f;
+    String eiHeard = "noise";
+
+    run_classifier_init();
+    melodies.reset();
+
+    while (remaining >= sizeof(samples)) {
+        file.read((uint8_t*)samples, sizeof(samples));
+        remaining -= sizeof(samples);
+        audioUs += 1000000ULL * EI_CLASSIFIER_SLICE_SIZE / SAMPLE_RATE;
+
+        // the model
+        signal_t signal;
+        signal.total_length = EI_CLASSIFIER_SLICE_SIZE;
+        signal.get_data = &getSliceData;
+        ei_impulse_result_t result = {0};
+        uint32_t start = micros();
+        EI_IMPULSE_ERROR error = run_classifier_continuous(&signal, &result, false);
+        eiTimeUs += micros() - start;
+        if (error == EI_IMPULSE_OK) {
+            for (size_t ix = 0; ix < EI_CLASSIFIER_LABEL_COUNT; ix++) {
+                summed[ix] = 0.5f * summed[ix] + 0.5f * result.classification[ix].value;
+                if (summed[ix] > eiBest && summed[ix] > EI_THRESHOLD && isMelody(result.classification[ix].label)) {
+                    eiBest = summed[ix];
+                    eiHeard = result.classification[ix].label;
+                }
+            }
+        }
+
+        // the melody detector, on the same samples
+        start = micros();
+        melodies.process(samples, EI_CLASSIFIER_SLICE_SIZE, esp_timer_get_time());
+        melodyTimeUs += micros() - start;
+    }
+
+    String melodyHeard = "noise";
+    float bestCost = 1e9f;
+    MelodyMatch match;
+    while (melodies.getMatch(match)) {
+        if (match.cost < bestCost) {
+            bestCost = match.cost;
+            melodyHeard = match.name;
+        }
+    }
+
+    if (!isMelody(truth)) truth = "noise";
+    files++;
+    if (eiHeard == truth) eiCorrect++;
+    if (melodyHeard == truth) melodyCorrect++;
+
+    Serial.printf("%-36s model: %-12s melody: %-12s %s\n", file.name(), eiHeard.c_str(), melodyHeard.c_str(),
+                  (eiHeard == truth && melodyHeard == truth) ? "" : "<--");
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    delay(2000);
+    Serial.println("--------------------");
+    Serial.println("* Melody Benchmark *");
+
+    // the melody with the sliding tone
+    for (int loop = 0; loop < 50; loop++) {
+        i_love_cake[2 * loop] = { (uint16_t)(800 - loop * 5), 15 };
+        i_love_cake[2 * loop + 1] = { 0, 15 };
+    }
+
+    melodies.begin();
+    melodies.addMelody("hello_there", hello_there, sizeof(hello_there) / sizeof(hello_there[0]));
+    melodies.addMelody("i_love_cake", i_love_cake, 100);
+    melodies.addMelody("get_bonus", get_bonus, sizeof(get_bonus) / sizeof(get_bonus[0]));
+
+    if (!sdCard.setup(SDCARD_CS_PIN)) {
+        return;
+    }
+
+    File dir = SD.open(RECORDINGS);
+    if (!dir || !dir.isDirectory()) {
+        Serial.println("No " RECORDINGS " folder on the SD card");
+        return;
+    }
+
+    File file = dir.openNextFile();
+    while (file) {
+        if (!file.isDirectory() && strstr(file.name(), ".wav")) {
+            testFile(file);
+        }
+        file.close();
+        file = dir.openNextFile();
+    }
+
+    if (files == 0) {
+        Serial.println("No recordings found");
+        return;
+    }
+
+    float seconds = audioUs / 1e6f;
+    Serial.println();
+    Serial.printf("%d files, %.0f seconds of audio\n", files, seconds);
+    Serial.printf("model:  %5.1f%% correct, %7.1f ms CPU per second of audio\n", 100.0f * eiCorrect / files, eiTimeUs / 1000.0f / seconds);
+    Serial.printf("melody: %5.1f%% correct, %7.1f ms CPU per second of audio\n", 100.0f * melodyCorrect / files, melodyTimeUs / 1000.0f / seconds);
+    Serial.printf("the melody detector needs %.1f%% of the CPU time of the model\n", 100.0f * melodyTimeUs / (float)eiTimeUs);
+}
+
+void loop()
+{
+    delay(1000);
+}
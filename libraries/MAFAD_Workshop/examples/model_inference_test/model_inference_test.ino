@@ -7,12 +7,45 @@
 #include <ai-workshop-main.h>
 #include <ai-workshop-ws2812.h>
 #include <ai-workshop-mic.h>
+#include <ai-workshop-telemetry.h>
+#include <ai-workshop-listen.h>
+#include <ai-workshop-store.h>
+#include <ai-workshop-results.h>
+#include <ai-workshop-boot.h>
+
+// Set to true to send the results as compact binary records instead of text.
+// Printing every label costs a lot of time in the loop, telemetry is sent
+// in the background. The Arduino Serial Monitor cannot show it, read it on
+// your computer with:
+//   python3 tools/telemetry_decode.py /dev/ttyACM0
+#define USE_TELEMETRY false
+
+// Save battery: while it is quiet only a simple loudness detector runs at a
+// low CPU clock, the classifier starts when a sound comes in.
+#define LOW_POWER_LISTENING false
+
+// Keep a log of every melody that was heard in flash, to look at after a performance.
+// Type 'e' in the Serial Monitor to print it (as CSV), 'c' to clear it,
+// 'd' and a number (like d0.7) to change the score smoothing; it is kept in flash too.
+#define LOG_DETECTIONS true
+
+// Answer a melody that was heard with a short melody of our own. The audio output engine
+// plays it in the background, the classifier keeps listening. The speaker pin gets a PDM
+// signal: it needs an RC filter or an amplifier. The microphone moves to I2S port 1, because
+// only port 0 can make PDM.
+#define PLAY_ANSWER false
+
+// Show the sound on the led ring: one led per band of frequencies, low (red) to high (blue),
+// instead of the scanning led. The melody colors still take over when a melody is heard.
+#define LED_SPECTRUM false
 
 // Microphone pins
 #define MIC_SCK_PIN 1   // clockPin
 #define MIC_WS_PIN 7    // wordSelectPin
 #define MIC_SD_PIN 10   // channelSelectPin
 
+#define AUDIO_OUT_PIN 11 // amplifier / speaker pin
+
 #define LEDRING_PIN 43   // ledring data pin
 #define NUM_LEDS 8 // the ledring uses 8 leds
 
@@ -29,9 +62,11 @@ uint32_t ledSequenceTimer = 0;
 uint32_t capture_size = EI_CLASSIFIER_SLICE_SIZE;
 int number_of_labels = EI_CLASSIFIER_LABEL_COUNT;
 
-// Share the classification results
-volatile ei_impulse_result_t classifier_results;
-volatile bool classifier_updated = false;
+// Share the classification results between the inference task and loop().
+// The channel keeps the last results, so none is lost when loop() is busy for a moment.
+ResultChannel results;
+uint32_t results_cursor = 0; // the last result loop() has seen
+uint32_t results_lost = 0;   // results loop() was too late for
 
 // In order to improve detection stability, we sum and average 
 // the classification scores over multiple inferences.
@@ -39,10 +74,51 @@ volatile bool classifier_updated = false;
 static float summed_scores[EI_CLASSIFIER_LABEL_COUNT];
 float max_score = 0.0f;
 int best_label = -1;
+int logged_label = -1;
+float score_decay = 0.5f; // how much of the old summed score is kept every inference
 
 // Create microphone object
 i2sMic mic;
 
+// Create telemetry object
+Telemetry telemetry;
+
+// Create the low power listening object
+ListeningMode listener;
+uint32_t listen_timer = 0;
+
+// Create the store object, it keeps the detection log and settings in flash
+Store store;
+bool store_ready = false;
+
+#if PLAY_ANSWER
+#include <ai-workshop-pitches.h>
+#include <ai-workshop-audio-out.h>
+
+// Create the audio output object and an answer for every melody
+uint32_t randomness = 0;
+AudioOut audio;
+int answered_label = -1;
+uint32_t audio_timer = 0;
+static const MelodyNote answers[3][4] = {
+    { { NOTE_C5, 80 }, { NOTE_E5, 80 }, { NOTE_G5, 80 }, { NOTE_C6, 160 } },
+    { { NOTE_G5, 80 }, { NOTE_E5, 80 }, { NOTE_C5, 80 }, { NOTE_G4, 160 } },
+    { { NOTE_E5, 120 }, { 0, 40 }, { NOTE_E5, 120 }, { NOTE_A5, 200 } },
+};
+#endif
+
+#if LED_SPECTRUM
+#include <ai-workshop-visualiser.h>
+
+// Create the visualiser object, it draws the spectrum in a task of its own
+Visualiser visualiser;
+uint32_t visualiser_timer = 0;
+#endif
+
+// Create the boot object, it starts the slow parts in the background and times the start
+Boot boot;
+bool boot_printed = false;
+
 
 // We create a Task, that can run on the second CPU core,
 // So we can things in parallel and have room on the first 
@@ -50,6 +126,15 @@ i2sMic mic;
 void inferenceTask(void* param) {
     while (true) {
 
+#if LOW_POWER_LISTENING
+        // While it is quiet the task sleeps here (and the CPU runs slow)
+        listener.waitForActive();
+        // Just woke up: the classifier still remembers the audio from before it went quiet
+        if (listener.needsResync()) {
+            run_classifier_init();
+        }
+#endif
+
         // A stream is not a real continuous signal but rather a series of
         // blocks/slices of audio data. We wait here until a now chunk of
         // audio data has come in from the microphone.
@@ -63,18 +148,22 @@ void inferenceTask(void* param) {
 
             // Run the classifier on the collected audio data and store the classification in 'result'.
             ei_impulse_result_t result = {0};
+            uint32_t start_time = micros();
             EI_IMPULSE_ERROR error = run_classifier_continuous(&signal, &result, false);
+            uint32_t inference_time = micros() - start_time;
+
+#if LOW_POWER_LISTENING
+            listener.markInference();
+#endif
 
             // If there is an error, we just skip this round
             if (error != EI_IMPULSE_OK) {
                 continue;
             }
 
-            // only update the shared result if the old results have been consumed.
-            if (classifier_updated == false) {
-                memcpy((void*)&classifier_results, (void*)&result, sizeof(ei_impulse_result_t));
-                classifier_updated = true;
-            }
+            // share the scores with loop(), it does not wait for loop()
+            results.publish(result, number_of_labels, -1, inference_time);
+            boot.mark("first result");
 
         }
         vTaskDelay(10 / portTICK_PERIOD_MS);
@@ -83,51 +172,89 @@ void inferenceTask(void* param) {
 
 void setup()
 {
+    // Start the boot timeline
+    boot.begin();
+
     // Start serial printing for debugging
     Serial.begin(115200);
     Serial.println("--------------------");
     Serial.println("* Model Inference Test *");
 
-    // Initialize the classifier / model
-    run_classifier_init();
-
+    // Listening comes first: a robot that was switched off and on should hear again quickly.
     // Set up the microphone and start audio stream for inference
-    mic.setup(MIC_SCK_PIN, MIC_WS_PIN, MIC_SD_PIN);
-    mic.startStream(capture_size); 
+    boot.run("microphone", [] {
+#if PLAY_ANSWER
+        bool ok = mic.setup(MIC_SCK_PIN, MIC_WS_PIN, MIC_SD_PIN, I2S_NUM_1);
+#else
+        bool ok = mic.setup(MIC_SCK_PIN, MIC_WS_PIN, MIC_SD_PIN);
+#endif
+#if LOW_POWER_LISTENING
+        listener.begin(mic);
+#endif
+#if LED_SPECTRUM
+        // the stream hook is added before the stream starts, the ring is switched on below
+        visualiser.setEnabled(false);
+        ok = ok && visualiser.begin(mic, ledRing, NUM_LEDS);
+#endif
+        return ok && mic.startStream(capture_size);
+    });
+
+    // Initialize the classifier / model
+    boot.run("classifier", [] {
+        run_classifier_init();
+        return true;
+    });
 
     // Clear the summed score for each label
     for (int i = 0; i< number_of_labels; i++) {
         summed_scores[i] = 0;
     }
 
-    // Setup LedRing
-    pinMode(LEDRING_PIN, OUTPUT);
-    ledRing.init(LEDRING_PIN, leds, NUM_LEDS);
-    ledRing.clear();
-    ledRing.update();
-
     // Start inference task on the other CPU core
     xTaskCreatePinnedToCore(inferenceTask, "InferenceTask", 8192, NULL, 2, NULL, 0); // 0 = core 0
 
+#if LOG_DETECTIONS
+    // Mounting the flash storage can take a while (the very first time it is formatted),
+    // so it happens in the background while the robot already listens
+    boot.start("flash storage", [] { return store.begin(); });
+#endif
+
+    // Setup LedRing
+    boot.run("led ring", [] {
+        pinMode(LEDRING_PIN, OUTPUT);
+        ledRing.init(LEDRING_PIN, leds, NUM_LEDS);
+        ledRing.clear();
+        ledRing.update();
+#if LED_SPECTRUM
+        visualiser.setEnabled(true);
+#endif
+        return true;
+    });
+
+#if PLAY_ANSWER
+    boot.run("audio out", [] { return audio.begin(AUDIO_OUT_PIN); });
+#endif
+
+#if USE_TELEMETRY
+    // Start sending results in the background
+    telemetry.begin(ei_classifier_inferencing_categories, number_of_labels);
+#endif
+
 }
 
 void loop()
 {
  
-    if (classifier_updated) {
+    // Handle every new result once, in order
+    ResultRecord record;
+    while (results.next(results_cursor, record, &results_lost)) {
         // reset the score tracking variables to calculate the new winner
         max_score = 0;
         best_label = -1;
 
-        // Print the averaged score for each label
+        // Average the score for each label and find the best one
         for (size_t ix = 0; ix < number_of_labels; ix++) {
-            summed_scores[ix] = 0.5f * summed_scores[ix] + classifier_results.classification[ix].value;
-
-            Serial.print(" ");
-            Serial.print(classifier_results.classification[ix].label);
-            Serial.print(" ");
-            Serial.print(summed_scores[ix], 3); // print with 3 decimal places
-            Serial.print("  ");
+            summed_scores[ix] = score_decay * summed_scores[ix] + record.score(ix);
 
             if (summed_scores[ix] > max_score) {
                 max_score = summed_scores[ix];
@@ -135,20 +262,107 @@ void loop()
             }
         }
 
+#if USE_TELEMETRY
+        // Queue the averaged scores, the telemetry task sends them when the serial port has time
+        telemetry.push(summed_scores, number_of_labels, best_label, max_score, record.classifyUs);
+#else
+        // Print the averaged score for each label
+        for (size_t ix = 0; ix < number_of_labels; ix++) {
+            Serial.print(" ");
+            Serial.print(ei_classifier_inferencing_categories[ix]);
+            Serial.print(" ");
+            Serial.print(summed_scores[ix], 3); // print with 3 decimal places
+            Serial.print("  ");
+        }
+
         // Print the best label and its score (if it is one of the melody labels)
         if (best_label == 0 || best_label == 1 || best_label == 2) {
             Serial.print("** top = ");
-            Serial.print(classifier_results.classification[best_label].label);
+            Serial.print(ei_classifier_inferencing_categories[best_label]);
             Serial.print(" ( ");
             Serial.print(max_score, 3);
             Serial.print(" ) **");
         }
-        classifier_updated = false;
         Serial.println();
+#endif
+#if LOG_DETECTIONS
+        // Log a melody once, when it is first heard (from when the flash storage is ready)
+        bool is_melody = best_label == 0 || best_label == 1 || best_label == 2;
+        if (store_ready && is_melody && best_label != logged_label) {
+            store.logDetection(ei_classifier_inferencing_categories[best_label], max_score * (1.0f - score_decay));
+        }
+        logged_label = is_melody ? best_label : -1;
+#endif
+#if PLAY_ANSWER
+        // Answer a melody once, when it is first heard (playMelody() returns at once)
+        bool is_answer = best_label == 0 || best_label == 1 || best_label == 2;
+        if (is_answer && best_label != answered_label) {
+            audio.playMelody(answers[best_label], 4, AudioWave::Triangle, 0.8f);
+        }
+        answered_label = is_answer ? best_label : -1;
+#endif
     }
     delay(1);
 
+    // Print how the start went, once everything is running
+    if (!boot_printed && boot.succeeded("first result") && boot.isComplete()) {
+        boot.printTimeline();
+        boot_printed = true;
+    }
+
+#if LOG_DETECTIONS
+    // Read the settings back when the flash storage is mounted
+    if (!store_ready && boot.succeeded("flash storage")) {
+        score_decay = store.getFloat("decay", score_decay);
+        store_ready = true;
+    }
+
+    // The log goes to flash every 30 seconds (STORE_COMMIT_MS), not on every detection
+    if (store_ready) store.update();
+
+    if (store_ready && Serial.available()) {
+        char command = Serial.read();
+        if (command == 'e') {
+            store.exportDetections();
+            store.printStats();
+        } else if (command == 'c') {
+            store.clearDetections();
+        } else if (command == 'd') {
+            score_decay = constrain(Serial.parseFloat(), 0.0f, 0.95f);
+            store.setFloat("decay", score_decay);
+            store.commit();
+        }
+    }
+#endif
+
+#if PLAY_ANSWER
+    // Print what the audio output costs every 10 seconds
+    if (millis() - audio_timer > 10000) {
+        audio_timer = millis();
+        audio.printStats();
+    }
+#endif
+
+#if LED_SPECTRUM
+    // Print what the spectrum costs every 10 seconds
+    if (millis() - visualiser_timer > 10000) {
+        visualiser_timer = millis();
+        visualiser.printStats();
+    }
+#endif
+
+#if LOW_POWER_LISTENING
+    // Print how long we were watching / listening every 10 seconds
+    if (millis() - listen_timer > 10000) {
+        listen_timer = millis();
+        listener.printStats();
+    }
+#endif
+
     if (best_label == 0 || best_label == 1 || best_label == 2) {
+#if LED_SPECTRUM
+        visualiser.setEnabled(false); // the ring is ours until the melody is gone
+#endif
         ledRing.clear();
         for (int l=0; l<NUM_LEDS;l++) {
             if (best_label==0) {
@@ -167,6 +381,9 @@ void loop()
     } 
     else 
     {
+#if LED_SPECTRUM
+        visualiser.setEnabled(true);
+#else
         // show the led sequence, scanning
         if (millis() - ledSequenceTimer > 200) {
             // Update LED ring sequence
@@ -180,6 +397,7 @@ void loop()
             }
             ledSequenceTimer = millis();
         }
+#endif
     }
 
 }
@@ -0,0 +1,136 @@
+// How far away is the other robot? Measured with sound only, no radio.
+// Load this sketch on two (or more) robots. Press the button on one of them: it plays a short
+// rising chirp, the other robots answer with a falling chirp exactly 250 ms after they heard it,
+// and the distance follows from the time the sound took there and back. The led ring shows it,
+// one led per 50 cm. The classifier keeps running in loop(); every 10 seconds the Serial Monitor
+// shows what the ranging costs next to it.
+// The speaker is on I2S0 (PDM), so the microphone moves to I2S1.
+
+// Include the model from Edge Impulse
+#define EIDSP_QUANTIZE_FILTERBANK   0
+#include <MAFAD_Classifier_inferencing.h>
+
+#include <Bounce2.h>
+
+// Include the AI Workshop libraries
+#include <ai-workshop-main.h>
+#include <ai-workshop-ws2812.h>
+#include <ai-workshop-mic.h>
+#include <ai-workshop-audio-out.h>
+#include <ai-workshop-ranging.h>
+
+// Microphone pins
+#define MIC_SCK_PIN 1   // clockPin
+#define MIC_WS_PIN 7    // wordSelectPin
+#define MIC_SD_PIN 10   // channelSelectPin
+
+#define AUDIO_OUT_PIN 11 // amplifier / speaker pin
+#define BUTTON_PIN 17    // button pin
+
+#define LEDRING_PIN 43   // ledring data pin
+#define NUM_LEDS 8 // the ledring uses 8 leds
+
+Color leds[NUM_LEDS];
+WS2812 ledRing;
+
+Bounce2::Button Button1 = Bounce2::Button();
+
+uint32_t capture_size = EI_CLASSIFIER_SLICE_SIZE;
+int number_of_labels = EI_CLASSIFIER_LABEL_COUNT;
+
+i2sMic mic;
+AudioOut audio;
+Ranger ranger;
+
+uint32_t statsTimer = 0;
+uint32_t inference_time = 0;
+
+// one led per 50 cm, red when there was no answer
+void showDistance(const RangingResult& result)
+{
+    ledRing.clear();
+    if (result.status != RangingStatus::Ok) {
+        ledRing[0].hex = 0x200000;
+    } else {
+        int lit = (int)ceilf(result.distanceM / 0.5f);
+        for (int i = 0; i < lit && i < NUM_LEDS; i++) ledRing[i].hex = 0x002000;
+    }
+    ledRing.update();
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    Serial.println("--------------------");
+    Serial.println("* Ranging *");
+
+    run_classifier_init();
+
+    pinMode(LEDRING_PIN, OUTPUT);
+    ledRing.init(LEDRING_PIN, leds, NUM_LEDS);
+    ledRing.clear();
+    ledRing.update();
+
+    Button1.attach(BUTTON_PIN, INPUT_PULLDOWN);
+    Button1.interval(10);
+    Button1.setPressedState(HIGH);
+
+    if (!audio.begin(AUDIO_OUT_PIN)) {
+        Serial.println("Audio out setup failed");
+    }
+    if (!mic.setup(MIC_SCK_PIN, MIC_WS_PIN, MIC_SD_PIN, I2S_NUM_1)) {
+        Serial.println("Microphone setup failed");
+    }
+
+    // before the stream starts; all robots need the same chirps and reply time
+    RangingConfig config;
+    if (!ranger.begin(mic, audio, config)) {
+        Serial.println("Ranging setup failed");
+    }
+    mic.startStream(capture_size);
+
+    // the robot hears one of its own chirps: now it can answer the others
+    if (!ranger.calibrate()) {
+        Serial.println("Did not hear the own chirp: check the speaker and the volume");
+    }
+}
+
+void loop()
+{
+    Button1.update();
+    if (Button1.pressed()) {
+        ranger.ping();
+    }
+
+    RangingResult result;
+    if (ranger.getResult(result)) {
+        showDistance(result);
+        if (result.status == RangingStatus::Ok) {
+            Serial.printf("distance %.2f m (%.0f us there and back, snr %.0f)\n", result.distanceM, result.roundTripUs, result.snr);
+        } else {
+            Serial.println(result.status == RangingStatus::NotHeard ? "did not hear the own ping" : "no answer");
+        }
+    }
+
+    // the classifier, the same as in the performance example
+    mic.waitForStream();
+
+    signal_t signal;
+    signal.total_length = mic.getStreamSize();
+    signal.get_data = [](size_t offset, size_t length, float* out_ptr) { return mic.readStream(offset, length, out_ptr); };
+
+    ei_impulse_result_t classification = {0};
+    uint32_t start_time = micros();
+    EI_IMPULSE_ERROR error = run_classifier_continuous(&signal, &classification, false);
+    inference_time = micros() - start_time;
+    if (error != EI_IMPULSE_OK) {
+        return;
+    }
+
+    // Print the cost of the ranging next to the classifier
+    if (millis() - statsTimer > 10000) {
+        statsTimer = millis();
+        ranger.printStats();
+        Serial.printf("classifier: %.1f ms per slice, %u overruns\n", inference_time / 1000.0f, (unsigned)mic.getStreamOverruns());
+    }
+}
@@ -0,0 +1,90 @@
+// React to what the robot hears without polling: the led ring listens to the event bus.
+// loop() only runs the classifier. When a melody is heard (its score goes over the
+// detection threshold) the classifier publishes a detection_onset event, when it is
+// gone a detection_offset. A task of the led ring on the other core waits for them and
+// lights the ring in the color of the melody; loop() is never held up by the leds.
+// Every 10 seconds the Serial Monitor shows how long each event took to reach the leds.
+
+// Include the model from Edge Impulse
+#define EIDSP_QUANTIZE_FILTERBANK   0
+#include <MAFAD_Classifier_inferencing.h>
+
+// Include the AI Workshop libraries
+#include <ai-workshop-main.h>
+#include <ai-workshop-ws2812.h>
+#include <ai-workshop-events.h>
+#include <ai-workshop-inference.h>
+
+// Microphone pins
+#define MIC_SCK_PIN 1   // clockPin
+#define MIC_WS_PIN 7    // wordSelectPin
+#define MIC_SD_PIN 10   // channelSelectPin
+
+#define LEDRING_PIN 43  // ledring data pin
+#define NUM_LEDS 8      // the ledring uses 8 leds
+
+Color leds[NUM_LEDS];
+WS2812 ledRing;
+
+// one color per label of the model, the last ones are reused when there are more labels
+const Color label_colors[] = { Color(40, 0, 0), Color(0, 40, 0), Color(0, 0, 40), Color(30, 30, 0) };
+
+AiWorkshopInference inference;
+ei_impulse_result_t result;
+
+uint32_t stats_timer = 0;
+
+// Runs on the task of the led ring, not in loop()
+void onDetection(const Event& event, void* user)
+{
+    (void)user;
+    if (event.type == EventType::DetectionOnset)
+    {
+        const int num_colors = sizeof(label_colors) / sizeof(label_colors[0]);
+        int color = event.label < num_colors ? event.label : num_colors - 1;
+        for (int i = 0; i < NUM_LEDS; i++) leds[i] = label_colors[color];
+        Serial.printf("heard %s (%.2f)\n", event.name, event.score);
+    }
+    else
+    {
+        ledRing.clear();
+    }
+    ledRing.update();
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    Serial.println("--------------------");
+    Serial.println("* Reactive *");
+
+    pinMode(LEDRING_PIN, OUTPUT);
+    ledRing.init(LEDRING_PIN, leds, NUM_LEDS);
+    ledRing.clear();
+    ledRing.update();
+
+    // the led ring gets its own task on core 0, loop() runs on core 1
+    SubscriberConfig config;
+    config.name = "leds";
+    config.core = 0;
+    eventBus().subscribe(eventMask(EventType::DetectionOnset) | eventMask(EventType::DetectionOffset), onDetection, nullptr, config);
+
+    inference.setDetectionThreshold(0.6f);
+    if (!inference.begin(MIC_SCK_PIN, MIC_WS_PIN, MIC_SD_PIN))
+    {
+        Serial.println("ERR: could not start the classifier");
+        while (true) delay(1000);
+    }
+}
+
+void loop()
+{
+    // waits for the next slice of audio and classifies it
+    inference.tick(result);
+
+    if (millis() - stats_timer > 10000)
+    {
+        stats_timer = millis();
+        eventBus().printStats();
+    }
+}
@@ -5,6 +5,9 @@
 #include <ai-workshop-pitches.h>
 #include <ai-workshop-sdcard.h>
 #include <ai-workshop-mic.h>
+#include <ai-workshop-store.h>
+#include <ai-workshop-boot.h>
+#include <ai-workshop-augment.h>
 
 #define MY_DEVICE "MAFAD"
 #define MY_MELODY_1 "hello_there"
@@ -27,6 +30,14 @@
 #define NUM_LEDS 8 // the ledring uses 8 leds
 
 #define NUM_CROPS 0 // create cropped audio files around the sound event
+#define NUM_AUGMENT 0 // extra changed copies of every take (softer, further away, noisier; see ai-workshop-augment.h)
+#define REJECT_BAD_TAKES false // true: silent, too quiet or clipped takes are not saved, false: they go to /flagged
+#define VERIFY_TAKES 0 // 1: the model (MAFAD_Classifier_inferencing library) listens to every take first, takes it hears wrong go to /review
+
+#if VERIFY_TAKES
+#include <MAFAD_Classifier_inferencing.h>
+#include <ai-workshop-verify.h>
+#endif
 
 uint32_t randomness = 0;
 
@@ -42,12 +53,26 @@ WS2812 ledRing;
 // Create a sd card object.
 SDCard sdCard;
 
-// Create a boolean variable to remember if an sd card is present.
-bool hasSDCard = false;
+// Create a boot object, it mounts the SD card in the background while the robot starts.
+Boot boot;
 
 // Create a microphone object.
 i2sMic microphone;
 
+// Create an augmenter object, it makes more takes out of every recording.
+Augmenter augmenter;
+
+// Create a store object, it keeps values in flash when the power is off.
+Store store;
+
+#if VERIFY_TAKES
+// Create a take verifier object, it runs the model over every take before it is saved.
+TakeVerifier verifier;
+#endif
+
+// What the model heard in the last take.
+TakeCheck takeCheck;
+
 // Create a value to keep track of the recordings we store
 uint32_t recordIndex = 0;
 
@@ -164,12 +189,62 @@ void playRandomSounds(int lengthMax)
     }
 }
 
+// True when the SD card is mounted (waits a moment if it is still mounting)
+bool hasSDCard()
+{
+    return boot.wait("sd card", 3000);
+}
+
+// Write NUM_AUGMENT changed copies of the take that was just recorded
+void augmentTake(const char* label)
+{
+    if (NUM_AUGMENT == 0) return;
+    augmenter.writeVariants(sdCard, microphone.getRecordedData(), microphone.getRecordedLengthMs(), label, MY_DEVICE, recordIndex);
+}
+
+// Let the model listen to the take that was just recorded (nullptr when VERIFY_TAKES is 0)
+const TakeCheck* verifyTake(const char* label)
+{
+#if VERIFY_TAKES
+    verifier.verify(microphone.getRecordedData(), microphone.getRecordedSamples(), label, takeCheck);
+    char line[64];
+    takeCheck.format(line, sizeof(line));
+    Serial.printf("Verified as %s in %u ms: %s%s\n", label, (unsigned)(takeCheck.verifyUs / 1000), line,
+                  takeCheck.checked && !takeCheck.agrees ? " (to review)" : "");
+    return &takeCheck;
+#else
+    (void)label;
+    return nullptr;
+#endif
+}
+
 void setup()
 {
+    // Start the boot timeline
+    boot.begin();
+
     // Setup printing to serial monitor
     Serial.begin(115200);
     Serial.println();
 
+    // Mount the SD Card in the background (it can take a while, or time out without a card),
+    // then load the noise takes of earlier sessions for augmentation
+    boot.start("sd card", [] {
+        if (!sdCard.setup(SDCARD_CS_PIN)) return false;
+        TakePolicy policy;
+        policy.reject = REJECT_BAD_TAKES;
+        sdCard.setTakePolicy(policy);
+        if (NUM_AUGMENT > 0)
+        {
+            AugmentConfig config;
+            config.variants = NUM_AUGMENT;
+            augmenter.begin(config);
+            augmenter.loadNoise(NUM_CROPS > 0 ? "/master" : "/");
+            Serial.printf("%u noise takes loaded for augmentation\n", augmenter.getNoiseCount());
+        }
+        return true;
+    });
+
     // Setup randomness 
     initializeRandomness();
 
@@ -192,11 +267,10 @@ void setup()
     Button1.interval(10);
     Button1.setPressedState(HIGH);
 
-    // Try to mount the SD Card and remember if it is present
-    hasSDCard = sdCard.setup(SDCARD_CS_PIN);
-
-    // load the last used recording index from the device EEPROM
-    recordIndex = restoreIndex();
+    // load the last used recording index from flash
+    // (the first time from the EEPROM, where older versions kept it)
+    boot.run("flash storage", [] { return store.begin(); });
+    recordIndex = store.getUInt("index", restoreIndex());
 
     // Setup audio output
     pinMode(AUDIO_OUT_PIN, OUTPUT);
@@ -207,11 +281,24 @@ void setup()
     Serial.println("Press button to record.");
     Serial.println();
 
+#if VERIFY_TAKES
+    verifier.begin();
+#endif
+
     activeLED = 0;
+    boot.mark("ready");
 }
 
 void loop()
 {
+    // Print how the start went, once the SD card is mounted (or not)
+    static bool bootPrinted = false;
+    if (!bootPrinted && boot.isComplete())
+    {
+        boot.printTimeline();
+        bootPrinted = true;
+    }
+
     Button1.update();
 
     if (Button1.pressed())
@@ -258,17 +345,23 @@ void loop()
         Serial.println(" milliseconds recorded.");
 
         // save the recorded audio to the SDCard (if present)
-        if (hasSDCard)
+        if (hasSDCard())
         {
             // write the audio file
-            sdCard.writeAudioFile(
+            TakeStats levels = microphone.getRecordedLevels();
+            TakeVerdict verdict = sdCard.writeAudioFile(
                 microphone.getRecordedData(),
                 microphone.getRecordedLengthMs(),
                 MY_MELODY_1,
                 MY_DEVICE,
                 recordIndex,
-                NUM_CROPS
+                NUM_CROPS,
+                &levels, // checked first: a bad take is flagged or rejected
+                verifyTake(MY_MELODY_1) // then what the model hears: a take it hears wrong goes to /review
             );
+
+            // write the augmented copies of a good take
+            if (verdict == TakeVerdict::Good) augmentTake(MY_MELODY_1);
         }
 
         Serial.println();
@@ -301,17 +394,23 @@ void loop()
         Serial.println(" milliseconds recorded.");
 
         // save the recorded audio to the SDCard (if present)
-        if (hasSDCard)
+        if (hasSDCard())
         {
             // write the audio file
-            sdCard.writeAudioFile(
+            TakeStats levels = microphone.getRecordedLevels();
+            TakeVerdict verdict = sdCard.writeAudioFile(
                 microphone.getRecordedData(),
                 microphone.getRecordedLengthMs(),
                 MY_MELODY_2,
                 MY_DEVICE,
                 recordIndex,
-                NUM_CROPS
+                NUM_CROPS,
+                &levels, // checked first: a bad take is flagged or rejected
+                verifyTake(MY_MELODY_2) // then what the model hears: a take it hears wrong goes to /review
             );
+
+            // write the augmented copies of a good take
+            if (verdict == TakeVerdict::Good) augmentTake(MY_MELODY_2);
         }
         Serial.println();
 
@@ -343,17 +442,23 @@ void loop()
         Serial.println(" milliseconds recorded.");
 
         // save the recorded audio to the SDCard (if present)
-        if (hasSDCard)
+        if (hasSDCard())
         {
             // write the audio file
-            sdCard.writeAudioFile(
+            TakeStats levels = microphone.getRecordedLevels();
+            TakeVerdict verdict = sdCard.writeAudioFile(
                 microphone.getRecordedData(),
                 microphone.getRecordedLengthMs(),
                 MY_MELODY_3,
                 MY_DEVICE,
                 recordIndex,
-                NUM_CROPS
+                NUM_CROPS,
+                &levels, // checked first: a bad take is flagged or rejected
+                verifyTake(MY_MELODY_3) // then what the model hears: a take it hears wrong goes to /review
             );
+
+            // write the augmented copies of a good take
+            if (verdict == TakeVerdict::Good) augmentTake(MY_MELODY_3);
         }
         Serial.println();
         
@@ -387,17 +492,23 @@ void loop()
         Serial.println(" milliseconds recorded.");
 
         // save the recorded audio to the SDCard (if present)
-        if (hasSDCard)
+        if (hasSDCard())
         {
             // write the audio file
-            sdCard.writeAudioFile(
+            TakeStats levels = microphone.getRecordedLevels();
+            TakeVerdict verdict = sdCard.writeAudioFile(
                 microphone.getRecordedData(),
                 microphone.getRecordedLengthMs(),
                 MY_MELODY_1,
                 MY_DEVICE,
                 recordIndex,
-                NUM_CROPS
+                NUM_CROPS,
+                &levels, // checked first: a bad take is flagged or rejected
+                verifyTake(MY_MELODY_1) // then what the model hears: a take it hears wrong goes to /review
             );
+
+            // write the augmented copies of a good take
+            if (verdict == TakeVerdict::Good) augmentTake(MY_MELODY_1);
         }
 
         Serial.println();
@@ -430,17 +541,23 @@ void loop()
         Serial.println(" milliseconds recorded.");
 
         // save the recorded audio to the SDCard (if present)
-        if (hasSDCard)
+        if (hasSDCard())
         {
             // write the audio file
-            sdCard.writeAudioFile(
+            TakeStats levels = microphone.getRecordedLevels();
+            TakeVerdict verdict = sdCard.writeAudioFile(
                 microphone.getRecordedData(),
                 microphone.getRecordedLengthMs(),
                 MY_MELODY_2,
                 MY_DEVICE,
                 recordIndex,
-                NUM_CROPS
+                NUM_CROPS,
+                &levels, // checked first: a bad take is flagged or rejected
+                verifyTake(MY_MELODY_2) // then what the model hears: a take it hears wrong goes to /review
             );
+
+            // write the augmented copies of a good take
+            if (verdict == TakeVerdict::Good) augmentTake(MY_MELODY_2);
         }
         Serial.println();
 
@@ -472,17 +589,23 @@ void loop()
         Serial.println(" milliseconds recorded.");
 
         // save the recorded audio to the SDCard (if present)
-        if (hasSDCard)
+        if (hasSDCard())
         {
             // write the audio file
-            sdCard.writeAudioFile(
+            TakeStats levels = microphone.getRecordedLevels();
+            TakeVerdict verdict = sdCard.writeAudioFile(
                 microphone.getRecordedData(),
                 microphone.getRecordedLengthMs(),
                 MY_MELODY_3,
                 MY_DEVICE,
                 recordIndex,
-                NUM_CROPS
+                NUM_CROPS,
+                &levels, // checked first: a bad take is flagged or rejected
+                verifyTake(MY_MELODY_3) // then what the model hears: a take it hears wrong goes to /review
             );
+
+            // write the augmented copies of a good take
+            if (verdict == TakeVerdict::Good) augmentTake(MY_MELODY_3);
         }
         Serial.println();
 
@@ -514,17 +637,23 @@ void loop()
         Serial.println(" milliseconds recorded.");
 
         // save the recorded audio to the SDCard (if present)
-        if (hasSDCard)
+        if (hasSDCard())
         {
             // write the audio file
-            sdCard.writeAudioFile(
+            TakeStats levels = microphone.getRecordedLevels();
+            TakeVerdict verdict = sdCard.writeAudioFile(
                 microphone.getRecordedData(),
                 microphone.getRecordedLengthMs(),
                 "random",
                 MY_DEVICE,
                 recordIndex,
-                NUM_CROPS
+                NUM_CROPS,
+                &levels, // checked first: a bad take is flagged or rejected
+                verifyTake("random") // then what the model hears: a take it hears wrong goes to /review
             );
+
+            // write the augmented copies of a good take
+            if (verdict == TakeVerdict::Good) augmentTake("random");
         }
         Serial.println();
 
@@ -551,17 +680,22 @@ void loop()
         Serial.println(" milliseconds recorded.");
 
         // save the recorded audio to the SDCard (if present)
-        if (hasSDCard)
+        if (hasSDCard())
         {
             // write the audio file
-            sdCard.writeAudioFile(
+            TakeVerdict verdict = sdCard.writeAudioFile(
                 microphone.getRecordedData(),
                 microphone.getRecordedLengthMs(),
                 "noise",
                 MY_DEVICE,
                 recordIndex,
-                NUM_CROPS
+                NUM_CROPS,
+                nullptr,
+                verifyTake("noise") // a melody heard in the noise goes to /review
             );
+
+            // keep the noise for mixing into the next takes
+            if (NUM_AUGMENT > 0 && verdict == TakeVerdict::Good) augmenter.addNoise(microphone.getRecordedData(), microphone.getRecordedSamples());
         }
         Serial.println();
 
@@ -575,7 +709,18 @@ void loop()
         // so each of our files will have a unique name
         recordIndex++;
 
-        // store the last used recording index into the device EEPROM
-        storeIndex(recordIndex);
+        // store the last used recording index in flash, right away:
+        // the next files must never get a name that is already used
+        store.setUInt("index", recordIndex);
+        store.commit();
+
+        if (NUM_AUGMENT > 0 && hasSDCard())
+        {
+            augmenter.printStats();
+        }
+
+#if VERIFY_TAKES
+        verifier.printStats();
+#endif
     }
 }
\ No newline at end of file
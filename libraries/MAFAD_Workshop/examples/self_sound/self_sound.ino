@@ -0,0 +1,150 @@
+// Does the robot hear itself?
+// A background task plays hello_there every 8 seconds while the classifier listens.
+// Every time the melody plays, the self sound filter switches to the next mode:
+//   off    the classifier hears our own melody
+//   flag   the audio is untouched, but results with our own sound in them are ignored
+//   gate   the audio is silenced while we play
+//   cancel our own tones are subtracted, other sounds still come through
+// Play a melody from a second robot (or your phone) while this one plays to hear the difference.
+
+// Include the model from Edge Impulse
+#define EIDSP_QUANTIZE_FILTERBANK   0
+#include <MAFAD_Classifier_inferencing.h>
+
+// Include the AI Workshop libraries
+#include <ai-workshop-main.h>
+#include <ai-workshop-mic.h>
+#include <ai-workshop-sound.h>
+#include <ai-workshop-pitches.h>
+#include <ai-workshop-selfsound.h>
+
+// Microphone pins
+#define MIC_SCK_PIN 1   // clockPin
+#define MIC_WS_PIN 7    // wordSelectPin
+#define MIC_SD_PIN 10   // channelSelectPin
+
+#define AUDIO_OUT_PIN 11 // amplifier / speaker pin
+
+uint32_t randomness = 0;
+
+// Get values from model settings
+uint32_t capture_size = EI_CLASSIFIER_SLICE_SIZE;
+int number_of_labels = EI_CLASSIFIER_LABEL_COUNT;
+
+// the classifier looks at this much audio (all slices of the model window)
+const int64_t window_us = (int64_t)EI_CLASSIFIER_SLICE_SIZE * EI_CLASSIFIER_SLICES_PER_MODEL_WINDOW * 1000000LL / EI_CLASSIFIER_FREQUENCY;
+
+static float summed_scores[EI_CLASSIFIER_LABEL_COUNT];
+
+// Create microphone and filter objects
+i2sMic mic;
+SelfSoundFilter selfSound;
+
+const char* mode_names[] = { "off", "flag", "gate", "cancel" };
+volatile int mode = 0;
+
+void playHelloThere()
+{
+    playTone(AUDIO_OUT_PIN, NOTE_C3, 60);
+    playTone(AUDIO_OUT_PIN, NOTE_C4, 60);
+    Silence(30);
+    playTone(AUDIO_OUT_PIN, NOTE_D3, 60);
+    playTone(AUDIO_OUT_PIN, NOTE_D4, 60);
+    Silence(30);
+    playTone(AUDIO_OUT_PIN, NOTE_DS3, 60);
+    playTone(AUDIO_OUT_PIN, NOTE_DS4, 60);
+    Silence(30);
+    playTone(AUDIO_OUT_PIN, NOTE_F3, 60);
+    playTone(AUDIO_OUT_PIN, NOTE_F4, 60);
+    Silence(30);
+    playTone(AUDIO_OUT_PIN, NOTE_G3, 60);
+    playTone(AUDIO_OUT_PIN, NOTE_G4, 60);
+    Silence(30);
+    playTone(AUDIO_OUT_PIN, NOTE_GS3, 60);
+    playTone(AUDIO_OUT_PIN, NOTE_GS4, 60);
+    Silence(30);
+    playTone(AUDIO_OUT_PIN, NOTE_AS3, 60);
+    playTone(AUDIO_OUT_PIN, NOTE_AS4, 60);
+    Silence(30);
+    playTone(AUDIO_OUT_PIN, NOTE_C4, 60);
+    playTone(AUDIO_OUT_PIN, NOTE_C5, 60);
+}
+
+// Plays the melody in the background, so loop() can keep classifying
+void playTask(void* parameter)
+{
+    (void)parameter;
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(8000));
+
+        mode = (mode + 1) % 4;
+        selfSound.setMode((SelfSoundMode)mode);
+        Serial.printf("\n-- playing hello_there, self sound filter: %s --\n", mode_names[mode]);
+
+        playHelloThere();
+        selfSound.printStats();
+        selfSound.resetStats();
+    }
+}
+
+void setup()
+{
+    // Start serial printing for debugging
+    Serial.begin(115200);
+    Serial.println("--------------------");
+    Serial.println("* Self Sound *");
+
+    // Initialize the classifier / model
+    run_classifier_init();
+
+    // Setup audio output
+    pinMode(AUDIO_OUT_PIN, OUTPUT);
+
+    // Set up the microphone, the filter goes first so everything after it gets clean audio
+    mic.setup(MIC_SCK_PIN, MIC_WS_PIN, MIC_SD_PIN);
+    SelfSoundConfig config;
+    config.mode = SelfSoundMode::Off;
+    selfSound.attach(mic, config);
+    mic.startStream(capture_size);
+
+    xTaskCreatePinnedToCore(playTask, "playTask", 4096, nullptr, 1, nullptr, 0);
+}
+
+void loop()
+{
+    mic.waitForStream();
+
+    signal_t signal;
+    signal.total_length = mic.getStreamSize();
+    signal.get_data = &i2sMic::getStreamData;
+
+    ei_impulse_result_t result = {0};
+    EI_IMPULSE_ERROR error = run_classifier_continuous(&signal, &result, false);
+    if (error != EI_IMPULSE_OK) {
+        return;
+    }
+
+    float max_score = 0.0f;
+    int best_label = -1;
+    for (size_t ix = 0; ix < number_of_labels; ix++) {
+        summed_scores[ix] = 0.5f * summed_scores[ix] + result.classification[ix].value;
+        if (summed_scores[ix] > max_score) {
+            max_score = summed_scores[ix];
+            best_label = ix;
+        }
+    }
+
+    // Only the melody labels are interesting
+    if (best_label < 0 || best_label > 2 || max_score < 0.8f) {
+        return;
+    }
+
+    // In flag mode: was our own sound anywhere in the audio the classifier looked at?
+    int64_t window_start = mic.getStreamTimeUs() - window_us;
+    if (selfSound.getMode() == SelfSoundMode::Flag && selfSound.heardSelf(window_start)) {
+        Serial.printf("(ignored %s, that was me)\n", result.classification[best_label].label);
+        return;
+    }
+
+    Serial.printf("heard %s (%.2f)\n", result.classification[best_label].label, max_score);
+}
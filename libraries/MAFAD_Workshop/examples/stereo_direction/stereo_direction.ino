@@ -0,0 +1,133 @@
+// Where did the sound come from?
+// Two microphones share the clock, word select and data pins: connect the
+// L/R (SEL) pin of the left microphone to GND and of the right one to 3V3.
+// The classifier runs on the left microphone, the direction finder uses both.
+// The led ring points towards the last sound; a robot could turn that way.
+
+// Include the model from Edge Impulse
+#define EIDSP_QUANTIZE_FILTERBANK   0
+#include <MAFAD_Classifier_inferencing.h>
+
+// Include the AI Workshop libraries
+#include <ai-workshop-main.h>
+#include <ai-workshop-ws2812.h>
+#include <ai-workshop-mic.h>
+#include <ai-workshop-doa.h>
+
+// Microphone pins
+#define MIC_SCK_PIN 1   // clockPin
+#define MIC_WS_PIN 7    // wordSelectPin
+#define MIC_SD_PIN 10   // channelSelectPin
+
+#define MIC_DISTANCE 0.08f  // meters between the two microphones
+
+#define LEDRING_PIN 43   // ledring data pin
+#define NUM_LEDS 8 // the ledring uses 8 leds
+
+// Create an array/list to store 8 colors for the ledring.
+Color leds[NUM_LEDS];
+
+// Create a led ring object.
+WS2812 ledRing;
+
+// Get values from model settings
+uint32_t capture_size = EI_CLASSIFIER_SLICE_SIZE;
+int number_of_labels = EI_CLASSIFIER_LABEL_COUNT;
+
+static float summed_scores[EI_CLASSIFIER_LABEL_COUNT];
+
+// Create microphone and direction finder objects
+i2sMic mic;
+DirectionFinder doa;
+
+uint32_t lastResult = 0;
+uint32_t statsTimer = 0;
+uint32_t inference_time = 0;
+
+// Show the direction on the front half of the ring: led 0 = left, led 4 = right
+void showDirection(float angle, float confidence)
+{
+    int led = (int)roundf((angle + 90.0f) / 180.0f * (NUM_LEDS / 2));
+    ledRing.clear();
+    uint8_t level = (uint8_t)(40 + 200 * constrain(confidence, 0.0f, 1.0f));
+    ledRing[led].hex = ((uint32_t)level << 8);   // green, brighter when certain
+    ledRing.update();
+}
+
+void setup()
+{
+    // Start serial printing for debugging
+    Serial.begin(115200);
+    Serial.println("--------------------");
+    Serial.println("* Stereo Direction *");
+
+    // Initialize the classifier / model
+    run_classifier_init();
+
+    // Set up both microphones in one stereo stream
+    if (!mic.setup(MIC_SCK_PIN, MIC_WS_PIN, MIC_SD_PIN, I2S_NUM_0, MicChannels::Stereo)) {
+        Serial.println("Microphone setup failed");
+    }
+
+    DoaConfig config;
+    config.micDistanceM = MIC_DISTANCE;
+    doa.begin(mic, config);
+
+    mic.startStream(capture_size);
+
+    // Setup LedRing
+    pinMode(LEDRING_PIN, OUTPUT);
+    ledRing.init(LEDRING_PIN, leds, NUM_LEDS);
+    ledRing.clear();
+    ledRing.update();
+}
+
+void loop()
+{
+    // the classifier, the same as in the performance example
+    mic.waitForStream();
+
+    signal_t signal;
+    signal.total_length = mic.getStreamSize();
+    signal.get_data = [](size_t offset, size_t length, float* out_ptr) { return mic.readStream(offset, length, out_ptr); };
+
+    ei_impulse_result_t result = {0};
+    uint32_t start_time = micros();
+    EI_IMPULSE_ERROR error = run_classifier_continuous(&signal, &result, false);
+    inference_time = micros() - start_time;
+    if (error != EI_IMPULSE_OK) {
+        return;
+    }
+
+    float max_score = 0.0f;
+    int best_label = -1;
+    for (size_t ix = 0; ix < number_of_labels; ix++) {
+        summed_scores[ix] = 0.5f * summed_scores[ix] + result.classification[ix].value;
+        if (summed_scores[ix] > max_score) {
+            max_score = summed_scores[ix];
+            best_label = ix;
+        }
+    }
+
+    // a new direction estimate?
+    if (doa.getResultCount() != lastResult) {
+        lastResult = doa.getResultCount();
+
+        DoaResult direction;
+        doa.latest(direction);
+        showDirection(direction.angleDeg, direction.confidence);
+
+        Serial.printf("sound from %.0f degrees (confidence %.2f)", direction.angleDeg, direction.confidence);
+        if (best_label >= 0) {
+            Serial.printf(", sounds like %s (%.2f)", result.classification[best_label].label, max_score);
+        }
+        Serial.println();
+    }
+
+    // Print the cost of the direction finder next to the classifier
+    if (millis() - statsTimer > 10000) {
+        statsTimer = millis();
+        doa.printStats();
+        Serial.printf("classifier: %.1f ms per slice, %u overruns\n", inference_time / 1000.0f, (unsigned)mic.getStreamOverruns());
+    }
+}
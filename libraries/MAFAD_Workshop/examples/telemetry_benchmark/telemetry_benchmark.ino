@@ -0,0 +1,124 @@
+// Compare the time the loop spends on reporting classifier results:
+// the text printing from model_inference_test against the binary telemetry.
+// No model is needed, we make up scores for 4 labels.
+//
+// Open the Serial Monitor (or tools/telemetry_decode.py --text) to read the results.
+
+#include <ai-workshop-main.h>
+#include <ai-workshop-telemetry.h>
+
+#define NUM_LABELS 4
+#define NUM_RESULTS 200      // results per test
+#define RESULT_INTERVAL 50   // milliseconds between results (a slice of 1/20 second)
+
+const char* labels[NUM_LABELS] = { "hello_there", "i_love_cake", "get_bonus", "noise" };
+
+float summed_scores[NUM_LABELS];
+
+// Create telemetry object
+Telemetry telemetry;
+
+// make up some classifier scores
+void fakeScores(float* scores)
+{
+    float total = 0.0f;
+    for (int i = 0; i < NUM_LABELS; i++) {
+        scores[i] = random(1000) / 1000.0f;
+        total += scores[i];
+    }
+    for (int i = 0; i < NUM_LABELS; i++) {
+        scores[i] /= total;
+        summed_scores[i] = 0.5f * summed_scores[i] + scores[i];
+    }
+}
+
+int bestLabel(float* max_score)
+{
+    int best_label = -1;
+    *max_score = 0.0f;
+    for (int i = 0; i < NUM_LABELS; i++) {
+        if (summed_scores[i] > *max_score) {
+            *max_score = summed_scores[i];
+            best_label = i;
+        }
+    }
+    return best_label;
+}
+
+// The same printing as model_inference_test.ino
+void printText()
+{
+    float max_score;
+    int best_label = bestLabel(&max_score);
+
+    for (int ix = 0; ix < NUM_LABELS; ix++) {
+        Serial.print(" ");
+        Serial.print(labels[ix]);
+        Serial.print(" ");
+        Serial.print(summed_scores[ix], 3);
+        Serial.print("  ");
+    }
+    if (best_label == 0 || best_label == 1 || best_label == 2) {
+        Serial.print("** top = ");
+        Serial.print(labels[best_label]);
+        Serial.print(" ( ");
+        Serial.print(max_score, 3);
+        Serial.print(" ) **");
+    }
+    Serial.println();
+}
+
+void pushTelemetry()
+{
+    float max_score;
+    int best_label = bestLabel(&max_score);
+    telemetry.push(summed_scores, NUM_LABELS, best_label, max_score, 0);
+}
+
+void runTest(const char* name, void (*report)())
+{
+    uint32_t total = 0;
+    uint32_t worst = 0;
+    float scores[NUM_LABELS];
+
+    for (int n = 0; n < NUM_RESULTS; n++) {
+        fakeScores(scores);
+
+        uint32_t start = micros();
+        report();
+        uint32_t elapsed = micros() - start;
+
+        total += elapsed;
+        if (elapsed > worst) worst = elapsed;
+
+        delay(RESULT_INTERVAL);
+    }
+
+    // wait for the background task to catch up before we print
+    while (telemetry.getQueued() > 0) delay(10);
+    delay(100);
+
+    Serial.println();
+    Serial.printf("%s: %u results, average %u us, worst %u us per result in the loop\n",
+                  name, NUM_RESULTS, (unsigned)(total / NUM_RESULTS), (unsigned)worst);
+    Serial.printf("telemetry: %u sent, %u dropped, %u bytes\n",
+                  (unsigned)telemetry.getSent(), (unsigned)telemetry.getDropped(), (unsigned)telemetry.getBytesSent());
+    Serial.println();
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    delay(2000);
+    Serial.println("--------------------");
+    Serial.println("* Telemetry Benchmark *");
+
+    telemetry.begin(labels, NUM_LABELS);
+}
+
+void loop()
+{
+    runTest("text printing", printText);
+    runTest("binary telemetry", pushTelemetry);
+    delay(5000);
+}
@@ -6,6 +6,8 @@
 #include <ai-workshop-pitches.h>
 #include <ai-workshop-sdcard.h>
 #include <ai-workshop-mic.h>
+#include <ai-workshop-store.h>
+#include <ai-workshop-light.h>
 
 #define MY_DEVICE "MAFAD"
 
@@ -46,11 +48,17 @@ bool hasSDCard = false;
 // Create a microphone object.
 i2sMic microphone;
 
+// Create a light sensors object, it samples both sensors in the background.
+LightSensors lightSensors;
+
 // Create somes variables to keep track of elapsed time.
 uint32_t log_timer = 0;
 uint32_t sound_timer = 0;
 uint32_t next_sound_time = 100;
 
+// Create a store object, it keeps values in flash when the power is off.
+Store store;
+
 // Create a value to keep track of the recordings we store
 uint32_t recordIndex = 0;
 
@@ -63,9 +71,10 @@ void setup()
     // Setup randomness 
     initializeRandomness();
 
-    // Setup LightSensors
+    // Setup LightSensors: 2000 samples per second, 100 filtered values per second
     pinMode(LDR_LEFT_PIN, INPUT);
     pinMode(LDR_RIGHT_PIN, INPUT);
+    lightSensors.begin(LDR_LEFT_PIN, LDR_RIGHT_PIN, 2000, 100);
 
     // Setup microphone
     microphone.setup(I2S_MIC_SCK_PIN, I2S_MIC_WS_PIN, I2S_MIC_SD_PIN);
@@ -79,8 +88,10 @@ void setup()
     // Try to mount the SD Card and remember if it is present
     hasSDCard = sdCard.setup(SDCARD_CS_PIN);
 
-    // load the last used recording index from the device EEPROM
-    recordIndex = restoreIndex();
+    // load the last used recording index from flash
+    // (the first time from the EEPROM, where older versions kept it)
+    store.begin();
+    recordIndex = store.getUInt("index", restoreIndex());
 
     // Setup LedRing
     pinMode(LEDRING_PIN, OUTPUT);
@@ -143,26 +154,30 @@ void loop()
         // save the recorded audio to the SDCard (if present)
         if (hasSDCard)
         {
-            // write the audio file
-            sdCard.writeAudioFile(
+            // write the audio file, with its levels (a bad take goes to /flagged)
+            TakeStats levels = microphone.getRecordedLevels();
+            TakeVerdict verdict = sdCard.writeAudioFile(
                 microphone.getRecordedData(),
                 microphone.getRecordedLengthMs(),
                 "my_sound",
                 MY_DEVICE,
                 recordIndex,
-                CREATE_CROPS // dont't create cropped files
+                CREATE_CROPS, // dont't create cropped files
+                &levels
             );
 
-            // saved, set the led to GREEN
-            ledRing[recordIndex % 8] = Color::Green;
+            // saved, set the led to GREEN (YELLOW: saved but too quiet, clipped or silent)
+            ledRing[recordIndex % 8] = verdict == TakeVerdict::Good ? Color::Green : Color::Yellow;
             ledRing.update();
 
             // increase our index for the next recording
             // so each of our files will have a unique name
             recordIndex++;
 
-            // store the last used recording index into the device EEPROM
-            storeIndex(recordIndex);            
+            // store the last used recording index in flash, right away:
+            // the next files must never get a name that is already used
+            store.setUInt("index", recordIndex);
+            store.commit();
         } 
         else 
         {
@@ -178,10 +193,23 @@ void loop()
     {
         // set our timer to the current time.
         log_timer = millis();
-        Serial.print("Light Sensor L:");
-        Serial.print(analogRead(LDR_LEFT_PIN));
-        Serial.print(" | Light Sensor R:");
-        Serial.println(analogRead(LDR_RIGHT_PIN));
+
+        // the light sensors are sampled all the time, we just take the newest values
+        LightFrame light;
+        if (lightSensors.latest(light))
+        {
+            Serial.print("Light Sensor L:");
+            Serial.print(light.left, 3);
+            Serial.print(" | Light Sensor R:");
+            Serial.print(light.right, 3);
+            Serial.print(" | L-R:");
+            Serial.print(light.difference, 3);
+            Serial.print(" | change L:");
+            Serial.print(light.leftSlope, 2);
+            Serial.print("/s R:");
+            Serial.print(light.rightSlope, 2);
+            Serial.println("/s");
+        }
     }
 
     // Make some random sounds, usefull as background noise for the dataset
@@ -0,0 +1,109 @@
+// Where does the time go? Record a trace of the microphone, the classifier and the LEDs.
+// Type in the serial monitor:
+//   d   print the trace (copy it to a file, or let tools/trace2chrome.py read the port)
+//   s   save the trace to TRACE.TXT on the SD card
+// Then on the computer:
+//   python3 tools/trace2chrome.py /dev/ttyACM0 -o trace.json   (press d while it waits)
+// and open trace.json in https://ui.perfetto.dev
+
+// Switch tracing on, before the AI Workshop includes
+#define AIW_TRACE 1
+
+// Include the model from Edge Impulse
+#define EIDSP_QUANTIZE_FILTERBANK   0
+#include <MAFAD_Classifier_inferencing.h>
+
+// Include the AI Workshop libraries
+#include <ai-workshop-main.h>
+#include <ai-workshop-mic.h>
+#include <ai-workshop-ws2812.h>
+#include <ai-workshop-sdcard.h>
+
+// Microphone pins
+#define MIC_SCK_PIN 1   // clockPin
+#define MIC_WS_PIN 7    // wordSelectPin
+#define MIC_SD_PIN 10   // channelSelectPin
+
+#define RGBLED_PIN 40   // RGB led pin
+#define SDCARD_CS_PIN 6 // sdcard chip select pin
+
+// Get values from model settings
+uint32_t capture_size = EI_CLASSIFIER_SLICE_SIZE;
+int number_of_labels = EI_CLASSIFIER_LABEL_COUNT;
+
+static float summed_scores[EI_CLASSIFIER_LABEL_COUNT];
+
+// Create microphone, led and sd card objects
+i2sMic mic;
+LEDBuildin ledRGB;
+SDCard sdCard;
+bool hasSDCard = false;
+
+void setup()
+{
+    // Start serial printing for debugging
+    Serial.begin(115200);
+    Serial.println("--------------------");
+    Serial.println("* Trace *");
+
+    // Start tracing first, so the tasks started below get their names; sample stacks and heap every 100 ms
+    Trace::begin(100);
+
+    // Initialize the classifier / model
+    run_classifier_init();
+
+    ledRGB.init(RGBLED_PIN);
+    ledRGB.clear();
+    ledRGB.update();
+    hasSDCard = sdCard.setup(SDCARD_CS_PIN);
+
+    // Set up the microphone and start audio stream for inference
+    mic.setup(MIC_SCK_PIN, MIC_WS_PIN, MIC_SD_PIN);
+    mic.startStream(capture_size);
+}
+
+void loop()
+{
+    if (Serial.available()) {
+        char command = Serial.read();
+        if (command == 'd') {
+            Trace::dump(Serial);
+        } else if (command == 's' && hasSDCard) {
+            Serial.println(Trace::dumpToFile("/TRACE.TXT") ? "trace saved to TRACE.TXT" : "trace not saved");
+        }
+    }
+
+    mic.waitForStream();
+
+    signal_t signal;
+    signal.total_length = mic.getStreamSize();
+    signal.get_data = &i2sMic::getStreamData;
+
+    // Our own scope: it shows up in the trace next to the library events
+    ei_impulse_result_t result = {0};
+    AIW_TRACE_BEGIN("classify");
+    EI_IMPULSE_ERROR error = run_classifier_continuous(&signal, &result, false);
+    AIW_TRACE_END("classify");
+    if (error != EI_IMPULSE_OK) {
+        return;
+    }
+
+    float max_score = 0.0f;
+    int best_label = -1;
+    for (size_t ix = 0; ix < number_of_labels; ix++) {
+        summed_scores[ix] = 0.5f * summed_scores[ix] + result.classification[ix].value;
+        if (summed_scores[ix] > max_score) {
+            max_score = summed_scores[ix];
+            best_label = ix;
+        }
+    }
+    AIW_TRACE_COUNTER("best label", best_label);
+
+    // Blue for a melody, off for the rest
+    if (best_label >= 0 && best_label <= 2 && max_score > 0.8f) {
+        ledRGB.setColor(Color::Blue);
+    } else {
+        ledRGB.clear();
+    }
+    ledRGB.update();
+}
@@ -0,0 +1,836 @@
+#ifndef WORKSHOP_AUDIO_OUT_H
+#define WORKSHOP_AUDIO_OUT_H
+
+#include "ai-workshop-main.h"
+#include "ai-workshop-sound.h"
+#include "ai-workshop-melody.h"
+#include "ai-workshop-wav.h"
+#include "ai-workshop-trace.h"
+
+#include <Arduino.h>
+#include <SD.h>
+#include <atomic>
+#include <math.h>
+#include "driver/i2s.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define AUDIO_OUT_BLOCK 128          // samples rendered at a time (6.4 ms at 20 kHz)
+#define AUDIO_OUT_DMA_LEN 64         // samples per DMA buffer, a block fills two
+#define AUDIO_OUT_DMA_BUFFERS 6      // queued audio: 6 * 64 samples = 19.2 ms, covers an SD read
+#define AUDIO_OUT_VOICES 4           // notes that can sound at the same time
+#define AUDIO_OUT_COMMANDS 16        // play requests waiting for the next block
+#define AUDIO_OUT_FILE_CHUNK 512     // samples read from the SD card at a time
+#define AUDIO_OUT_TABLE_BITS 8       // wavetables of 256 samples
+#define AUDIO_OUT_HARMONICS 16       // the square, triangle and saw tables stop at this harmonic (less aliasing)
+
+enum class AudioWave : uint8_t
+{
+    Sine,
+    Triangle,
+    Square,     // closest to startTone()
+    Saw,
+};
+
+// How a note starts and ends. Attack, decay and release are linear.
+struct AudioEnvelope
+{
+    uint16_t attackMs = 2;
+    uint16_t decayMs = 30;
+    float sustain = 0.8f;      // level after the decay, 0 .. 1
+    uint16_t releaseMs = 20;   // after the note time is over
+};
+
+struct AudioOutStats
+{
+    uint32_t blocks = 0;         // blocks sent to the DMA
+    uint32_t underruns = 0;      // times the DMA queue ran empty while playing (a click)
+    uint32_t notes = 0;
+    uint32_t files = 0;
+    uint32_t clips = 0;          // sample buffers played (playSamples())
+    uint32_t lateClips = 0;      // ...not played: their start sample was already rendered
+    uint32_t dropped = 0;        // play requests lost because the command queue was full
+    uint32_t maxRenderUs = 0;    // slowest block (synth + file)
+    uint64_t totalRenderUs = 0;
+    uint64_t fileReadUs = 0;     // part of the render time spent reading the SD card
+    uint64_t audioUs = 0;        // audio rendered in that time
+    int32_t minMarginUs = -1;    // least audio left in the queue when a block started, -1 = none yet
+};
+
+// Plays sound through I2S with DMA, so the CPU is free while a melody plays.
+//
+// startTone() / playTone() drive the speaker with a square wave from the LEDC and wait with
+// delay() until the note is over. AudioOut runs a small synthesizer in its own task instead:
+//   - up to AUDIO_OUT_VOICES notes at the same time, each a wavetable (sine, triangle, square,
+//     saw) with an attack / decay / sustain / release envelope, all in fixed point
+//   - melodies: the same MelodyNote lists (NOTE_* values) the melody detector uses
+//   - WAV files from the SD card (e.g. the recordings of SDCard), streamed a chunk at a time
+//     and resampled when the file has another sample rate
+//   - sample buffers (e.g. the chirps of ai-workshop-ranging.h), started at an exact output
+//     sample: outputSample() counts the samples rendered, keepStreaming() keeps that count
+//     locked to the sample clock by sending silence instead of stopping
+// Every call returns at once; the task mixes a block of AUDIO_OUT_BLOCK samples while the DMA
+// plays the blocks before it (AUDIO_OUT_DMA_BUFFERS deep). When nothing plays the task sleeps.
+// Notes are published with publishTone() at the moment they leave the speaker, so the
+// self sound filter keeps working.
+//
+// Output:
+//   begin(pin)                 PDM on I2S0: pin -> RC filter (or a class D amp) -> speaker.
+//                              Only I2S0 can do PDM, so the microphone must use I2S1.
+//   beginI2s(bck, ws, data)    a standard I2S amplifier (e.g. MAX98357A), any free port
+class AudioOut
+{
+private:
+    enum : uint8_t { CmdNote, CmdMelody, CmdSamples, CmdStop };
+    enum : uint8_t { Off, Attack, Decay, Sustain, Release };
+
+    struct Command
+    {
+        uint8_t type = CmdNote;
+        AudioWave wave = AudioWave::Square;
+        uint16_t volumeQ = 0;          // Q15
+        uint32_t frequency = 0;
+        uint32_t ms = 0;
+        const MelodyNote* notes = nullptr;
+        uint16_t count = 0;
+        const int16_t* samples = nullptr;
+        uint32_t sampleCount = 0;
+        uint64_t atSample = 0;         // CmdSamples: first output sample, 0 = the next block
+    };
+
+    struct Voice
+    {
+        uint8_t stage = Off;
+        const int16_t* table = nullptr;
+        uint32_t phase = 0;
+        uint32_t step = 0;             // phase increment per sample
+        uint32_t frequency = 0;
+        uint32_t gate = 0;             // samples until the release
+        int32_t level = 0;             // envelope, Q24 (1 << 24 = full)
+        int32_t attackStep = 0, decayStep = 0, releaseStep = 0;
+        uint32_t release = 0;          // release time in samples
+        int32_t sustain = 0;
+        int32_t volumeQ = 0;           // Q15
+        uint32_t started = 0;          // for stealing the oldest voice
+    };
+
+    static constexpr uint32_t kTableSize = 1u << AUDIO_OUT_TABLE_BITS;
+    static constexpr int32_t kLevelOne = 1 << 24;
+
+    int16_t _tables[4][kTableSize + 1];   // one extra sample for the interpolation
+    Voice _voices[AUDIO_OUT_VOICES];
+    uint32_t _noteCounter = 0;
+    uint32_t _sampleRate = SAMPLE_RATE;
+    i2s_port_t _port = I2S_NUM_0;
+    TaskHandle_t _task = nullptr;
+    volatile bool _running = false;
+
+    // play requests, from any task to the render task
+    Command _commands[AUDIO_OUT_COMMANDS];
+    uint32_t _commandHead = 0, _commandTail = 0;
+    AudioEnvelope _envelope;
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+    std::atomic<int32_t> _volumeQ{ 32767 };
+
+    // melody sequencer (render task)
+    const MelodyNote* _melody = nullptr;
+    uint16_t _melodyCount = 0, _melodyIndex = 0;
+    uint32_t _melodyLeft = 0;          // samples until the next note
+    AudioWave _melodyWave = AudioWave::Square;
+    uint16_t _melodyVolumeQ = 0;
+
+    // WAV streaming: playFile() hands the file over, the render task reads it
+    enum : uint8_t { FileFree, FileFilling, FileReady };
+    std::atomic<uint8_t> _fileRequest{ FileFree };
+    File _pendingFile;
+    WavInfo _pendingInfo;
+    uint16_t _pendingVolumeQ = 0;
+    File _file;
+    bool _filePlaying = false;
+    uint16_t _fileChannels = 1;
+    uint32_t _fileLeft = 0;            // frames not read yet
+    int16_t _fileBuffer[AUDIO_OUT_FILE_CHUNK];
+    uint32_t _fileCount = 0, _filePos = 0;
+    uint32_t _fileStep = 1u << 16;     // source samples per output sample, Q16
+    uint32_t _fileFrac = 0;
+    int32_t _filePrev = 0, _fileCur = 0;
+    uint8_t _fileTail = 0;             // a sample after the end, to play the last one
+    int32_t _fileVolumeQ = 0;
+
+    // sample buffer (render task)
+    const int16_t* _clip = nullptr;
+    uint32_t _clipCount = 0, _clipPos = 0;
+    uint64_t _clipStart = 0;
+    int32_t _clipVolumeQ = 0;
+
+    int32_t _mix[AUDIO_OUT_BLOCK];
+    int16_t _block[AUDIO_OUT_BLOCK];
+    int64_t _audioEndUs = 0;           // when the queued audio runs out, 0 = idle
+    std::atomic<int64_t> _playingUntilUs{ 0 };
+    std::atomic<bool> _active{ false };
+    std::atomic<bool> _keepStreaming{ false };
+    std::atomic<uint64_t> _outputSample{ 0 };   // first sample of the next block to render
+    AudioOutStats _stats;
+
+    void makeTables()
+    {
+        for (uint32_t i = 0; i <= kTableSize; i++) {
+            float x = 2.0f * (float)M_PI * (i % kTableSize) / kTableSize;
+            float square = 0.0f, triangle = 0.0f, saw = 0.0f;
+            for (int h = 1; h <= AUDIO_OUT_HARMONICS; h++) {
+                float s = sinf(h * x);
+                saw += s / h;
+                if (h & 1) {
+                    square += s / h;
+                    triangle += ((h / 2) & 1 ? -1.0f : 1.0f) * s / (h * h);
+                }
+            }
+            _tables[(int)AudioWave::Sine][i] = (int16_t)(32000.0f * sinf(x));
+            _tables[(int)AudioWave::Triangle][i] = (int16_t)(32000.0f * triangle * 8.0f / (float)(M_PI * M_PI));
+            _tables[(int)AudioWave::Square][i] = (int16_t)(27000.0f * square * 4.0f / (float)M_PI);   // room for the ripple
+            _tables[(int)AudioWave::Saw][i] = (int16_t)(17000.0f * saw);
+        }
+    }
+
+    static uint16_t toQ15(float value)
+    {
+        if (!(value > 0.0f)) return 0;
+        return value >= 1.0f ? 32767 : (uint16_t)(value * 32767.0f);
+    }
+
+    bool push(const Command& command)
+    {
+        bool ok = false;
+        portENTER_CRITICAL(&_lock);
+        if (_commandHead - _commandTail < AUDIO_OUT_COMMANDS) {
+            _commands[_commandHead % AUDIO_OUT_COMMANDS] = command;
+            _commandHead++;
+            ok = true;
+        } else {
+            _stats.dropped++;
+        }
+        portEXIT_CRITICAL(&_lock);
+        if (!ok) {
+            Serial.println("ERR: audio out command queue full");
+            return false;
+        }
+        if (_task) xTaskNotifyGive(_task);
+        return true;
+    }
+
+    // the same random detune as startTone(), so every robot sounds a little different
+    static uint32_t detune(uint32_t frequency)
+    {
+        if (frequency >= randomness * 2) return frequency + random(randomness * 2) - randomness;
+        return frequency;
+    }
+
+    // the frequency the speaker plays now: the newest note that is not released
+    void publishVoices(int64_t timeUs)
+    {
+        const Voice* newest = nullptr;
+        for (const Voice& v : _voices) {
+            if ((v.stage == Attack || v.stage == Decay || v.stage == Sustain) && (!newest || v.started > newest->started)) newest = &v;
+        }
+        uint32_t frequency = newest ? newest->frequency : 0;
+        publishTone(frequency, timeUs);
+        AIW_TRACE_COUNTER("tone", frequency);
+    }
+
+    void startVoice(uint32_t frequency, uint32_t ms, AudioWave wave, uint16_t volumeQ, const AudioEnvelope& env, int64_t timeUs)
+    {
+        if (frequency == 0 || frequency >= _sampleRate / 2) return;
+        Voice* voice = &_voices[0];
+        for (Voice& v : _voices) {
+            if (v.stage == Off) { voice = &v; break; }
+            if (v.started < voice->started) voice = &v;   // none free: take the oldest
+        }
+        uint32_t attack = env.attackMs * _sampleRate / 1000 + 1;
+        uint32_t decay = env.decayMs * _sampleRate / 1000 + 1;
+        uint32_t release = env.releaseMs * _sampleRate / 1000 + 1;
+        float sustain = env.sustain < 0.0f ? 0.0f : env.sustain > 1.0f ? 1.0f : env.sustain;
+
+        voice->table = _tables[(uint8_t)wave & 3];
+        voice->frequency = frequency;
+        voice->step = (uint32_t)(((uint64_t)frequency << 32) / _sampleRate);
+        voice->phase = 0;
+        voice->gate = (uint32_t)((uint64_t)ms * _sampleRate / 1000);
+        voice->level = 0;
+        voice->sustain = (int32_t)(sustain * kLevelOne);
+        voice->attackStep = kLevelOne / attack;
+        voice->decayStep = (kLevelOne - voice->sustain) / decay + 1;
+        voice->release = release;
+        voice->volumeQ = volumeQ;
+        voice->started = ++_noteCounter;
+        voice->stage = Attack;
+        portENTER_CRITICAL(&_lock);
+        _stats.notes++;
+        portEXIT_CRITICAL(&_lock);
+        publishVoices(timeUs);
+    }
+
+    void startMelodyNote(int64_t timeUs, const AudioEnvelope& env)
+    {
+        const MelodyNote& note = _melody[_melodyIndex];
+        _melodyLeft = (uint32_t)((uint64_t)note.ms * _sampleRate / 1000);
+        if (_melodyLeft == 0) _melodyLeft = 1;
+        if (note.frequency) startVoice(detune(note.frequency), note.ms, _melodyWave, _melodyVolumeQ, env, timeUs);
+    }
+
+    // render task: take the play requests made since the last block
+    void takeCommands(int64_t timeUs, AudioEnvelope& env)
+    {
+        Command command;
+        while (true) {
+            portENTER_CRITICAL(&_lock);
+            bool have = _commandTail != _commandHead;
+            if (have) command = _commands[_commandTail++ % AUDIO_OUT_COMMANDS];
+            env = _envelope;
+            portEXIT_CRITICAL(&_lock);
+            if (!have) break;
+
+            if (command.type == CmdNote) {
+                startVoice(command.frequency, command.ms, command.wave, command.volumeQ, env, timeUs);
+            } else if (command.type == CmdSamples) {
+                const uint64_t next = _outputSample.load(std::memory_order_relaxed);
+                if (command.atSample != 0 && command.atSample < next) {
+                    portENTER_CRITICAL(&_lock);
+                    _stats.lateClips++;
+                    portEXIT_CRITICAL(&_lock);
+                    continue;
+                }
+                _clip = command.samples;
+                _clipCount = command.sampleCount;
+                _clipPos = 0;
+                _clipStart = command.atSample ? command.atSample : next;
+                _clipVolumeQ = command.volumeQ;
+                portENTER_CRITICAL(&_lock);
+                _stats.clips++;
+                portEXIT_CRITICAL(&_lock);
+            } else if (command.type == CmdMelody) {
+                _melody = command.notes;
+                _melodyCount = command.count;
+                _melodyIndex = 0;
+                _melodyWave = command.wave;
+                _melodyVolumeQ = command.volumeQ;
+                startMelodyNote(timeUs, env);
+            } else {
+                _melody = nullptr;
+                _clip = nullptr;
+                for (Voice& v : _voices) v.stage = Off;
+                closeFile();
+                publishVoices(timeUs);
+            }
+        }
+
+        if (_fileRequest.load(std::memory_order_acquire) == FileReady) {
+            closeFile();
+            _file = _pendingFile;
+            _pendingFile = File();
+            WavInfo info = _pendingInfo;
+            _fileVolumeQ = _pendingVolumeQ;
+            _fileRequest.store(FileFree, std::memory_order_release);
+
+            _fileChannels = info.channels;
+            _fileLeft = info.numSamples;
+            _fileCount = _filePos = 0;
+            _fileStep = (uint32_t)(((uint64_t)info.sampleRate << 16) / _sampleRate);
+            _fileFrac = 0;
+            _fileTail = 1;
+            _filePlaying = _file.seek(info.dataOffset);
+            _filePrev = nextFileSample();
+            _fileCur = nextFileSample();
+            portENTER_CRITICAL(&_lock);
+            _stats.files++;
+            portEXIT_CRITICAL(&_lock);
+        }
+    }
+
+    void closeFile()
+    {
+        if (_file) _file.close();
+        _filePlaying = false;
+    }
+
+    // next source sample (channels averaged), reads a chunk when the buffer is empty
+    int32_t nextFileSample()
+    {
+        if (_filePos + _fileChannels > _fileCount) {
+            if (_fileLeft == 0) {
+                if (_fileTail) _fileTail--;
+                else _filePlaying = false;
+                return 0;
+            }
+            int64_t start = esp_timer_get_time();
+            uint32_t frames = AUDIO_OUT_FILE_CHUNK / _fileChannels;
+            if (frames > _fileLeft) frames = _fileLeft;
+            size_t bytes = _file.read((uint8_t*)_fileBuffer, frames * _fileChannels * 2);
+            portENTER_CRITICAL(&_lock);
+            _stats.fileReadUs += esp_timer_get_time() - start;
+            portEXIT_CRITICAL(&_lock);
+            frames = bytes / (2 * _fileChannels);
+            _fileLeft = frames ? _fileLeft - frames : 0;   // a short read: the file ends here
+            _fileCount = frames * _fileChannels;
+            _filePos = 0;
+            if (frames == 0) return nextFileSample();
+        }
+        int32_t sum = 0;
+        for (uint16_t c = 0; c < _fileChannels; c++) sum += _fileBuffer[_filePos++];
+        return sum / _fileChannels;
+    }
+
+    void renderVoices(int32_t* mix, uint32_t count)
+    {
+        for (Voice& v : _voices) {
+            if (v.stage == Off) continue;
+            const int16_t* table = v.table;
+            for (uint32_t i = 0; i < count; i++) {
+                switch (v.stage) {
+                case Attack:
+                    v.level += v.attackStep;
+                    if (v.level >= kLevelOne) { v.level = kLevelOne; v.stage = Decay; }
+                    break;
+                case Decay:
+                    v.level -= v.decayStep;
+                    if (v.level <= v.sustain) { v.level = v.sustain; v.stage = Sustain; }
+                    break;
+                case Release:
+                    v.level -= v.releaseStep;
+                    if (v.level <= 0) { v.level = 0; v.stage = Off; }
+                    break;
+                default:
+                    break;
+                }
+                if (v.stage != Release && v.gate-- == 0) {
+                    v.stage = Release;   // from the level it has now to 0 in releaseMs
+                    v.releaseStep = v.level / (int32_t)v.release + 1;
+                }
+
+                // wavetable with linear interpolation between the two nearest samples
+                uint32_t index = v.phase >> (32 - AUDIO_OUT_TABLE_BITS);
+                int32_t frac = (v.phase >> (17 - AUDIO_OUT_TABLE_BITS)) & 0x7fff;
+                int32_t s = table[index] + (((table[index + 1] - table[index]) * frac) >> 15);
+                v.phase += v.step;
+                int32_t gain = (int32_t)(((int64_t)(v.level >> 9) * v.volumeQ) >> 15);   // Q15
+                mix[i] += (s * gain) >> 15;
+                if (v.stage == Off) break;
+            }
+        }
+    }
+
+    void renderFile(int32_t* mix, uint32_t count)
+    {
+        for (uint32_t i = 0; i < count && _filePlaying; i++) {
+            int32_t s = _filePrev + (((_fileCur - _filePrev) * (int32_t)(_fileFrac >> 1)) >> 15);
+            mix[i] += (s * _fileVolumeQ) >> 15;
+            _fileFrac += _fileStep;
+            while (_fileFrac >= 1u << 16 && _filePlaying) {
+                _fileFrac -= 1u << 16;
+                _filePrev = _fileCur;
+                _fileCur = nextFileSample();
+            }
+        }
+        if (!_filePlaying) closeFile();
+    }
+
+    void renderClip(int32_t* mix)
+    {
+        const uint64_t first = _outputSample.load(std::memory_order_relaxed);
+        uint32_t i = _clipStart > first ? (uint32_t)(_clipStart - first) : 0;
+        for (; i < AUDIO_OUT_BLOCK && _clipPos < _clipCount; i++) {
+            mix[i] += (_clip[_clipPos++] * _clipVolumeQ) >> 15;
+        }
+        if (_clipPos >= _clipCount) _clip = nullptr;
+    }
+
+    // one block: the melody sequencer splits it where notes start
+    void render(int64_t playUs, const AudioEnvelope& env)
+    {
+        memset(_mix, 0, sizeof(_mix));
+        const float usPerSample = 1e6f / _sampleRate;
+        uint32_t done = 0;
+        while (done < AUDIO_OUT_BLOCK) {
+            uint32_t count = AUDIO_OUT_BLOCK - done;
+            if (_melody && _melodyLeft < count) count = _melodyLeft;
+
+            // a note ends inside this part: publish what is left at the sample it ends
+            uint32_t gateEnd = count;
+            for (const Voice& v : _voices) {
+                if (v.stage != Off && v.stage != Release && v.gate < gateEnd) gateEnd = v.gate;
+            }
+            renderVoices(_mix + done, count);
+            if (gateEnd < count) publishVoices(playUs + (int64_t)((done + gateEnd) * usPerSample));
+            if (_filePlaying) renderFile(_mix + done, count);
+            done += count;
+
+            if (_melody) {
+                _melodyLeft -= count;
+                if (_melodyLeft == 0) {
+                    if (++_melodyIndex < _melodyCount) {
+                        startMelodyNote(playUs + (int64_t)(done * usPerSample), env);
+                    } else {
+                        _melody = nullptr;
+                    }
+                }
+            }
+        }
+
+        if (_clip && _clipStart < _outputSample.load(std::memory_order_relaxed) + AUDIO_OUT_BLOCK) renderClip(_mix);
+        _outputSample.fetch_add(AUDIO_OUT_BLOCK, std::memory_order_release);
+
+        int32_t volumeQ = _volumeQ.load(std::memory_order_relaxed);
+        for (uint32_t i = 0; i < AUDIO_OUT_BLOCK; i++) {
+            int32_t s = (_mix[i] * volumeQ) >> 15;
+            _block[i] = (int16_t)(s > 32767 ? 32767 : s < -32768 ? -32768 : s);
+        }
+    }
+
+    bool busy()
+    {
+        if (_melody || _filePlaying || _clip) return true;
+        for (const Voice& v : _voices) {
+            if (v.stage != Off) return true;
+        }
+        return false;
+    }
+
+    void countUnderrun()
+    {
+        portENTER_CRITICAL(&_lock);
+        _stats.underruns++;
+        portEXIT_CRITICAL(&_lock);
+        AIW_TRACE_INSTANT("audio out underrun");
+    }
+
+    static void renderTask(void* param)
+    {
+        AudioOut* out = (AudioOut*)param;
+        AIW_TRACE_TASK("AudioOut");
+        const int64_t blockUs = (int64_t)AUDIO_OUT_BLOCK * 1000000 / out->_sampleRate;
+        const int64_t dmaUs = (int64_t)AUDIO_OUT_DMA_LEN * 1000000 / out->_sampleRate;
+        const int64_t queueUs = dmaUs * AUDIO_OUT_DMA_BUFFERS;
+        AudioEnvelope env;
+        bool filled = false;   // the queue was full since the start or the last underrun
+
+        while (out->_running) {
+            int64_t now = esp_timer_get_time();
+            if (out->_audioEndUs != 0 && now > out->_audioEndUs + dmaUs / 2) {
+                out->countUnderrun();
+                filled = false;
+            }
+            int32_t marginUs = filled ? (int32_t)(out->_audioEndUs - now) : -1;
+            if (now > out->_audioEndUs) out->_audioEndUs = now;   // nothing queued (start, or an underrun)
+            int64_t playUs = out->_audioEndUs;                     // when this block will be heard
+
+            out->takeCommands(playUs, env);
+            const bool playing = out->busy();
+            if (!playing && !out->_keepStreaming.load(std::memory_order_relaxed)) {
+                // nothing to play: the DMA sends silence (tx_desc_auto_clear), sleep until a request
+                if (out->_audioEndUs > out->_playingUntilUs.load(std::memory_order_relaxed)) {
+                    out->_playingUntilUs.store(out->_audioEndUs, std::memory_order_release);
+                }
+                out->_active.store(false, std::memory_order_release);
+                out->_audioEndUs = 0;
+                filled = false;
+                ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+                continue;
+            }
+            out->_active.store(playing, std::memory_order_release);
+
+            {
+                AIW_TRACE_SCOPE("audio out block");
+                out->render(playUs, env);
+            }
+            int64_t rendered = esp_timer_get_time();
+
+            size_t written = 0;
+            i2s_write(out->_port, out->_block, sizeof(out->_block), &written, portMAX_DELAY);
+            int64_t after = esp_timer_get_time();
+            if (after > out->_audioEndUs + dmaUs / 2) {
+                // the task was held up and the queue ran dry before this block got in
+                out->countUnderrun();
+                filled = false;
+                out->_audioEndUs = after;
+            }
+            out->_audioEndUs += blockUs;
+            // the write had to wait: the queue is full again, which says where the DMA is.
+            // Small corrections only (the I2S clock drifts slowly from esp_timer), a big one
+            // means the task was held up during the write and the queue was not full.
+            int64_t full = after + queueUs - dmaUs / 2;
+            if (after - rendered > dmaUs / 4 && full - out->_audioEndUs < dmaUs && out->_audioEndUs - full < dmaUs) {
+                out->_audioEndUs = full;
+                filled = true;
+            }
+            if (playing) out->_playingUntilUs.store(out->_audioEndUs, std::memory_order_release);
+
+            uint32_t renderUs = (uint32_t)(rendered - now);
+            portENTER_CRITICAL(&out->_lock);
+            AudioOutStats& s = out->_stats;
+            s.blocks++;
+            s.totalRenderUs += renderUs;
+            if (renderUs > s.maxRenderUs) s.maxRenderUs = renderUs;
+            s.audioUs += blockUs;
+            if (marginUs >= 0 && (s.minMarginUs < 0 || marginUs < s.minMarginUs)) s.minMarginUs = marginUs;
+            portEXIT_CRITICAL(&out->_lock);
+        }
+        AIW_TRACE_TASK_END();
+        out->_task = nullptr;
+        vTaskDelete(nullptr);
+    }
+
+    bool install(const i2s_config_t& cfg, const i2s_pin_config_t& pins, UBaseType_t priority, BaseType_t core)
+    {
+        if (_running) return false;
+        if (i2s_driver_install(_port, &cfg, 0, NULL) != ESP_OK) {
+            Serial.println("ERR: audio out i2s_driver_install failed");
+            return false;
+        }
+        if (i2s_set_pin(_port, &pins) != ESP_OK) {
+            Serial.println("ERR: audio out i2s_set_pin failed");
+            i2s_driver_uninstall(_port);
+            return false;
+        }
+        i2s_zero_dma_buffer(_port);
+        makeTables();
+        _audioEndUs = 0;
+        _outputSample.store(0, std::memory_order_relaxed);
+        _clip = nullptr;
+        _stats = AudioOutStats();
+        _running = true;
+        if (pdPASS != xTaskCreatePinnedToCore(renderTask, "AudioOut", 4096, this, priority, &_task, core)) {
+            Serial.println("ERR: audio out task not started");
+            _running = false;
+            i2s_driver_uninstall(_port);
+            return false;
+        }
+        return true;
+    }
+
+public:
+    // Constructor
+    AudioOut() {}
+
+    // PDM output on one pin (I2S0 only). priority / core: the render task, it needs about
+    // 1% of a core and must run at least every few ms, so give it a higher priority than inference.
+    bool begin(int pin, uint32_t sampleRate = SAMPLE_RATE, UBaseType_t priority = 4, BaseType_t core = 1)
+    {
+        _port = I2S_NUM_0;
+        _sampleRate = sampleRate;
+        i2s_config_t cfg = {
+            .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_TX | I2S_MODE_PDM),
+            .sample_rate = sampleRate,
+            .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
+            .channel_format = I2S_CHANNEL_FMT_ONLY_LEFT,
+            .communication_format = I2S_COMM_FORMAT_STAND_I2S,
+            .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
+            .dma_buf_count = AUDIO_OUT_DMA_BUFFERS,
+            .dma_buf_len = AUDIO_OUT_DMA_LEN,
+            .use_apll = false,
+            .tx_desc_auto_clear = true,   // silence instead of old audio when the queue runs empty
+            .fixed_mclk = 0,
+        };
+        i2s_pin_config_t pins = {
+            .bck_io_num = I2S_PIN_NO_CHANGE,
+            .ws_io_num = I2S_PIN_NO_CHANGE,   // the PDM clock is not needed for an RC filter
+            .data_out_num = pin,
+            .data_in_num = I2S_PIN_NO_CHANGE,
+        };
+        return install(cfg, pins, priority, core);
+    }
+
+    // A standard I2S amplifier
+    bool beginI2s(int bckPin, int wsPin, int dataPin, i2s_port_t port = I2S_NUM_1, uint32_t sampleRate = SAMPLE_RATE,
+                  UBaseType_t priority = 4, BaseType_t core = 1)
+    {
+        _port = port;
+        _sampleRate = sampleRate;
+        i2s_config_t cfg = {
+            .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_TX),
+            .sample_rate = sampleRate,
+            .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
+            .channel_format = I2S_CHANNEL_FMT_ONLY_LEFT,
+            .communication_format = I2S_COMM_FORMAT_STAND_I2S,
+            .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
+            .dma_buf_count = AUDIO_OUT_DMA_BUFFERS,
+            .dma_buf_len = AUDIO_OUT_DMA_LEN,
+            .use_apll = false,
+            .tx_desc_auto_clear = true,
+            .fixed_mclk = 0,
+        };
+        i2s_pin_config_t pins = {
+            .bck_io_num = bckPin,
+            .ws_io_num = wsPin,
+            .data_out_num = dataPin,
+            .data_in_num = I2S_PIN_NO_CHANGE,
+        };
+        return install(cfg, pins, priority, core);
+    }
+
+    void end()
+    {
+        _running = false;
+        if (_task) xTaskNotifyGive(_task);
+        for (int i = 0; i < 200 && _task != nullptr; i++) delay(1);
+        if (_task == nullptr) {
+            closeFile();
+            i2s_driver_uninstall(_port);
+        }
+    }
+
+    // Master volume, 0 .. 1
+    void setVolume(float volume)
+    {
+        _volumeQ.store(toQ15(volume), std::memory_order_relaxed);
+    }
+
+    // Used by the notes started after this call
+    void setEnvelope(const AudioEnvelope& envelope)
+    {
+        portENTER_CRITICAL(&_lock);
+        _envelope = envelope;
+        portEXIT_CRITICAL(&_lock);
+    }
+
+    // Play a note (NOTE_* or any frequency) for ms, plus the release. Returns at once;
+    // the note starts with the next block. No random detune, unlike playTone().
+    bool playNote(uint32_t frequency, uint32_t ms, AudioWave wave = AudioWave::Square, float volume = 1.0f)
+    {
+        Command command;
+        command.type = CmdNote;
+        command.frequency = frequency;
+        command.ms = ms;
+        command.wave = wave;
+        command.volumeQ = toQ15(volume);
+        return push(command);
+    }
+
+    // Play a melody (frequency 0 = a rest). The notes are read while they play, so keep the
+    // array alive (a static const array). Replaces the melody that is playing.
+    bool playMelody(const MelodyNote* notes, uint16_t count, AudioWave wave = AudioWave::Square, float volume = 1.0f)
+    {
+        if (notes == nullptr || count == 0) return false;
+        Command command;
+        command.type = CmdMelody;
+        command.notes = notes;
+        command.count = count;
+        command.wave = wave;
+        command.volumeQ = toQ15(volume);
+        return push(command);
+    }
+
+    // Stream a 16 bit PCM WAV file from the SD card (mixed with the notes). Replaces the file
+    // that is playing. Not known to the self sound filter: it only knows notes.
+    bool playFile(const char* path, float volume = 1.0f)
+    {
+        uint8_t expected = FileFree;
+        if (!_fileRequest.compare_exchange_strong(expected, FileFilling)) {
+            Serial.println("ERR: audio out is still starting the last file");
+            return false;
+        }
+        File file = SD.open(path, FILE_READ);
+        uint8_t header[256];
+        size_t n = file ? file.read(header, sizeof(header)) : 0;
+        WavInfo info;
+        if (!parseWavHeader(header, n, info)) {
+            Serial.print("ERR: not a 16 bit WAV file: ");
+            Serial.println(path);
+            if (file) file.close();
+            _fileRequest.store(FileFree, std::memory_order_release);
+            return false;
+        }
+        info.numSamples = wavDataBytes(info, file.size()) / (2 * info.channels);
+        _pendingFile = file;
+        _pendingInfo = info;
+        _pendingVolumeQ = toQ15(volume);
+        _fileRequest.store(FileReady, std::memory_order_release);
+        if (_task) xTaskNotifyGive(_task);
+        return true;
+    }
+
+    // Play a buffer of samples (at the sample rate of the output) once, mixed with the rest.
+    // atSample: the output sample it starts at (see outputSample()), 0 = as soon as possible.
+    // When the render task already made that sample the buffer is not played (lateClips).
+    // Keep the buffer alive until it played. Replaces the buffer that is playing.
+    bool playSamples(const int16_t* samples, uint32_t count, float volume = 1.0f, uint64_t atSample = 0)
+    {
+        if (samples == nullptr || count == 0) return false;
+        Command command;
+        command.type = CmdSamples;
+        command.samples = samples;
+        command.sampleCount = count;
+        command.atSample = atSample;
+        command.volumeQ = toQ15(volume);
+        return push(command);
+    }
+
+    // Samples rendered since begin(): the first sample of the next block. A sample at least
+    // two blocks after it can still be started with playSamples().
+    uint64_t outputSample() const { return _outputSample.load(std::memory_order_acquire); }
+
+    // Send silence when nothing plays instead of stopping the DMA, so an output sample is
+    // heard a fixed time after the one before it (as long as there are no underruns).
+    void keepStreaming(bool on)
+    {
+        _keepStreaming.store(on, std::memory_order_relaxed);
+        if (on && _task) xTaskNotifyGive(_task);
+    }
+
+    // Stop notes, melody, file and sample buffer
+    void stop()
+    {
+        Command command;
+        command.type = CmdStop;
+        push(command);
+    }
+
+    // True while something plays or is about to (including the audio still in the DMA queue)
+    bool isPlaying()
+    {
+        portENTER_CRITICAL(&_lock);
+        bool pending = _commandHead != _commandTail;
+        portEXIT_CRITICAL(&_lock);
+        return pending || _active.load(std::memory_order_acquire) || _fileRequest.load(std::memory_order_acquire) != FileFree ||
+               esp_timer_get_time() < _playingUntilUs.load(std::memory_order_acquire);
+    }
+
+    // Wait until everything played (at most timeoutMs), like playTone() did. Returns false on a timeout.
+    bool wait(uint32_t timeoutMs = 10000)
+    {
+        uint32_t start = millis();
+        while (isPlaying()) {
+            if (millis() - start >= timeoutMs) return false;
+            delay(1);
+        }
+        return true;
+    }
+
+    AudioOutStats getStats()
+    {
+        portENTER_CRITICAL(&_lock);
+        AudioOutStats s = _stats;
+        portEXIT_CRITICAL(&_lock);
+        return s;
+    }
+
+    void printStats(Print& out = Serial)
+    {
+        AudioOutStats s = getStats();
+        float blockMs = 1000.0f * AUDIO_OUT_BLOCK / _sampleRate;
+        float averageUs = s.blocks ? (float)s.totalRenderUs / s.blocks : 0.0f;
+        float cpu = s.audioUs ? 100.0f * s.totalRenderUs / s.audioUs : 0.0f;
+        char line[200];
+        int n = snprintf(line, sizeof(line),
+                         "audio out: %u blocks, %u underruns, %u notes, %u files, %u dropped | %.1f us per %.1f ms block (max %u, sd %.1f) = %.2f%% cpu | closest to an underrun %.1f ms\r\n",
+                         (unsigned)s.blocks, (unsigned)s.underruns, (unsigned)s.notes, (unsigned)s.files, (unsigned)s.dropped,
+                         averageUs, blockMs, (unsigned)s.maxRenderUs, s.blocks ? (float)s.fileReadUs / s.blocks : 0.0f, cpu,
+                         s.minMarginUs < 0 ? 0.0f : s.minMarginUs / 1000.0f);
+        out.write((const uint8_t*)line, n);
+        if (s.clips || s.lateClips) {
+            n = snprintf(line, sizeof(line), "audio out: %u sample buffers, %u too late\r\n", (unsigned)s.clips, (unsigned)s.lateClips);
+            out.write((const uint8_t*)line, n);
+        }
+    }
+};
+
+#endif // WORKSHOP_AUDIO_OUT_H
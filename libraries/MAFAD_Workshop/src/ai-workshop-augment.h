@@ -0,0 +1,398 @@
+#ifndef WORKSHOP_AUGMENT_H
+#define WORKSHOP_AUGMENT_H
+
+#include "ai-workshop-main.h"
+#include "ai-workshop-sdcard.h"
+#include "ai-workshop-trace.h"
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <math.h>
+
+#define AUGMENT_NOISE_TAKES 4     // noise takes kept for mixing in (3 s each, in PSRAM)
+#define AUGMENT_BLOCK 512         // samples rendered and written at a time
+#define AUGMENT_COMBS 3           // comb filters of the reverb
+
+struct AugmentConfig
+{
+    uint8_t variants = 4;            // augmented files per take
+    const char* folder = "/augment"; // where they go on the SD card
+
+    float maxShiftMs = 150.0f;       // move the sound up to this much earlier or later
+    float minGainDb = -20.0f;        // softer (a robot far away or facing the other way)...
+    float maxGainDb = 3.0f;          // ...or a little louder
+
+    float noiseChance = 0.7f;        // part of the variants with a noise take mixed in
+    float minSnrDb = 5.0f;           // noise level below the (softer or louder) take; too much
+    float maxSnrDb = 25.0f;          // noise and the melody is gone, the label would be wrong
+
+    float distanceChance = 0.5f;     // part of the variants that sound far away (reverb + low-pass)
+    float maxPitchCents = 40.0f;     // tone nudged up or down (100 cents is a semitone)
+
+    uint32_t seed = 0;               // 0: a new random seed every begin()
+};
+
+// What was done to one variant (printed for every file)
+struct AugmentVariant
+{
+    int32_t shift;      // samples, positive is later
+    float gainDb;
+    float pitchCents;
+    float distance;     // 0 = close, 1 = far (low-pass and reverb)
+    int8_t noise;       // noise take, -1 for none
+    float snrDb;
+};
+
+struct AugmentStats
+{
+    uint32_t takes = 0;
+    uint32_t variants = 0;
+    uint64_t samples = 0;         // samples written
+    uint64_t busyUs = 0;          // time in writeVariants (rendering + SD)
+    uint64_t sdUs = 0;            // ...of which writing to the SD card
+    uint64_t bytes = 0;
+
+    float variantsPerSecond() const { return busyUs ? variants * 1e6f / busyUs : 0.0f; }
+    float sdKBps() const { return sdUs ? bytes * 1e6f / 1024.0f / sdUs : 0.0f; }
+};
+
+// Turns every recorded take into more takes for the dataset, on the robot.
+//
+// Seven real takes per button press is not a lot, and our weakest spots are soft sounds and
+// sounds from far away. For every take writeVariants() writes a few changed copies:
+//   time shift   the melody starts earlier or later (the edges are mirrored)
+//   gain         softer or louder
+//   noise        a piece of an earlier "noise" take mixed in (addNoise / loadNoise)
+//   distance     low-pass (high tones fade first) and a small reverb (room echo)
+//   pitch        a nudge up or down by resampling
+// Every variant is rendered in small blocks straight into its WAV file, so the only memory
+// needed is one block and the reverb (the take stays in the microphone's PSRAM buffer).
+// The file name keeps the label: hello_there.MAFAD000012_a1.wav
+class Augmenter
+{
+private:
+    AugmentConfig _config;
+    uint32_t _rng = 1;
+
+    int16_t* _noise[AUGMENT_NOISE_TAKES] = { nullptr };
+    uint32_t _noiseLength[AUGMENT_NOISE_TAKES] = { 0 };
+    float _noisePower[AUGMENT_NOISE_TAKES] = { 0 };
+    uint8_t _noiseCount = 0;
+    uint8_t _noiseNext = 0;   // the oldest is replaced when all are in use
+
+    int16_t _block[AUGMENT_BLOCK];
+    float* _comb = nullptr;   // delay lines of the reverb, one after the other
+    AugmentStats _stats;
+
+    // comb delays in samples (30 - 41 ms), not multiples of each other so the echo is smooth
+    static constexpr uint16_t _combDelay[AUGMENT_COMBS] = { 593, 739, 827 };
+    static constexpr uint32_t _combTotal = 593 + 739 + 827;
+
+    uint32_t next()
+    {
+        // xorshift32: quick, and the same seed gives the same variants
+        _rng ^= _rng << 13;
+        _rng ^= _rng >> 17;
+        _rng ^= _rng << 5;
+        return _rng;
+    }
+
+    float uniform(float low, float high)
+    {
+        return low + (high - low) * (next() >> 8) * (1.0f / 16777216.0f);
+    }
+
+    bool chance(float p)
+    {
+        return uniform(0.0f, 1.0f) < p;
+    }
+
+    static float power(const int16_t* samples, uint32_t count)
+    {
+        double sum = 0.0;
+        for (uint32_t i = 0; i < count; i++) sum += (float)samples[i] * samples[i];
+        return count ? (float)(sum / count) : 0.0f;
+    }
+
+    // a sample of the take, mirrored at the edges (16 bit units)
+    static inline float tap(const int32_t* take, int32_t count, int32_t index)
+    {
+        if (index < 0) index = -index;
+        if (index >= count) index = 2 * count - 2 - index;
+        if (index < 0) index = 0;
+        return take[index] * (1.0f / 4096.0f);
+    }
+
+    AugmentVariant pick()
+    {
+        AugmentVariant v;
+        int32_t maxShift = (int32_t)(_config.maxShiftMs * SAMPLE_RATE / 1000.0f);
+        v.shift = maxShift > 0 ? (int32_t)(next() % (2 * maxShift + 1)) - maxShift : 0;
+        v.gainDb = uniform(_config.minGainDb, _config.maxGainDb);
+        v.pitchCents = uniform(-_config.maxPitchCents, _config.maxPitchCents);
+        v.distance = chance(_config.distanceChance) ? uniform(0.2f, 1.0f) : 0.0f;
+        v.noise = (_noiseCount > 0 && chance(_config.noiseChance)) ? (int8_t)(next() % _noiseCount) : -1;
+        v.snrDb = uniform(_config.minSnrDb, _config.maxSnrDb);
+        return v;
+    }
+
+    // Read a noise take file into take, as the microphone would have recorded it.
+    // Only 16 bit mono files at SAMPLE_RATE (the model's rate); returns the number of samples.
+    uint32_t readNoiseFile(File& file, int32_t* take)
+    {
+        uint8_t header[256];
+        size_t headerBytes = file.read(header, sizeof(header));
+        WavInfo info;
+        if (!parseWavHeader(header, headerBytes, info) || info.channels != 1 || info.sampleRate != SAMPLE_RATE) {
+            Serial.print("ERR: not a 16 bit mono WAV file at the model rate: ");
+            Serial.println(file.name());
+            return 0;
+        }
+        if (!file.seek(info.dataOffset)) return 0;
+
+        uint32_t total = wavDataBytes(info, file.size()) / sizeof(int16_t);
+        if (total > SAMPLE_BUFFER_SIZE) total = SAMPLE_BUFFER_SIZE;
+
+        uint32_t count = 0;
+        while (count < total) {
+            uint32_t n = total - count;
+            if (n > AUGMENT_BLOCK) n = AUGMENT_BLOCK;
+            n = file.read((uint8_t*)_block, n * sizeof(int16_t)) / sizeof(int16_t);
+            if (n == 0) break;
+            for (uint32_t i = 0; i < n; i++) take[count + i] = (int32_t)_block[i] * 4096;
+            count += n;
+        }
+        return count;
+    }
+
+    bool writeVariant(SDCard& sdCard, const char* name, const int32_t* take, uint32_t count, float takePower, const AugmentVariant& v)
+    {
+        int64_t sdStart = esp_timer_get_time();
+        File file = sdCard.createAudioFile(name, count);
+        if (!file) return false;
+        uint64_t sdUs = esp_timer_get_time() - sdStart;
+
+        const float ratio = powf(2.0f, v.pitchCents / 1200.0f);
+        const float gain = powf(10.0f, v.gainDb / 20.0f);
+
+        // far away: the low-pass goes from 8 kHz down to 1.5 kHz, more echo
+        const float cutoff = 8000.0f - 6500.0f * v.distance;
+        const float lowpass = v.distance > 0.0f ? 1.0f - expf(-2.0f * (float)M_PI * cutoff / SAMPLE_RATE) : 1.0f;
+        const float feedback = 0.55f + 0.25f * v.distance;
+        const float wet = 0.5f * v.distance;
+        if (v.distance > 0.0f) memset(_comb, 0, _combTotal * sizeof(float));
+        uint32_t combPos[AUGMENT_COMBS] = { 0 };
+        float low1 = 0.0f, low2 = 0.0f;
+
+        const int16_t* noise = v.noise >= 0 ? _noise[v.noise] : nullptr;
+        const uint32_t noiseLength = v.noise >= 0 ? _noiseLength[v.noise] : 0;
+        float noiseGain = 0.0f;
+        uint32_t noisePos = 0;
+        if (noise && _noisePower[v.noise] > 0.0f) {
+            noiseGain = gain * sqrtf(takePower / (_noisePower[v.noise] * powf(10.0f, v.snrDb / 10.0f)));
+            noisePos = next() % noiseLength;
+        }
+
+        float position = (float)-v.shift;
+        uint32_t written = 0;
+        bool ok = true;
+        while (written < count) {
+            uint32_t n = count - written;
+            if (n > AUGMENT_BLOCK) n = AUGMENT_BLOCK;
+
+            for (uint32_t i = 0; i < n; i++) {
+                // time shift and pitch: read the take at a fractional position
+                int32_t index = (int32_t)floorf(position);
+                float frac = position - index;
+                float x = tap(take, count, index) * (1.0f - frac) + tap(take, count, index + 1) * frac;
+                position += ratio;
+
+                if (v.distance > 0.0f) {
+                    low1 += lowpass * (x - low1);
+                    low2 += lowpass * (low1 - low2);
+                    x = low2;
+
+                    float echo = 0.0f;
+                    float* line = _comb;
+                    for (int c = 0; c < AUGMENT_COMBS; c++) {
+                        float delayed = line[combPos[c]];
+                        line[combPos[c]] = x + feedback * delayed;
+                        if (++combPos[c] == _combDelay[c]) combPos[c] = 0;
+                        echo += delayed;
+                        line += _combDelay[c];
+                    }
+                    x += wet * echo * (1.0f / AUGMENT_COMBS);
+                }
+
+                x *= gain;
+                if (noiseGain > 0.0f) {
+                    x += noiseGain * noise[noisePos];
+                    if (++noisePos == noiseLength) noisePos = 0;
+                }
+                _block[i] = clip32((int32_t)lrintf(x));
+            }
+
+            sdStart = esp_timer_get_time();
+            if (file.write((const uint8_t*)_block, n * sizeof(int16_t)) != n * sizeof(int16_t)) ok = false;
+            sdUs += esp_timer_get_time() - sdStart;
+            if (!ok) break;
+            written += n;
+        }
+
+        sdStart = esp_timer_get_time();
+        file.close();
+        sdUs += esp_timer_get_time() - sdStart;
+
+        _stats.sdUs += sdUs;
+        _stats.bytes += 44 + (uint64_t)written * sizeof(int16_t);
+        _stats.samples += written;
+        if (!ok) Serial.println("ERR: writing an augmented file failed (SD card full?)");
+        return ok;
+    }
+
+public:
+    Augmenter() {}
+
+    bool begin(const AugmentConfig& config = AugmentConfig())
+    {
+        _config = config;
+        _rng = config.seed ? config.seed : (uint32_t)esp_random() | 1;
+        if (!_comb) {
+            _comb = (float*)heap_caps_malloc(_combTotal * sizeof(float), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+            if (!_comb) _comb = (float*)heap_caps_malloc(_combTotal * sizeof(float), MALLOC_CAP_SPIRAM);
+            if (!_comb) {
+                Serial.println("ERR: Augmenter alloc failed");
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Keep a copy of a noise take (the microphone's recording: 16 bit value * 4096) for mixing in.
+    // With AUGMENT_NOISE_TAKES takes kept, the oldest one is replaced.
+    bool addNoise(const int32_t* samples, uint32_t count)
+    {
+        if (count > SAMPLE_BUFFER_SIZE) count = SAMPLE_BUFFER_SIZE;
+        if (samples == nullptr || count < SAMPLE_RATE / 10) return false;
+
+        uint8_t slot = _noiseNext;
+        if (!_noise[slot]) {
+            _noise[slot] = (int16_t*)heap_caps_malloc(SAMPLE_BUFFER_SIZE * sizeof(int16_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+            if (!_noise[slot]) {
+                Serial.println("ERR: no PSRAM for the noise take");
+                return false;
+            }
+        }
+        for (uint32_t i = 0; i < count; i++) _noise[slot][i] = clip32(samples[i] / 4096);
+        _noiseLength[slot] = count;
+        _noisePower[slot] = power(_noise[slot], count);
+
+        _noiseNext = (slot + 1) % AUGMENT_NOISE_TAKES;
+        if (_noiseCount < AUGMENT_NOISE_TAKES) _noiseCount++;
+        return true;
+    }
+
+    // Load noise takes recorded earlier (files in folder whose name starts with "noise")
+    uint8_t loadNoise(const char* folder = "/")
+    {
+        File dir = SD.open(folder);
+        if (!dir || !dir.isDirectory()) return 0;
+
+        // read into a take buffer, as the microphone would have recorded it
+        int32_t* take = (int32_t*)heap_caps_malloc(SAMPLE_BUFFER_SIZE * sizeof(int32_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!take) {
+            Serial.println("ERR: no PSRAM for loading noise takes");
+            return 0;
+        }
+
+        uint8_t loaded = 0;
+        File file = dir.openNextFile();
+        while (file && loaded < AUGMENT_NOISE_TAKES) {
+            if (!file.isDirectory() && strncmp(file.name(), "noise", 5) == 0 && strstr(file.name(), ".wav")) {
+                uint32_t count = readNoiseFile(file, take);
+                if (count > 0 && addNoise(take, count)) loaded++;
+            }
+            file.close();
+            file = dir.openNextFile();
+        }
+        free(take);
+        return loaded;
+    }
+
+    uint8_t getNoiseCount() const
+    {
+        return _noiseCount;
+    }
+
+    // samples in noise take i (0 .. getNoiseCount() - 1)
+    uint32_t getNoiseLength(uint8_t i) const
+    {
+        return i < _noiseCount ? _noiseLength[i] : 0;
+    }
+
+    // Write config.variants augmented copies of a take (e.g. microphone.getRecordedData()) as
+    // <folder>/<baseName>.<deviceName><fileIndex>_a<n>.wav. Returns the number of files written.
+    uint8_t writeVariants(SDCard& sdCard, const int32_t* take, uint32_t durationMs, const char* baseName, const char* deviceName, uint32_t fileIndex)
+    {
+        AIW_TRACE_SCOPE("augment");
+        uint32_t count = (uint32_t)((uint64_t)durationMs * SAMPLE_RATE / 1000);
+        if (count > SAMPLE_BUFFER_SIZE) count = SAMPLE_BUFFER_SIZE;
+        if (take == nullptr || count < 2 || !_comb) return 0;
+
+        int64_t start = esp_timer_get_time();
+
+        // the noise level is set against the whole take
+        double sum = 0.0;
+        for (uint32_t i = 0; i < count; i++) {
+            float x = take[i] * (1.0f / 4096.0f);
+            sum += x * x;
+        }
+        float takePower = (float)(sum / count);
+
+        uint8_t written = 0;
+        for (uint8_t k = 0; k < _config.variants; k++) {
+            AugmentVariant v = pick();
+            char name[96];
+            snprintf(name, sizeof(name), "%s/%s.%s%06u_a%u.wav", _config.folder, baseName, deviceName, (unsigned)fileIndex, (unsigned)k + 1);
+            if (!writeVariant(sdCard, name, take, count, takePower, v)) break;
+            written++;
+            _stats.variants++;
+
+            char line[160];
+            int n = snprintf(line, sizeof(line), "Wrote augmented file: %s (shift %+d ms, %+.1f dB, %+.0f cents, distance %.1f",
+                             name, (int)(v.shift * 1000 / SAMPLE_RATE), v.gainDb, v.pitchCents, v.distance);
+            if (v.noise >= 0 && n < (int)sizeof(line)) n += snprintf(line + n, sizeof(line) - n, ", noise %d at %.0f dB", v.noise, v.snrDb);
+            if (n < (int)sizeof(line)) snprintf(line + n, sizeof(line) - n, ")");
+            Serial.println(line);
+        }
+        _stats.takes++;
+        _stats.busyUs += esp_timer_get_time() - start;
+        return written;
+    }
+
+    AugmentStats getStats() const
+    {
+        return _stats;
+    }
+
+    void resetStats()
+    {
+        _stats = AugmentStats();
+    }
+
+    void printStats(Print& out = Serial)
+    {
+        const AugmentStats& s = _stats;
+        float audioS = s.samples / (float)SAMPLE_RATE;
+        float busyS = s.busyUs / 1e6f;
+        char line[200];
+        int n = snprintf(line, sizeof(line),
+                         "augment: %u variants of %u takes, %.1f variants/s, %.1f s of audio per second, SD %.0f KB/s (%.0f%% of the time)\n",
+                         (unsigned)s.variants, (unsigned)s.takes, s.variantsPerSecond(), busyS > 0.0f ? audioS / busyS : 0.0f,
+                         s.sdKBps(), s.busyUs ? 100.0f * s.sdUs / s.busyUs : 0.0f);
+        out.write((const uint8_t*)line, n);
+    }
+};
+
+#endif // WORKSHOP_AUGMENT_H
@@ -0,0 +1,197 @@
+#ifndef WORKSHOP_BOOT_H
+#define WORKSHOP_BOOT_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define BOOT_MAX_STEPS 16         // steps and marks on the timeline
+#define BOOT_STACK_SIZE 6144      // stack of a background step (SD and LittleFS need a few KB)
+
+// What a step runs: true when it worked. A lambda without captures works too:
+//   boot.start("sd card", [] { return sdCard.setup(SDCARD_CS_PIN); });
+typedef bool (*BootFunction)();
+
+// Starts the robot quickly and shows where the time goes.
+//
+// setup() used to do everything one after the other, so the robot only started listening
+// after the SD card was mounted (hundreds of ms, or a long timeout without a card). With Boot:
+//   run()    does a step now, in setup() (the microphone, the classifier: needed to listen)
+//   start()  does a step in a background task (the SD card, flash storage: needed later)
+//   mark()   notes a moment from any task, e.g. "first result" in the inference task
+//   wait()   waits until a background step is done, before its result is used
+// printTimeline() prints every step with its start and end, counted from power on
+// (esp_timer starts just before setup()). Steps in the background must not use the same
+// hardware as each other or as setup() at the same time.
+class Boot
+{
+private:
+    enum : uint8_t { Running, Succeeded, Failed, Marked };
+
+    struct Step
+    {
+        const char* name = nullptr;
+        BootFunction function = nullptr;
+        int64_t startUs = 0;
+        int64_t endUs = 0;
+        std::atomic<uint8_t> state{ Running };
+    };
+
+    Step _steps[BOOT_MAX_STEPS];
+    std::atomic<uint8_t> _count{ 0 };
+    int64_t _setupUs = 0;
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+
+    // a new step, filled in before other tasks can find it. once: not when a step with this
+    // name is there already (looked up in the same critical section, so two tasks adding the
+    // same name at the same time give one step)
+    Step* add(const char* name, uint8_t state = Running, bool once = false)
+    {
+        Step* step = nullptr;
+        portENTER_CRITICAL(&_lock);
+        uint8_t index = _count.load(std::memory_order_relaxed);
+        for (uint8_t i = 0; once && i < index; i++) {
+            if (strcmp(_steps[i].name, name) == 0) {
+                portEXIT_CRITICAL(&_lock);
+                return &_steps[i];
+            }
+        }
+        if (index < BOOT_MAX_STEPS) {
+            step = &_steps[index];
+            step->name = name;
+            step->startUs = step->endUs = esp_timer_get_time();
+            step->state.store(state, std::memory_order_relaxed);
+            _count.store(index + 1, std::memory_order_release);
+        }
+        portEXIT_CRITICAL(&_lock);
+        if (!step) Serial.println("ERR: too many boot steps (BOOT_MAX_STEPS)");
+        return step;
+    }
+
+    Step* find(const char* name)
+    {
+        uint8_t count = _count.load(std::memory_order_acquire);
+        for (uint8_t i = 0; i < count; i++) {
+            if (strcmp(_steps[i].name, name) == 0) return &_steps[i];
+        }
+        return nullptr;
+    }
+
+    static void finish(Step& step, bool ok)
+    {
+        step.endUs = esp_timer_get_time();
+        step.state.store(ok ? Succeeded : Failed, std::memory_order_release);
+    }
+
+    static void stepTask(void* param)
+    {
+        Step& step = *(Step*)param;
+        finish(step, step.function());
+        vTaskDelete(NULL);
+    }
+
+public:
+    // Call first in setup()
+    void begin()
+    {
+        _setupUs = esp_timer_get_time();
+    }
+
+    // Do a step now. Returns what the step returned.
+    bool run(const char* name, BootFunction function)
+    {
+        Step* step = add(name);
+        if (!step) return function();
+        bool ok = function();
+        finish(*step, ok);
+        return ok;
+    }
+
+    // Do a step in a background task (priority 1, on any core). Returns false when it could not start.
+    bool start(const char* name, BootFunction function, uint32_t stackSize = BOOT_STACK_SIZE)
+    {
+        Step* step = add(name);
+        if (!step) return false;
+        step->function = function;
+        if (xTaskCreate(stepTask, name, stackSize, step, 1, NULL) != pdPASS) {
+            Serial.println("ERR: boot task not started");
+            finish(*step, false);
+            return false;
+        }
+        return true;
+    }
+
+    // Note a moment on the timeline (only the first time per name), from any task
+    void mark(const char* name)
+    {
+        if (!find(name)) add(name, Marked, true);   // find() first: no lock for a mark that is there
+    }
+
+    bool isDone(const char* name)
+    {
+        Step* step = find(name);
+        return step && step->state.load(std::memory_order_acquire) != Running;
+    }
+
+    // True when the step is done and worked (or the mark was made)
+    bool succeeded(const char* name)
+    {
+        Step* step = find(name);
+        if (!step) return false;
+        uint8_t state = step->state.load(std::memory_order_acquire);
+        return state == Succeeded || state == Marked;
+    }
+
+    // Wait until a background step is done (at most timeoutMs), returns succeeded()
+    bool wait(const char* name, uint32_t timeoutMs = 10000)
+    {
+        uint32_t start = millis();
+        while (!isDone(name) && millis() - start < timeoutMs) vTaskDelay(1);
+        return succeeded(name);
+    }
+
+    // Time from power on to the end of a step or to a mark (ms), -1 when not there (yet)
+    float getMs(const char* name)
+    {
+        Step* step = find(name);
+        if (!step || step->state.load(std::memory_order_acquire) == Running) return -1.0f;
+        return step->endUs / 1000.0f;
+    }
+
+    // True when every step is done
+    bool isComplete()
+    {
+        uint8_t count = _count.load(std::memory_order_acquire);
+        for (uint8_t i = 0; i < count; i++) {
+            if (_steps[i].state.load(std::memory_order_acquire) == Running) return false;
+        }
+        return true;
+    }
+
+    void printTimeline(Print& out = Serial)
+    {
+        char line[120];
+        int n = snprintf(line, sizeof(line), "boot timeline (ms since power on), setup() started at %.1f\n", _setupUs / 1000.0f);
+        out.write((const uint8_t*)line, n);
+        uint8_t count = _count.load(std::memory_order_acquire);
+        for (uint8_t i = 0; i < count; i++) {
+            const Step& step = _steps[i];
+            uint8_t state = step.state.load(std::memory_order_acquire);
+            if (state == Marked) {
+                n = snprintf(line, sizeof(line), "  %8.1f            * %s\n", step.startUs / 1000.0f, step.name);
+            } else if (state == Running) {
+                n = snprintf(line, sizeof(line), "  %8.1f -     ...  %-16s %s\n", step.startUs / 1000.0f, step.name,
+                             step.function ? "(background, running)" : "(running)");
+            } else {
+                n = snprintf(line, sizeof(line), "  %8.1f - %8.1f  %-16s %7.1f ms %s%s\n", step.startUs / 1000.0f, step.endUs / 1000.0f,
+                             step.name, (step.endUs - step.startUs) / 1000.0f, step.function ? "(background) " : "",
+                             state == Failed ? "FAILED" : "");
+            }
+            out.write((const uint8_t*)line, n);
+        }
+    }
+};
+
+#endif // WORKSHOP_BOOT_H
@@ -0,0 +1,197 @@
+#ifndef WORKSHOP_CAPTURE_H
+#define WORKSHOP_CAPTURE_H
+
+// How the microphone is read: the I2S DMA buffers and the size of every i2s_read, as named
+// profiles, and a meter for how the blocks really arrive. Plain C++, no Arduino needed, so
+// the host tools can use it too.
+//
+// The I2S driver fills dmaBufCount buffers of dmaBufLen frames in a ring, the capture task
+// takes readFrames frames per i2s_read (with MIC_I2S_STD the interrupt takes every DMA buffer
+// as it completes, readFrames is not used). That decides:
+//   - latency:  a block is handed on when its last frame is in (at least one DMA buffer)
+//   - wakeups:  the task wakes up once per DMA buffer while it waits in i2s_read
+//   - headroom: how long the task may be away from i2s_read (hooks, other tasks on its core)
+//               before the driver has to drop audio: the DMA buffers minus the one being filled
+//   - DMA memory: dmaBufCount * dmaBufLen frames of internal RAM
+
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+
+#define CAPTURE_MAX_DMA_BYTES 4092   // limit of one DMA buffer in the legacy I2S driver
+
+enum class CaptureProfile : uint8_t
+{
+    LowLatency,   // 3.2 ms blocks, 312 wakeups per second, little headroom
+    Balanced,     // 25.6 ms blocks, 78 wakeups per second
+    LowPower,     // 50 ms blocks, 40 wakeups per second, the most headroom
+};
+
+struct CaptureConfig
+{
+    uint16_t dmaBufCount = 8;
+    uint16_t dmaBufLen = 128;     // frames per DMA buffer
+    uint16_t readFrames = 1024;   // frames per i2s_read (i2sMic: at most DMA_BUFFER_SIZE)
+
+    CaptureConfig() {}
+    CaptureConfig(uint16_t count, uint16_t len, uint16_t read) : dmaBufCount(count), dmaBufLen(len), readFrames(read) {}
+
+    static CaptureConfig forProfile(CaptureProfile profile)
+    {
+        switch (profile) {
+            case CaptureProfile::LowLatency: return CaptureConfig(6, 64, 64);
+            case CaptureProfile::Balanced: return CaptureConfig(8, 256, 512);
+            case CaptureProfile::LowPower: return CaptureConfig(4, 500, 1000);
+        }
+        return CaptureConfig();
+    }
+
+    bool operator==(const CaptureConfig& other) const
+    {
+        return dmaBufCount == other.dmaBufCount && dmaBufLen == other.dmaBufLen && readFrames == other.readFrames;
+    }
+
+    // What the driver accepts: 2 to 128 buffers of 8 to 1024 frames, at most 4092 bytes each
+    // (32 bit samples, two per frame in stereo)
+    bool valid(uint32_t channels) const
+    {
+        return dmaBufCount >= 2 && dmaBufCount <= 128 && dmaBufLen >= 8 && dmaBufLen <= 1024 &&
+               (uint32_t)dmaBufLen * 4 * channels <= CAPTURE_MAX_DMA_BYTES && readFrames > 0;
+    }
+
+    float latencyMs(uint32_t rate) const
+    {
+        return 1000.0f * (readFrames > dmaBufLen ? readFrames : dmaBufLen) / rate;
+    }
+
+    float headroomMs(uint32_t rate) const { return 1000.0f * (dmaBufCount - 1) * dmaBufLen / rate; }
+    float wakeupsPerSecond(uint32_t rate) const { return (float)rate / dmaBufLen; }
+    float readsPerSecond(uint32_t rate) const { return (float)rate / readFrames; }
+    uint32_t dmaBytes(uint32_t channels) const { return (uint32_t)dmaBufCount * dmaBufLen * 4 * channels; }
+
+    // One line, e.g. "8 x 256 frames, 512 per read: 25.6 ms, 78 wakeups/s, 89.6 ms headroom, 8192 bytes"
+    int format(char* out, size_t size, uint32_t rate, uint32_t channels = 1) const
+    {
+        return snprintf(out, size, "%u x %u frames, %u per read: %.1f ms, %.0f wakeups/s, %.1f ms headroom, %u bytes",
+                        (unsigned)dmaBufCount, (unsigned)dmaBufLen, (unsigned)readFrames, latencyMs(rate),
+                        wakeupsPerSecond(rate), headroomMs(rate), (unsigned)dmaBytes(channels));
+    }
+};
+
+// What the auto tuner tries, cheapest first: fewest wakeups, then the least DMA memory.
+static const CaptureConfig kCaptureCandidates[] = {
+    CaptureConfig(4, 500, 1000),   // LowPower
+    CaptureConfig(8, 256, 512),    // Balanced
+    CaptureConfig(8, 128, 1024),   // what i2sMic always used
+    CaptureConfig(8, 128, 256),
+    CaptureConfig(6, 64, 64),      // LowLatency
+    CaptureConfig(16, 64, 128),    // low latency with the headroom of the bigger ones
+};
+static const uint8_t kCaptureCandidateCount = sizeof(kCaptureCandidates) / sizeof(kCaptureCandidates[0]);
+
+// How the blocks of a capture really arrived
+struct CaptureTiming
+{
+    uint32_t blocks = 0;
+    uint32_t frames = 0;
+    float seconds = 0.0f;
+    float meanLatencyUs = 0.0f;   // first frame of a block to the capture task having it
+    uint32_t maxLatencyUs = 0;
+    float jitterUs = 0.0f;        // standard deviation of the arrival against the audio clock
+    uint32_t maxLateUs = 0;       // latest arrival after the last frame of a block was in
+    uint32_t overruns = 0;        // times the task was away longer than the DMA buffers last
+    uint32_t lostFrames = 0;      // estimate of the audio the driver dropped then
+
+    float blocksPerSecond() const { return seconds > 0.0f ? blocks / seconds : 0.0f; }
+
+    // One line, e.g. "latency 25.7 ms (max 26.1), jitter 40 us, late 310 us max, 39 blocks/s, 0 overruns"
+    int format(char* out, size_t size) const
+    {
+        return snprintf(out, size, "latency %.1f ms (max %.1f), jitter %.0f us, late %u us max, %.0f blocks/s, %u overruns (%u frames)",
+                        meanLatencyUs / 1000.0f, maxLatencyUs / 1000.0f, jitterUs, (unsigned)maxLateUs, blocksPerSecond(),
+                        (unsigned)overruns, (unsigned)lostFrames);
+    }
+};
+
+// Follows the audio clock from the blocks the capture task gets: block k should arrive when
+// its last frame is in. Arriving later means the task was away (or woke up late); arriving
+// later than the DMA buffers last means the driver dropped audio in between.
+class CaptureMeter
+{
+private:
+    uint32_t _rate = 1;
+    uint32_t _bufferUs = 0;
+    int64_t _anchorUs = 0;      // when the audio clock started, frame 0
+    uint64_t _clockFrames = 0;  // frames read since the anchor (plus the ones estimated lost)
+    int64_t _firstUs = 0;
+    int64_t _lastUs = 0;
+    double _lateSum = 0.0;
+    double _lateSquares = 0.0;
+    double _latencySum = 0.0;
+    CaptureTiming _timing;
+
+public:
+    void start(const CaptureConfig& config, uint32_t rate)
+    {
+        *this = CaptureMeter();
+        _rate = rate;
+        _bufferUs = (uint32_t)(1000000ULL * config.dmaBufCount * config.dmaBufLen / rate);
+    }
+
+    // A block of `frames` frames came out of i2s_read at arrivalUs
+    void block(int64_t arrivalUs, uint32_t frames)
+    {
+        int64_t blockUs = (int64_t)frames * 1000000 / _rate;
+        if (_timing.blocks == 0) {
+            _anchorUs = arrivalUs - blockUs;
+            _firstUs = _anchorUs;
+        }
+        _clockFrames += frames;
+        int64_t late = arrivalUs - (_anchorUs + (int64_t)(_clockFrames * 1000000 / _rate));
+        if (late < 0) {
+            // the clock started later than the first block said: move it
+            _anchorUs += late;
+            late = 0;
+        }
+        if (late > _bufferUs) {
+            // away longer than the buffers last: the audio in between was dropped, the
+            // clock moves on by what is missing
+            uint32_t lost = (uint32_t)((late - _bufferUs) * _rate / 1000000);
+            _timing.overruns++;
+            _timing.lostFrames += lost;
+            _clockFrames += lost;
+            late -= (int64_t)lost * 1000000 / _rate;
+        }
+
+        _timing.blocks++;
+        _timing.frames += frames;
+        _lateSum += (double)late;
+        _lateSquares += (double)late * late;
+        _latencySum += (double)(blockUs + late);
+        if ((uint32_t)late > _timing.maxLateUs) _timing.maxLateUs = (uint32_t)late;
+        if ((uint32_t)(blockUs + late) > _timing.maxLatencyUs) _timing.maxLatencyUs = (uint32_t)(blockUs + late);
+        _lastUs = arrivalUs;
+    }
+
+    // MIC_I2S_STD: a block that had to be dropped (newRun: the first of a run, one overrun)
+    void lost(uint32_t frames, bool newRun)
+    {
+        if (newRun) _timing.overruns++;
+        _timing.lostFrames += frames;
+        _clockFrames += frames;
+    }
+
+    CaptureTiming timing() const
+    {
+        CaptureTiming t = _timing;
+        if (t.blocks == 0) return t;
+        double mean = _lateSum / t.blocks;
+        double variance = _lateSquares / t.blocks - mean * mean;
+        t.jitterUs = variance > 0.0 ? (float)sqrt(variance) : 0.0f;
+        t.meanLatencyUs = (float)(_latencySum / t.blocks);
+        t.seconds = (_lastUs - _firstUs) / 1e6f;
+        return t;
+    }
+};
+
+#endif // WORKSHOP_CAPTURE_H
@@ -0,0 +1,365 @@
+#ifndef WORKSHOP_DOA_H
+#define WORKSHOP_DOA_H
+
+#include "ai-workshop-main.h"
+#include "ai-workshop-mic.h"
+#include "ai-workshop-fft.h"
+#include "ai-workshop-trace.h"
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define DOA_FRAME_SIZE 1024   // samples per channel in one estimate (51 ms at 20 kHz), power of two
+
+struct DoaConfig
+{
+    float micDistanceM = 0.08f;     // distance between the two microphones
+    float speedOfSound = 343.0f;    // meters per second
+    float onsetRatio = 3.0f;        // a block this many times louder (RMS) than the noise floor is an event
+    float minLevel = 60.0f;         // ...and it must be at least this loud (RMS in 16 bit units)
+    uint32_t holdoffMs = 250;       // ignore new events this long after one (echoes, the rest of the sound)
+    float minHz = 200.0f;           // frequency band used for the estimate
+    float maxHz = 6000.0f;
+};
+
+struct DoaResult
+{
+    int64_t timeUs = 0;      // esp_timer time of the end of the analysed frame
+    float angleDeg = 0.0f;   // -90 (left) .. 0 (straight ahead) .. 90 (right)
+    float delayUs = 0.0f;    // how much later the sound reached the left microphone
+    float confidence = 0.0f; // height of the correlation peak, 0 .. 1
+    uint32_t computeUs = 0;  // time the estimate took
+};
+
+struct DoaStats
+{
+    uint32_t events = 0;       // loud onsets detected
+    uint32_t estimates = 0;    // estimates computed
+    uint32_t busy = 0;         // events skipped because the last estimate was still running
+    uint32_t lastComputeUs = 0;
+    uint32_t maxComputeUs = 0;
+    uint64_t totalComputeUs = 0;
+};
+
+// Direction of arrival from two microphones (i2sMic in MicChannels::Stereo mode) with GCC-PHAT.
+//
+// A stereo stream hook keeps the last DOA_FRAME_SIZE samples of both channels and runs a
+// loudness detector. Half a frame after a sound starts, the frame is copied (windowed) and a
+// low priority task estimates the delay between the microphones:
+//   both channels go into one complex FFT (left = real, right = imaginary),
+//   cross spectrum L * conj(R), keep only the phase (PHAT), inverse FFT,
+//   peak search within the physically possible delays, parabolic interpolation of the peak.
+// The delay gives the angle: sin(angle) = delay * speedOfSound / micDistance.
+// Only events are analysed, so the cost is per sound, not per block; see printStats().
+class DirectionFinder
+{
+private:
+    DoaConfig _config;
+    TaskHandle_t _task = nullptr;
+    volatile bool _running = false;
+
+    FFT _fft;
+    float *_ring = nullptr;      // [2][DOA_FRAME_SIZE] history of the left and right channel
+    uint32_t _ringPos = 0;
+    float *_window = nullptr;    // Hann window
+    float *_frame = nullptr;     // complex frame: left in the real, right in the imaginary parts
+    float *_left = nullptr;      // spectra, DOA_FRAME_SIZE/2 + 1 complex bins each
+    float *_right = nullptr;
+    volatile bool _busy = false;
+    int64_t _frameTimeUs = 0;
+
+    float _noise = 0.0f;         // noise floor (mean square)
+    bool _noiseValid = false;
+    int64_t _lastEventUs = 0;
+    uint32_t _pending = 0;       // samples of the sound still to come before the frame is taken
+
+    DoaResult _result;
+    volatile uint32_t _resultCount = 0;
+    DoaStats _stats;
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+
+    static void stereoHook(float *left, float *right, uint32_t count, int64_t timeUs, void *user)
+    {
+        static_cast<DirectionFinder *>(user)->onBlock(left, right, count, timeUs);
+    }
+
+    static void estimateTask(void *parameter)
+    {
+        AIW_TRACE_TASK("DoaEstimate");
+        DirectionFinder *doa = static_cast<DirectionFinder *>(parameter);
+        while (doa->_running)
+        {
+            if (ulTaskNotifyTake(pdTRUE, 100 / portTICK_PERIOD_MS) == 0) continue;
+            if (!doa->_running) break;
+            AIW_TRACE_BEGIN("doa estimate");
+            doa->estimate();
+            AIW_TRACE_END("doa estimate");
+            doa->_busy = false;
+        }
+        AIW_TRACE_TASK_END();
+        doa->_task = nullptr;
+        vTaskDelete(nullptr);
+    }
+
+    void estimate()
+    {
+        const uint32_t n = DOA_FRAME_SIZE;
+        int64_t start = esp_timer_get_time();
+
+        _fft.forwardRealPair(_frame, _left, _right);
+
+        // PHAT weighted cross spectrum, only inside the frequency band; rebuilt as a full
+        // (conjugate symmetric) spectrum in _frame for the inverse FFT
+        const uint32_t kMin = (uint32_t)(_config.minHz * n / SAMPLE_RATE);
+        uint32_t kMax = (uint32_t)(_config.maxHz * n / SAMPLE_RATE);
+        if (kMax > n / 2) kMax = n / 2;
+        for (uint32_t k = 0; k <= n / 2; k++)
+        {
+            float gr = 0.0f, gi = 0.0f;
+            if (k >= kMin && k <= kMax)
+            {
+                float lr = _left[2 * k], li = _left[2 * k + 1];
+                float rr = _right[2 * k], ri = _right[2 * k + 1];
+                gr = lr * rr + li * ri;
+                gi = li * rr - lr * ri;
+                float magnitude = sqrtf(gr * gr + gi * gi);
+                if (magnitude > 1e-9f)
+                {
+                    gr /= magnitude;
+                    gi /= magnitude;
+                }
+            }
+            _frame[2 * k] = gr;
+            _frame[2 * k + 1] = gi;
+            if (k > 0 && k < n / 2)
+            {
+                _frame[2 * (n - k)] = gr;
+                _frame[2 * (n - k) + 1] = -gi;
+            }
+        }
+        _fft.inverse(_frame);
+
+        // the correlation is in the real parts, lag L sits at index L (L >= 0) or n + L (L < 0)
+        const float bins = (float)(kMax >= kMin ? 2 * (kMax - kMin + 1) : 1);
+        const int maxLag = (int)ceilf(_config.micDistanceM / _config.speedOfSound * SAMPLE_RATE) + 1;
+        int bestLag = 0;
+        float best = -1e30f;
+        for (int lag = -maxLag; lag <= maxLag; lag++)
+        {
+            float v = _frame[2 * ((lag + n) % n)];
+            if (v > best)
+            {
+                best = v;
+                bestLag = lag;
+            }
+        }
+
+        float before = _frame[2 * ((bestLag - 1 + n) % n)];
+        float after = _frame[2 * ((bestLag + 1 + n) % n)];
+        float curve = before - 2.0f * best + after;
+        float offset = (curve < 0.0f) ? 0.5f * (before - after) / curve : 0.0f;
+
+        DoaResult result;
+        result.timeUs = _frameTimeUs;
+        result.delayUs = (bestLag + offset) * 1000000.0f / SAMPLE_RATE;
+        float s = result.delayUs * 1e-6f * _config.speedOfSound / _config.micDistanceM;
+        if (s > 1.0f) s = 1.0f;
+        if (s < -1.0f) s = -1.0f;
+        result.angleDeg = asinf(s) * 180.0f / (float)M_PI;
+        result.confidence = best * n / bins;
+        result.computeUs = (uint32_t)(esp_timer_get_time() - start);
+
+        portENTER_CRITICAL(&_lock);
+        _result = result;
+        _resultCount++;
+        _stats.estimates++;
+        _stats.lastComputeUs = result.computeUs;
+        if (result.computeUs > _stats.maxComputeUs) _stats.maxComputeUs = result.computeUs;
+        _stats.totalComputeUs += result.computeUs;
+        portEXIT_CRITICAL(&_lock);
+    }
+
+    void release()
+    {
+        if (_ring) { heap_caps_free(_ring); _ring = nullptr; }
+        if (_window) { heap_caps_free(_window); _window = nullptr; }
+        if (_frame) { heap_caps_free(_frame); _frame = nullptr; }
+        if (_left) { heap_caps_free(_left); _left = nullptr; }
+        if (_right) { heap_caps_free(_right); _right = nullptr; }
+    }
+
+    // copies the newest DOA_FRAME_SIZE samples (oldest first), windowed, into the complex frame
+    void takeFrame(int64_t timeUs)
+    {
+        for (uint32_t i = 0; i < DOA_FRAME_SIZE; i++)
+        {
+            uint32_t r = (_ringPos + i) & (DOA_FRAME_SIZE - 1);
+            _frame[2 * i] = _ring[r] * _window[i];
+            _frame[2 * i + 1] = _ring[DOA_FRAME_SIZE + r] * _window[i];
+        }
+        _frameTimeUs = timeUs;
+        _busy = true;
+        xTaskNotifyGive(_task);
+    }
+
+public:
+    // Constructor
+    DirectionFinder() {}
+
+    // Call before mic.startStream(). The microphone must be set up with MicChannels::Stereo.
+    bool begin(i2sMic &mic, const DoaConfig &config = DoaConfig(), UBaseType_t priority = 1, BaseType_t core = 1)
+    {
+        if (_running) return false;
+        if (!mic.isStereo())
+        {
+            Serial.println("ERR: DirectionFinder needs a stereo microphone");
+            return false;
+        }
+
+        _config = config;
+        if (!_fft.begin(DOA_FRAME_SIZE)) return false;
+
+        const uint32_t caps = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+        _ring = (float *)heap_caps_calloc(2 * DOA_FRAME_SIZE, sizeof(float), caps);
+        _window = (float *)heap_caps_malloc(DOA_FRAME_SIZE * sizeof(float), caps);
+        _frame = (float *)heap_caps_malloc(2 * DOA_FRAME_SIZE * sizeof(float), caps);
+        _left = (float *)heap_caps_malloc((DOA_FRAME_SIZE + 2) * sizeof(float), caps);
+        _right = (float *)heap_caps_malloc((DOA_FRAME_SIZE + 2) * sizeof(float), caps);
+        if (!_ring || !_window || !_frame || !_left || !_right)
+        {
+            Serial.println("ERR: DirectionFinder alloc failed");
+            release();
+            return false;
+        }
+        FFT::hannWindow(_window, DOA_FRAME_SIZE);
+
+        _ringPos = 0;
+        _busy = false;
+        _noiseValid = false;
+        _lastEventUs = 0;
+        _pending = 0;
+        _resultCount = 0;
+        _stats = DoaStats();
+
+        _running = true;
+        if (pdPASS != xTaskCreatePinnedToCore(estimateTask, "DoaEstimate", 4096, this, priority, &_task, core))
+        {
+            _running = false;
+            release();
+            return false;
+        }
+
+        return mic.addStereoHook(stereoHook, this);
+    }
+
+    void end(i2sMic &mic)
+    {
+        mic.removeStereoHook(stereoHook, this);
+        _running = false;
+        if (_task) xTaskNotifyGive(_task);
+        for (int i = 0; i < 200 && _task != nullptr; i++) delay(1);
+        if (_task == nullptr) release();
+    }
+
+    // The stream hook: keep the history and look for the start of a sound.
+    void onBlock(const float *left, const float *right, uint32_t count, int64_t timeUs)
+    {
+        if (count == 0) return;
+
+        float energy = 0.0f;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            _ring[_ringPos] = left[i];
+            _ring[DOA_FRAME_SIZE + _ringPos] = right[i];
+            _ringPos = (_ringPos + 1) & (DOA_FRAME_SIZE - 1);
+            energy += 0.5f * (left[i] * left[i] + right[i] * right[i]);
+        }
+        energy /= count;
+
+        // small blocks: wait until half a frame of the sound is in the ring
+        if (_pending > 0)
+        {
+            _pending = count >= _pending ? 0 : _pending - count;
+            if (_pending == 0) takeFrame(timeUs);
+            return;
+        }
+
+        if (!_noiseValid)
+        {
+            _noise = energy;
+            _noiseValid = true;
+        }
+
+        float threshold = _noise * _config.onsetRatio * _config.onsetRatio;
+        float minimum = _config.minLevel * _config.minLevel;
+        if (threshold < minimum) threshold = minimum;
+        bool loud = energy > threshold;
+
+        // the noise floor follows quiet blocks slowly and drops quickly
+        if (!loud)
+        {
+            _noise += (energy < _noise ? 0.3f : 0.02f) * (energy - _noise);
+            return;
+        }
+
+        if (_lastEventUs != 0 && timeUs - _lastEventUs < (int64_t)_config.holdoffMs * 1000) return;
+        _lastEventUs = timeUs;
+
+        portENTER_CRITICAL(&_lock);
+        _stats.events++;
+        portEXIT_CRITICAL(&_lock);
+
+        if (_busy)
+        {
+            portENTER_CRITICAL(&_lock);
+            _stats.busy++;
+            portEXIT_CRITICAL(&_lock);
+            return;
+        }
+
+        if (count < DOA_FRAME_SIZE / 2)
+        {
+            _pending = DOA_FRAME_SIZE / 2 - count;
+            return;
+        }
+        takeFrame(timeUs);
+    }
+
+    // Number of estimates so far, compare with an older value to see if there is a new one.
+    uint32_t getResultCount() const { return _resultCount; }
+
+    bool latest(DoaResult &out)
+    {
+        portENTER_CRITICAL(&_lock);
+        bool found = _resultCount > 0;
+        out = _result;
+        portEXIT_CRITICAL(&_lock);
+        return found;
+    }
+
+    DoaStats getStats()
+    {
+        portENTER_CRITICAL(&_lock);
+        DoaStats stats = _stats;
+        portEXIT_CRITICAL(&_lock);
+        return stats;
+    }
+
+    // The cost of one estimate compared to the time of one stream block (the real-time budget).
+    void printStats(Print &out = Serial)
+    {
+        DoaStats s = getStats();
+        float blockMs = 1000.0f * DMA_BUFFER_SIZE / SAMPLE_RATE;
+        float averageMs = s.estimates ? s.totalComputeUs / 1000.0f / s.estimates : 0.0f;
+        char line[160];
+        snprintf(line, sizeof(line),
+                 "doa: %u events, %u estimates, %u skipped | %.2f ms per estimate (max %.2f) = %.1f%% of a %.1f ms block\r\n",
+                 (unsigned)s.events, (unsigned)s.estimates, (unsigned)s.busy,
+                 averageMs, s.maxComputeUs / 1000.0f, 100.0f * averageMs / blockMs, blockMs);
+        out.write((const uint8_t *)line, strlen(line));
+    }
+};
+
+#endif // WORKSHOP_DOA_H
@@ -0,0 +1,486 @@
+#ifndef WORKSHOP_ENROL_H
+#define WORKSHOP_ENROL_H
+
+#include "ai-workshop-main.h"
+#include "ai-workshop-melody.h"
+#include "ai-workshop-store.h"
+#include "ai-workshop-trace.h"
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <esp_timer.h>
+
+#define ENROL_MAX_MELODIES 4      // melodies students can add (MELODY_MAX_TEMPLATES is shared with the built in ones)
+#define ENROL_MAX_TAKES 5
+#define ENROL_NAME_SIZE 24        // longest name + 1
+#define ENROL_FILE_MAGIC "MEL1"
+
+struct EnrolConfig
+{
+    uint8_t takes = 3;              // plays of the melody (up to ENROL_MAX_TAKES)
+    uint16_t endSilenceMs = 500;    // a take ends after this much silence
+    uint16_t minTakeMs = 250;       // shorter sounds (a click, a knock) are not a take
+    float maxSpread = 0.15f;        // the takes must be this much alike (DTW cost per step against the template)
+    const char *path = "/enrol/melodies.bin";   // on the flash (LittleFS)
+};
+
+enum class EnrolState : uint8_t
+{
+    Idle,
+    Waiting,     // for the next take to start
+    Playing,     // a take is being heard
+    Building,    // all takes are in, update() makes the template
+    Complete,    // enrolled: the detector recognises the melody from now on
+    Failed,      // see failReason(); start() again
+};
+
+struct EnrolStats
+{
+    uint32_t enrolled = 0;
+    uint32_t failed = 0;
+    uint32_t takes = 0;             // takes heard
+    uint32_t lastEnrolMs = 0;       // start() to Complete, with the playing
+    uint32_t lastBuildUs = 0;       // choosing and checking the template
+    uint32_t lastSaveUs = 0;        // writing it to flash
+    float lastSpread = 0.0f;        // how different the takes were (0 = the same)
+};
+
+// Teaches the melody detector (ai-workshop-melody.h) a new melody on the robot, without
+// Edge Impulse, retraining or flashing. A student plays the melody a few times:
+//
+//   enroller.begin(melodies);             // after melodies.begin(), loads what was enrolled before
+//   enroller.start("my_song");
+//   ... in loop(): enroller.update() until Complete (or Failed)
+//
+// The detector's note frames are the template material: one note (or silence) per 12.8 ms,
+// at most MELODY_MAX_TEMPLATE_FRAMES bytes per melody. A take starts at the first note and
+// ends after endSilenceMs of silence. When all takes are in, the take that is closest to the
+// others (DTW, as the matcher measures it) becomes the template. Takes that do not agree, or a
+// melody that is too close to one the detector knows already, are refused. The template goes
+// to the flash and into the detector's matcher, which recognises it in the stream beside the
+// CNN from then on (MelodyDetector::getMatch()).
+// Call start(), update() and forget() from one task (e.g. loop()).
+class MelodyEnroller
+{
+private:
+    struct Melody
+    {
+        bool used = false;
+        char name[ENROL_NAME_SIZE];   // the detector keeps a pointer to it: slots never move
+        int8_t notes[MELODY_MAX_TEMPLATE_FRAMES];
+        uint16_t length = 0;
+    };
+
+    MelodyDetector *_detector = nullptr;
+    EnrolConfig _config;
+    Melody _melodies[ENROL_MAX_MELODIES];
+    EnrolStats _stats;
+
+    // the melody being enrolled; the frame hook fills _takes[_takeCount], update() reads the ones before
+    char _name[ENROL_NAME_SIZE] = "";
+    int8_t _takes[ENROL_MAX_TAKES][MELODY_MAX_TEMPLATE_FRAMES];
+    uint16_t _takeLengths[ENROL_MAX_TAKES];
+    uint8_t _takeCount = 0;
+    uint16_t _length = 0;           // frames of the take being heard
+    uint16_t _silence = 0;          // silence frames at its end
+    EnrolState _state = EnrolState::Idle;
+    const char *_failReason = "";
+    bool _reportFailure = false;
+    uint32_t _startMs = 0;
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+
+    static void frameHook(const NoteFrame &frame, int64_t timeUs, void *user)
+    {
+        (void)timeUs;
+        static_cast<MelodyEnroller *>(user)->onFrame(frame);
+    }
+
+    static uint16_t msToFrames(uint32_t ms) { return (uint16_t)((ms * (SAMPLE_RATE / 1000) + MELODY_HOP_SIZE - 1) / MELODY_HOP_SIZE); }
+
+    // On the task that feeds the detector: a few instructions per frame, under the lock
+    void onFrame(const NoteFrame &frame)
+    {
+        portENTER_CRITICAL(&_lock);
+        if (_state == EnrolState::Waiting && frame.note != MELODY_SILENCE)
+        {
+            _state = EnrolState::Playing;
+            _length = 0;
+            _silence = 0;
+        }
+        if (_state == EnrolState::Playing)
+        {
+            int8_t *take = _takes[_takeCount];
+            bool tooLong = false;
+            if (_length < MELODY_MAX_TEMPLATE_FRAMES) take[_length++] = frame.note;
+            else tooLong = frame.note != MELODY_SILENCE;
+            _silence = frame.note == MELODY_SILENCE ? _silence + 1 : 0;
+
+            if (tooLong)
+            {
+                fail("the melody is longer than MELODY_MAX_TEMPLATE_FRAMES (about 2 s)");
+            }
+            else if (_silence >= msToFrames(_config.endSilenceMs))
+            {
+                uint16_t length = _length;
+                while (length > 0 && take[length - 1] == MELODY_SILENCE) length--;
+                if (length < msToFrames(_config.minTakeMs))
+                {
+                    _state = EnrolState::Waiting;   // a click, not a take
+                }
+                else
+                {
+                    _takeLengths[_takeCount++] = length;
+                    _stats.takes++;
+                    _state = _takeCount >= _config.takes ? EnrolState::Building : EnrolState::Waiting;
+                }
+            }
+        }
+        portEXIT_CRITICAL(&_lock);
+    }
+
+    // with _lock held
+    void fail(const char *reason)
+    {
+        _failReason = reason;
+        _reportFailure = true;
+        _state = EnrolState::Failed;
+        _stats.failed++;
+    }
+
+    // on the task that calls update()
+    void failNow(const char *reason)
+    {
+        portENTER_CRITICAL(&_lock);
+        fail(reason);
+        _reportFailure = false;
+        portEXIT_CRITICAL(&_lock);
+        Serial.printf("ERR: enrolling '%s' failed: %s\n", _name, reason);
+    }
+
+    Melody *find(const char *name)
+    {
+        for (uint8_t i = 0; i < ENROL_MAX_MELODIES; i++)
+        {
+            if (_melodies[i].used && strcmp(_melodies[i].name, name) == 0) return &_melodies[i];
+        }
+        return nullptr;
+    }
+
+    Melody *freeSlot()
+    {
+        for (uint8_t i = 0; i < ENROL_MAX_MELODIES; i++)
+        {
+            if (!_melodies[i].used) return &_melodies[i];
+        }
+        return nullptr;
+    }
+
+    // All takes are in: the take closest to the others is the template
+    EnrolState build()
+    {
+        AIW_TRACE_SCOPE("enrol build");
+        int64_t start = esp_timer_get_time();
+        const uint8_t count = _takeCount;
+
+        int best = 0;
+        float bestSpread = 1e30f;
+        for (uint8_t t = 0; t < count; t++)
+        {
+            float sum = 0.0f;
+            for (uint8_t o = 0; o < count; o++)
+            {
+                if (o != t) sum += MelodyMatcher::distance(_takes[o], _takeLengths[o], _takes[t], _takeLengths[t]);
+            }
+            float spread = count > 1 ? sum / (count - 1) : 0.0f;
+            if (spread < bestSpread)
+            {
+                bestSpread = spread;
+                best = t;
+            }
+        }
+        _stats.lastSpread = bestSpread;
+        if (bestSpread > _config.maxSpread)
+        {
+            failNow("the takes are not the same melody (play it the same way every time)");
+            return EnrolState::Failed;
+        }
+        const int8_t *notes = _takes[best];
+        const uint16_t length = _takeLengths[best];
+
+        // a melody the detector cannot tell apart from one it knows would give wrong matches
+        MelodyMatcher &matcher = _detector->matcher();
+        float threshold = matcher.threshold();
+        for (uint8_t i = 0; i < matcher.size(); i++)
+        {
+            if (strcmp(matcher.name(i), _name) == 0) continue;   // enrolled again: replaced below
+            float d = MelodyMatcher::distance(notes, length, matcher.notes(i), matcher.length(i));
+            float back = MelodyMatcher::distance(matcher.notes(i), matcher.length(i), notes, length);
+            if (back < d) d = back;
+            if (d <= threshold)
+            {
+                Serial.printf("'%s' sounds like '%s' (cost %.2f)\n", _name, matcher.name(i), d);
+                failNow("too much like a melody the detector knows already");
+                return EnrolState::Failed;
+            }
+        }
+
+        // enrolled again: the new template goes in first, so a failure keeps the old one
+        Melody *slot = find(_name);
+        const bool again = slot != nullptr;
+        if (!again)
+        {
+            slot = freeSlot();
+            if (!slot)
+            {
+                failNow("no room for more melodies (ENROL_MAX_MELODIES), forget() one first");
+                return EnrolState::Failed;
+            }
+            snprintf(slot->name, sizeof(slot->name), "%s", _name);
+        }
+        if (_detector->addTemplate(slot->name, notes, length) < 0)
+        {
+            failNow("the detector has no room for more templates (MELODY_MAX_TEMPLATES)");
+            return EnrolState::Failed;
+        }
+        if (again) _detector->removeTemplate(slot->name);   // the first one with the name: the old template
+        memcpy(slot->notes, notes, length);
+        slot->length = length;
+        slot->used = true;
+        _stats.lastBuildUs = (uint32_t)(esp_timer_get_time() - start);
+
+        int64_t saveStart = esp_timer_get_time();
+        if (!save()) Serial.println("ERR: enrolled melodies not saved, they are gone after a restart");
+        _stats.lastSaveUs = (uint32_t)(esp_timer_get_time() - saveStart);
+        _stats.lastEnrolMs = millis() - _startMs;
+        _stats.enrolled++;
+
+        portENTER_CRITICAL(&_lock);
+        _state = EnrolState::Complete;
+        portEXIT_CRITICAL(&_lock);
+        return EnrolState::Complete;
+    }
+
+    // File: "MEL1", count, then per melody: name length, name, frames (2 bytes), notes; crc16 of it all.
+    // Written next to the old one and renamed, so a power loss keeps the old file.
+    bool save()
+    {
+        char temp[64];
+        snprintf(temp, sizeof(temp), "%s.tmp", _config.path);
+        File file = LittleFS.open(temp, FILE_WRITE);
+        if (!file) return false;
+        uint8_t head[5];
+        memcpy(head, ENROL_FILE_MAGIC, 4);
+        head[4] = (uint8_t)size();
+        uint16_t crc = Store::crc16(head, sizeof(head));
+        bool ok = file.write(head, sizeof(head)) == sizeof(head);
+        for (uint8_t i = 0; i < ENROL_MAX_MELODIES && ok; i++)
+        {
+            const Melody &m = _melodies[i];
+            if (!m.used) continue;
+            uint8_t entry[1 + ENROL_NAME_SIZE + 2];
+            uint8_t nameLength = (uint8_t)strlen(m.name);
+            entry[0] = nameLength;
+            memcpy(entry + 1, m.name, nameLength);
+            memcpy(entry + 1 + nameLength, &m.length, 2);
+            uint32_t entryLength = 3 + nameLength;
+            crc = Store::crc16((const uint8_t *)m.notes, m.length, Store::crc16(entry, entryLength, crc));
+            ok = file.write(entry, entryLength) == entryLength && file.write((const uint8_t *)m.notes, m.length) == m.length;
+        }
+        ok = ok && file.write((const uint8_t *)&crc, 2) == 2;
+        file.close();
+        if (!ok || !LittleFS.rename(temp, _config.path))
+        {
+            LittleFS.remove(temp);
+            return false;
+        }
+        return true;
+    }
+
+    bool load()
+    {
+        File file = LittleFS.open(_config.path, FILE_READ);
+        if (!file) return true;   // nothing enrolled yet
+        uint8_t data[5 + ENROL_MAX_MELODIES * (3 + ENROL_NAME_SIZE + MELODY_MAX_TEMPLATE_FRAMES) + 2];
+        size_t size = file.read(data, sizeof(data));
+        file.close();
+
+        uint16_t crc;
+        if (size < 7 || memcmp(data, ENROL_FILE_MAGIC, 4) != 0 || data[4] > ENROL_MAX_MELODIES) return false;
+        memcpy(&crc, data + size - 2, 2);
+        if (Store::crc16(data, size - 2) != crc) return false;
+
+        size_t at = 5;
+        for (uint8_t i = 0; i < data[4]; i++)
+        {
+            Melody &m = _melodies[i];
+            uint8_t nameLength = data[at];
+            if (nameLength == 0 || nameLength >= ENROL_NAME_SIZE || at + 3 + nameLength > size - 2) return false;
+            memcpy(m.name, data + at + 1, nameLength);
+            m.name[nameLength] = 0;
+            memcpy(&m.length, data + at + 1 + nameLength, 2);
+            at += 3 + nameLength;
+            if (m.length == 0 || m.length > MELODY_MAX_TEMPLATE_FRAMES || at + m.length > size - 2) return false;
+            memcpy(m.notes, data + at, m.length);
+            at += m.length;
+            m.used = true;
+        }
+        return true;
+    }
+
+public:
+    // Constructor
+    MelodyEnroller() {}
+
+    // Call after detector.begin() (and after its built in melodies were added).
+    // Mounts the flash and gives the detector the melodies that were enrolled before.
+    bool begin(MelodyDetector &detector, const EnrolConfig &config = EnrolConfig())
+    {
+        if (config.takes == 0 || config.takes > ENROL_MAX_TAKES)
+        {
+            Serial.println("ERR: EnrolConfig::takes must be 1 .. ENROL_MAX_TAKES");
+            return false;
+        }
+        _detector = &detector;
+        _config = config;
+        _state = EnrolState::Idle;
+        for (uint8_t i = 0; i < ENROL_MAX_MELODIES; i++) _melodies[i].used = false;
+
+        if (!LittleFS.begin(true))
+        {
+            Serial.println("ERR: flash file system not mounted");
+            return false;
+        }
+        char dir[64];
+        snprintf(dir, sizeof(dir), "%s", _config.path);
+        char *slash = strrchr(dir, '/');
+        if (slash && slash != dir)
+        {
+            *slash = 0;
+            LittleFS.mkdir(dir);
+        }
+
+        if (!load())
+        {
+            Serial.println("ERR: enrolled melodies unreadable, starting without them");
+            for (uint8_t i = 0; i < ENROL_MAX_MELODIES; i++) _melodies[i].used = false;
+        }
+        for (uint8_t i = 0; i < ENROL_MAX_MELODIES; i++)
+        {
+            Melody &m = _melodies[i];
+            if (m.used && _detector->addTemplate(m.name, m.notes, m.length) < 0) m.used = false;
+        }
+        _detector->setFrameHook(frameHook, this);
+        return true;
+    }
+
+    // Listen for config.takes plays of the melody. A name that was enrolled before is replaced.
+    bool start(const char *name)
+    {
+        size_t length = name ? strlen(name) : 0;
+        if (!_detector || length == 0 || length >= ENROL_NAME_SIZE)
+        {
+            Serial.println("ERR: enrol needs begin() and a name of 1 .. ENROL_NAME_SIZE - 1 characters");
+            return false;
+        }
+        portENTER_CRITICAL(&_lock);
+        snprintf(_name, sizeof(_name), "%s", name);
+        _takeCount = 0;
+        _reportFailure = false;
+        _state = EnrolState::Waiting;
+        portEXIT_CRITICAL(&_lock);
+        _startMs = millis();
+        return true;
+    }
+
+    void cancel()
+    {
+        portENTER_CRITICAL(&_lock);
+        _state = EnrolState::Idle;
+        portEXIT_CRITICAL(&_lock);
+    }
+
+    // Call often while enrolling (e.g. every loop()): builds the template when all takes are in.
+    EnrolState update()
+    {
+        portENTER_CRITICAL(&_lock);
+        EnrolState state = _state;
+        bool report = _reportFailure;
+        _reportFailure = false;
+        portEXIT_CRITICAL(&_lock);
+        if (report) Serial.printf("ERR: enrolling '%s' failed: %s\n", _name, _failReason);
+        if (state == EnrolState::Building) state = build();
+        return state;
+    }
+
+    EnrolState state()
+    {
+        portENTER_CRITICAL(&_lock);
+        EnrolState state = _state;
+        portEXIT_CRITICAL(&_lock);
+        return state;
+    }
+
+    // Takes heard so far of the melody being enrolled
+    uint8_t takesHeard()
+    {
+        portENTER_CRITICAL(&_lock);
+        uint8_t count = _takeCount;
+        portEXIT_CRITICAL(&_lock);
+        return count;
+    }
+
+    const char *failReason() const { return _failReason; }
+
+    // Remove an enrolled melody from the detector and the flash.
+    bool forget(const char *name)
+    {
+        Melody *m = find(name);
+        if (!m) return false;
+        _detector->removeTemplate(m->name);
+        m->used = false;
+        return save();
+    }
+
+    void forgetAll()
+    {
+        for (uint8_t i = 0; i < ENROL_MAX_MELODIES; i++)
+        {
+            if (_melodies[i].used) _detector->removeTemplate(_melodies[i].name);
+            _melodies[i].used = false;
+        }
+        LittleFS.remove(_config.path);
+    }
+
+    uint8_t size() const
+    {
+        uint8_t count = 0;
+        for (uint8_t i = 0; i < ENROL_MAX_MELODIES; i++) count += _melodies[i].used;
+        return count;
+    }
+
+    // Name of the i'th enrolled melody, nullptr past the end
+    const char *name(uint8_t index) const
+    {
+        for (uint8_t i = 0; i < ENROL_MAX_MELODIES; i++)
+        {
+            if (_melodies[i].used && index-- == 0) return _melodies[i].name;
+        }
+        return nullptr;
+    }
+
+    EnrolStats getStats() const { return _stats; }
+
+    // e.g. "enrol: 2 melodies, 2 enrolled, 1 failed | last 9.4 s (1.3 ms to build, 21 ms to save), spread 0.03 | matcher 38 us per slice of 4000 samples"
+    void printStats(Print &out = Serial, uint32_t sliceSamples = 4000)
+    {
+        const EnrolStats &s = _stats;
+        char line[220];
+        snprintf(line, sizeof(line),
+                 "enrol: %u melodies, %u enrolled, %u failed | last %.1f s (%.1f ms to build, %.0f ms to save), spread %.2f | matcher %.0f us per slice of %u samples\n",
+                 (unsigned)size(), (unsigned)s.enrolled, (unsigned)s.failed, s.lastEnrolMs / 1000.0f, s.lastBuildUs / 1000.0f,
+                 s.lastSaveUs / 1000.0f, s.lastSpread, _detector ? _detector->getMatchUs(sliceSamples) : 0.0f, (unsigned)sliceSamples);
+        out.write((const uint8_t *)line, strlen(line));
+    }
+};
+
+#endif // WORKSHOP_ENROL_H
@@ -0,0 +1,431 @@
+#ifndef WORKSHOP_EVENTS_H
+#define WORKSHOP_EVENTS_H
+
+#include "ai-workshop-trace.h"
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <atomic>
+#include <cstring>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#ifndef EVENTS_MAX_SUBSCRIBERS
+#define EVENTS_MAX_SUBSCRIBERS 4   // handlers and loops listening to the bus
+#endif
+#ifndef EVENTS_QUEUE_SIZE
+#define EVENTS_QUEUE_SIZE 16       // events waiting per subscriber (power of 2), newer ones are dropped
+#endif
+#define EVENT_NAME_SIZE 16
+
+// What happened. The library publishes these itself:
+enum class EventType : uint8_t
+{
+    SliceReady,        // a stream slice is complete; value: samples, timeUs: its last sample
+    DetectionOnset,    // a smoothed classifier score reached the threshold; label, name, score, timeUs: end of the slice
+    DetectionOffset,   // ...and fell below it again
+    ToneStart,         // the speaker plays value Hz (also when it goes from one note to the next)
+    ToneStop,          // the speaker went quiet
+    TakeSaved,         // a take was written to the SD card; name: label, value: file index, detail: TakeVerdict
+    SdError,           // the SD card failed; name: the end of the file name ("mount" when it did not mount)
+    User,              // for sketches: publish your own
+};
+#define EVENT_TYPES 8
+
+// Who published it
+enum class EventSource : uint8_t
+{
+    Mic,          // i2sMic
+    Inference,    // AiWorkshopInference
+    Sound,        // startTone() / stopTone() and AudioOut
+    SdCard,
+    Sketch,
+};
+
+struct Event
+{
+    EventType type = EventType::User;
+    EventSource source = EventSource::Sketch;
+    int8_t label = -1;              // classifier label index, -1 = none
+    uint8_t detail = 0;             // depends on the type
+    uint32_t value = 0;             // depends on the type
+    float score = 0.0f;
+    uint32_t sequence = 0;          // set by publish(): 1, 2, 3, ... over all events
+    int64_t timeUs = 0;             // esp_timer time of what happened, the latency is measured from it
+    char name[EVENT_NAME_SIZE] = "";
+
+    Event() {}
+    Event(EventType type, EventSource source, int64_t timeUs = esp_timer_get_time()) : type(type), source(source), timeUs(timeUs) {}
+
+    // copies the end of text when it is too long (file names differ at the end)
+    void setName(const char *text)
+    {
+        size_t length = text ? strlen(text) : 0;
+        if (length >= sizeof(name))
+        {
+            text += length - (sizeof(name) - 1);
+            length = sizeof(name) - 1;
+        }
+        if (length) memcpy(name, text, length);
+        name[length] = 0;
+    }
+};
+
+static inline uint32_t eventMask(EventType type) { return 1u << (uint8_t)type; }
+#define EVENTS_ALL ((1u << EVENT_TYPES) - 1)
+
+inline const char *eventTypeName(EventType type)
+{
+    switch (type)
+    {
+    case EventType::SliceReady: return "slice_ready";
+    case EventType::DetectionOnset: return "detection_onset";
+    case EventType::DetectionOffset: return "detection_offset";
+    case EventType::ToneStart: return "tone_start";
+    case EventType::ToneStop: return "tone_stop";
+    case EventType::TakeSaved: return "take_saved";
+    case EventType::SdError: return "sd_error";
+    case EventType::User: return "user";
+    }
+    return "?";
+}
+
+// Runs on the subscriber's own task for every event it subscribed to, one after the other.
+typedef void (*EventHandler)(const Event &event, void *user);
+
+// Time from what happened (Event::timeUs) to the subscriber getting the event.
+struct EventLatency
+{
+    uint32_t count = 0;
+    uint32_t maxUs = 0;
+    uint64_t totalUs = 0;
+
+    float averageUs() const { return count ? (float)totalUs / count : 0.0f; }
+};
+
+struct SubscriberConfig
+{
+    const char *name = "events";   // of the task, and in printStats()
+    BaseType_t core = 1;           // 1: the core loop() runs on, 0: the other one (WiFi)
+    UBaseType_t priority = 2;      // loop() has 1
+    uint32_t stackSize = 4096;
+};
+
+// Typed events between the parts of the library, so a sketch reacts to what happens without
+// volatile flags, polling or waiting in loop():
+//
+//   void onEvent(const Event& event, void* user) { ... }   // runs on a task of its own
+//   eventBus().subscribe(eventMask(EventType::DetectionOnset) | eventMask(EventType::ToneStart), onEvent);
+//
+//   int id = eventBus().subscribe(eventMask(EventType::TakeSaved), "loop");   // or read them yourself
+//   Event event;
+//   while (eventBus().next(id, event)) { ... }                               // wait(id, event, ms) sleeps until one comes
+//
+// Every subscriber has its own queue of EVENTS_QUEUE_SIZE: a slow one loses its own events
+// (counted), never anyone else's, and a publisher never waits. The queues are lock free: a
+// publisher claims a cell with one compare-and-swap and marks it full with a release store
+// (a bounded ring with a sequence number per cell), so publish() is safe from any task, on
+// either core, and from an interrupt, and costs one relaxed load when nobody listens.
+// Subscribe from one task (setup()); there are EVENTS_MAX_SUBSCRIBERS places.
+class EventBus
+{
+private:
+    static constexpr uint32_t kMask = EVENTS_QUEUE_SIZE - 1;
+    static_assert((EVENTS_QUEUE_SIZE & kMask) == 0, "EVENTS_QUEUE_SIZE must be a power of 2");
+
+    struct Cell
+    {
+        std::atomic<uint32_t> sequence{ 0 };   // == position: free, position + 1: full
+        Event event;
+    };
+
+    struct Subscriber
+    {
+        Cell cells[EVENTS_QUEUE_SIZE];
+        std::atomic<uint32_t> head{ 0 };       // next position to claim (publishers)
+        uint32_t tail = 0;                     // next position to read (the subscriber only)
+        std::atomic<uint32_t> mask{ 0 };
+        std::atomic<uint32_t> dropped{ 0 };
+        SemaphoreHandle_t ready = nullptr;     // given after every event
+        EventHandler handler = nullptr;
+        void *user = nullptr;
+        EventBus *bus = nullptr;
+        const char *name = "";
+        BaseType_t core = -1;                  // -1: read with next() / wait()
+        portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+        EventLatency latency[EVENT_TYPES];
+    };
+
+    Subscriber _subscribers[EVENTS_MAX_SUBSCRIBERS];
+    std::atomic<uint8_t> _count{ 0 };
+    std::atomic<uint32_t> _mask{ 0 };          // types anybody listens to
+    std::atomic<uint32_t> _sequence{ 0 };
+    std::atomic<uint32_t> _published[EVENT_TYPES];
+    std::atomic<uint32_t> _dropped{ 0 };
+
+    static bool push(Subscriber &s, const Event &event)
+    {
+        uint32_t position = s.head.load(std::memory_order_relaxed);
+        Cell *cell;
+        while (true)
+        {
+            cell = &s.cells[position & kMask];
+            int32_t diff = (int32_t)(cell->sequence.load(std::memory_order_acquire) - position);
+            if (diff == 0)
+            {
+                if (s.head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+            }
+            else if (diff < 0)
+            {
+                return false;   // full: the subscriber did not read the cell a lap ago yet
+            }
+            else
+            {
+                position = s.head.load(std::memory_order_relaxed);   // another publisher was first
+            }
+        }
+        cell->event = event;
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // The next event of a subscriber (on its task), with its latency
+    bool take(Subscriber &s, Event &out)
+    {
+        Cell &cell = s.cells[s.tail & kMask];
+        if (cell.sequence.load(std::memory_order_acquire) != s.tail + 1) return false;
+        out = cell.event;
+        cell.sequence.store(s.tail + EVENTS_QUEUE_SIZE, std::memory_order_release);
+        s.tail++;
+
+        int64_t latency = esp_timer_get_time() - out.timeUs;
+        uint32_t us = latency > 0 ? (uint32_t)latency : 0;   // AudioOut publishes notes ahead of time
+        uint8_t type = (uint8_t)out.type < EVENT_TYPES ? (uint8_t)out.type : (uint8_t)EventType::User;
+        portENTER_CRITICAL(&s.lock);
+        EventLatency &l = s.latency[type];
+        l.count++;
+        l.totalUs += us;
+        if (us > l.maxUs) l.maxUs = us;
+        portEXIT_CRITICAL(&s.lock);
+        return true;
+    }
+
+    static void handlerTask(void *parameter)
+    {
+        Subscriber &s = *static_cast<Subscriber *>(parameter);
+        AIW_TRACE_TASK(s.name);
+        Event event;
+        while (true)
+        {
+            xSemaphoreTake(s.ready, portMAX_DELAY);
+            while (s.bus->take(s, event))
+            {
+                AIW_TRACE_BEGIN("event handler");
+                s.handler(event, s.user);
+                AIW_TRACE_END("event handler");
+            }
+        }
+    }
+
+    int add(uint32_t mask, EventHandler handler, void *user, const char *name, BaseType_t core)
+    {
+        uint8_t index = _count.load(std::memory_order_relaxed);
+        if (index >= EVENTS_MAX_SUBSCRIBERS)
+        {
+            Serial.println("ERR: no room for another subscriber (EVENTS_MAX_SUBSCRIBERS)");
+            return -1;
+        }
+        Subscriber &s = _subscribers[index];
+        if (!s.ready) s.ready = xSemaphoreCreateBinary();
+        if (!s.ready)
+        {
+            Serial.println("ERR: no memory for a subscriber");
+            return -1;
+        }
+        for (uint32_t i = 0; i < EVENTS_QUEUE_SIZE; i++) s.cells[i].sequence.store(i, std::memory_order_relaxed);
+        s.head.store(0, std::memory_order_relaxed);
+        s.tail = 0;
+        s.handler = handler;
+        s.user = user;
+        s.bus = this;
+        s.name = name;
+        s.core = core;
+        s.mask.store(mask & EVENTS_ALL, std::memory_order_relaxed);
+        // release: publishers that see the new count see a ready subscriber
+        _count.store(index + 1, std::memory_order_release);
+        _mask.fetch_or(mask & EVENTS_ALL, std::memory_order_relaxed);
+        return index;
+    }
+
+public:
+    // Constructor
+    EventBus()
+    {
+        for (uint8_t t = 0; t < EVENT_TYPES; t++) _published[t].store(0, std::memory_order_relaxed);
+    }
+
+    // handler runs on a task of its own on config.core for every event in mask (eventMask(...) | ...).
+    // Returns the subscriber id, or -1.
+    int subscribe(uint32_t mask, EventHandler handler, void *user = nullptr, const SubscriberConfig &config = SubscriberConfig())
+    {
+        if (!handler) return -1;
+        int id = add(0, handler, user, config.name, config.core);
+        if (id < 0) return -1;
+        Subscriber &s = _subscribers[id];
+        if (xTaskCreatePinnedToCore(handlerTask, config.name, config.stackSize, &s, config.priority, nullptr, config.core) != pdPASS)
+        {
+            Serial.println("ERR: subscriber task not started");
+            return -1;
+        }
+        setMask(id, mask);
+        return id;
+    }
+
+    // A subscriber without a task: read its events with next() or wait() (e.g. in loop()).
+    int subscribe(uint32_t mask, const char *name = "loop")
+    {
+        return add(mask, nullptr, nullptr, name, -1);
+    }
+
+    // Change what a subscriber gets; 0 stops it (the place stays taken)
+    void setMask(int id, uint32_t mask)
+    {
+        if (id < 0 || id >= (int)_count.load(std::memory_order_acquire)) return;
+        _subscribers[id].mask.store(mask & EVENTS_ALL, std::memory_order_relaxed);
+        uint32_t all = 0;
+        for (uint8_t i = 0; i < _count.load(std::memory_order_acquire); i++) all |= _subscribers[i].mask.load(std::memory_order_relaxed);
+        _mask.store(all, std::memory_order_relaxed);
+    }
+
+    void unsubscribe(int id) { setMask(id, 0); }
+
+    // Somebody listens to this type: worth filling in an Event
+    bool wants(EventType type) const { return (_mask.load(std::memory_order_relaxed) & eventMask(type)) != 0; }
+
+    // From any task or interrupt. Sets event.sequence; returns true when a subscriber got it.
+    bool publish(Event event)
+    {
+        const uint32_t bit = eventMask(event.type);
+        if ((_mask.load(std::memory_order_relaxed) & bit) == 0) return false;
+        const bool isr = xPortInIsrContext();
+        event.sequence = _sequence.fetch_add(1, std::memory_order_relaxed) + 1;
+        _published[(uint8_t)event.type].fetch_add(1, std::memory_order_relaxed);
+
+        bool delivered = false;
+        BaseType_t woken = pdFALSE;
+        const uint8_t count = _count.load(std::memory_order_acquire);
+        for (uint8_t i = 0; i < count; i++)
+        {
+            Subscriber &s = _subscribers[i];
+            if ((s.mask.load(std::memory_order_relaxed) & bit) == 0) continue;
+            if (!push(s, event))
+            {
+                s.dropped.fetch_add(1, std::memory_order_relaxed);
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            delivered = true;
+            if (isr) xSemaphoreGiveFromISR(s.ready, &woken);
+            else xSemaphoreGive(s.ready);
+        }
+        if (isr && woken) portYIELD_FROM_ISR();
+        return delivered;
+    }
+
+    // The next event of a subscriber without a handler, false when there is none
+    bool next(int id, Event &out)
+    {
+        if (id < 0 || id >= (int)_count.load(std::memory_order_acquire) || _subscribers[id].handler) return false;
+        return take(_subscribers[id], out);
+    }
+
+    // As next(), but sleeps until an event comes or timeoutMs passed
+    bool wait(int id, Event &out, uint32_t timeoutMs = portMAX_DELAY)
+    {
+        if (id < 0 || id >= (int)_count.load(std::memory_order_acquire) || _subscribers[id].handler) return false;
+        Subscriber &s = _subscribers[id];
+        uint32_t start = millis();
+        while (!take(s, out))
+        {
+            uint32_t waited = millis() - start;
+            if (timeoutMs != portMAX_DELAY && waited >= timeoutMs) return false;
+            TickType_t ticks = timeoutMs == portMAX_DELAY ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs - waited);
+            if (xSemaphoreTake(s.ready, ticks) != pdTRUE) return false;
+        }
+        return true;
+    }
+
+    uint8_t size() const { return _count.load(std::memory_order_acquire); }
+    uint32_t getPublished(EventType type) const { return _published[(uint8_t)type].load(std::memory_order_relaxed); }
+    uint32_t getDropped() const { return _dropped.load(std::memory_order_relaxed); }
+    uint32_t getDropped(int id) const { return id >= 0 && id < (int)size() ? _subscribers[id].dropped.load(std::memory_order_relaxed) : 0; }
+
+    EventLatency getLatency(int id, EventType type)
+    {
+        EventLatency l;
+        if (id < 0 || id >= (int)size() || (uint8_t)type >= EVENT_TYPES) return l;
+        Subscriber &s = _subscribers[id];
+        portENTER_CRITICAL(&s.lock);
+        l = s.latency[(uint8_t)type];
+        portEXIT_CRITICAL(&s.lock);
+        return l;
+    }
+
+    void resetStats()
+    {
+        for (uint8_t t = 0; t < EVENT_TYPES; t++) _published[t].store(0, std::memory_order_relaxed);
+        _dropped.store(0, std::memory_order_relaxed);
+        for (uint8_t i = 0; i < size(); i++)
+        {
+            Subscriber &s = _subscribers[i];
+            s.dropped.store(0, std::memory_order_relaxed);
+            portENTER_CRITICAL(&s.lock);
+            for (uint8_t t = 0; t < EVENT_TYPES; t++) s.latency[t] = EventLatency();
+            portEXIT_CRITICAL(&s.lock);
+        }
+    }
+
+    // e.g.
+    // events: 1207 published, 0 dropped
+    //   leds (core 1):
+    //     slice_ready 402 in 61 us (max 380)
+    //     detection_onset 3 in 1840 us (max 2210)
+    void printStats(Print &out = Serial)
+    {
+        char line[96];
+        uint32_t published = 0;
+        for (uint8_t t = 0; t < EVENT_TYPES; t++) published += getPublished((EventType)t);
+        int n = snprintf(line, sizeof(line), "events: %u published, %u dropped\n", (unsigned)published, (unsigned)getDropped());
+        out.write((const uint8_t *)line, n);
+
+        for (uint8_t i = 0; i < size(); i++)
+        {
+            const Subscriber &s = _subscribers[i];
+            if (s.mask.load(std::memory_order_relaxed) == 0) continue;   // unsubscribed
+            uint32_t dropped = getDropped(i);
+            char extra[24] = "";
+            if (dropped) snprintf(extra, sizeof(extra), ", %u dropped", (unsigned)dropped);
+            n = s.core >= 0 ? snprintf(line, sizeof(line), "  %s (core %d)%s:\n", s.name, (int)s.core, extra)
+                            : snprintf(line, sizeof(line), "  %s (polled)%s:\n", s.name, extra);
+            out.write((const uint8_t *)line, n);
+            for (uint8_t t = 0; t < EVENT_TYPES; t++)
+            {
+                EventLatency l = getLatency(i, (EventType)t);
+                if (l.count == 0) continue;
+                n = snprintf(line, sizeof(line), "    %s %u in %.0f us (max %u)\n", eventTypeName((EventType)t),
+                             (unsigned)l.count, l.averageUs(), (unsigned)l.maxUs);
+                out.write((const uint8_t *)line, n);
+            }
+        }
+    }
+};
+
+// One bus for the whole program (inline: the same object in every file). It lives at namespace
+// scope so it is built before setup(): a function-local static would be built by the first
+// eventBus() call, which can be publish() from the I2S receive interrupt.
+inline EventBus workshopEventBus;
+
+inline EventBus &eventBus() { return workshopEventBus; }
+
+#endif // WORKSHOP_EVENTS_H
@@ -0,0 +1,165 @@
+#ifndef WORKSHOP_FFT_H
+#define WORKSHOP_FFT_H
+
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <math.h>
+
+// Complex float FFT (radix-2, in place) for power of two sizes.
+// Data is interleaved: re0, im0, re1, im1, ... (the same layout as ESP-DSP's dsps_fft2r_fc32).
+// The twiddle factors and bit reversal table are computed once in begin().
+class FFT
+{
+private:
+    uint32_t _size = 0;
+    uint8_t _bits = 0;
+    float *_twiddle = nullptr;     // cos, sin pairs for k = 0 .. size/2
+    uint16_t *_reverse = nullptr;  // bit reversed index of every position
+
+    void release()
+    {
+        if (_twiddle) { heap_caps_free(_twiddle); _twiddle = nullptr; }
+        if (_reverse) { heap_caps_free(_reverse); _reverse = nullptr; }
+        _size = 0;
+        _bits = 0;
+    }
+
+    void transform(float *data, float sign)
+    {
+        // reorder
+        for (uint32_t i = 0; i < _size; i++)
+        {
+            uint32_t j = _reverse[i];
+            if (j > i)
+            {
+                float re = data[2 * i], im = data[2 * i + 1];
+                data[2 * i] = data[2 * j];
+                data[2 * i + 1] = data[2 * j + 1];
+                data[2 * j] = re;
+                data[2 * j + 1] = im;
+            }
+        }
+
+        // butterflies
+        for (uint32_t half = 1, step = _size / 2; half < _size; half *= 2, step /= 2)
+        {
+            for (uint32_t start = 0; start < _size; start += 2 * half)
+            {
+                for (uint32_t k = 0; k < half; k++)
+                {
+                    float wr = _twiddle[2 * k * step];
+                    float wi = sign * _twiddle[2 * k * step + 1];
+
+                    float *a = &data[2 * (start + k)];
+                    float *b = &data[2 * (start + k + half)];
+                    float tr = wr * b[0] - wi * b[1];
+                    float ti = wr * b[1] + wi * b[0];
+                    b[0] = a[0] - tr;
+                    b[1] = a[1] - ti;
+                    a[0] += tr;
+                    a[1] += ti;
+                }
+            }
+        }
+    }
+
+public:
+    // Constructor
+    FFT() {}
+    ~FFT() { release(); }
+
+    FFT(const FFT &) = delete;
+    FFT &operator=(const FFT &) = delete;
+
+    // size: 2 .. 32768, a power of two
+    bool begin(uint32_t size)
+    {
+        if (size < 2 || size > 32768 || (size & (size - 1)) != 0) return false;
+        if (size == _size) return true;
+        release();
+
+        _twiddle = (float *)heap_caps_malloc(size * sizeof(float), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        _reverse = (uint16_t *)heap_caps_malloc(size * sizeof(uint16_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (!_twiddle || !_reverse)
+        {
+            Serial.println("ERR: FFT alloc failed");
+            release();
+            return false;
+        }
+
+        _size = size;
+        while ((1UL << _bits) < size) _bits++;
+
+        // e^(-2 pi i k / size), the sign of the sine is flipped for the inverse
+        for (uint32_t k = 0; k < size / 2; k++)
+        {
+            double angle = 2.0 * M_PI * k / size;
+            _twiddle[2 * k] = (float)cos(angle);
+            _twiddle[2 * k + 1] = (float)-sin(angle);
+        }
+
+        for (uint32_t i = 0; i < size; i++)
+        {
+            uint32_t r = 0;
+            for (uint8_t b = 0; b < _bits; b++)
+            {
+                if (i & (1UL << b)) r |= 1UL << (_bits - 1 - b);
+            }
+            _reverse[i] = (uint16_t)r;
+        }
+        return true;
+    }
+
+    uint32_t size() const { return _size; }
+
+    void forward(float *data) { transform(data, 1.0f); }
+
+    // Inverse transform, scaled by 1/size so inverse(forward(x)) == x.
+    void inverse(float *data)
+    {
+        transform(data, -1.0f);
+        const float scale = 1.0f / _size;
+        for (uint32_t i = 0; i < 2 * _size; i++) data[i] *= scale;
+    }
+
+    // Two real signals in one complex FFT: data holds x + i*y (x in the real parts, y in the imaginary parts).
+    // Afterwards X and Y (size/2 + 1 complex bins each, interleaved) hold the spectra of x and y.
+    void forwardRealPair(float *data, float *X, float *Y)
+    {
+        forward(data);
+
+        const uint32_t n = _size;
+        for (uint32_t k = 0; k <= n / 2; k++)
+        {
+            uint32_t m = (n - k) & (n - 1);
+            float zr = data[2 * k], zi = data[2 * k + 1];
+            float cr = data[2 * m], ci = -data[2 * m + 1];   // conj(Z[n - k])
+
+            // X = (Z[k] + conj(Z[n-k])) / 2,  Y = (Z[k] - conj(Z[n-k])) / 2i
+            X[2 * k] = 0.5f * (zr + cr);
+            X[2 * k + 1] = 0.5f * (zi + ci);
+            Y[2 * k] = 0.5f * (zi - ci);
+            Y[2 * k + 1] = -0.5f * (zr - cr);
+        }
+    }
+
+    // Squared magnitude of bins 0 .. size/2 (real input), e.g. for a spectrum display.
+    void power(const float *data, float *out, uint32_t bins) const
+    {
+        for (uint32_t k = 0; k < bins; k++)
+        {
+            out[k] = data[2 * k] * data[2 * k] + data[2 * k + 1] * data[2 * k + 1];
+        }
+    }
+
+    // Hann window of length n, written to out (compute once, multiply per frame).
+    static void hannWindow(float *out, uint32_t n)
+    {
+        for (uint32_t i = 0; i < n; i++)
+        {
+            out[i] = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / (n - 1));
+        }
+    }
+};
+
+#endif // WORKSHOP_FFT_H
@@ -2,10 +2,16 @@
 #define WORKSHOP_INFERENCE_H
 
 #include "ai-workshop-main.h"
+#include "ai-workshop-scores.h"
+#include "ai-workshop-results.h"
+#include "ai-workshop-trace.h"
+#include "ai-workshop-capture.h"
+#include "ai-workshop-events.h"
 
 #include <Arduino.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "driver/i2s.h"
 
 // This helper expects the Edge Impulse model header to be included BEFORE it.
@@ -13,6 +19,15 @@
 #ifndef EI_CLASSIFIER_FREQUENCY
 #error "Include your Edge Impulse *_inferencing.h before ai-workshop-inference.h"
 #endif
+static_assert(EI_CLASSIFIER_LABEL_COUNT <= SCORES_MAX_LABELS, "the model has more labels than SCORES_MAX_LABELS");
+static_assert(EI_CLASSIFIER_LABEL_COUNT <= RESULTS_MAX_LABELS, "the model has more labels than RESULTS_MAX_LABELS");
+
+// What to do when a new slice is complete but the classifier did not take the previous one yet.
+enum class BackPressure : uint8_t {
+    DropOldest,     // replace the waiting slice with the new one (lowest latency, default)
+    DropNewest,     // keep the waiting slice, throw the new one away
+    BlockProducer,  // let the capture task wait for the classifier (bounded), then drop the oldest
+};
 
 class AiWorkshopInference {
 public:
@@ -22,16 +37,35 @@ public:
         float score = 0.0f;
     };
 
+    struct Stats {
+        uint32_t slices = 0;          // slices captured
+        uint32_t classified = 0;      // slices that produced a result
+        uint32_t droppedOldest = 0;
+        uint32_t droppedNewest = 0;
+        uint32_t blocked = 0;         // BlockProducer: times the capture task waited and got through
+        uint32_t blockTimeouts = 0;   // BlockProducer: waits that ran out (counted as dropped oldest too)
+        uint32_t resyncs = 0;         // classifier restarts after a gap in the audio
+        uint32_t warmupSlices = 0;    // slices classified while refilling the window after a resync
+        uint64_t lostSamples = 0;
+
+        float lostMs() const { return lostSamples * 1000.0f / EI_CLASSIFIER_FREQUENCY; }
+    };
+
     bool begin(int bckPin, int wsPin, int sdPin, i2s_port_t port = I2S_NUM_1, float smoothing = 0.5f) {
         _port = port;
-        _smoothing = smoothing;
-
-        for (size_t i = 0; i < EI_CLASSIFIER_LABEL_COUNT; i++) _ema[i] = 0.0f;
+        _scores.setSmoothing(smoothing);
+        _scores.reset();
 
         if (!allocBuffers(EI_CLASSIFIER_SLICE_SIZE)) {
             return false;
         }
 
+        if (!_sliceReady) _sliceReady = xSemaphoreCreateBinary();
+        if (!_sliceTaken) _sliceTaken = xSemaphoreCreateBinary();
+        if (!_sliceReady || !_sliceTaken) {
+            return false;
+        }
+
         if (i2sInit(EI_CLASSIFIER_FREQUENCY, bckPin, wsPin, sdPin) != ESP_OK) {
             return false;
         }
@@ -43,8 +77,54 @@ public:
         return true;
     }
 
+    // DMA buffers and read size of the capture (ai-workshop-capture.h), before begin().
+    // Reads are at most kI2SReadSamples. The BlockProducer wait is limited again to fit.
+    bool setCapture(const CaptureConfig& capture) {
+        if (_recording || !capture.valid(1)) {
+            Serial.println("ERR: capture config not accepted (invalid, or already running)");
+            return false;
+        }
+        _capture = capture;
+        if (_capture.readFrames > kI2SReadSamples) _capture.readFrames = kI2SReadSamples;
+        setBackPressure(_policy, _maxBlockRequestMs);
+        return true;
+    }
+
+    bool setCapture(CaptureProfile profile) { return setCapture(CaptureConfig::forProfile(profile)); }
+
+    const CaptureConfig& getCapture() const { return _capture; }
+
+    // Choose what happens when the classifier falls behind (see BackPressure).
+    // maxBlockMs bounds the wait of BlockProducer, it is kept below the DMA buffer time
+    // so the I2S driver itself never has to drop audio.
+    void setBackPressure(BackPressure policy, uint32_t maxBlockMs = 40) {
+        const uint32_t dmaMs = (uint32_t)(_capture.dmaBufCount * _capture.dmaBufLen * 1000ULL / EI_CLASSIFIER_FREQUENCY);
+        const uint32_t readMs = (uint32_t)(_capture.readFrames * 1000ULL / EI_CLASSIFIER_FREQUENCY);
+        const uint32_t limit = dmaMs > readMs ? dmaMs - readMs : 0;
+        _policy = policy;
+        _maxBlockRequestMs = maxBlockMs;
+        _maxBlockMs = maxBlockMs < limit ? maxBlockMs : limit;
+    }
+
+    BackPressure backPressure() const { return _policy; }
+
+    // Smoothed score a label needs for a DetectionOnset event (ai-workshop-events.h);
+    // DetectionOffset follows when it falls below again.
+    void setDetectionThreshold(float threshold) { _detectThreshold = threshold; }
+
+    Stats stats() {
+        portENTER_CRITICAL(&_lock);
+        Stats s = _stats;
+        portEXIT_CRITICAL(&_lock);
+        return s;
+    }
+
+    // True while the classifier refills its window after audio was dropped.
+    bool isResyncing() const { return _warmup > 0; }
+
     // Blocking: waits for next slice, then runs EI continuous classifier.
-    // Returns true when classification ran successfully.
+    // Returns true when classification ran successfully. Returns false when no slice
+    // came in time, on classifier errors and while resyncing after dropped audio.
     bool tick(ei_impulse_result_t& outResult, bool debug = false) {
         if (!_recording) return false;
 
@@ -52,57 +132,122 @@ public:
             return false;
         }
 
+        // Audio went missing since the last slice: the classifier's window now has a hole in it.
+        // Restart the continuous classifier and refill the window before reporting again.
+        if (_gap) {
+            _gap = false;
+            run_classifier_init();
+            _scores.reset();
+            _top = Top{};
+            _warmup = EI_CLASSIFIER_SLICES_PER_MODEL_WINDOW;
+            portENTER_CRITICAL(&_lock);
+            _stats.resyncs++;
+            portEXIT_CRITICAL(&_lock);
+        }
+
         signal_t signal;
         signal.total_length = EI_CLASSIFIER_SLICE_SIZE;
+#if EIDSP_SIGNAL_C_FN_POINTER
         signal.get_data = &signalGetDataTrampoline;
+#else
+        // get_data is a std::function: bind this object, so more than one instance can run
+        signal.get_data = [this](size_t offset, size_t length, float* out_ptr) {
+            return signalGetData(offset, length, out_ptr);
+        };
+#endif
 
+        AIW_TRACE_BEGIN("classify");
+        uint32_t startUs = micros();
         EI_IMPULSE_ERROR r = run_classifier_continuous(&signal, &outResult, debug);
+        uint32_t classifyUs = micros() - startUs;
+        AIW_TRACE_END("classify");
         if (r != EI_IMPULSE_OK) {
             return false;
         }
 
-        // EMA smoothing for workshop stability
+        if (_warmup > 0) {
+            _warmup--;
+            portENTER_CRITICAL(&_lock);
+            _stats.warmupSlices++;
+            portEXIT_CRITICAL(&_lock);
+            return false;
+        }
+
+        portENTER_CRITICAL(&_lock);
+        _stats.classified++;
+        portEXIT_CRITICAL(&_lock);
+
+        // EMA smoothing for workshop stability (the same in tools/host/model_eval.cpp)
+        _scores.update(outResult, EI_CLASSIFIER_LABEL_COUNT);
         _top = Top{};
-        for (size_t ix = 0; ix < EI_CLASSIFIER_LABEL_COUNT; ix++) {
-            _ema[ix] = _smoothing * _ema[ix] + (1.0f - _smoothing) * outResult.classification[ix].value;
-            if (_ema[ix] > _top.score) {
-                _top.score = _ema[ix];
-                _top.index = (int)ix;
-                _top.label = outResult.classification[ix].label;
-            }
+        if (_scores.topIndex() >= 0) {
+            _top.index = _scores.topIndex();
+            _top.score = _scores.topScore();
+            _top.label = outResult.classification[_top.index].label;
         }
 
+        // share the smoothed scores with the other tasks (LEDs, sound, telemetry)
+        float smoothed[EI_CLASSIFIER_LABEL_COUNT];
+        for (size_t ix = 0; ix < EI_CLASSIFIER_LABEL_COUNT; ix++) smoothed[ix] = _scores.score(ix);
+        _results.publishScores(smoothed, EI_CLASSIFIER_LABEL_COUNT, _top.index, classifyUs);
+        publishDetection(outResult);
+
         return true;
     }
 
     Top top() const { return _top; }
 
+    // The last results (smoothed scores), for tasks other than the one calling tick().
+    // See ai-workshop-results.h: latest(), next(), since() and series().
+    ResultChannel& results() { return _results; }
+
     void end() {
         _recording = false;
         i2s_driver_uninstall(_port);
-        if (_buf0) { free(_buf0); _buf0 = nullptr; }
-        if (_buf1) { free(_buf1); _buf1 = nullptr; }
+        for (int i = 0; i < kNumBuffers; i++) {
+            if (_buf[i]) { free(_buf[i]); _buf[i] = nullptr; }
+        }
     }
 
 private:
     // --- Buffering ---
-    int16_t* _buf0 = nullptr;
-    int16_t* _buf1 = nullptr;
-    volatile uint8_t _bufSelect = 0;
-    volatile uint32_t _bufCount = 0;
-    volatile uint8_t _bufReady = 0;
+    // Three slices: the capture task fills _write, a complete slice waits in _ready
+    // and the classifier reads _read. So a new slice never overwrites the one being classified.
+    static constexpr int kNumBuffers = 3;
+    int16_t* _buf[kNumBuffers] = { nullptr, nullptr, nullptr };
+    int8_t _write = 0;
+    int8_t _ready = -1;
+    int8_t _read = -1;
+    uint32_t _bufCount = 0;
     uint32_t _nSamples = 0;
 
+    // --- Back pressure ---
+    BackPressure _policy = BackPressure::DropOldest;
+    uint32_t _maxBlockMs = 40;
+    uint32_t _maxBlockRequestMs = 40;
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+    SemaphoreHandle_t _sliceReady = nullptr;   // given by the capture task
+    SemaphoreHandle_t _sliceTaken = nullptr;   // given by the classifier (wakes a blocked producer)
+    volatile bool _gap = false;
+    uint8_t _warmup = 0;
+    Stats _stats;
+    int64_t _sliceUs[kNumBuffers] = { 0, 0, 0 };   // when the slice in each buffer was complete
+
+    // --- Detection events ---
+    float _detectThreshold = 0.6f;
+    int _detected = -1;   // label of the last DetectionOnset, -1 after its DetectionOffset
+
     // --- Runtime state ---
     i2s_port_t _port = I2S_NUM_1;
     volatile bool _recording = false;
 
-    float _smoothing = 0.5f;
-    float _ema[EI_CLASSIFIER_LABEL_COUNT];
+    ScoreSmoother _scores;
     Top _top;
+    ResultChannel _results;
 
     // small DMA read buffer (32-bit I2S samples)
     static constexpr uint32_t kI2SReadSamples = 1024;
+    CaptureConfig _capture = CaptureConfig(8, 256, kI2SReadSamples);
     int32_t _i2sRaw[kI2SReadSamples];
 
 private:
@@ -114,50 +259,151 @@ private:
 
     bool allocBuffers(uint32_t nSamples) {
         _nSamples = nSamples;
-        _buf0 = (int16_t*)malloc(_nSamples * sizeof(int16_t));
-        _buf1 = (int16_t*)malloc(_nSamples * sizeof(int16_t));
-        if (!_buf0 || !_buf1) return false;
+        for (int i = 0; i < kNumBuffers; i++) {
+            if (!_buf[i]) _buf[i] = (int16_t*)malloc(_nSamples * sizeof(int16_t));
+            if (!_buf[i]) return false;
+        }
 
-        _bufSelect = 0;
+        _write = 0;
+        _ready = -1;
+        _read = -1;
         _bufCount = 0;
-        _bufReady = 0;
+        _gap = false;
+        _warmup = 0;
+        _stats = Stats{};
         return true;
     }
 
+    // Takes the waiting slice (or waits up to two slice lengths for one).
     bool waitForSlice() {
-        // If the consumer falls behind, EI example flags overrun.
-        // For workshop: fail fast so user sees it.
-        if (_bufReady == 1) {
-            return false;
+        const TickType_t timeout = pdMS_TO_TICKS(2 * 1000ULL * _nSamples / EI_CLASSIFIER_FREQUENCY + 10);
+
+        while (true) {
+            portENTER_CRITICAL(&_lock);
+            if (_ready >= 0) {
+                _read = _ready;
+                _ready = -1;
+                portEXIT_CRITICAL(&_lock);
+                xSemaphoreGive(_sliceTaken);
+                return true;
+            }
+            // nothing waiting: the previous slice is done, hand it back
+            _read = -1;
+            portEXIT_CRITICAL(&_lock);
+
+            if (xSemaphoreTake(_sliceReady, timeout) != pdTRUE) {
+                return false;
+            }
         }
-        while (_bufReady == 0) delay(1);
-        _bufReady = 0;
-        return true;
+    }
+
+    // the buffer that is neither waiting nor being classified
+    int8_t freeBuffer() const {
+        for (int8_t i = 0; i < kNumBuffers; i++) {
+            if (i != _ready && i != _read) return i;
+        }
+        return -1;
+    }
+
+    // Called by the capture task when _write holds a complete slice.
+    void publishSlice() {
+        const int64_t nowUs = esp_timer_get_time();
+        // clear an old signal before looking at _ready: a slice taken after this point
+        // gives the semaphore again, so the wait below cannot miss it
+        if (_policy == BackPressure::BlockProducer) xSemaphoreTake(_sliceTaken, 0);
+
+        portENTER_CRITICAL(&_lock);
+        _stats.slices++;
+        _sliceUs[_write] = nowUs;
+
+        if (_ready >= 0 && _policy == BackPressure::BlockProducer) {
+            portEXIT_CRITICAL(&_lock);
+
+            // wait for the classifier to take the waiting slice
+            xSemaphoreTake(_sliceTaken, pdMS_TO_TICKS(_maxBlockMs));
+
+            portENTER_CRITICAL(&_lock);
+            if (_ready < 0) {
+                _stats.blocked++;
+            } else {
+                _stats.blockTimeouts++;
+            }
+        }
+
+        if (_ready < 0) {
+            _ready = _write;
+            _write = freeBuffer();
+        } else if (_policy == BackPressure::DropNewest) {
+            // keep filling the same buffer, the new slice is lost
+            _stats.droppedNewest++;
+            _stats.lostSamples += _nSamples;
+            _gap = true;
+        } else {
+            // DropOldest (and BlockProducer after a timeout): swap the waiting slice for the new one
+            int8_t old = _ready;
+            _ready = _write;
+            _write = old;
+            _stats.droppedOldest++;
+            _stats.lostSamples += _nSamples;
+            _gap = true;
+        }
+        portEXIT_CRITICAL(&_lock);
+
+        xSemaphoreGive(_sliceReady);
+
+        if (eventBus().wants(EventType::SliceReady)) {
+            Event event(EventType::SliceReady, EventSource::Inference, nowUs);
+            event.value = _nSamples;
+            eventBus().publish(event);
+        }
+    }
+
+    // Onset and offset of the top label, timed from the end of the slice it was heard in
+    // (so a subscriber's latency includes the classifier)
+    void publishDetection(const ei_impulse_result_t& result) {
+        const int64_t sliceUs = _sliceUs[_read];
+        if (_detected >= 0 && _scores.score(_detected) < _detectThreshold) {
+            publishDetectionEvent(EventType::DetectionOffset, _detected, result, sliceUs);
+            _detected = -1;
+        }
+        if (_detected < 0 && _top.index >= 0 && _top.score >= _detectThreshold) {
+            _detected = _top.index;
+            publishDetectionEvent(EventType::DetectionOnset, _detected, result, sliceUs);
+        }
+    }
+
+    void publishDetectionEvent(EventType type, int label, const ei_impulse_result_t& result, int64_t sliceUs) {
+        if (!eventBus().wants(type)) return;
+        Event event(type, EventSource::Inference, sliceUs);
+        event.label = (int8_t)label;
+        event.score = _scores.score(label);
+        event.setName(result.classification[label].label);
+        eventBus().publish(event);
     }
 
     void onSamples(uint32_t numSamples) {
-        int16_t* active = (_bufSelect == 0) ? _buf0 : _buf1;
+        int16_t* active = _buf[_write];
         for (uint32_t i = 0; i < numSamples; i++) {
             // ESP32 I2S mic samples are 32-bit; your original code scaled by /4096
             active[_bufCount++] = clip32to16(_i2sRaw[i] / 4096);
 
             if (_bufCount >= _nSamples) {
-                _bufSelect ^= 1;
                 _bufCount = 0;
-                _bufReady = 1;
-                active = (_bufSelect == 0) ? _buf0 : _buf1;
+                publishSlice();
+                active = _buf[_write];
             }
         }
     }
 
-    // EI signal getter reads from the *previous* completed buffer
+    // EI signal getter reads from the slice the classifier took in waitForSlice().
+    // The trampoline is only needed when EI is built with plain function pointers (one instance).
     static int signalGetDataTrampoline(size_t offset, size_t length, float* out_ptr) {
         return instance()->signalGetData(offset, length, out_ptr);
     }
 
     int signalGetData(size_t offset, size_t length, float* out_ptr) {
-        int16_t* ready = (_bufSelect == 0) ? _buf1 : _buf0;
-        numpy::int16_to_float(&ready[offset], out_ptr, length);
+        if (_read < 0) return -1;
+        numpy::int16_to_float(&_buf[_read][offset], out_ptr, length);
         return 0;
     }
 
@@ -170,14 +416,16 @@ private:
     static void captureTaskTrampoline(void* arg) {
         AiWorkshopInference* self = (AiWorkshopInference*)arg;
         instance() = self;
+        AIW_TRACE_TASK("InferenceCapture");
         self->captureTask();
+        AIW_TRACE_TASK_END();
         vTaskDelete(nullptr);
     }
 
     void captureTask() {
         while (_recording) {
             size_t bytesRead = 0;
-            i2s_read(_port, (void*)_i2sRaw, kI2SReadSamples * sizeof(int32_t), &bytesRead, portMAX_DELAY);
+            i2s_read(_port, (void*)_i2sRaw, _capture.readFrames * sizeof(int32_t), &bytesRead, portMAX_DELAY);
             if (bytesRead == 0) continue;
 
             uint32_t samplesRead = (uint32_t)(bytesRead / sizeof(int32_t));
@@ -193,8 +441,8 @@ private:
             .channel_format = I2S_CHANNEL_FMT_ONLY_LEFT,
             .communication_format = I2S_COMM_FORMAT_I2S,
             .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
-            .dma_buf_count = 8,
-            .dma_buf_len = 256,
+            .dma_buf_count = _capture.dmaBufCount,
+            .dma_buf_len = _capture.dmaBufLen,
             .use_apll = false,
             .tx_desc_auto_clear = false,
             .fixed_mclk = 0,
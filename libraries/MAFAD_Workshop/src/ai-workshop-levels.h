@@ -0,0 +1,165 @@
+#ifndef WORKSHOP_LEVELS_H
+#define WORKSHOP_LEVELS_H
+
+// Levels of a take (loudness, peak, clipping, DC offset), measured while it is recorded,
+// and a check that finds bad takes before they go to the SD card. Plain C++, no Arduino
+// needed, so the host tools can use it too.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+
+#define LEVELS_CLIP_LEVEL 32767   // a 16 bit sample at (or past) full scale is clipped
+#define LEVELS_FULL_SCALE 32768.0f
+
+enum class TakeVerdict : uint8_t
+{
+    Good,
+    Silent,      // no signal at all: microphone not connected or broken
+    TooQuiet,    // the loudest sound is far below full scale: nothing was played, or too far away
+    Clipped,     // too loud: samples cut off at full scale
+    DcOffset,    // the signal is not around zero: a microphone problem
+    Mislabelled, // the classifier heard something else than the label (TakeCheck)
+};
+
+static inline const char* takeVerdictName(TakeVerdict verdict)
+{
+    switch (verdict) {
+        case TakeVerdict::Good: return "good";
+        case TakeVerdict::Silent: return "silent";
+        case TakeVerdict::TooQuiet: return "too quiet";
+        case TakeVerdict::Clipped: return "clipped";
+        case TakeVerdict::DcOffset: return "dc offset";
+        case TakeVerdict::Mislabelled: return "mislabelled";
+    }
+    return "?";
+}
+
+struct TakeStats
+{
+    uint32_t samples = 0;
+    float rms = 0.0f;          // without the DC offset (16 bit units)
+    int32_t peak = 0;          // largest distance from zero (16 bit units)
+    uint32_t clipped = 0;      // samples at full scale
+    float dcOffset = 0.0f;     // average sample value
+
+    float rmsDb() const { return 20.0f * log10f(rms / LEVELS_FULL_SCALE + 1e-9f); }
+    float peakDb() const { return 20.0f * log10f(peak / LEVELS_FULL_SCALE + 1e-9f); }
+
+    // One line, e.g. "rms -31.2 dBFS, peak -6.0 dBFS, 0 clipped, dc 3"
+    int format(char* out, size_t size) const
+    {
+        return snprintf(out, size, "rms %.1f dBFS, peak %.1f dBFS, %u clipped, dc %.0f",
+                        rmsDb(), peakDb(), (unsigned)clipped, dcOffset);
+    }
+};
+
+// Adds up the samples block by block, in the loop that already touches every sample,
+// so there is no second pass over the take. Integer sums: exact for any take length.
+class LevelMeter
+{
+private:
+    uint32_t _samples = 0;
+    int64_t _sum = 0;
+    uint64_t _sumSquares = 0;
+    int32_t _max = INT32_MIN;
+    int32_t _min = INT32_MAX;
+    uint32_t _clipped = 0;
+
+public:
+    void reset() { *this = LevelMeter(); }
+
+    // Raw 32 bit microphone samples (16 bit value * 4096, as in the DMA buffer), every
+    // stride'th one: stride 2 takes the left microphone of stereo frames.
+    void addRaw(const int32_t* raw, uint32_t count, uint32_t stride = 1)
+    {
+        int64_t sum = 0;
+        uint64_t squares = 0;
+        int32_t lo = _min, hi = _max;
+        uint32_t clipped = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            int32_t v = raw[i * stride] / 4096;   // the same value as the WAV file gets
+            if (v > LEVELS_CLIP_LEVEL) v = LEVELS_CLIP_LEVEL;
+            if (v < -LEVELS_CLIP_LEVEL - 1) v = -LEVELS_CLIP_LEVEL - 1;
+            sum += v;
+            squares += (uint64_t)((int64_t)v * v);
+            if (v > hi) hi = v;
+            if (v < lo) lo = v;
+            clipped += (v >= LEVELS_CLIP_LEVEL || v < -LEVELS_CLIP_LEVEL);
+        }
+        _sum += sum;
+        _sumSquares += squares;
+        _min = lo;
+        _max = hi;
+        _clipped += clipped;
+        _samples += count;
+    }
+
+    // Another meter (e.g. one block) on top of this one
+    void merge(const LevelMeter& other)
+    {
+        _samples += other._samples;
+        _sum += other._sum;
+        _sumSquares += other._sumSquares;
+        _clipped += other._clipped;
+        if (other._max > _max) _max = other._max;
+        if (other._min < _min) _min = other._min;
+    }
+
+    uint32_t samples() const { return _samples; }
+
+    TakeStats stats() const
+    {
+        TakeStats s;
+        if (_samples == 0) return s;
+        s.samples = _samples;
+        double mean = (double)_sum / _samples;
+        double power = (double)_sumSquares / _samples - mean * mean;
+        s.rms = power > 0.0 ? (float)sqrt(power) : 0.0f;
+        s.peak = _max > -_min ? _max : -_min;
+        s.clipped = _clipped;
+        s.dcOffset = (float)mean;
+        return s;
+    }
+};
+
+// When is a take bad. The defaults let a melody played close to the robot through.
+struct TakePolicy
+{
+    float silentDb = -80.0f;        // rms below this: no signal at all
+    float minPeakDb = -30.0f;       // the loudest sample must reach this
+    uint32_t maxClipped = 20;       // 1 ms of samples at full scale
+    float maxDcOffset = 1000.0f;    // about -30 dBFS
+    bool reject = false;            // false: bad takes are kept apart (flagged), true: not written at all
+};
+
+static inline TakeVerdict judgeTake(const TakeStats& stats, const TakePolicy& policy = TakePolicy())
+{
+    if (stats.samples == 0 || stats.rmsDb() < policy.silentDb) return TakeVerdict::Silent;
+    if (stats.clipped > policy.maxClipped) return TakeVerdict::Clipped;
+    if (fabsf(stats.dcOffset) > policy.maxDcOffset) return TakeVerdict::DcOffset;
+    if (stats.peakDb() < policy.minPeakDb) return TakeVerdict::TooQuiet;
+    return TakeVerdict::Good;
+}
+
+// What the classifier heard in a take, before it was saved (TakeVerifier, ai-workshop-verify.h).
+// Here and not there, so the SD card code does not need the model header.
+struct TakeCheck
+{
+    bool checked = false;      // false: the label is not one the model knows (or it failed), nothing to say
+    bool agrees = true;        // heard the label; for a background label (noise): heard no melody
+    char heard[32] = "-";      // the first label over the threshold, "-" for none
+    float confidence = 0.0f;   // smoothed score of the heard label (none heard: the best a melody got)
+    uint32_t slices = 0;       // classifier runs
+    uint32_t verifyUs = 0;     // time the check took
+    uint32_t takeMs = 0;       // length of the take
+
+    // One line, e.g. "heard hello_there 0.91"
+    int format(char* out, size_t size) const
+    {
+        if (!checked) return snprintf(out, size, "not verified");
+        return snprintf(out, size, "heard %s %.2f", heard, confidence);
+    }
+};
+
+#endif // WORKSHOP_LEVELS_H
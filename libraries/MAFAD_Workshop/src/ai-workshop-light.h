@@ -0,0 +1,267 @@
+#ifndef WORKSHOP_LIGHT_H
+#define WORKSHOP_LIGHT_H
+
+#include "ai-workshop-main.h"
+#include "ai-workshop-trace.h"
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define LIGHT_HISTORY 256          // frames kept in the ring buffer (2.5 seconds at 100 frames per second)
+#define LIGHT_ADC_MAX 4095.0f      // 12 bit ADC
+
+// One decimated, filtered reading of both light sensors.
+struct LightFrame
+{
+    int64_t timeUs = 0;      // esp_timer time of the end of the frame, same clock as i2sMic stream slices
+    float left = 0.0f;       // filtered level 0.0 (dark) .. 1.0 (ADC max)
+    float right = 0.0f;
+    float leftSlope = 0.0f;  // change of the level per second
+    float rightSlope = 0.0f;
+    float difference = 0.0f; // left - right, > 0 means more light on the left
+};
+
+// Samples both light sensors continuously with the ADC DMA (no analogRead in loop()).
+// The ADC averages `sampleRate / frameRate` conversions per frame (decimation),
+// a low pass filter smooths the levels and the slopes are taken from the filtered values.
+// While running, analogRead() on ADC1 pins is not available.
+class LightSensors
+{
+private:
+    TaskHandle_t _task = nullptr;
+    volatile bool _running = false;
+
+    uint8_t _pins[2] = {0, 0};
+    uint32_t _frameRate = 100;
+    float _smoothing = 0.5f;
+
+    // ring buffer, protected by _lock (readers copy a few frames at most)
+    LightFrame _frames[LIGHT_HISTORY];
+    volatile uint32_t _count = 0;
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+
+    volatile uint32_t _missed = 0;
+
+    // the ADC callback has no argument
+    static LightSensors *s_activeInstance;
+
+    static void ARDUINO_ISR_ATTR conversionDone()
+    {
+        if (s_activeInstance && s_activeInstance->_task)
+        {
+            BaseType_t woken = pdFALSE;
+            vTaskNotifyGiveFromISR(s_activeInstance->_task, &woken);
+            portYIELD_FROM_ISR(woken);
+        }
+    }
+
+    static void captureTask(void *parameter)
+    {
+        AIW_TRACE_TASK("LightCapture");
+        LightSensors *light = static_cast<LightSensors *>(parameter);
+
+        LightFrame previous;
+        bool first = true;
+
+        while (light->_running)
+        {
+            uint32_t notified = ulTaskNotifyTake(pdTRUE, 100 / portTICK_PERIOD_MS);
+            if (!light->_running) break;
+            if (notified == 0) continue;
+            if (notified > 1) light->_missed += notified - 1;
+
+            adc_continuous_data_t *result = nullptr;
+            if (!analogContinuousRead(&result, 0) || result == nullptr) continue;
+
+            float raw[2] = {0.0f, 0.0f};
+            for (int i = 0; i < 2; i++)
+            {
+                // the result order follows the ADC channel order, not ours
+                uint8_t r = (result[0].pin == light->_pins[i]) ? 0 : 1;
+                raw[i] = result[r].avg_read_raw / LIGHT_ADC_MAX;
+            }
+
+            LightFrame frame;
+            frame.timeUs = esp_timer_get_time();
+
+            if (first)
+            {
+                frame.left = raw[0];
+                frame.right = raw[1];
+                first = false;
+            }
+            else
+            {
+                frame.left = light->_smoothing * previous.left + (1.0f - light->_smoothing) * raw[0];
+                frame.right = light->_smoothing * previous.right + (1.0f - light->_smoothing) * raw[1];
+
+                float dt = (frame.timeUs - previous.timeUs) / 1000000.0f;
+                if (dt > 0.0f)
+                {
+                    frame.leftSlope = (frame.left - previous.left) / dt;
+                    frame.rightSlope = (frame.right - previous.right) / dt;
+                }
+            }
+            frame.difference = frame.left - frame.right;
+            previous = frame;
+
+            portENTER_CRITICAL(&light->_lock);
+            light->_frames[light->_count % LIGHT_HISTORY] = frame;
+            light->_count++;
+            portEXIT_CRITICAL(&light->_lock);
+        }
+
+        AIW_TRACE_TASK_END();
+        light->_task = nullptr;
+        vTaskDelete(nullptr);
+    }
+
+    // newest frame with timeUs <= t, walking back from the newest; call with _lock held
+    bool findLocked(int64_t t, uint32_t &index)
+    {
+        uint32_t count = _count;
+        uint32_t available = count < LIGHT_HISTORY ? count : LIGHT_HISTORY;
+        for (uint32_t n = 1; n <= available; n++)
+        {
+            uint32_t i = count - n;
+            if (_frames[i % LIGHT_HISTORY].timeUs <= t)
+            {
+                index = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+public:
+    // Constructor
+    LightSensors() {}
+
+    // sampleRate: ADC conversions per second per sensor (the ESP32-S3 needs at least ~320)
+    // frameRate: filtered frames per second that end up in the ring buffer
+    // smoothing: low pass filter, 0.0 = off, closer to 1.0 = smoother
+    bool begin(uint8_t leftPin, uint8_t rightPin, uint32_t sampleRate = 2000, uint32_t frameRate = 100, float smoothing = 0.5f)
+    {
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+        if (_running || s_activeInstance) return false;
+        if (frameRate == 0 || sampleRate < frameRate) return false;
+
+        _pins[0] = leftPin;
+        _pins[1] = rightPin;
+        _frameRate = frameRate;
+        _smoothing = smoothing;
+        _count = 0;
+        _missed = 0;
+
+        uint8_t pins[2] = {leftPin, rightPin};
+        uint32_t conversionsPerPin = sampleRate / frameRate;
+
+        s_activeInstance = this;
+        _running = true;
+
+        if (pdPASS != xTaskCreatePinnedToCore(captureTask, "LightCapture", 4096, this, 5, &_task, 1))
+        {
+            _running = false;
+            s_activeInstance = nullptr;
+            return false;
+        }
+
+        if (!analogContinuous(pins, 2, conversionsPerPin, sampleRate * 2, &conversionDone) || !analogContinuousStart())
+        {
+            Serial.println("ERR: LightSensors ADC continuous mode failed");
+            end();
+            return false;
+        }
+        return true;
+#else
+        Serial.println("LightSensors needs the ESP32 Arduino core v3 or newer.");
+        return false;
+#endif
+    }
+
+    void end()
+    {
+        if (!s_activeInstance) return;
+        analogContinuousStop();
+        analogContinuousDeinit();
+        _running = false;
+        s_activeInstance = nullptr;
+    }
+
+    bool latest(LightFrame &out)
+    {
+        bool found = false;
+        portENTER_CRITICAL(&_lock);
+        if (_count > 0)
+        {
+            out = _frames[(_count - 1) % LIGHT_HISTORY];
+            found = true;
+        }
+        portEXIT_CRITICAL(&_lock);
+        return found;
+    }
+
+    // The frame that was current at timeUs (e.g. mic.getStreamTimeUs()).
+    bool at(int64_t timeUs, LightFrame &out)
+    {
+        bool found = false;
+        portENTER_CRITICAL(&_lock);
+        uint32_t index;
+        if (findLocked(timeUs, index))
+        {
+            out = _frames[index % LIGHT_HISTORY];
+            found = true;
+        }
+        portEXIT_CRITICAL(&_lock);
+        return found;
+    }
+
+    // Average of the frames between fromUs and toUs, e.g. the time span of one audio slice.
+    // The slopes hold the steepest change in the window. Returns the number of frames used.
+    uint32_t average(int64_t fromUs, int64_t toUs, LightFrame &out)
+    {
+        LightFrame sum;
+        uint32_t used = 0;
+
+        portENTER_CRITICAL(&_lock);
+        uint32_t index;
+        if (findLocked(toUs, index))
+        {
+            uint32_t oldest = _count > LIGHT_HISTORY ? _count - LIGHT_HISTORY : 0;
+            for (uint32_t i = index + 1; i-- > oldest;)
+            {
+                const LightFrame &f = _frames[i % LIGHT_HISTORY];
+                if (f.timeUs < fromUs) break;
+                sum.left += f.left;
+                sum.right += f.right;
+                if (fabsf(f.leftSlope) > fabsf(sum.leftSlope)) sum.leftSlope = f.leftSlope;
+                if (fabsf(f.rightSlope) > fabsf(sum.rightSlope)) sum.rightSlope = f.rightSlope;
+                used++;
+            }
+        }
+        portEXIT_CRITICAL(&_lock);
+
+        if (used == 0) return 0;
+
+        out.timeUs = toUs;
+        out.left = sum.left / used;
+        out.right = sum.right / used;
+        out.leftSlope = sum.leftSlope;
+        out.rightSlope = sum.rightSlope;
+        out.difference = out.left - out.right;
+        return used;
+    }
+
+    uint32_t getFrameCount() const { return _count; }
+    uint32_t getFrameRate() const { return _frameRate; }
+
+    // frames the task was too late for (the ADC already overwrote them)
+    uint32_t getMissedFrames() const { return _missed; }
+};
+
+// static pointer
+LightSensors *LightSensors::s_activeInstance = nullptr;
+
+#endif // WORKSHOP_LIGHT_H
@@ -0,0 +1,327 @@
+#ifndef WORKSHOP_LISTEN_H
+#define WORKSHOP_LISTEN_H
+
+#include "ai-workshop-main.h"
+#include "ai-workshop-mic.h"
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#if CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
+
+enum class ListenState : uint8_t
+{
+    Watch,    // low clock, only the energy detector runs
+    Active,   // full clock, the classifier runs
+};
+
+struct ListenConfig
+{
+    float onsetRatio = 4.0f;      // a block this many times louder (RMS) than the noise floor wakes us up
+    float minLevel = 40.0f;       // ...and it must be at least this loud (RMS in 16 bit units)
+    uint32_t holdMs = 1500;       // stay active this long after the last loud block
+    uint32_t floorWindowMs = 10000; // a room that stays louder than the noise floor this long is the new floor
+    uint32_t watchCpuMhz = 80;    // CPU clock while watching (80 keeps the I2S/APB clocks untouched)
+    uint32_t activeCpuMhz = 240;
+    bool lightSleep = true;       // allow automatic light sleep while watching (needs CONFIG_PM_ENABLE)
+};
+
+struct ListenStats
+{
+    uint64_t watchUs = 0;         // time spent in each state
+    uint64_t activeUs = 0;
+    uint32_t wakeups = 0;
+    uint32_t lastWakeUs = 0;      // onset of the sound -> full clock
+    uint32_t maxWakeUs = 0;
+    uint32_t lastFirstInferenceUs = 0;  // onset of the sound -> first classification after waking up
+    uint32_t maxFirstInferenceUs = 0;
+    float noiseFloor = 0.0f;      // current RMS estimate of the background
+};
+
+// Duty cycled listening: watch the mic stream with a cheap energy detector at a
+// low clock and only switch to full speed (and run the classifier) when there is sound.
+//
+// The detector runs as an i2sMic stream hook, so it sees every DMA block. The hook only
+// changes the state; the clock follows in waitForActive() or update() (the listening task
+// or loop()), so the wake-up latency is one block (DMA_BUFFER_SIZE samples) plus the time
+// until that task runs. The inference task asks isActive() / waitForActive() before running
+// the classifier and calls markInference() after it, which measures the latency up to the
+// first result. After a wake-up needsResync() is true once: the classifier window still
+// holds audio from before the watch period.
+//
+// The noise floor follows quiet blocks, and it takes the quietest block of the last
+// floorWindowMs when even that one was louder: a fan that was switched on does not keep
+// the robot awake at full clock.
+//
+// Note: the legacy I2S driver keeps a power management lock while it runs, so
+// automatic light sleep only happens when nothing else holds the APB clock.
+class ListeningMode
+{
+private:
+    ListenConfig _config;
+    volatile ListenState _state = ListenState::Watch;
+
+    float _noise = 0.0f;          // noise floor (mean square)
+    bool _noiseValid = false;
+    float _quietest = 0.0f;       // quietest block of this half of the floor window...
+    float _quietestBefore = 0.0f; // ...and of the half before
+    int64_t _halfStartUs = 0;
+    int64_t _lastLoudUs = 0;
+    int64_t _stateSinceUs = 0;
+    int64_t _onsetUs = 0;
+    volatile bool _waitingFirstInference = false;
+    std::atomic<bool> _clockPending{false};   // the state changed, update() sets the clock
+    std::atomic<bool> _resync{false};         // woke up: the classifier window holds old audio
+    bool _waitingWake = false;
+
+    ListenStats _stats;
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+    SemaphoreHandle_t _wake = nullptr;
+
+#if CONFIG_PM_ENABLE
+    esp_pm_lock_handle_t _cpuLock = nullptr;
+    std::atomic<bool> _cpuLockHeld{false};    // the state the clock was last set for (Active: held)
+#endif
+
+    static void streamHook(float* samples, uint32_t count, int64_t timeUs, void* user)
+    {
+        static_cast<ListeningMode*>(user)->onBlock(samples, count, timeUs);
+    }
+
+    void setClock(ListenState state)
+    {
+#if CONFIG_PM_ENABLE
+        if (_cpuLock)
+        {
+            // the state can go Active -> Watch -> Active between two update() calls:
+            // acquire and release only when it differs from the state the lock was set for
+            bool active = state == ListenState::Active;
+            if (_cpuLockHeld.exchange(active) != active)
+            {
+                if (active) esp_pm_lock_acquire(_cpuLock);
+                else esp_pm_lock_release(_cpuLock);
+            }
+            return;
+        }
+#endif
+        setCpuFrequencyMhz(state == ListenState::Active ? _config.activeCpuMhz : _config.watchCpuMhz);
+    }
+
+    void enter(ListenState state, int64_t timeUs)
+    {
+        portENTER_CRITICAL(&_lock);
+        uint64_t spent = (uint64_t)(timeUs - _stateSinceUs);
+        if (_state == ListenState::Watch) _stats.watchUs += spent;
+        else _stats.activeUs += spent;
+        _stateSinceUs = timeUs;
+        _state = state;
+        portEXIT_CRITICAL(&_lock);
+    }
+
+public:
+    // Constructor
+    ListeningMode() {}
+
+    bool begin(i2sMic& mic, const ListenConfig& config = ListenConfig())
+    {
+        _config = config;
+        _state = ListenState::Watch;
+        _noiseValid = false;
+        _clockPending = false;
+        _resync = false;
+        _stats = ListenStats();
+        _stateSinceUs = esp_timer_get_time();
+
+        if (_wake == nullptr) _wake = xSemaphoreCreateBinary();
+        if (_wake == nullptr) return false;
+
+#if CONFIG_PM_ENABLE
+        esp_pm_config_t pm = {};
+        pm.max_freq_mhz = (int)_config.activeCpuMhz;
+        pm.min_freq_mhz = (int)_config.watchCpuMhz;
+        pm.light_sleep_enable = _config.lightSleep;
+        if (esp_pm_configure(&pm) == ESP_OK && _cpuLock == nullptr)
+        {
+            esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "listen", &_cpuLock);
+        }
+#endif
+        setClock(ListenState::Watch);
+
+        return mic.addStreamHook(streamHook, this);
+    }
+
+    void end(i2sMic& mic)
+    {
+        mic.removeStreamHook(streamHook, this);
+        if (_state == ListenState::Active) enter(ListenState::Watch, esp_timer_get_time());
+        _clockPending = false;
+#if CONFIG_PM_ENABLE
+        if (_cpuLock)
+        {
+            setClock(ListenState::Watch);   // releases the lock when it is held
+            esp_pm_lock_delete(_cpuLock);
+            _cpuLock = nullptr;
+
+            // full clock from now on, no scaling down or light sleep
+            esp_pm_config_t pm = {};
+            pm.max_freq_mhz = pm.min_freq_mhz = (int)_config.activeCpuMhz;
+            pm.light_sleep_enable = false;
+            esp_pm_configure(&pm);
+            return;
+        }
+#endif
+        setClock(ListenState::Active);
+    }
+
+    // The energy detector, called for every stream block.
+    void onBlock(const float* samples, uint32_t count, int64_t timeUs)
+    {
+        if (count == 0) return;
+
+        float energy = 0.0f;
+        for (uint32_t i = 0; i < count; i++) energy += samples[i] * samples[i];
+        energy /= count;
+
+        if (!_noiseValid)
+        {
+            _noise = energy;
+            _quietest = _quietestBefore = energy;
+            _halfStartUs = timeUs;
+            _noiseValid = true;
+        }
+
+        // minimum statistics: when the quietest block of the whole window is louder than
+        // the floor, the room got louder (a sound would have gaps), so that is the new floor
+        if (energy < _quietest) _quietest = energy;
+        if (timeUs - _halfStartUs >= (int64_t)_config.floorWindowMs * 500)
+        {
+            float quietest = _quietest < _quietestBefore ? _quietest : _quietestBefore;
+            if (quietest > _noise) _noise = quietest;
+            _quietestBefore = _quietest;
+            _quietest = energy;
+            _halfStartUs = timeUs;
+        }
+
+        float threshold = _noise * _config.onsetRatio * _config.onsetRatio;
+        float minimum = _config.minLevel * _config.minLevel;
+        if (threshold < minimum) threshold = minimum;
+        bool loud = energy > threshold;
+
+        // the noise floor follows quiet blocks slowly and drops quickly
+        if (!loud)
+        {
+            _noise += (energy < _noise ? 0.3f : 0.02f) * (energy - _noise);
+        }
+
+        if (loud) _lastLoudUs = timeUs;
+
+        if (_state == ListenState::Watch && loud)
+        {
+            // the sound started somewhere in this block, take the start as the worst case
+            _onsetUs = timeUs - (int64_t)count * 1000000LL / SAMPLE_RATE;
+            enter(ListenState::Active, timeUs);
+            portENTER_CRITICAL(&_lock);
+            _stats.wakeups++;
+            _waitingWake = true;
+            portEXIT_CRITICAL(&_lock);
+
+            _waitingFirstInference = true;
+            _resync = true;
+            _clockPending = true;
+            xSemaphoreGive(_wake);
+        }
+        else if (_state == ListenState::Active && timeUs - _lastLoudUs > (int64_t)_config.holdMs * 1000)
+        {
+            enter(ListenState::Watch, timeUs);
+            _clockPending = true;
+        }
+    }
+
+    // Sets the clock after a state change. Called by waitForActive(); call it from loop()
+    // (or the listening task) when that task does not use waitForActive().
+    void update()
+    {
+        if (!_clockPending.exchange(false)) return;
+        ListenState state = _state;
+        setClock(state);
+        if (state != ListenState::Active) return;
+
+        // onset of the sound -> full clock
+        uint32_t latency = (uint32_t)(esp_timer_get_time() - _onsetUs);
+        portENTER_CRITICAL(&_lock);
+        if (_waitingWake)
+        {
+            _waitingWake = false;
+            _stats.lastWakeUs = latency;
+            if (latency > _stats.maxWakeUs) _stats.maxWakeUs = latency;
+        }
+        portEXIT_CRITICAL(&_lock);
+    }
+
+    bool isActive() const { return _state == ListenState::Active; }
+    ListenState state() const { return _state; }
+
+    // Blocks the calling task while watching (and sets the clock). Returns true when active.
+    bool waitForActive(uint32_t timeoutMs = portMAX_DELAY)
+    {
+        update();
+        if (_state == ListenState::Active) return true;
+        TickType_t ticks = (timeoutMs == portMAX_DELAY) ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs);
+        xSemaphoreTake(_wake, ticks);
+        update();
+        return _state == ListenState::Active;
+    }
+
+    // True once after every wake-up: the continuous classifier still holds audio from before
+    // the watch period, so restart it (run_classifier_init()) before the next slice.
+    bool needsResync()
+    {
+        return _resync.exchange(false);
+    }
+
+    // Call after each classification, measures the time from the sound onset to the first result.
+    void markInference()
+    {
+        if (!_waitingFirstInference) return;
+        _waitingFirstInference = false;
+
+        uint32_t latency = (uint32_t)(esp_timer_get_time() - _onsetUs);
+        portENTER_CRITICAL(&_lock);
+        _stats.lastFirstInferenceUs = latency;
+        if (latency > _stats.maxFirstInferenceUs) _stats.maxFirstInferenceUs = latency;
+        portEXIT_CRITICAL(&_lock);
+    }
+
+    ListenStats getStats()
+    {
+        portENTER_CRITICAL(&_lock);
+        ListenStats stats = _stats;
+        uint64_t current = (uint64_t)(esp_timer_get_time() - _stateSinceUs);
+        if (_state == ListenState::Watch) stats.watchUs += current;
+        else stats.activeUs += current;
+        stats.noiseFloor = sqrtf(_noise);
+        portEXIT_CRITICAL(&_lock);
+        return stats;
+    }
+
+    void printStats(Print& out = Serial)
+    {
+        ListenStats s = getStats();
+        uint64_t total = s.watchUs + s.activeUs;
+        char line[160];
+        snprintf(line, sizeof(line),
+                 "listen: %s | watch %.1f s (%.0f%%) active %.1f s | %u wakeups | wake %.1f ms (max %.1f) | first result %.1f ms (max %.1f)\r\n",
+                 isActive() ? "active" : "watch",
+                 s.watchUs / 1e6, total ? 100.0 * s.watchUs / total : 0.0, s.activeUs / 1e6,
+                 (unsigned)s.wakeups, s.lastWakeUs / 1000.0, s.maxWakeUs / 1000.0,
+                 s.lastFirstInferenceUs / 1000.0, s.maxFirstInferenceUs / 1000.0);
+        out.write((const uint8_t*)line, strlen(line));
+    }
+};
+
+#endif // WORKSHOP_LISTEN_H
@@ -0,0 +1,686 @@
+#ifndef WORKSHOP_MELODY_H
+#define WORKSHOP_MELODY_H
+
+#include "ai-workshop-main.h"
+#include "ai-workshop-pitches.h"
+#include "ai-workshop-mic.h"
+#include "ai-workshop-trace.h"
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#define MELODY_FRAME_SIZE 512            // samples per Goertzel frame (25.6 ms at 20 kHz)
+#define MELODY_HOP_SIZE 256              // a new note frame every 12.8 ms
+#define MELODY_MAX_NOTES 64              // filters in the bank
+#define MELODY_MAX_TEMPLATES 8
+#define MELODY_MAX_TEMPLATE_FRAMES 160   // about 2 seconds of melody
+#define MELODY_MATCH_QUEUE 4
+#define MELODY_SILENCE -1
+#define MELODY_WARP_COST 0.1f            // extra DTW cost for a step that is not at the template speed
+
+// One note of a melody template, the same numbers as playTone(pin, frequency, ms).
+struct MelodyNote
+{
+    uint16_t frequency;   // NOTE_* value, 0 = silence
+    uint16_t ms;
+};
+
+// Result of one frame of the filter bank.
+struct NoteFrame
+{
+    int8_t note = MELODY_SILENCE;   // index in the bank, or MELODY_SILENCE
+    float tonality = 0.0f;          // 0 .. 1, how much of the frame energy is in the strongest note
+    float level = 0.0f;             // RMS in 16 bit units
+};
+
+struct MelodyMatch
+{
+    uint8_t templateIndex = 0;
+    const char *name = nullptr;
+    float cost = 0.0f;              // average DTW cost per step, 0 = perfect
+    int64_t startUs = 0;            // esp_timer time of the first and last frame of the match
+    int64_t endUs = 0;
+};
+
+struct MelodyStats
+{
+    uint32_t frames = 0;
+    uint32_t tonalFrames = 0;
+    uint32_t matches = 0;
+    uint32_t dropped = 0;           // matches lost because nobody read them
+    uint64_t busyUs = 0;            // time spent in the filter bank and the matcher
+    uint64_t matchUs = 0;           // ...of which in the matcher (grows with the templates)
+    uint64_t audioUs = 0;           // audio processed in that time
+};
+
+// Called for every note frame, on the task that feeds the detector (see MelodyDetector::setFrameHook).
+typedef void (*NoteFrameHook)(const NoteFrame &frame, int64_t timeUs, void *user);
+
+// The notes the workshop melodies use: C3 .. C7 (49 semitones).
+static const uint16_t MELODY_DEFAULT_NOTES[] = {
+    NOTE_C3, NOTE_CS3, NOTE_D3, NOTE_DS3, NOTE_E3, NOTE_F3, NOTE_FS3, NOTE_G3, NOTE_GS3, NOTE_A3, NOTE_AS3, NOTE_B3,
+    NOTE_C4, NOTE_CS4, NOTE_D4, NOTE_DS4, NOTE_E4, NOTE_F4, NOTE_FS4, NOTE_G4, NOTE_GS4, NOTE_A4, NOTE_AS4, NOTE_B4,
+    NOTE_C5, NOTE_CS5, NOTE_D5, NOTE_DS5, NOTE_E5, NOTE_F5, NOTE_FS5, NOTE_G5, NOTE_GS5, NOTE_A5, NOTE_AS5, NOTE_B5,
+    NOTE_C6, NOTE_CS6, NOTE_D6, NOTE_DS6, NOTE_E6, NOTE_F6, NOTE_FS6, NOTE_G6, NOTE_GS6, NOTE_A6, NOTE_AS6, NOTE_B6,
+    NOTE_C7};
+
+// A bank of fixed point Goertzel filters, one per note.
+// Every MELODY_HOP_SIZE samples the last MELODY_FRAME_SIZE samples are windowed and
+// every filter measures the power at its note; the strongest note wins if the frame is tonal enough.
+class NoteBank
+{
+private:
+    uint16_t _frequencies[MELODY_MAX_NOTES];
+    int32_t _coeffs[MELODY_MAX_NOTES];       // 2 cos(w) in Q14
+    uint8_t _count = 0;
+
+    int16_t _history[MELODY_FRAME_SIZE];     // ring of the last frame
+    uint32_t _pos = 0;
+    uint32_t _sinceHop = 0;
+    uint32_t _filled = 0;
+
+    int16_t _window[MELODY_FRAME_SIZE];      // Hann in Q15
+    float _toneGain = 1.0f;                  // power of a full scale on-bin tone per unit of frame energy
+
+    float _minTonality = 0.25f;
+    float _minLevel = 40.0f;
+
+public:
+    bool begin(const uint16_t *frequencies = MELODY_DEFAULT_NOTES,
+               uint8_t count = sizeof(MELODY_DEFAULT_NOTES) / sizeof(MELODY_DEFAULT_NOTES[0]))
+    {
+        if (count == 0 || count > MELODY_MAX_NOTES) return false;
+        _count = count;
+        for (uint8_t i = 0; i < count; i++)
+        {
+            _frequencies[i] = frequencies[i];
+            float c = 2.0f * cosf(2.0f * (float)M_PI * frequencies[i] / SAMPLE_RATE);
+            _coeffs[i] = (int32_t)lroundf(c * 16384.0f);
+        }
+
+        float sum = 0.0f, sumSquares = 0.0f;
+        for (uint32_t i = 0; i < MELODY_FRAME_SIZE; i++)
+        {
+            float w = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / MELODY_FRAME_SIZE);
+            _window[i] = (int16_t)lroundf(w * 32767.0f);
+            sum += w;
+            sumSquares += w * w;
+        }
+        // tone of amplitude A on a bin: power (A/2 * sum w)^2, windowed frame energy A^2/2 * sum w^2
+        _toneGain = sum * sum / (2.0f * sumSquares);
+
+        reset();
+        return true;
+    }
+
+    void reset()
+    {
+        memset(_history, 0, sizeof(_history));
+        _pos = 0;
+        _sinceHop = 0;
+        _filled = 0;
+    }
+
+    // minTonality: share of the frame energy in the strongest note (a clean tone is close to 1)
+    // minLevel: RMS (16 bit units) below which a frame counts as silence
+    void setThresholds(float minTonality, float minLevel)
+    {
+        _minTonality = minTonality;
+        _minLevel = minLevel;
+    }
+
+    uint8_t size() const { return _count; }
+    uint16_t frequency(uint8_t index) const { return index < _count ? _frequencies[index] : 0; }
+
+    // Nearest note of the bank (by pitch), for turning melodies into templates.
+    int8_t noteIndex(uint16_t frequency) const
+    {
+        if (frequency == 0 || _count == 0) return MELODY_SILENCE;
+        int8_t best = 0;
+        float bestDistance = 1e9f;
+        for (uint8_t i = 0; i < _count; i++)
+        {
+            float d = fabsf(logf((float)frequency / _frequencies[i]));
+            if (d < bestDistance)
+            {
+                bestDistance = d;
+                best = (int8_t)i;
+            }
+        }
+        return best;
+    }
+
+    // Adds one sample; returns true when a new frame is complete (written to out).
+    bool push(int16_t sample, NoteFrame &out)
+    {
+        _history[_pos] = sample;
+        _pos = (_pos + 1) & (MELODY_FRAME_SIZE - 1);
+        if (_filled < MELODY_FRAME_SIZE) _filled++;
+        if (++_sinceHop < MELODY_HOP_SIZE || _filled < MELODY_FRAME_SIZE) return false;
+        _sinceHop = 0;
+        analyse(out);
+        return true;
+    }
+
+    void analyse(NoteFrame &out)
+    {
+        // window the frame once (oldest sample first), scaled down 2 bits to leave headroom in the filters
+        int16_t frame[MELODY_FRAME_SIZE];
+        int64_t energy = 0;
+        for (uint32_t i = 0; i < MELODY_FRAME_SIZE; i++)
+        {
+            int32_t x = ((int32_t)_history[(_pos + i) & (MELODY_FRAME_SIZE - 1)] * _window[i]) >> 17;
+            frame[i] = (int16_t)x;
+            energy += (int64_t)x * x;
+        }
+
+        out = NoteFrame();
+        // RMS of the unwindowed signal in 16 bit units (the Hann window keeps 3/8 of the energy)
+        out.level = sqrtf((float)energy * 16.0f / (0.375f * MELODY_FRAME_SIZE));
+        if (energy == 0 || out.level < _minLevel) return;
+
+        float bestPower = 0.0f;
+        int8_t best = MELODY_SILENCE;
+        for (uint8_t n = 0; n < _count; n++)
+        {
+            const int64_t c = _coeffs[n];
+            int32_t s1 = 0, s2 = 0;
+            for (uint32_t i = 0; i < MELODY_FRAME_SIZE; i++)
+            {
+                int32_t s0 = frame[i] + (int32_t)((c * s1) >> 14) - s2;
+                s2 = s1;
+                s1 = s0;
+            }
+            float f1 = (float)s1, f2 = (float)s2;
+            float power = f1 * f1 + f2 * f2 - (c / 16384.0f) * f1 * f2;
+            if (power > bestPower)
+            {
+                bestPower = power;
+                best = (int8_t)n;
+            }
+        }
+
+        out.tonality = bestPower / ((float)energy * _toneGain);
+        if (out.tonality > 1.0f) out.tonality = 1.0f;
+        if (out.tonality >= _minTonality) out.note = best;
+    }
+};
+
+// Streaming subsequence DTW of the note sequence against registered templates.
+// A match may start at any frame; each step can stay on a template frame (slower),
+// move to the next (same speed) or skip one (up to twice as fast).
+class MelodyMatcher
+{
+private:
+    struct Template
+    {
+        const char *name = nullptr;
+        int8_t notes[MELODY_MAX_TEMPLATE_FRAMES];
+        uint16_t length = 0;
+        float cost[MELODY_MAX_TEMPLATE_FRAMES + 1];      // accumulated cost of the best path ending here
+        uint16_t steps[MELODY_MAX_TEMPLATE_FRAMES + 1];  // length of that path
+        uint32_t start[MELODY_MAX_TEMPLATE_FRAMES + 1];  // frame where that path started
+        float bestCost = 1e30f;
+        uint32_t bestStart = 0;
+        uint32_t bestEnd = 0;
+        uint16_t bestAge = 0;
+    };
+
+    Template _templates[MELODY_MAX_TEMPLATES];
+    uint8_t _count = 0;
+    uint32_t _frame = 0;
+    float _threshold = 0.2f;
+    uint16_t _patience = 4;
+
+    static void clear(Template &t)
+    {
+        for (uint16_t i = 0; i <= t.length; i++)
+        {
+            t.cost[i] = 1e30f;
+            t.steps[i] = 0;
+            t.start[i] = 0;
+        }
+        t.bestCost = 1e30f;
+        t.bestAge = 0;
+    }
+
+public:
+    // Cost of hearing note a where the template has note b
+    static float noteCost(int8_t a, int8_t b)
+    {
+        if (a == b) return 0.0f;
+        if (a == MELODY_SILENCE || b == MELODY_SILENCE) return 1.0f;
+        int d = abs(a - b);
+        if (d % 12 == 0) return 0.3f;   // octave errors (square wave harmonics, small speakers)
+        return d >= 3 ? 1.0f : d / 3.0f;
+    }
+
+    // Average cost per step of a whole note sequence against a template, with the steps of step():
+    // what the matcher would score it if the sequence were played on its own. For comparing takes.
+    static float distance(const int8_t *take, uint16_t takeLength, const int8_t *notes, uint16_t length)
+    {
+        if (takeLength == 0 || length == 0 || length > MELODY_MAX_TEMPLATE_FRAMES) return 1e30f;
+        float cost[MELODY_MAX_TEMPLATE_FRAMES + 1];
+        for (uint16_t i = 0; i <= length; i++) cost[i] = 1e30f;
+        for (uint16_t f = 0; f < takeLength; f++)
+        {
+            const float begin = f == 0 ? 0.0f : 1e30f;   // the match starts with the first frame
+            for (uint16_t i = length; i >= 1; i--)
+            {
+                float best = cost[i] + MELODY_WARP_COST;
+                float c = i == 1 ? begin : cost[i - 1];
+                if (c < best) best = c;
+                if (i >= 2)
+                {
+                    c = (i == 2 ? begin : cost[i - 2]) + MELODY_WARP_COST;
+                    if (c < best) best = c;
+                }
+                cost[i] = best + noteCost(take[f], notes[i - 1]);
+            }
+        }
+        return cost[length] / takeLength;
+    }
+
+    // threshold: average cost per step that still counts as the melody (0 = exact, 1 = nothing alike)
+    // patience: frames to wait for a better end of the match before reporting it
+    void setThreshold(float threshold, uint16_t patience = 4)
+    {
+        _threshold = threshold;
+        _patience = patience;
+    }
+
+    float threshold() const { return _threshold; }
+
+    // Template from a note sequence (one entry per frame). The name is not copied.
+    int addTemplate(const char *name, const int8_t *notes, uint16_t length)
+    {
+        if (_count >= MELODY_MAX_TEMPLATES || length == 0 || length > MELODY_MAX_TEMPLATE_FRAMES) return -1;
+        Template &t = _templates[_count];
+        t.name = name;
+        t.length = length;
+        memcpy(t.notes, notes, length);
+        clear(t);
+        return _count++;
+    }
+
+    // Template from a melody the way it is played with playTone(). Every template frame gets the
+    // note the filter bank would see: the note with the most (Hann weighted) time in the frame window,
+    // or silence when the notes fill less than a third of it. Leading and trailing silence is dropped.
+    int addMelody(const char *name, const MelodyNote *melody, uint16_t count, const NoteBank &bank)
+    {
+        int8_t notes[MELODY_MAX_TEMPLATE_FRAMES];
+        uint16_t length = 0;
+        const float hopMs = 1000.0f * MELODY_HOP_SIZE / SAMPLE_RATE;
+        const float windowMs = 1000.0f * MELODY_FRAME_SIZE / SAMPLE_RATE;
+        const float stepMs = 0.5f;
+
+        float totalMs = 0.0f;
+        for (uint16_t i = 0; i < count; i++) totalMs += melody[i].ms;
+
+        for (float frameStart = -windowMs + hopMs; frameStart < totalMs; frameStart += hopMs)
+        {
+            float weights[MELODY_MAX_TEMPLATE_FRAMES];   // per melody note (a window spans only a few)
+            uint16_t first = 0, used = 0;
+            float silence = 0.0f, total = 0.0f;
+
+            float noteStart = 0.0f;
+            for (uint16_t i = 0; i < count; i++)
+            {
+                float noteEnd = noteStart + melody[i].ms;
+                if (noteEnd > frameStart && noteStart < frameStart + windowMs)
+                {
+                    if (used == 0) first = i;
+                    float w = 0.0f;
+                    for (float t = frameStart + stepMs / 2; t < frameStart + windowMs; t += stepMs)
+                    {
+                        if (t >= noteStart && t < noteEnd) w += 0.5f - 0.5f * cosf(2.0f * (float)M_PI * (t - frameStart) / windowMs);
+                    }
+                    if (used < MELODY_MAX_TEMPLATE_FRAMES) weights[used++] = w;
+                    if (melody[i].frequency == 0) silence += w;
+                    total += w;
+                }
+                noteStart = noteEnd;
+            }
+
+            int8_t note = MELODY_SILENCE;
+            if (total > 0.0f && silence < total * 0.67f)
+            {
+                float best = 0.0f;
+                for (uint16_t k = 0; k < used; k++)
+                {
+                    if (melody[first + k].frequency != 0 && weights[k] > best)
+                    {
+                        best = weights[k];
+                        note = bank.noteIndex(melody[first + k].frequency);
+                    }
+                }
+            }
+
+            if (note == MELODY_SILENCE && length == 0) continue;
+            if (length >= MELODY_MAX_TEMPLATE_FRAMES) return -1;
+            notes[length++] = note;
+        }
+        while (length > 0 && notes[length - 1] == MELODY_SILENCE) length--;
+        return addTemplate(name, notes, length);
+    }
+
+    void removeAll() { _count = 0; }
+
+    // The templates after it move down one place.
+    bool removeTemplate(uint8_t index)
+    {
+        if (index >= _count) return false;
+        for (uint8_t t = index; t + 1 < _count; t++) _templates[t] = _templates[t + 1];
+        _count--;
+        return true;
+    }
+
+    uint8_t size() const { return _count; }
+    const char *name(uint8_t index) const { return index < _count ? _templates[index].name : nullptr; }
+    const int8_t *notes(uint8_t index) const { return index < _count ? _templates[index].notes : nullptr; }
+    uint16_t length(uint8_t index) const { return index < _count ? _templates[index].length : 0; }
+
+    int find(const char *name) const
+    {
+        for (uint8_t t = 0; t < _count; t++)
+        {
+            if (strcmp(_templates[t].name, name) == 0) return t;
+        }
+        return -1;
+    }
+
+    void reset()
+    {
+        for (uint8_t t = 0; t < _count; t++) clear(_templates[t]);
+    }
+
+    // Feeds the note of the next frame. Returns the index of a template that just matched, or -1.
+    // The match covers frames matchStart .. matchEnd (frame numbers counted by this matcher).
+    int step(int8_t note, float &matchCost, uint32_t &matchStart, uint32_t &matchEnd)
+    {
+        int found = -1;
+        for (uint8_t ti = 0; ti < _count; ti++)
+        {
+            Template &t = _templates[ti];
+
+            // column update, walking down so cost[i-1] and cost[i-2] still hold the previous frame.
+            // Index 0 is the empty start of a match: free, and it starts at this frame.
+            for (uint16_t i = t.length; i >= 1; i--)
+            {
+                float best = t.cost[i] + MELODY_WARP_COST;   // stay on this template frame (slower)
+                uint16_t steps = t.steps[i];
+                uint32_t start = t.start[i];
+                for (uint16_t k = i - 1; k + 2 >= i; k--)
+                {
+                    // k = i - 1 is the normal step, k = i - 2 skips a template frame (faster)
+                    float c = ((k == 0) ? 0.0f : t.cost[k]) + ((k + 2 == i) ? MELODY_WARP_COST : 0.0f);
+                    if (c < best)
+                    {
+                        best = c;
+                        steps = (k == 0) ? 0 : t.steps[k];
+                        start = (k == 0) ? _frame : t.start[k];
+                    }
+                    if (k == 0) break;
+                }
+                t.cost[i] = best + noteCost(note, t.notes[i - 1]);
+                t.steps[i] = steps + 1;
+                t.start[i] = start;
+            }
+
+            // a complete match: wait a few frames for a better end, then report the best one
+            float average = t.cost[t.length] / t.steps[t.length];
+            if (average <= _threshold && average < t.bestCost)
+            {
+                t.bestCost = average;
+                t.bestStart = t.start[t.length];
+                t.bestEnd = _frame;
+                t.bestAge = 0;
+            }
+            else if (t.bestCost <= _threshold && ++t.bestAge >= _patience)
+            {
+                if (found < 0 || t.bestCost < matchCost)
+                {
+                    found = ti;
+                    matchCost = t.bestCost;
+                    matchStart = t.bestStart;
+                    matchEnd = t.bestEnd;
+                }
+                clear(t);
+            }
+        }
+        _frame++;
+        return found;
+    }
+};
+
+// Melody recogniser: filter bank + matcher, fed by the i2sMic stream (or by process()).
+// It costs a few percent of one core, so it can run on its own or as a cheap gate in
+// front of run_classifier_continuous (see isToneActive()).
+class MelodyDetector
+{
+private:
+    NoteBank _bank;
+    MelodyMatcher _matcher;
+
+    NoteFrame _last;
+    int64_t _lastToneUs = 0;
+
+    MelodyMatch _queue[MELODY_MATCH_QUEUE];
+    volatile uint8_t _head = 0;
+    volatile uint8_t _tail = 0;
+
+    MelodyStats _stats;
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+    SemaphoreHandle_t _templateLock = nullptr;   // templates change while the stream runs (enrolment)
+
+    NoteFrameHook _frameHook = nullptr;
+    void *_frameHookUser = nullptr;
+
+    static void streamHook(float *samples, uint32_t count, int64_t timeUs, void *user)
+    {
+        static_cast<MelodyDetector *>(user)->process(samples, count, timeUs);
+    }
+
+    void onFrame(const NoteFrame &frame, int64_t timeUs)
+    {
+        float cost = 0.0f;
+        uint32_t start = 0, end = 0;
+        int64_t matchStart = esp_timer_get_time();
+        xSemaphoreTake(_templateLock, portMAX_DELAY);
+        int found = _matcher.step(frame.note, cost, start, end);
+        const char *name = found >= 0 ? _matcher.name((uint8_t)found) : nullptr;
+        xSemaphoreGive(_templateLock);
+        int64_t matchUs = esp_timer_get_time() - matchStart;
+
+        portENTER_CRITICAL(&_lock);
+        NoteFrameHook hook = _frameHook;
+        void *hookUser = _frameHookUser;
+        portEXIT_CRITICAL(&_lock);
+        if (hook) hook(frame, timeUs, hookUser);
+
+        portENTER_CRITICAL(&_lock);
+        _last = frame;
+        _stats.frames++;
+        _stats.matchUs += (uint64_t)matchUs;
+        if (frame.note != MELODY_SILENCE)
+        {
+            _stats.tonalFrames++;
+            _lastToneUs = timeUs;
+        }
+        if (found >= 0)
+        {
+            // frame numbers -> time, counting back from this frame
+            const int64_t frameUs = 1000000LL * MELODY_HOP_SIZE / SAMPLE_RATE;
+            uint32_t now = _stats.frames - 1;
+            MelodyMatch m;
+            m.templateIndex = (uint8_t)found;
+            m.name = name;
+            m.cost = cost;
+            m.startUs = timeUs - (int64_t)(now - start) * frameUs - 1000000LL * MELODY_FRAME_SIZE / SAMPLE_RATE;
+            m.endUs = timeUs - (int64_t)(now - end) * frameUs;
+
+            uint8_t next = (_head + 1) % MELODY_MATCH_QUEUE;
+            if (next == _tail)
+            {
+                _tail = (_tail + 1) % MELODY_MATCH_QUEUE;   // drop the oldest
+                _stats.dropped++;
+            }
+            _queue[_head] = m;
+            _head = next;
+            _stats.matches++;
+        }
+        portEXIT_CRITICAL(&_lock);
+    }
+
+public:
+    // Constructor
+    MelodyDetector() {}
+
+    bool begin(const uint16_t *notes = MELODY_DEFAULT_NOTES,
+               uint8_t count = sizeof(MELODY_DEFAULT_NOTES) / sizeof(MELODY_DEFAULT_NOTES[0]))
+    {
+        _head = _tail = 0;
+        _stats = MelodyStats();
+        _lastToneUs = 0;
+        if (!_templateLock) _templateLock = xSemaphoreCreateMutex();
+        if (!_templateLock) return false;
+        _matcher.reset();
+        return _bank.begin(notes, count);
+    }
+
+    // Listen to the microphone stream (call before mic.startStream()).
+    bool attach(i2sMic &mic) { return mic.addStreamHook(streamHook, this); }
+    void detach(i2sMic &mic) { mic.removeStreamHook(streamHook, this); }
+
+    NoteBank &bank() { return _bank; }
+    MelodyMatcher &matcher() { return _matcher; }
+
+    // Templates can be added and removed while the stream runs (partial matches start over).
+    // The name is not copied. Returns the template index or -1.
+    int addMelody(const char *name, const MelodyNote *melody, uint16_t count)
+    {
+        xSemaphoreTake(_templateLock, portMAX_DELAY);
+        int index = _matcher.addMelody(name, melody, count, _bank);
+        xSemaphoreGive(_templateLock);
+        return index;
+    }
+
+    int addTemplate(const char *name, const int8_t *notes, uint16_t length)
+    {
+        xSemaphoreTake(_templateLock, portMAX_DELAY);
+        int index = _matcher.addTemplate(name, notes, length);
+        if (index >= 0) _matcher.reset();
+        xSemaphoreGive(_templateLock);
+        return index;
+    }
+
+    bool removeTemplate(const char *name)
+    {
+        xSemaphoreTake(_templateLock, portMAX_DELAY);
+        int index = _matcher.find(name);
+        bool removed = index >= 0 && _matcher.removeTemplate((uint8_t)index);
+        if (removed) _matcher.reset();
+        xSemaphoreGive(_templateLock);
+        return removed;
+    }
+
+    // Every note frame also goes to hook (nullptr to stop), e.g. MelodyEnroller.
+    void setFrameHook(NoteFrameHook hook, void *user = nullptr)
+    {
+        portENTER_CRITICAL(&_lock);
+        _frameHook = hook;
+        _frameHookUser = user;
+        portEXIT_CRITICAL(&_lock);
+    }
+
+    // Feed samples (16 bit values, as float like the stream hooks or as int16_t from a WAV file).
+    // timeUs: esp_timer time of the last sample.
+    template <typename Sample>
+    void process(const Sample *samples, uint32_t count, int64_t timeUs)
+    {
+        AIW_TRACE_SCOPE("melody");
+        int64_t start = esp_timer_get_time();
+        NoteFrame frame;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            if (_bank.push((int16_t)clip((int32_t)samples[i]), frame))
+            {
+                onFrame(frame, timeUs - (int64_t)(count - 1 - i) * 1000000LL / SAMPLE_RATE);
+            }
+        }
+        portENTER_CRITICAL(&_lock);
+        _stats.busyUs += (uint64_t)(esp_timer_get_time() - start);
+        _stats.audioUs += (uint64_t)count * 1000000ULL / SAMPLE_RATE;
+        portEXIT_CRITICAL(&_lock);
+    }
+
+    // Takes the oldest match that was not read yet.
+    bool getMatch(MelodyMatch &out)
+    {
+        bool found = false;
+        portENTER_CRITICAL(&_lock);
+        if (_tail != _head)
+        {
+            out = _queue[_tail];
+            _tail = (_tail + 1) % MELODY_MATCH_QUEUE;
+            found = true;
+        }
+        portEXIT_CRITICAL(&_lock);
+        return found;
+    }
+
+    NoteFrame lastFrame()
+    {
+        portENTER_CRITICAL(&_lock);
+        NoteFrame f = _last;
+        portEXIT_CRITICAL(&_lock);
+        return f;
+    }
+
+    // The pre-filter: true when a note was heard in the last holdMs.
+    // Keep holdMs at least one model window so the classifier sees the whole melody.
+    bool isToneActive(uint32_t holdMs = 1000)
+    {
+        portENTER_CRITICAL(&_lock);
+        int64_t last = _lastToneUs;
+        portEXIT_CRITICAL(&_lock);
+        return last != 0 && esp_timer_get_time() - last <= (int64_t)holdMs * 1000;
+    }
+
+    // Clears the filter history and partial matches (e.g. between files).
+    void reset()
+    {
+        _bank.reset();
+        xSemaphoreTake(_templateLock, portMAX_DELAY);
+        _matcher.reset();
+        xSemaphoreGive(_templateLock);
+        _lastToneUs = 0;
+    }
+
+    MelodyStats getStats()
+    {
+        portENTER_CRITICAL(&_lock);
+        MelodyStats s = _stats;
+        portEXIT_CRITICAL(&_lock);
+        return s;
+    }
+
+    // CPU use as a share of real time (0.02 = 2% of one core).
+    float getLoad()
+    {
+        MelodyStats s = getStats();
+        return s.audioUs ? (float)s.busyUs / s.audioUs : 0.0f;
+    }
+
+    // Matcher time for samples of audio (e.g. one classifier slice), in microseconds.
+    float getMatchUs(uint32_t samples)
+    {
+        MelodyStats s = getStats();
+        return s.audioUs ? (float)s.matchUs * samples * 1000000.0f / SAMPLE_RATE / s.audioUs : 0.0f;
+    }
+};
+
+#endif // WORKSHOP_MELODY_H
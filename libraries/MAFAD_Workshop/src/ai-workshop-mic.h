@@ -2,154 +2,763 @@
 #define WORKSHOP_MIC_H
 
 #include "ai-workshop-main.h"
+#include "ai-workshop-trace.h"
+#include "ai-workshop-levels.h"
+#include "ai-workshop-capture.h"
+#include "ai-workshop-events.h"
+
+// The I2S driver i2sMic captures with:
+//   0: the legacy driver (driver/i2s.h), a capture task reads every block with i2s_read
+//   1: the channel driver of ESP-IDF 5 (driver/i2s_std.h, Arduino-ESP32 3.x): the I2S interrupt
+//      converts every DMA buffer straight into the take or the stream slice, the hooks run on a
+//      task of their own. ESP-IDF stops at boot when both drivers are in one firmware, so the
+//      rest of the sketch may not use driver/i2s.h then (AiWorkshopInference, AudioOut).
+// Set it before the #include, e.g. #define MIC_I2S_STD 1
+#ifndef MIC_I2S_STD
+#define MIC_I2S_STD 0
+#endif
 
 #include <Arduino.h>
+#if MIC_I2S_STD
+#include <driver/i2s_std.h>
+#else
 #include <driver/i2s.h>
+#endif
 #include <esp_system.h>
+#include <esp_timer.h>
 #include <cstring>
 #include <climits>
+#include <atomic>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
 #define DMA_BUFFER_SIZE 1024      // size of the DMA buffer
+#define MIC_MAX_STREAM_HOOKS 4    // callbacks that can look at the stream blocks
+#define MIC_HOOK_QUEUE 16         // MIC_I2S_STD: stream blocks waiting for the hook task
+
+// Called for every block of the stream (up to DMA_BUFFER_SIZE samples) before it goes into a slice.
+// Samples are 16 bit values as float and may be changed in place. timeUs is the esp_timer time of
+// the last sample. Runs on the capture task (MIC_I2S_STD: the hook task): keep it short.
+typedef void (*MicStreamHook)(float* samples, uint32_t count, int64_t timeUs, void* user);
+
+// The same for stereo microphones: both channels of the block, the left one is also what goes into the slices.
+typedef void (*MicStereoHook)(float* left, float* right, uint32_t count, int64_t timeUs, void* user);
+
+enum class MicChannels : uint8_t
+{
+    Mono,     // one microphone, L/R pin low (left slot)
+    Stereo,   // two microphones on the same clock and data line, L/R pin low (left) and high (right)
+};
+
+// What the capture task does. One task serves both, so the two can never read the I2S port at once.
+enum class MicMode : uint8_t
+{
+    Idle,
+    Recording,
+    Streaming,
+};
+
+struct MicStats
+{
+    uint32_t switches = 0;        // start/stop calls that changed the mode
+    uint32_t lastSwitchUs = 0;    // time the last one took (not counting the wait for the end of a take)
+    uint32_t maxSwitchUs = 0;
+    uint64_t totalSwitchUs = 0;
+    uint32_t discarded = 0;       // blocks that were being read during a switch, thrown away
+    uint32_t allocations = 0;     // slice buffer allocations: only when a stream needs bigger slices than before
+
+    // what the capture costs, per second of audio: frames / SAMPLE_RATE
+    uint64_t frames = 0;          // frames taken into a recording or the stream
+    uint64_t captureUs = 0;       // converting and copying them (not the hooks, not waiting)
+    uint64_t copiedBytes = 0;     // audio copied from buffer to buffer (i2s_read included), not converted
+    uint32_t droppedBlocks = 0;   // MIC_I2S_STD: blocks dropped because the hooks still had the audio they would overwrite
+};
 
 class i2sMic
 {
 private:
+    // The capture task, created in setup() and never stopped. Callers change _command
+    // (a new generation with the wanted mode); the task picks it up after every block.
+    // MIC_I2S_STD: the I2S interrupt picks it up at every DMA buffer, _task runs the hooks.
     TaskHandle_t _task = nullptr;
+    std::atomic<uint32_t> _command{ 0 };       // generation << 2 | MicMode
+    std::atomic<bool> _processing{ false };    // the task (MIC_I2S_STD: the interrupt) is using the buffers of a block
+    std::atomic<bool> _switching{ false };     // a start/stop call is changing the mode
+#if MIC_I2S_STD
+    std::atomic<bool> _hooking{ false };       // the hook task is running the hooks of a block
+
+    i2s_chan_handle_t _rx = nullptr;
+    uint32_t _current = 0;                     // the command the interrupt serves
+    int64_t _warmupEndUs = 0;                  // blocks before this are not used (the microphone starts up)
+    bool _dropping = false;                    // the last block was dropped too (one overrun per run of them)
+
+    // Stream blocks waiting for the hook task. The samples are in the slice buffers already,
+    // the hook task runs the hooks on them there and then hands a complete slice on.
+    struct HookBlock {
+        uint32_t command;   // skipped when the mode changed since
+        uint32_t offset;    // in the slice buffer
+        uint32_t count;
+        int64_t timeUs;     // last sample
+        uint8_t select;     // slice buffer
+        bool endsSlice;
+    };
+    HookBlock _hookQueue[MIC_HOOK_QUEUE];
+    std::atomic<uint32_t> _hookHead{ 0 };      // written by the interrupt
+    std::atomic<uint32_t> _hookTail{ 0 };      // written by the hook task
+    std::atomic<uint32_t> _hookFrames{ 0 };    // frames in the queue, the interrupt may not overwrite them
+#else
+    std::atomic<bool> _inRead{ false };        // the task is in (or about to call) i2s_read
+#endif
 
-    // async state
-    volatile bool _done = false;
-    volatile uint32_t _samplesRecorded = 0;
-
-    volatile uint32_t _recLength = 0;
+    // recording state
+    std::atomic<bool> _done{ false };
+    std::atomic<uint32_t> _samplesRecorded{ 0 };
+    std::atomic<uint32_t> _recLength{ 0 };
     size_t _recTimer = 0;
 
+    MicStats _stats;
+    CaptureMeter _meter;   // block arrival of the current mode
+    portMUX_TYPE _statsLock = portMUX_INITIALIZER_UNLOCKED;
+
+    // DMA geometry and read size (see ai-workshop-capture.h), only changed while idle
+    CaptureConfig _capture;
+    int _pins[3] = { -1, -1, -1 };   // clock, word select, data
+
+    // levels of the recording and of the stream, added up per DMA block
+    LevelMeter _recordLevels;
+    LevelMeter _streamLevels;
+    portMUX_TYPE _levelLock = portMUX_INITIALIZER_UNLOCKED;
+
     // PSRAM buffer pointer
     int32_t *_psramBuffer = nullptr;
 
-    // DMA-capable buffer pointer
+#if !MIC_I2S_STD
+    // DMA-capable buffer pointer (DMA_BUFFER_SIZE frames, two samples per frame in stereo)
     int32_t *_dmaBuffer = nullptr;
 
+    // converted stream block, handed to the hooks
+    float *_blockBuffer = nullptr;
+    float *_blockBufferRight = nullptr;
+#endif
+
+    i2s_port_t _port = I2S_NUM_0;
+    MicChannels _channels = MicChannels::Mono;
+
+    struct StreamHook {
+        MicStreamHook hook = nullptr;
+        MicStereoHook stereo = nullptr;
+        void* user = nullptr;
+    };
+    StreamHook _hooks[MIC_MAX_STREAM_HOOKS];
+    volatile uint8_t _hookCount = 0;
+
     // Audio stream state (for inference)
 
     struct StreamState {
-        float* buffers[2] = { nullptr, nullptr };
-        volatile uint8_t bufferSelect = 0;
-        volatile uint32_t bufferCount = 0;
-        volatile uint8_t bufferReady = 0;
+        float* buffers[2] = { nullptr, nullptr };   // kept between streams, only grown
+        float* right[2] = { nullptr, nullptr };     // MIC_I2S_STD stereo: the right microphone, for the stereo hooks
+        uint32_t capacity = 0;                      // samples per buffer
+        std::atomic<uint8_t> bufferSelect{ 0 };     // the buffer being filled
+        uint32_t bufferCount = 0;
+        std::atomic<uint8_t> bufferReady{ 0 };
+        std::atomic<uint8_t> readySelect{ 0 };      // the buffer of the ready slice
         uint32_t sliceSamples = 0;
-        volatile bool running = false;
-        TaskHandle_t task = nullptr;
-        volatile uint32_t overruns = 0;
+        std::atomic<uint32_t> overruns{ 0 };
+        volatile int64_t endTimeUs[2] = { 0, 0 };  // esp_timer time of the last sample in each buffer
     };
 
     StreamState _stream;
 
-    // single active instance for signal.get_data 
+    // the most recently started stream, for the static getStreamData()
     static i2sMic* s_activeStreamInstance;
 
-    static void streamTask(void* parameter)
-    {
-        i2sMic* microphone = static_cast<i2sMic*>(parameter);
-        s_activeStreamInstance = microphone;
+    uint32_t channelCount() const { return _channels == MicChannels::Stereo ? 2 : 1; }
 
-        // small warmup (matches EI examples)
-        delay(50);
+    static MicMode modeOf(uint32_t command) { return (MicMode)(command & 3); }
 
-        while (microphone->_stream.running)
+#if MIC_I2S_STD
+    // on_recv of the I2S channel: once per DMA buffer, in the interrupt. Only atomics, the
+    // buffers and critical sections in here (no delay(), Serial or malloc). Not IRAM_ATTR: it
+    // writes to PSRAM, which the default (not IRAM safe) I2S interrupt may do.
+    static bool onReceive(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user)
+    {
+        i2sMic* microphone = static_cast<i2sMic*>(user);
+        const int64_t arrivalUs = esp_timer_get_time();
+        if (arrivalUs < microphone->_warmupEndUs) return false;
+
+        // ESP-IDF 5.1: event->data points at the pointer of the DMA buffer
+        const int32_t* dma = *(const int32_t**)event->data;
+        const uint32_t frames = event->size / (sizeof(int32_t) * microphone->channelCount());
+
+        // the handshake of the capture task of the legacy driver: a caller changes _command,
+        // then waits while _processing is set
+        BaseType_t woken = pdFALSE;
+        microphone->_processing.store(true);
+        uint32_t command = microphone->_command.load();
+        if (command != microphone->_current)
         {
-            size_t bytesRead = 0;
+            // most of this buffer was recorded before the switch: not for the new mode
+            microphone->_current = command;
+            if (microphone->beginMode(modeOf(command)))
+            {
+                portENTER_CRITICAL_ISR(&microphone->_statsLock);
+                microphone->_stats.discarded++;
+                portEXIT_CRITICAL_ISR(&microphone->_statsLock);
+            }
+        }
+        else if (modeOf(command) == MicMode::Streaming)
+        {
+            microphone->streamDma(dma, frames, arrivalUs, &woken);
+        }
+        else if (modeOf(command) == MicMode::Recording && !microphone->_done.load())
+        {
+            uint32_t recorded = microphone->_samplesRecorded.load(std::memory_order_relaxed);
+            uint32_t take = SAMPLE_BUFFER_SIZE - recorded < frames ? SAMPLE_BUFFER_SIZE - recorded : frames;
+            bool more = microphone->recordBlock(dma, take);
+            microphone->countBlock(arrivalUs, take, (uint32_t)(esp_timer_get_time() - arrivalUs), take * sizeof(int32_t));
+            if (!more) microphone->finishRecording();
+        }
+        microphone->_processing.store(false);
+        return woken == pdTRUE;
+    }
 
-            esp_err_t err = i2s_read(
-                I2S_NUM_0,
-                (void*)microphone->_dmaBuffer,
-                DMA_BUFFER_SIZE * sizeof(int32_t),
-                &bytesRead,
-                portMAX_DELAY
-            );
+    // Converts a DMA buffer straight into the slice buffers and queues it for the hooks
+    void streamDma(const int32_t* dma, uint32_t frames, int64_t arrivalUs, BaseType_t* woken)
+    {
+        const uint32_t channels = channelCount();
+        const uint32_t slice = _stream.sliceSamples;
+
+        // The hook task still has audio this block would overwrite (both slice buffers are in
+        // the queue), or the queue is full: drop the block, as the legacy driver drops DMA
+        // buffers when the capture task is too late.
+        uint32_t head = _hookHead.load(std::memory_order_relaxed);
+        uint32_t queued = _hookFrames.load(std::memory_order_acquire);
+        uint32_t entries = (_stream.bufferCount + frames - 1) / slice + 1;
+        if ((queued > 0 && queued + frames > 2 * slice) ||
+            head - _hookTail.load(std::memory_order_acquire) + entries > MIC_HOOK_QUEUE)
+        {
+            portENTER_CRITICAL_ISR(&_statsLock);
+            _stats.droppedBlocks++;
+            _meter.lost(frames, !_dropping);
+            portEXIT_CRITICAL_ISR(&_statsLock);
+            _dropping = true;
+            return;
+        }
+        _dropping = false;
 
-            if (!microphone->_stream.running) break;
-            if (err != ESP_OK || bytesRead == 0) continue;
+        LevelMeter blockLevels;
+        blockLevels.addRaw(dma, frames, channels);
+        portENTER_CRITICAL_ISR(&_levelLock);
+        _streamLevels.merge(blockLevels);
+        portEXIT_CRITICAL_ISR(&_levelLock);
 
-            const uint32_t samplesRead = bytesRead / sizeof(int32_t);
+        uint32_t done = 0;
+        while (done < frames)
+        {
+            uint8_t select = _stream.bufferSelect.load(std::memory_order_relaxed);
+            uint32_t offset = _stream.bufferCount;
+            uint32_t count = frames - done < slice - offset ? frames - done : slice - offset;
+            float* left = _stream.buffers[select] + offset;
+            // acquire: a consumed slice was read before this buffer is filled again
+            // (overruns are counted when the hook task hands the next slice on)
+            if (offset == 0) _stream.bufferReady.load(std::memory_order_acquire);
+            if (channels == 2)
+            {
+                deinterleave(dma + 2 * done, left, _stream.right[select] + offset, count);
+            }
+            else
+            {
+                convertMono(dma + done, left, count);
+            }
+            done += count;
+
+            HookBlock& block = _hookQueue[head++ % MIC_HOOK_QUEUE];
+            block.command = _current;
+            block.offset = offset;
+            block.count = count;
+            block.timeUs = arrivalUs - (int64_t)(frames - done) * 1000000LL / SAMPLE_RATE;
+            block.select = select;
+            block.endsSlice = offset + count >= slice;
+
+            _stream.bufferCount = offset + count;
+            if (block.endsSlice)
+            {
+                _stream.bufferSelect.store(select ^ 1, std::memory_order_relaxed);
+                _stream.bufferCount = 0;
+            }
+        }
+        _hookFrames.fetch_add(frames, std::memory_order_relaxed);
+        _hookHead.store(head, std::memory_order_release);
+
+        countBlock(arrivalUs, frames, (uint32_t)(esp_timer_get_time() - arrivalUs), 0);
+        vTaskNotifyGiveFromISR(_task, woken);
+    }
+
+    // Runs the hooks on the stream blocks the interrupt queued
+    static void hookTask(void* parameter)
+    {
+        AIW_TRACE_TASK("MicHooks");
+        i2sMic* microphone = static_cast<i2sMic*>(parameter);
+        const uint32_t channels = microphone->channelCount();
+        uint32_t tail = 0;
 
-            float* activeBuffer = (microphone->_stream.bufferSelect == 0)
-                ? microphone->_stream.buffers[0]
-                : microphone->_stream.buffers[1];
-                        
-            for (uint32_t i = 0; i < samplesRead; i++)
+        while (true)
+        {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            while (tail != microphone->_hookHead.load(std::memory_order_acquire))
             {
-                activeBuffer[microphone->_stream.bufferCount++] = (float) (clip(microphone->_dmaBuffer[i] / 4096));
+                const HookBlock& block = microphone->_hookQueue[tail % MIC_HOOK_QUEUE];
 
-                if (microphone->_stream.bufferCount >= microphone->_stream.sliceSamples)
+                // the same handshake as _processing: a stop either waits for these hooks or
+                // the block is skipped
+                microphone->_hooking.store(true);
+                if (block.command == microphone->_command.load())
                 {
-                    // if consumer didn’t take the previous slice yet, we drop/overwrite and count it
-                    if (microphone->_stream.bufferReady == 1) {
-                        microphone->_stream.overruns++;
-                    }
+                    float* left = microphone->_stream.buffers[block.select] + block.offset;
+                    float* right = channels == 2 ? microphone->_stream.right[block.select] + block.offset : nullptr;
+                    microphone->callHooks(left, right, block.count, block.timeUs);
+                    if (block.endsSlice) microphone->publishSlice(block.select, block.timeUs);
+                }
+                microphone->_hooking.store(false);
+
+                // release: the interrupt overwrites these samples only after the hooks are done
+                microphone->_hookFrames.fetch_sub(block.count, std::memory_order_release);
+                microphone->_hookTail.store(++tail, std::memory_order_release);
+            }
+        }
+    }
+#else
+    static void captureTask(void* parameter)
+    {
+        AIW_TRACE_TASK("MicCapture");
+        i2sMic* microphone = static_cast<i2sMic*>(parameter);
+        const uint32_t channels = microphone->channelCount();
+        uint32_t current = 0;   // the command being served
+        bool reading = false;
 
-                    microphone->_stream.bufferSelect ^= 1;
-                    microphone->_stream.bufferCount = 0;
-                    microphone->_stream.bufferReady = 1;
+        // small warmup after the microphone got its clock (matches EI examples), once
+        delay(50);
 
-                    activeBuffer = (microphone->_stream.bufferSelect == 0) ? microphone->_stream.buffers[0] : microphone->_stream.buffers[1];
+        while (true)
+        {
+            if (!reading)
+            {
+                // idle, or the take is complete: sleep until a start call
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+                uint32_t command = microphone->_command.load();
+                if (command != current)
+                {
+                    current = command;
+                    reading = microphone->beginMode(modeOf(command));
                 }
+                continue;
+            }
+
+            // setCapture() reinstalls the driver: it changes _command first, then waits
+            // while _inRead is set (the same handshake as _processing below)
+            microphone->_inRead.store(true);
+            if (microphone->_command.load() != current)
+            {
+                microphone->_inRead.store(false);
+                current = microphone->_command.load();
+                reading = microphone->beginMode(modeOf(current));
+                continue;
+            }
+
+            uint32_t frames = microphone->_capture.readFrames;
+            uint32_t recorded = microphone->_samplesRecorded.load(std::memory_order_relaxed);
+            if (modeOf(current) == MicMode::Recording && SAMPLE_BUFFER_SIZE - recorded < frames)
+                frames = SAMPLE_BUFFER_SIZE - recorded;
+
+            size_t bytesRead = 0;
+            esp_err_t err = i2s_read(microphone->_port, (void*)microphone->_dmaBuffer,
+                                     frames * channels * sizeof(int32_t), &bytesRead, portMAX_DELAY);
+            // i2s_read returns when the last sample of the block came in
+            const int64_t arrivalUs = esp_timer_get_time();
+            microphone->_inRead.store(false);
+
+            // A caller first changes _command, then waits while _processing is set. Here it
+            // is the other way round, so either the caller waits for this block or this
+            // block sees the new command.
+            microphone->_processing.store(true);
+            uint32_t command = microphone->_command.load();
+            if (command != current)
+            {
+                // the block was (partly) read before the switch: not for the new mode
+                microphone->_processing.store(false);
+                portENTER_CRITICAL(&microphone->_statsLock);
+                microphone->_stats.discarded++;
+                portEXIT_CRITICAL(&microphone->_statsLock);
+                current = command;
+                reading = microphone->beginMode(modeOf(command));
+                continue;
             }
-        }
 
-        microphone->_stream.task = nullptr;
-        vTaskDelete(nullptr);
-    }        
+            const uint32_t framesRead = bytesRead / (sizeof(int32_t) * channels);
+            const bool ok = err == ESP_OK && framesRead > 0;
+            uint32_t hookUs = 0;
+            if (modeOf(current) == MicMode::Streaming)
+            {
+                if (ok) hookUs = microphone->streamBlock(framesRead, arrivalUs);
+            }
+            else if (!ok || !microphone->recordBlock(microphone->_dmaBuffer, framesRead))
+            {
+                microphone->finishRecording();
+                reading = false;
+            }
+            // i2s_read copied the block out of the DMA buffers, then into the slice or the take
+            if (ok) microphone->countBlock(arrivalUs, framesRead, (uint32_t)(esp_timer_get_time() - arrivalUs) - hookUs,
+                                           (uint32_t)bytesRead + framesRead * sizeof(int32_t));
+            microphone->_processing.store(false);
+        }
+    }
 
-    static void recordTask(void *parameter)
+    // One block of the stream: convert, hooks, into the slice. Returns the time in the hooks.
+    uint32_t streamBlock(uint32_t samplesRead, int64_t blockTimeUs)
     {
-        i2sMic *_mic = static_cast<i2sMic *>(parameter);
-        
-        uint32_t samplesRecorded = 0;
+        const uint32_t channels = channelCount();
+        AIW_TRACE_SCOPE("mic block");
+
+        // levels of the block (left microphone), while it is still in internal memory
+        LevelMeter blockLevels;
+        blockLevels.addRaw(_dmaBuffer, samplesRead, channels);
+        portENTER_CRITICAL(&_levelLock);
+        _streamLevels.merge(blockLevels);
+        portEXIT_CRITICAL(&_levelLock);
+
+        float* block = _blockBuffer;
+        float* right = _blockBufferRight;
+        if (channels == 2)
+        {
+            deinterleave(_dmaBuffer, block, right, samplesRead);
+        }
+        else
+        {
+            convertMono(_dmaBuffer, block, samplesRead);
+        }
+
+        int64_t hooksUs = esp_timer_get_time();
+        callHooks(block, right, samplesRead, blockTimeUs);
+        hooksUs = esp_timer_get_time() - hooksUs;
+
+        uint8_t select = _stream.bufferSelect.load(std::memory_order_relaxed);
+        float* activeBuffer = _stream.buffers[select];
 
-        while (samplesRecorded < SAMPLE_BUFFER_SIZE)
+        for (uint32_t i = 0; i < samplesRead; i++)
         {
-            size_t bytes_read = 0;
-            uint32_t samplesToRead = SAMPLE_BUFFER_SIZE - samplesRecorded;
-            if (samplesToRead > DMA_BUFFER_SIZE)
-                samplesToRead = DMA_BUFFER_SIZE;
+            activeBuffer[_stream.bufferCount++] = block[i];
 
-            esp_err_t err = i2s_read(I2S_NUM_0, _mic->_dmaBuffer, sizeof(int32_t) * samplesToRead, &bytes_read, portMAX_DELAY);
-    
-            if (err != ESP_OK || bytes_read == 0)
+            if (_stream.bufferCount >= _stream.sliceSamples)
             {
-                break;
+                publishSlice(select, blockTimeUs - (int64_t)(samplesRead - 1 - i) * 1000000LL / SAMPLE_RATE);
+
+                select ^= 1;
+                _stream.bufferSelect.store(select, std::memory_order_relaxed);
+                _stream.bufferCount = 0;
+
+                activeBuffer = _stream.buffers[select];
             }
+        }
+        return (uint32_t)hooksUs;
+    }
+#endif
 
-            std::memcpy((uint8_t *)_mic->_psramBuffer + samplesRecorded * sizeof(int32_t),
-                        (const uint8_t *)_mic->_dmaBuffer,
-                        bytes_read);
+    // On the capture task (MIC_I2S_STD: the interrupt), when it takes up a new mode. False: nothing to read.
+    bool beginMode(MicMode mode)
+    {
+        if (mode == MicMode::Idle) return false;
+#if MIC_I2S_STD
+        // every DMA buffer is handed over as it completes: nothing queued to flush
+        _dropping = false;
+        portENTER_CRITICAL_ISR(&_statsLock);
+        _meter.start(_capture, SAMPLE_RATE);
+        portEXIT_CRITICAL_ISR(&_statsLock);
+#else
+        // Flush the audio queued so far so the new mode starts "now"
+        i2s_zero_dma_buffer(_port);
+        portENTER_CRITICAL(&_statsLock);
+        _meter.start(_capture, SAMPLE_RATE);
+        portEXIT_CRITICAL(&_statsLock);
+#endif
+        return true;
+    }
 
-            samplesRecorded += bytes_read / sizeof(int32_t);
+    void callHooks(float* left, float* right, uint32_t count, int64_t timeUs)
+    {
+        AIW_TRACE_BEGIN("mic hooks");
+        for (uint8_t h = 0; h < _hookCount; h++)
+        {
+            const StreamHook& hook = _hooks[h];
+            if (hook.hook) hook.hook(left, count, timeUs, hook.user);
+            if (hook.stereo && right) hook.stereo(left, right, count, timeUs, hook.user);
         }
+        AIW_TRACE_END("mic hooks");
+    }
 
-        // Check if already stopped
-        if (_mic->_recLength == 0) {
-            _mic->_recLength = (uint32_t)((samplesRecorded * 1000ULL) / SAMPLE_RATE);  
+    // The slice in buffers[select] is complete (hooks done): hand it to the consumer
+    void publishSlice(uint8_t select, int64_t endTimeUs)
+    {
+        // if consumer didn’t take the previous slice yet, we drop/overwrite and count it
+        // (acquire: a consumed slice was read before the next one overwrites its buffer)
+        if (_stream.bufferReady.load(std::memory_order_acquire) == 1) {
+            _stream.overruns.fetch_add(1, std::memory_order_relaxed);
+            AIW_TRACE_COUNTER("mic overruns", _stream.overruns.load(std::memory_order_relaxed));
         }
 
-        _mic->_samplesRecorded = samplesRecorded;
-        _mic->_done = true;
-        _mic->_task = nullptr;
+        _stream.endTimeUs[select] = endTimeUs;
+        _stream.readySelect.store(select, std::memory_order_relaxed);
+        _stream.bufferReady.store(1, std::memory_order_release);
 
-        vTaskDelete(nullptr);
+        if (eventBus().wants(EventType::SliceReady)) {
+            Event event(EventType::SliceReady, EventSource::Mic, endTimeUs);
+            event.value = _stream.sliceSamples;
+            eventBus().publish(event);
+        }
+    }
+
+    // One block of a recording (raw samples, framesRead of them fit). False when the buffer is full.
+    bool recordBlock(const int32_t* raw, uint32_t framesRead)
+    {
+        const uint32_t channels = channelCount();
+        uint32_t samplesRecorded = _samplesRecorded.load(std::memory_order_relaxed);
+
+        // levels of the block, only up to where stopRecording() cut the take
+        uint32_t recLength = _recLength.load();
+        uint32_t takeEnd = recLength ? recLength * (SAMPLE_RATE / 1000) : SAMPLE_BUFFER_SIZE;
+        if (samplesRecorded < takeEnd)
+        {
+            uint32_t frames = takeEnd - samplesRecorded < framesRead ? takeEnd - samplesRecorded : framesRead;
+            _recordLevels.addRaw(raw, frames, channels);
+        }
+
+        if (channels == 1)
+        {
+            std::memcpy(_psramBuffer + samplesRecorded, raw, framesRead * sizeof(int32_t));
+        }
+        else
+        {
+            // recordings stay mono: keep the left microphone
+            int32_t* out = _psramBuffer + samplesRecorded;
+            for (uint32_t i = 0; i < framesRead; i++) out[i] = raw[2 * i];
+        }
+
+        samplesRecorded += framesRead;
+        _samplesRecorded.store(samplesRecorded, std::memory_order_relaxed);
+
+        // a take fills the whole buffer, also when it was stopped: getRecordedSamples() is
+        // SAMPLE_BUFFER_SIZE and the take is the first getRecordedLengthMs() of it
+        return samplesRecorded < SAMPLE_BUFFER_SIZE;
+    }
+
+    void finishRecording()
+    {
+        // not stopped: the take is as long as the buffer (or what the microphone gave)
+        uint32_t notStopped = 0;
+        _recLength.compare_exchange_strong(notStopped, (uint32_t)((_samplesRecorded.load() * 1000ULL) / SAMPLE_RATE));
+        _done.store(true);
+    }
+
+    // A block that went into the take or the stream: its arrival and what it cost
+    void countBlock(int64_t arrivalUs, uint32_t frames, uint32_t captureUs, uint32_t copiedBytes)
+    {
+        portENTER_CRITICAL_SAFE(&_statsLock);
+        _meter.block(arrivalUs, frames);
+        _stats.frames += frames;
+        _stats.captureUs += captureUs;
+        _stats.copiedBytes += copiedBytes;
+        portEXIT_CRITICAL_SAFE(&_statsLock);
     }
 
+    // Start/stop calls from more than one task take turns
+    void lockModes()
+    {
+        while (_switching.exchange(true, std::memory_order_acquire)) delay(1);
+    }
+
+    void unlockModes() { _switching.store(false, std::memory_order_release); }
+
+    // Hands the capture task a new mode and waits until it no longer uses the buffers of
+    // the old one: at most the processing of one block, not the i2s_read in progress (a
+    // block read during the switch is thrown away). MIC_I2S_STD: at most one DMA buffer in
+    // the interrupt and the hooks of one block.
+    void setMode(MicMode mode)
+    {
+        uint32_t command = _command.load();
+        _command.store((((command >> 2) + 1) << 2) | (uint32_t)mode);
+#if MIC_I2S_STD
+        while (_processing.load() || _hooking.load()) delay(1);
+#else
+        while (_processing.load()) delay(1);
+        if (mode != MicMode::Idle) xTaskNotifyGive(_task);
+#endif
+    }
+
+    void countSwitch(int64_t startUs)
+    {
+        uint32_t us = (uint32_t)(esp_timer_get_time() - startUs);
+        portENTER_CRITICAL(&_statsLock);
+        _stats.switches++;
+        _stats.lastSwitchUs = us;
+        if (us > _stats.maxSwitchUs) _stats.maxSwitchUs = us;
+        _stats.totalSwitchUs += us;
+        portEXIT_CRITICAL(&_statsLock);
+    }
+
+    // The mode the capture task serves (a complete take counts as idle)
+    MicMode currentMode() const
+    {
+        MicMode mode = modeOf(_command.load());
+        if (mode == MicMode::Recording && _done.load()) return MicMode::Idle;
+        return mode;
+    }
+
+#if MIC_I2S_STD
+    bool installDriver()
+    {
+        i2s_chan_config_t channel = I2S_CHANNEL_DEFAULT_CONFIG(_port, I2S_ROLE_MASTER);
+        channel.dma_desc_num = _capture.dmaBufCount;
+        channel.dma_frame_num = _capture.dmaBufLen;
+        if (i2s_new_channel(&channel, NULL, &_rx) != ESP_OK) return false;
+
+        i2s_std_config_t config = {
+            .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(SAMPLE_RATE),
+            .slot_cfg = I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_32BIT,
+                            _channels == MicChannels::Stereo ? I2S_SLOT_MODE_STEREO : I2S_SLOT_MODE_MONO),
+            .gpio_cfg = {
+                .mclk = I2S_GPIO_UNUSED,
+                .bclk = (gpio_num_t)_pins[0],
+                .ws = (gpio_num_t)_pins[1],
+                .dout = I2S_GPIO_UNUSED,
+                .din = (gpio_num_t)_pins[2],
+                .invert_flags = { .mclk_inv = false, .bclk_inv = false, .ws_inv = false },
+            },
+        };
+        if (_channels == MicChannels::Mono) config.slot_cfg.slot_mask = I2S_STD_SLOT_LEFT;
+
+        i2s_event_callbacks_t callbacks = {
+            .on_recv = onReceive,
+            .on_recv_q_ovf = nullptr,   // nobody calls i2s_channel_read: its queue overflows, harmless
+            .on_sent = nullptr,
+            .on_send_q_ovf = nullptr,
+        };
+
+        _warmupEndUs = esp_timer_get_time() + 50000;   // the same warmup as the capture task
+        if (i2s_channel_init_std_mode(_rx, &config) != ESP_OK ||
+            i2s_channel_register_event_callback(_rx, &callbacks, this) != ESP_OK ||
+            i2s_channel_enable(_rx) != ESP_OK)
+        {
+            i2s_del_channel(_rx);
+            _rx = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+    void removeDriver()
+    {
+        i2s_channel_disable(_rx);
+        i2s_del_channel(_rx);
+        _rx = nullptr;
+    }
+#else
+    bool installDriver()
+    {
+        i2s_config_t i2s_config = {
+            .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX),
+            .sample_rate = SAMPLE_RATE,
+            .bits_per_sample = I2S_BITS_PER_SAMPLE_32BIT,
+            .channel_format = (_channels == MicChannels::Stereo) ? I2S_CHANNEL_FMT_RIGHT_LEFT : I2S_CHANNEL_FMT_ONLY_LEFT,
+            .communication_format = I2S_COMM_FORMAT_STAND_I2S,
+            .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
+            .dma_buf_count = _capture.dmaBufCount,
+            .dma_buf_len = _capture.dmaBufLen,
+            .use_apll = false,
+            .tx_desc_auto_clear = false,
+            .fixed_mclk = 0,
+        };
+
+        if (i2s_driver_install(_port, &i2s_config, 0, NULL) != ESP_OK) return false;
+
+        i2s_pin_config_t i2s_mic_pins = {
+            .bck_io_num = _pins[0],
+            .ws_io_num = _pins[1],
+            .data_out_num = I2S_PIN_NO_CHANGE,
+            .data_in_num = _pins[2]};
+
+        i2s_set_pin(_port, &i2s_mic_pins);
+        return true;
+    }
+
+    void removeDriver() { i2s_driver_uninstall(_port); }
+#endif
+
 public:
 
     int32_t *data = nullptr;
 
+    // Conversion of DMA blocks, used by the capture tasks (public for tools/host/bench.cpp).
+    static inline float toSample(int32_t raw)
+    {
+        return (float) (clip(raw / 4096));
+    }
+
+    // 32 bit mono DMA samples -> 16 bit values as float.
+    // Unrolled by 4 so the loads and conversions of neighbouring samples can overlap.
+    static void convertMono(const int32_t* in, float* out, uint32_t frames)
+    {
+        uint32_t i = 0;
+        for (; i + 4 <= frames; i += 4)
+        {
+            out[i] = toSample(in[i]);
+            out[i + 1] = toSample(in[i + 1]);
+            out[i + 2] = toSample(in[i + 2]);
+            out[i + 3] = toSample(in[i + 3]);
+        }
+        for (; i < frames; i++) out[i] = toSample(in[i]);
+    }
+
+    // Interleaved stereo frames (left, right, left, right, ...) -> two channel blocks, unrolled by 2 frames.
+    static void deinterleave(const int32_t* in, float* left, float* right, uint32_t frames)
+    {
+        uint32_t i = 0;
+        for (; i + 2 <= frames; i += 2)
+        {
+            int32_t l0 = in[2 * i], r0 = in[2 * i + 1];
+            int32_t l1 = in[2 * i + 2], r1 = in[2 * i + 3];
+            left[i] = toSample(l0);
+            right[i] = toSample(r0);
+            left[i + 1] = toSample(l1);
+            right[i + 1] = toSample(r1);
+        }
+        for (; i < frames; i++)
+        {
+            left[i] = toSample(in[2 * i]);
+            right[i] = toSample(in[2 * i + 1]);
+        }
+    }
+
     // Constructor
     i2sMic() {}
 
-    bool setup(int clockPin, int wordSelectPin, int channelSelectPin)
+    // port: use I2S_NUM_1 for a second microphone (pair).
+    // channels: Stereo reads two microphones on one data line (both channels in one DMA stream).
+    // capture: DMA buffers and read size, e.g. CaptureConfig::forProfile(CaptureProfile::LowLatency)
+    // (or let autoTune() pick one later).
+    bool setup(int clockPin, int wordSelectPin, int channelSelectPin,
+               i2s_port_t port = I2S_NUM_0, MicChannels channels = MicChannels::Mono,
+               const CaptureConfig& capture = CaptureConfig())
     {
+        _port = port;
+        _channels = channels;
+        _pins[0] = clockPin;
+        _pins[1] = wordSelectPin;
+        _pins[2] = channelSelectPin;
+        if (!capture.valid(channelCount()) || capture.readFrames > DMA_BUFFER_SIZE)
+        {
+            Serial.println("ERR: i2sMic capture config not possible");
+            return false;
+        }
+        _capture = capture;
 
         _psramBuffer = (int32_t *)heap_caps_malloc(
             sizeof(int32_t) * SAMPLE_BUFFER_SIZE,
@@ -164,8 +773,9 @@ public:
 
         data = _psramBuffer;
 
+#if !MIC_I2S_STD
         _dmaBuffer = (int32_t *)heap_caps_malloc(
-            (size_t)DMA_BUFFER_SIZE * sizeof(int32_t),
+            (size_t)DMA_BUFFER_SIZE * channelCount() * sizeof(int32_t),
             MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA | MALLOC_CAP_8BIT);
         
         if (!_dmaBuffer)
@@ -174,120 +784,244 @@ public:
             return false;
         }
 
-        i2s_config_t i2s_config = {
-            .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX),
-            .sample_rate = SAMPLE_RATE,
-            .bits_per_sample = I2S_BITS_PER_SAMPLE_32BIT,
-            .channel_format = I2S_CHANNEL_FMT_ONLY_LEFT,
-            .communication_format = I2S_COMM_FORMAT_STAND_I2S,
-            .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
-            .dma_buf_count = 8,
-            .dma_buf_len = 128,
-            .use_apll = false,
-            .tx_desc_auto_clear = false,
-            .fixed_mclk = 0,
-        };
+        _blockBuffer = (float *)heap_caps_malloc(
+            (size_t)DMA_BUFFER_SIZE * sizeof(float),
+            MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
 
-        i2s_driver_install(I2S_NUM_0, &i2s_config, 0, NULL);
+        if (_channels == MicChannels::Stereo)
+        {
+            _blockBufferRight = (float *)heap_caps_malloc(
+                (size_t)DMA_BUFFER_SIZE * sizeof(float),
+                MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        }
 
-        i2s_pin_config_t i2s_mic_pins = {
-            .bck_io_num = clockPin,
-            .ws_io_num = wordSelectPin,
-            .data_out_num = I2S_PIN_NO_CHANGE,
-            .data_in_num = channelSelectPin};
+        if (!_blockBuffer || (_channels == MicChannels::Stereo && !_blockBufferRight))
+        {
+            Serial.println("ERR: i2sMic block alloc failed");
+            return false;
+        }
+#endif
+
+        if (!installDriver())
+        {
+            Serial.println("ERR: i2sMic I2S driver install failed");
+            return false;
+        }
 
-        i2s_set_pin(I2S_NUM_0, &i2s_mic_pins);
+#if MIC_I2S_STD
+        // the interrupt fills the takes and the slices, a task runs the stream hooks
+        if (pdPASS != xTaskCreatePinnedToCore(hookTask, "MicHooks", 1024 * 8, this, 10, &_task, 0))
+        {
+            _task = nullptr;
+            Serial.println("ERR: i2sMic hook task failed");
+            return false;
+        }
+#else
+        // one capture task for recordings and the stream, waiting for a start call
+        if (pdPASS != xTaskCreatePinnedToCore(captureTask, "MicCapture", 1024 * 8, this, 10, &_task, 0))
+        {
+            _task = nullptr;
+            Serial.println("ERR: i2sMic capture task failed");
+            return false;
+        }
+#endif
 
         return true;
     }
-    bool startStream(uint32_t sliceSamples)
-    {
-        if (_task != nullptr) return false;          // don’t infer while recording task runs
-        if (_stream.running) return false;
-        if (!_dmaBuffer) return false;
-        if (sliceSamples == 0) return false;
 
-        _stream.sliceSamples = sliceSamples;
-        _stream.bufferSelect = 0;
-        _stream.bufferCount = 0;
-        _stream.bufferReady = 0;
-        _stream.overruns = 0;
-        
-        _stream.buffers[0] = (float*)malloc(_stream.sliceSamples * sizeof(float));
-        _stream.buffers[1] = (float*)malloc(_stream.sliceSamples * sizeof(float));
-        
-        if (!_stream.buffers[0] || !_stream.buffers[1]) {
-            if (_stream.buffers[0]) { free(_stream.buffers[0]); _stream.buffers[0] = nullptr; }
-            if (_stream.buffers[1]) { free(_stream.buffers[1]); _stream.buffers[1] = nullptr; }
+    // Give the stream its slice buffers up front (e.g. in setup()), so that no start after
+    // this one allocates. startStream() does it too for a bigger slice size than before.
+    bool reserveStream(uint32_t sliceSamples)
+    {
+        if (sliceSamples <= _stream.capacity) return true;
+        if (currentMode() == MicMode::Streaming) return false;   // the task writes into them
+
+        // MIC_I2S_STD stereo: the right microphone too, the interrupt converts into them
+        const bool right = MIC_I2S_STD && _channels == MicChannels::Stereo;
+        float* buffers[4] = {
+            (float*)malloc(sliceSamples * sizeof(float)),
+            (float*)malloc(sliceSamples * sizeof(float)),
+            right ? (float*)malloc(sliceSamples * sizeof(float)) : nullptr,
+            right ? (float*)malloc(sliceSamples * sizeof(float)) : nullptr,
+        };
+        if (!buffers[0] || !buffers[1] || (right && (!buffers[2] || !buffers[3]))) {
+            for (float* buffer : buffers) free(buffer);
+            Serial.println("ERR: i2sMic stream alloc failed");
             return false;
         }
+        for (int b = 0; b < 2; b++) {
+            free(_stream.buffers[b]);
+            free(_stream.right[b]);
+            _stream.buffers[b] = buffers[b];
+            _stream.right[b] = buffers[2 + b];
+        }
+        _stream.capacity = sliceSamples;
+        portENTER_CRITICAL(&_statsLock);
+        _stats.allocations++;
+        portEXIT_CRITICAL(&_statsLock);
+        return true;
+    }
 
-        i2s_zero_dma_buffer(I2S_NUM_0);
-
-        _stream.running = true;
-        if (pdPASS != xTaskCreatePinnedToCore(
-                streamTask,
-                "MicStreamCapture",
-                1024 * 8,
-                this,
-                10,
-                &_stream.task,
-                0))
-        {
-            _stream.running = false;
-            free(_stream.buffers[0]); _stream.buffers[0] = nullptr;
-            free(_stream.buffers[1]); _stream.buffers[1] = nullptr;
+    // Fails while a recording runs: stopRecording() first.
+    bool startStream(uint32_t sliceSamples)
+    {
+        if (_task == nullptr || sliceSamples == 0) return false;
+
+        int64_t startUs = esp_timer_get_time();
+        lockModes();
+        MicMode mode = currentMode();
+        if (mode != MicMode::Idle) {
+            unlockModes();
+            return false;   // streaming already, or recording
+        }
+        if (!reserveStream(sliceSamples)) {
+            unlockModes();
             return false;
         }
 
+        _stream.sliceSamples = sliceSamples;
+        _stream.bufferSelect.store(0);
+        _stream.bufferCount = 0;
+        _stream.bufferReady.store(0);
+        _stream.overruns.store(0);
+        getStreamLevels();
+
+        s_activeStreamInstance = this;
+        setMode(MicMode::Streaming);
+        unlockModes();
+        countSwitch(startUs);
         return true;
     }
 
     // Blocking: waits for next slice and consumes it.
     bool waitForStream()
     {
-        while (_stream.bufferReady == 0) {
+        while (_stream.bufferReady.load(std::memory_order_acquire) == 0) {
             delay(1);
         }
-        _stream.bufferReady = 0;
+        _stream.bufferReady.store(0, std::memory_order_release);
         return true;
     }
 
-    bool isStreamReady() const { return _stream.bufferReady == 1; }
-    void consumeStream() { _stream.bufferReady = 0; }
+    // Add hooks before startStream(), they are not locked against the capture task.
+    bool addStreamHook(MicStreamHook hook, void* user = nullptr)
+    {
+        if (hook == nullptr || _hookCount >= MIC_MAX_STREAM_HOOKS) return false;
+        _hooks[_hookCount].hook = hook;
+        _hooks[_hookCount].stereo = nullptr;
+        _hooks[_hookCount].user = user;
+        _hookCount++;
+        return true;
+    }
 
-    uint32_t getStreamOverruns() const { return _stream.overruns; }
+    // Stereo hooks only run when the microphone was set up with MicChannels::Stereo.
+    bool addStereoHook(MicStereoHook hook, void* user = nullptr)
+    {
+        if (hook == nullptr || _hookCount >= MIC_MAX_STREAM_HOOKS) return false;
+        _hooks[_hookCount].hook = nullptr;
+        _hooks[_hookCount].stereo = hook;
+        _hooks[_hookCount].user = user;
+        _hookCount++;
+        return true;
+    }
 
-    static int getStreamData(size_t offset, size_t length, float* out_ptr)
+    void removeStreamHook(MicStreamHook hook, void* user = nullptr)
     {
-        if (!s_activeStreamInstance) return -1;
-        float* readyBuffer = s_activeStreamInstance->_stream.buffers[s_activeStreamInstance->_stream.bufferSelect ^ 1];
+        removeHook(hook, nullptr, user);
+    }
+
+    void removeStereoHook(MicStereoHook hook, void* user = nullptr)
+    {
+        removeHook(nullptr, hook, user);
+    }
+
+    void removeHook(MicStreamHook hook, MicStereoHook stereo, void* user)
+    {
+        for (uint8_t h = 0; h < _hookCount; h++)
+        {
+            if (_hooks[h].hook == hook && _hooks[h].stereo == stereo && _hooks[h].user == user)
+            {
+                for (uint8_t k = h + 1; k < _hookCount; k++) _hooks[k - 1] = _hooks[k];
+                _hookCount--;
+                return;
+            }
+        }
+    }
+
+    bool isStreamReady() const { return _stream.bufferReady.load(std::memory_order_acquire) == 1; }
+    void consumeStream() { _stream.bufferReady.store(0, std::memory_order_release); }
+
+    uint32_t getStreamOverruns() const { return _stream.overruns.load(std::memory_order_relaxed); }
+
+    // Levels of the stream since the last call (with reset) or since startStream()
+    TakeStats getStreamLevels(bool reset = true)
+    {
+        portENTER_CRITICAL(&_levelLock);
+        LevelMeter levels = _streamLevels;
+        if (reset) _streamLevels.reset();
+        portEXIT_CRITICAL(&_levelLock);
+        return levels.stats();
+    }
+
+    bool isStereo() const { return _channels == MicChannels::Stereo; }
+    i2s_port_t getPort() const { return _port; }
+
+    // Copies samples of the ready slice. With more than one microphone, hand this to the
+    // classifier with a lambda: signal.get_data = [](size_t o, size_t l, float* p) { return mic2.readStream(o, l, p); };
+    int readStream(size_t offset, size_t length, float* out_ptr) const
+    {
+        float* readyBuffer = _stream.buffers[_stream.readySelect.load(std::memory_order_relaxed)];
+        if (!readyBuffer) return -1;
         memcpy(out_ptr, &readyBuffer[offset], length * sizeof(float));
 
         return 0;
     }
 
-    void stopStream()
+    // For signal.get_data: reads the most recently started stream.
+    static int getStreamData(size_t offset, size_t length, float* out_ptr)
     {
-        _stream.running = false;
-
-        if (_stream.buffers[0]) { free(_stream.buffers[0]); _stream.buffers[0] = nullptr; }
-        if (_stream.buffers[1]) { free(_stream.buffers[1]); _stream.buffers[1] = nullptr; }
+        if (!s_activeStreamInstance) return -1;
+        return s_activeStreamInstance->readStream(offset, length, out_ptr);
+    }
 
-        _stream.bufferReady = 0;
-        _stream.bufferCount = 0;
+    // Returns when the capture task no longer writes into the slices (the buffers are kept
+    // for the next startStream()).
+    void stopStream()
+    {
+        int64_t startUs = esp_timer_get_time();
+        lockModes();
+        if (modeOf(_command.load()) != MicMode::Streaming) {
+            unlockModes();
+            return;
+        }
+        setMode(MicMode::Idle);
+        _stream.bufferReady.store(0);
         _stream.sliceSamples = 0;
+        unlockModes();
+        countSwitch(startUs);
     }
 
     uint32_t getStreamSize() const {
         return _stream.sliceSamples;
     }
 
+    // esp_timer time (microseconds) of the first and last sample of the ready slice,
+    // use it to line up other sensors (e.g. LightSensors::average) with the audio.
+    int64_t getStreamTimeUs() const {
+        return _stream.endTimeUs[_stream.readySelect.load(std::memory_order_relaxed)];
+    }
+
+    int64_t getStreamStartTimeUs() const {
+        return getStreamTimeUs() - (int64_t)_stream.sliceSamples * 1000000LL / SAMPLE_RATE;
+    }
+
     bool isRecordDone()
     {
-        return _done;
+        return _done.load();
     }
 
+    MicMode getMode() const { return currentMode(); }
+
     int getRecordedSamples()
     {
         return _samplesRecorded;
@@ -303,7 +1037,16 @@ public:
         return _psramBuffer;
     }
 
+    // Levels of the last recording (the part up to stopRecording()), measured while recording.
+    // Check a take before it goes to the SD card: judgeTake(mic.getRecordedLevels())
+    TakeStats getRecordedLevels()
+    {
+        if (!_done.load()) return TakeStats();
+        return _recordLevels.stats();
+    }
+
 
+    // The take ends now (getRecordedLengthMs()). Waits until the buffer is full, then the microphone is idle.
     bool stopRecording()
     {
         // Never started
@@ -312,47 +1055,194 @@ public:
         }
 
         uint32_t t = (uint32_t)(millis() - _recTimer);
-        uint32_t maxMs = (uint32_t)((SAMPLE_BUFFER_SIZE * 1000ULL) / SAMPLE_RATE);        
+        uint32_t maxMs = (uint32_t)((SAMPLE_BUFFER_SIZE * 1000ULL) / SAMPLE_RATE);
         if (t > maxMs) t = maxMs;
+        if (t == 0) t = 1;
 
         // Check if already stopped
-        if (_recLength == 0) {
-            _recLength = t;
-        }
+        uint32_t notStopped = 0;
+        _recLength.compare_exchange_strong(notStopped, t);
 
-        // not recording or finished
-        if (_task == nullptr) {
-            return _done; 
+        // not recording (or the take was complete already)
+        if (modeOf(_command.load()) != MicMode::Recording) {
+            return _done.load();
         }
 
-        // wait for task to finish
-        while (!_done)
+        // wait for the capture task to fill the buffer
+        while (!_done.load())
         {
-            delay(10);
+            delay(1);
         }
+
+        int64_t startUs = esp_timer_get_time();
+        lockModes();
+        if (modeOf(_command.load()) == MicMode::Recording) setMode(MicMode::Idle);
+        unlockModes();
+        countSwitch(startUs);
         return true;
     }
 
+    // Fails while streaming: stopStream() first.
     bool startRecording()
     {
-        if (_task != nullptr)
-            return false; // already recording
+        if (_task == nullptr) return false;
 
-        _samplesRecorded = 0;
-        _recLength = 0;
-        _done = false;
+        int64_t startUs = esp_timer_get_time();
+        lockModes();
+        if (currentMode() != MicMode::Idle) {
+            unlockModes();
+            return false;   // already recording, or streaming
+        }
+        // a complete take: make sure the task is done with it before it is reset
+        if (modeOf(_command.load()) != MicMode::Idle) setMode(MicMode::Idle);
 
-        // Flush any queued audio so the recording starts "now"
-        i2s_zero_dma_buffer(I2S_NUM_0);
+        _samplesRecorded.store(0);
+        _recLength.store(0);
+        _done.store(false);
+        _recordLevels.reset();
 
         _recTimer = millis();
+        setMode(MicMode::Recording);
+        unlockModes();
+        countSwitch(startUs);
+        return true;
+    }
 
-        if (pdPASS != xTaskCreatePinnedToCore(recordTask, "MicRecordCapture", 4096, this, 2, &_task, 0))
+    // New DMA buffers and read size (see ai-workshop-capture.h). Reinstalls the I2S driver,
+    // so only while idle.
+    bool setCapture(const CaptureConfig& capture)
+    {
+        if (_task == nullptr) return false;
+        if (!capture.valid(channelCount()) || capture.readFrames > DMA_BUFFER_SIZE)
         {
-            _task = nullptr;
+            Serial.println("ERR: i2sMic capture config not possible");
             return false;
         }
-        return true;
+
+        lockModes();
+        if (currentMode() != MicMode::Idle) {
+            unlockModes();
+            return false;
+        }
+        if (modeOf(_command.load()) != MicMode::Idle) setMode(MicMode::Idle);
+#if !MIC_I2S_STD
+        // the read the last mode started may still be waiting for its block
+        while (_inRead.load()) delay(1);
+#endif
+
+        bool ok = true;
+        if (!(capture == _capture))
+        {
+            removeDriver();
+            _capture = capture;
+            ok = installDriver();
+            if (!ok) Serial.println("ERR: i2sMic I2S driver install failed");
+        }
+        unlockModes();
+        return ok;
+    }
+
+    bool setCapture(CaptureProfile profile) { return setCapture(CaptureConfig::forProfile(profile)); }
+
+    CaptureConfig getCapture() const { return _capture; }
+
+    // How the blocks of the current (or last) recording or stream arrived
+    CaptureTiming getCaptureTiming()
+    {
+        portENTER_CRITICAL(&_statsLock);
+        CaptureTiming t = _meter.timing();
+        portEXIT_CRITICAL(&_statsLock);
+        return t;
+    }
+
+    // Picks the capture config for what runs on the robot now. Tries kCaptureCandidates
+    // (cheapest first) with the stream running for measureMs each, next to the hooks, the
+    // classifier and whatever else was started, and keeps the first one within maxLatencyMs
+    // that keeps up: no overruns and no block later than half its headroom. Call it while
+    // idle, after the other tasks are running. Prints a line per candidate to `report`
+    // (nullptr: nothing). False when none kept up; the one that came closest is kept then.
+    bool autoTune(float maxLatencyMs = 60.0f, uint32_t measureMs = 500, uint32_t sliceSamples = 4000, Print* report = &Serial)
+    {
+        if (currentMode() != MicMode::Idle) return false;
+
+        const CaptureConfig before = _capture;
+        int best = -1;
+        float bestScore = 0.0f;
+        bool keepsUp = false;
+        char line[320];
+        char config[120];
+
+        for (uint8_t c = 0; c < kCaptureCandidateCount && !keepsUp; c++)
+        {
+            const CaptureConfig& candidate = kCaptureCandidates[c];
+            if (!candidate.valid(channelCount()) || candidate.readFrames > DMA_BUFFER_SIZE) continue;
+            if (candidate.latencyMs(SAMPLE_RATE) > maxLatencyMs) continue;
+            if (!setCapture(candidate) || !startStream(sliceSamples)) break;
+            delay(measureMs);
+            stopStream();
+
+            CaptureTiming timing = getCaptureTiming();
+            float headroomUs = candidate.headroomMs(SAMPLE_RATE) * 1000.0f;
+            keepsUp = timing.blocks > 0 && timing.overruns == 0 && timing.maxLateUs < headroomUs / 2;
+            // how close it came: the latest block against the headroom, every overrun counts as a full one
+            float score = timing.maxLateUs / headroomUs + timing.overruns;
+            if (keepsUp || best < 0 || score < bestScore)
+            {
+                best = c;
+                bestScore = score;
+            }
+
+            if (report)
+            {
+                candidate.format(config, sizeof(config), SAMPLE_RATE, channelCount());
+                int n = snprintf(line, sizeof(line), "capture tune: %s\r\n  ", config);
+                n += timing.format(line + n, sizeof(line) - n);
+                n += snprintf(line + n, sizeof(line) - n, keepsUp ? " -> keeps up\r\n" : " -> too late\r\n");
+                report->write((const uint8_t*)line, n);
+            }
+        }
+
+        if (!setCapture(best >= 0 ? kCaptureCandidates[best] : before)) return false;
+        if (report)
+        {
+            _capture.format(config, sizeof(config), SAMPLE_RATE, channelCount());
+            int n = snprintf(line, sizeof(line), "capture tune: %s %s\r\n", keepsUp ? "chose" : "nothing kept up, kept", config);
+            report->write((const uint8_t*)line, n);
+        }
+        return keepsUp;
+    }
+
+    MicStats getStats()
+    {
+        portENTER_CRITICAL(&_statsLock);
+        MicStats s = _stats;
+        portEXIT_CRITICAL(&_statsLock);
+        return s;
+    }
+
+    void printStats(Print& out = Serial)
+    {
+        MicStats s = getStats();
+        char line[320];
+        int n = snprintf(line, sizeof(line),
+                         "mic: %u switches, %.0f us average, %u us max, %u blocks discarded, %u allocations, %u overruns\r\n",
+                         (unsigned)s.switches, s.switches ? (float)s.totalSwitchUs / s.switches : 0.0f,
+                         (unsigned)s.maxSwitchUs, (unsigned)s.discarded, (unsigned)s.allocations, (unsigned)getStreamOverruns());
+        out.write((const uint8_t*)line, n);
+
+        n = snprintf(line, sizeof(line), "capture: ");
+        n += _capture.format(line + n, sizeof(line) - n, SAMPLE_RATE, channelCount());
+        n += snprintf(line + n, sizeof(line) - n, "\r\n  ");
+        n += getCaptureTiming().format(line + n, sizeof(line) - n);
+        n += snprintf(line + n, sizeof(line) - n, "\r\n");
+        out.write((const uint8_t*)line, n);
+
+        // per second of audio, to compare the two drivers
+        float seconds = s.frames > 0 ? (float)s.frames / SAMPLE_RATE : 1.0f;
+        n = snprintf(line, sizeof(line), "capture cost (%s): %.0f us cpu, %.0f bytes copied per second of audio, %u blocks dropped\r\n",
+                     MIC_I2S_STD ? "i2s_std interrupt" : "i2s_read task", s.captureUs / seconds, s.copiedBytes / seconds,
+                     (unsigned)s.droppedBlocks);
+        out.write((const uint8_t*)line, n);
     }
 };
 
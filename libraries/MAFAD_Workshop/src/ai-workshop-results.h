@@ -0,0 +1,211 @@
+#ifndef WORKSHOP_RESULTS_H
+#define WORKSHOP_RESULTS_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define RESULTS_MAX_LABELS 16     // scores in one record (as many as SCORES_MAX_LABELS)
+#define RESULTS_HISTORY 64        // records kept (power of 2), 64 slices of 200 ms = almost 13 seconds
+#define RESULTS_SCORE_ONE 4096    // scores are kept as Q4.12 (4096 = 1.0, max ~16.0), as in telemetry
+
+// One classifier result, small enough to copy often (56 bytes, an ei_impulse_result_t is bigger
+// and has pointers into the classifier).
+struct ResultRecord
+{
+    uint32_t sequence = 0;        // 1, 2, 3, ... (0: no result)
+    uint32_t classifyUs = 0;      // time spent in the classifier
+    int64_t timeUs = 0;           // esp_timer_get_time() when it was published
+    int8_t top = -1;              // label with the highest score, -1 = none
+    uint8_t count = 0;            // number of scores
+    uint16_t topScoreQ = 0;
+    uint16_t scoresQ[RESULTS_MAX_LABELS] = { 0 };
+
+    float score(uint8_t label) const { return label < count ? scoresQ[label] / (float)RESULTS_SCORE_ONE : 0.0f; }
+    float topScore() const { return topScoreQ / (float)RESULTS_SCORE_ONE; }
+};
+
+static_assert(sizeof(ResultRecord) == 20 + 2 * RESULTS_MAX_LABELS + 4 && offsetof(ResultRecord, top) == 16 &&
+                  offsetof(ResultRecord, scoresQ) == 20 && RESULTS_MAX_LABELS % 2 == 0,
+              "ResultChannel::publishScores() writes ResultRecord as 32 bit words");
+
+// Shares classifier results between tasks and cores: one task publishes (the inference task),
+// any number of tasks read (LEDs, sound, telemetry), and nobody waits for anybody.
+//
+// The last RESULTS_HISTORY results are kept in a ring. Every slot has a version number that is
+// odd while the slot is being written (a "seqlock"). A reader copies the slot and checks that the
+// version did not change in the meantime; if it did, it copies again. So a reader never sees half
+// of an old and half of a new result, and the writer never has to wait for a slow reader: when a
+// reader falls more than RESULTS_HISTORY results behind, it skips ahead and counts what it missed.
+//
+//   inference task:  results.publish(result, EI_CLASSIFIER_LABEL_COUNT, top, classifyUs);
+//   loop():          while (results.next(cursor, record)) { ... every result once ... }
+//   LED task:        if (results.latest(record)) { ... only the newest ... }
+class ResultChannel
+{
+private:
+    static constexpr uint32_t kWords = sizeof(ResultRecord) / 4;
+    static constexpr uint32_t kMask = RESULTS_HISTORY - 1;
+    static_assert((RESULTS_HISTORY & kMask) == 0, "RESULTS_HISTORY must be a power of 2");
+
+    // the words are atomics, so a copy that races with the writer is allowed (and then retried)
+    struct Slot
+    {
+        std::atomic<uint32_t> version{0};
+        std::atomic<uint32_t> words[kWords];
+    };
+
+    Slot _slots[RESULTS_HISTORY];
+    std::atomic<uint32_t> _head{0};   // sequence of the newest result
+    std::atomic<uint32_t> _retries{0};
+
+    // without branches (min / max), this runs for every score of every result
+    static uint16_t encodeScore(float value)
+    {
+        float q = value * RESULTS_SCORE_ONE + 0.5f;
+        q = q > 0.0f ? q : 0.0f;   // also catches NaN
+        q = q < 65535.0f ? q : 65535.0f;
+        return (uint16_t)q;
+    }
+
+    // copy of the slot that holds sequence, false when it was overwritten (or not written yet)
+    bool read(uint32_t sequence, ResultRecord& out)
+    {
+        Slot& slot = _slots[sequence & kMask];
+        uint32_t words[kWords];
+        for (uint32_t attempt = 1;; attempt++) {
+            uint32_t before = slot.version.load(std::memory_order_acquire);
+            if ((before & 1) == 0) {
+                for (uint32_t i = 0; i < kWords; i++) words[i] = slot.words[i].load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.version.load(std::memory_order_relaxed) == before) break;
+            }
+            _retries.fetch_add(1, std::memory_order_relaxed);
+            // the writer may be a lower priority task on this core: let it finish
+            if (attempt % 16 == 0) vTaskDelay(1);
+        }
+        memcpy(&out, words, sizeof(out));
+        return out.sequence == sequence;
+    }
+
+    // cursor for next() that starts at the first result after timeUs
+    uint32_t cursorAfter(int64_t timeUs)
+    {
+        uint32_t head = this->head();
+        uint32_t oldest = head > RESULTS_HISTORY ? head - RESULTS_HISTORY + 1 : 1;
+        uint32_t first = head + 1;
+        ResultRecord record;
+        while (first > oldest && read(first - 1, record) && record.timeUs > timeUs) first--;
+        return first - 1;
+    }
+
+public:
+    // Add a result. scores: count values (e.g. the smoothed scores), top: best label or -1.
+    // Call from one task only.
+    void publishScores(const float* scores, uint8_t count, int top, uint32_t classifyUs, int64_t timeUs = esp_timer_get_time())
+    {
+        if (count > RESULTS_MAX_LABELS) count = RESULTS_MAX_LABELS;
+        uint16_t q[RESULTS_MAX_LABELS] = { 0 };
+        for (uint8_t i = 0; i < count; i++) q[i] = encodeScore(scores[i]);
+        if (top >= count) top = -1;
+        uint32_t sequence = _head.load(std::memory_order_relaxed) + 1;
+
+        // the words of a ResultRecord (little endian), written straight into the slot
+        Slot& slot = _slots[sequence & kMask];
+        uint32_t version = slot.version.load(std::memory_order_relaxed);
+        slot.version.store(version + 1, std::memory_order_relaxed);   // odd: being written
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.words[0].store(sequence, std::memory_order_relaxed);
+        slot.words[1].store(classifyUs, std::memory_order_relaxed);
+        slot.words[2].store((uint32_t)timeUs, std::memory_order_relaxed);
+        slot.words[3].store((uint32_t)((uint64_t)timeUs >> 32), std::memory_order_relaxed);
+        slot.words[4].store((uint8_t)top | (uint32_t)count << 8 | (uint32_t)(top >= 0 ? q[top] : 0) << 16, std::memory_order_relaxed);
+        for (uint32_t i = 0; i < RESULTS_MAX_LABELS / 2; i++) {
+            slot.words[5 + i].store(q[2 * i] | (uint32_t)q[2 * i + 1] << 16, std::memory_order_relaxed);
+        }
+        slot.version.store(version + 2, std::memory_order_release);
+        _head.store(sequence, std::memory_order_release);
+    }
+
+    // The same for a classifier result (anything with classification[i].value, e.g. ei_impulse_result_t)
+    template <typename Result>
+    void publish(const Result& result, uint8_t count, int top, uint32_t classifyUs)
+    {
+        float scores[RESULTS_MAX_LABELS];
+        if (count > RESULTS_MAX_LABELS) count = RESULTS_MAX_LABELS;
+        for (uint8_t i = 0; i < count; i++) scores[i] = result.classification[i].value;
+        publishScores(scores, count, top, classifyUs);
+    }
+
+    // Sequence of the newest result (0: none yet)
+    uint32_t head() const
+    {
+        return _head.load(std::memory_order_acquire);
+    }
+
+    // The newest result, false when there is none yet
+    bool latest(ResultRecord& out)
+    {
+        // when the writer passes us during the copy, try the (even newer) head again
+        for (uint32_t head = this->head(); head != 0; head = this->head()) {
+            if (read(head, out)) return true;
+        }
+        return false;
+    }
+
+    // Every result once, in order: cursor is the sequence of the last result you read (start at 0,
+    // or at head() for only new results). Returns false when there is nothing new. Results that
+    // were overwritten before you got to them are skipped; lost counts them.
+    bool next(uint32_t& cursor, ResultRecord& out, uint32_t* lost = nullptr)
+    {
+        while (true) {
+            uint32_t head = this->head();
+            if (cursor >= head) return false;
+            uint32_t oldest = head > RESULTS_HISTORY ? head - RESULTS_HISTORY + 1 : 1;
+            uint32_t wanted = cursor + 1 < oldest ? oldest : cursor + 1;
+            if (lost) *lost += wanted - (cursor + 1);
+            cursor = wanted;
+            if (read(wanted, out)) return true;
+            cursor = wanted - 1;   // overwritten during the copy: look at head again
+        }
+    }
+
+    // The results published after timeUs, oldest first. Returns how many were written to out.
+    size_t since(int64_t timeUs, ResultRecord* out, size_t max)
+    {
+        uint32_t cursor = cursorAfter(timeUs);
+        size_t n = 0;
+        while (n < max && next(cursor, out[n])) {
+            if (out[n].timeUs > timeUs) n++;
+        }
+        return n;
+    }
+
+    // The scores of one label after timeUs, oldest first (for graphs, or "was it loud for 1 second?").
+    // times may be nullptr. Returns how many values were written.
+    size_t series(uint8_t label, int64_t timeUs, float* scores, int64_t* times, size_t max)
+    {
+        uint32_t cursor = cursorAfter(timeUs);
+        ResultRecord record;
+        size_t n = 0;
+        while (n < max && next(cursor, record)) {
+            if (record.timeUs <= timeUs) continue;
+            scores[n] = record.score(label);
+            if (times) times[n] = record.timeUs;
+            n++;
+        }
+        return n;
+    }
+
+    // How often a reader had to copy again because the writer was busy with that slot
+    uint32_t getRetries() const
+    {
+        return _retries.load(std::memory_order_relaxed);
+    }
+};
+
+#endif // WORKSHOP_RESULTS_H
@@ -0,0 +1,82 @@
+#ifndef WORKSHOP_SCORES_H
+#define WORKSHOP_SCORES_H
+
+// Smoothing of the classifier scores, shared by AiWorkshopInference (on the robot) and the
+// host tools (tools/host/model_eval.cpp), so both turn scores into answers the same way.
+// Plain C++, no Arduino or Edge Impulse header needed.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SCORES_MAX_LABELS 16      // labels a model can have
+
+// Exponential moving average of the scores of every label, and the best one.
+// smoothing 0: only the last result counts; 0.9: very steady but slow to react.
+class ScoreSmoother
+{
+private:
+    float _smoothing = 0.5f;
+    float _ema[SCORES_MAX_LABELS];
+    uint8_t _count = 0;
+    int _topIndex = -1;
+    float _topScore = 0.0f;
+
+public:
+    explicit ScoreSmoother(float smoothing = 0.5f) : _smoothing(smoothing)
+    {
+        reset();
+    }
+
+    void setSmoothing(float smoothing)
+    {
+        _smoothing = smoothing;
+    }
+
+    float getSmoothing() const
+    {
+        return _smoothing;
+    }
+
+    // Forget the history (a new recording, or a gap in the audio)
+    void reset()
+    {
+        for (size_t i = 0; i < SCORES_MAX_LABELS; i++) _ema[i] = 0.0f;
+        _topIndex = -1;
+        _topScore = 0.0f;
+    }
+
+    // Add one classifier result (anything with classification[i].value, e.g. ei_impulse_result_t)
+    template <typename Result>
+    void update(const Result& result, size_t count)
+    {
+        if (count > SCORES_MAX_LABELS) count = SCORES_MAX_LABELS;
+        _count = (uint8_t)count;
+        _topIndex = -1;
+        _topScore = 0.0f;
+        for (size_t ix = 0; ix < count; ix++) {
+            _ema[ix] = _smoothing * _ema[ix] + (1.0f - _smoothing) * result.classification[ix].value;
+            if (_ema[ix] > _topScore) {
+                _topScore = _ema[ix];
+                _topIndex = (int)ix;
+            }
+        }
+    }
+
+    // The label with the highest smoothed score, -1 before the first result
+    int topIndex() const
+    {
+        return _topIndex;
+    }
+
+    float topScore() const
+    {
+        return _topScore;
+    }
+
+    float score(size_t index) const
+    {
+        return index < _count ? _ema[index] : 0.0f;
+    }
+};
+
+#endif // WORKSHOP_SCORES_H
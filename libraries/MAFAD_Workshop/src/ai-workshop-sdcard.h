@@ -2,43 +2,46 @@
 #define WORKSHOP_SDCARD_H
 
 #include "ai-workshop-main.h"
+#include "ai-workshop-trace.h"
+#include "ai-workshop-wav.h"
+#include "ai-workshop-levels.h"
+#include "ai-workshop-events.h"
 
 #include <Arduino.h>
 #include "FS.h"
 #include "SD.h"
 #include "SPI.h"
 
-#define CROP_OFFSET 2000          // size of crop offset (samples)
-
 
 class SDCard
 {
 private:
-    void writeWavHeader(File f, uint32_t numSamples, uint32_t sampleRate)
+    TakePolicy _policy;
+
+    void writeWavHeader(File f, uint32_t numSamples, uint32_t sampleRate, uint32_t extraBytes = 0)
+    {
+        uint8_t header[WAV_HEADER_SIZE];
+        fillWavHeader(header, numSamples, sampleRate, 1, extraBytes);
+        f.write(header, sizeof(header));
+    }
+
+    // for the subscribers of the event bus (ai-workshop-events.h)
+    static void publishError(const char *what)
     {
-        uint32_t b4 = 0;
-        uint16_t b2 = 0;
-        f.print("RIFF");
-        b4 = numSamples * 2 + 44 - 8; // exclude 'RIFF' and filesize field
-        f.write((byte *)&b4, 4); // filesize
-        f.print("WAVE");
-        f.print("fmt ");
-        b4 = 16;
-        f.write((byte *)&b4, 4); // fmt size
-        b2 = 1;
-        f.write((byte *)&b2, 2); // 1=PCM
-        f.write((byte *)&b2, 2); // num channels, 1 = mono
-        b4 = sampleRate;
-        f.write((byte *)&b4, 4); // samplerate
-        b4 = sampleRate * 2;
-        f.write((byte *)&b4, 4); // Sample Rate * BitsPerSample * Channels) / 8.
-        b2 = 2;
-        f.write((byte *)&b2, 2); // bytes per sample
-        b2 = 16;
-        f.write((byte *)&b2, 2); // bits per sample
-        f.print("data");
-        b4 = numSamples * 2;
-        f.write((byte *)&b4, 4); // data length in bytes
+        if (!eventBus().wants(EventType::SdError)) return;
+        Event event(EventType::SdError, EventSource::SdCard);
+        event.setName(what);
+        eventBus().publish(event);
+    }
+
+    static void publishTake(const String &label, uint32_t fileIndex, TakeVerdict verdict)
+    {
+        if (!eventBus().wants(EventType::TakeSaved)) return;
+        Event event(EventType::TakeSaved, EventSource::SdCard);
+        event.value = fileIndex;
+        event.detail = (uint8_t)verdict;
+        event.setName(label.c_str());
+        eventBus().publish(event);
     }
 
     String padZeros(uint32_t number, int width)
@@ -53,6 +56,7 @@ private:
 
     bool writeCroppedFiles(const char *waveFileName, int32_t *sampleBuffer, uint32_t sampleOffset, uint32_t numSamples=NN_WINDOW_SIZE)
     {
+        AIW_TRACE_SCOPE("sd write cropped");
         if (waveFileName == nullptr || sampleBuffer == nullptr || numSamples == 0)
         {
             return false;
@@ -76,6 +80,7 @@ private:
         if (!file)
         {
             Serial.println("Failed to open file for writing");
+            publishError(waveFileName);
             return false;
         }
 
@@ -100,8 +105,11 @@ private:
         return SD.mkdir(path);
     }
     
-    bool writeMasterFile(const char *waveFileName, int32_t *sampleBuffer, uint32_t numSamples)
+    // info: a LIST chunk (fillWavInfoChunk) to write after the samples, or nullptr
+    bool writeMasterFile(const char *waveFileName, int32_t *sampleBuffer, uint32_t numSamples,
+                         const uint8_t *info = nullptr, uint32_t infoSize = 0)
     {
+        AIW_TRACE_SCOPE("sd write master");
         if (waveFileName == nullptr || sampleBuffer == nullptr || numSamples == 0)
         {
             return false;
@@ -120,11 +128,12 @@ private:
         if (!file)
         {
             Serial.println("Failed to open file for writing");
+            publishError(waveFileName);
             return false;
         }
 
         // Write the WAV audio header.
-        writeWavHeader(file, numSamples, SAMPLE_RATE);
+        writeWavHeader(file, numSamples, SAMPLE_RATE, info ? infoSize : 0);
 
         // Write the samples.
         for (uint s = 0; s < numSamples; s++)
@@ -133,6 +142,9 @@ private:
             file.write((byte *)&sample, 2);
         }
 
+        // Write the levels of the take.
+        if (info) file.write(info, infoSize);
+
         // Close the file.
         file.close();
         return true;
@@ -161,6 +173,7 @@ public:
         {
             Serial.println("Card Mount Failed");
         }
+        publishError("mount");
         return false;
     }
 
@@ -205,116 +218,125 @@ public:
     }
 
 
-    void writeAudioFile(int32_t *sampleBuffer, uint32_t duration, String baseName, String deviceName, uint32_t fileIndex, uint8_t numCrops=8)
+    // Open a new WAV file (16 bit mono, SAMPLE_RATE) with room for numSamples, for writing the samples yourself.
+    // The folder is created when needed, an old file with the same name is replaced.
+    File createAudioFile(const char *waveFileName, uint32_t numSamples)
+    {
+        char dir[96];
+        snprintf(dir, sizeof(dir), "%s", waveFileName);
+        char *slash = strrchr(dir, '/');
+        if (slash && slash != dir) {
+            *slash = 0;
+            ensureDir(dir);
+        }
+
+        if (SD.exists(waveFileName)) {
+            SD.remove(waveFileName);
+        }
+
+        File file = SD.open(waveFileName, FILE_WRITE);
+        if (!file)
+        {
+            Serial.println("Failed to open file for writing");
+            publishError(waveFileName);
+            return file;
+        }
+        writeWavHeader(file, numSamples, SAMPLE_RATE);
+        return file;
+    }
+
+    // What happens to a bad take that comes with its levels (see writeAudioFile)
+    void setTakePolicy(const TakePolicy& policy)
+    {
+        _policy = policy;
+    }
+
+    // levels: the levels of the take (mic.getRecordedLevels()), or nullptr to write it unchecked.
+    // With levels, the master file gets them in a LIST/INFO comment and a bad take (judgeTake) is
+    // not written at all (TakePolicy::reject) or only its master goes to /flagged, without crops,
+    // so it is not uploaded by mistake. Returns the verdict.
+    // check: what the classifier heard (TakeVerifier, ai-workshop-verify.h), or nullptr. It goes
+    // into the comment too, and a take the classifier disagrees with only goes to /review (as
+    // Mislabelled), to listen to before it is moved to the dataset or deleted.
+    TakeVerdict writeAudioFile(int32_t *sampleBuffer, uint32_t duration, String baseName, String deviceName, uint32_t fileIndex, uint8_t numCrops=8,
+                               const TakeStats *levels = nullptr, const TakeCheck *check = nullptr)
     {
         uint32_t numSamples = (duration * SAMPLE_RATE) / 1000;
 
         if (numSamples > SAMPLE_BUFFER_SIZE) numSamples = SAMPLE_BUFFER_SIZE;
 
+        TakeVerdict verdict = TakeVerdict::Good;
+        uint8_t info[192];
+        uint32_t infoSize = 0;
+        char comment[160] = "";
+        int n = 0;
+        if (levels) {
+            verdict = judgeTake(*levels, _policy);
+            n = levels->format(comment, sizeof(comment));
+            n += snprintf(comment + n, sizeof(comment) - n, ", %s", takeVerdictName(verdict));
+        }
+        if (check && n < (int)sizeof(comment)) {
+            n += snprintf(comment + n, sizeof(comment) - n, "%s", n > 0 ? ", " : "");
+            if (n < (int)sizeof(comment)) check->format(comment + n, sizeof(comment) - n);
+        }
+        if (levels || check) infoSize = fillWavInfoChunk(info, sizeof(info), comment);
+
+        if (verdict != TakeVerdict::Good) {
+            Serial.printf("%s take (%s): %s\n", _policy.reject ? "Rejected" : "Flagged", takeVerdictName(verdict), comment);
+            if (_policy.reject) return verdict;
+
+            ensureDir("/flagged");
+            String flaggedName = "/flagged/" + baseName + "." + deviceName + padZeros(fileIndex, 6) + ".wav";
+            if (writeMasterFile(flaggedName.c_str(), sampleBuffer, numSamples, info, infoSize)) publishTake(baseName, fileIndex, verdict);
+            Serial.println("Wrote flagged file: " + flaggedName);
+            return verdict;
+        }
+
+        if (check && check->checked && !check->agrees) {
+            Serial.printf("Take to review (recorded as %s): %s\n", baseName.c_str(), comment);
+            ensureDir("/review");
+            String reviewName = "/review/" + baseName + "." + deviceName + padZeros(fileIndex, 6) + ".wav";
+            if (writeMasterFile(reviewName.c_str(), sampleBuffer, numSamples, info, infoSize)) publishTake(baseName, fileIndex, TakeVerdict::Mislabelled);
+            Serial.println("Wrote review file: " + reviewName);
+            return TakeVerdict::Mislabelled;
+        }
+
         if (numCrops == 0) {
             // not using crops store in root of SD card
             // Save full file
             String masterName = "/" + baseName + "." + deviceName + padZeros(fileIndex, 6) + ".wav";  
-            writeMasterFile(masterName.c_str(), sampleBuffer, numSamples);
+            if (writeMasterFile(masterName.c_str(), sampleBuffer, numSamples, infoSize ? info : nullptr, infoSize)) publishTake(baseName, fileIndex, verdict);
             Serial.println("Wrote file: " + masterName); 
-            return;
+            return verdict;
         }
 
         ensureDir("/master");
 
         // Save full file
         String masterName = "/master/" + baseName + "." + deviceName + padZeros(fileIndex, 6) + ".wav";  
-        writeMasterFile(masterName.c_str(), sampleBuffer, numSamples);
+        bool written = writeMasterFile(masterName.c_str(), sampleBuffer, numSamples, infoSize ? info : nullptr, infoSize);
         Serial.println("Wrote master file: " + masterName); 
 
         // Save cropped files
         ensureDir("/crops");
 
-        // Edge case: not enough audio to make a 1s crop
-        if (numSamples < NN_WINDOW_SIZE) {
-            return;
-        }
-
-        uint32_t sampleMargin = numSamples - NN_WINDOW_SIZE;
-        uint maxCrops = sampleMargin / CROP_OFFSET + 1; // every 100 ms
-
-        bool used[24] = { false };
-        uint16_t idxs[24] = {0};
-        uint8_t picked = 0;
-
-        if (maxCrops > 24) maxCrops = 24;
-
-        // pick a 8 crops within maxCrops
-        if (numCrops > maxCrops) numCrops = maxCrops;
-
-        if (numCrops <= 1) {
-            
-            uint32_t offset = sampleMargin / 2;
-
-            String name = "/crops/" + baseName + "." + deviceName + padZeros(fileIndex, 6) + "_" + padZeros(offset, 5) + ".wav";  
-            writeCroppedFiles(name.c_str(), sampleBuffer, offset, NN_WINDOW_SIZE);
-        
-            Serial.println("Wrote file: " + name);
-            return;
-        }
-
-        for (uint8_t b = 0; b < numCrops; b++)
-        {
-            uint32_t start = (uint32_t)b * maxCrops / numCrops;
-            uint32_t end   = (uint32_t)(b + 1) * maxCrops / numCrops;
-            if (end == 0) continue;
-            end -= 1;
-
-            if (end >= maxCrops) end = maxCrops - 1;
-            if (start > end) start = end;
-
-            uint32_t span = end - start + 1;
-            uint32_t idx = start + (uint32_t)random((long)span);
-
-            // avoid duplicates (wrap inside bin)
-            for (uint32_t tries = 0; tries < span && used[idx]; tries++)
-            {
-                idx++;
-                if (idx > end) idx = start;
-            }
-
-            // fallback: global search forward
-            if (used[idx])
-            {
-                for (uint32_t j = 0; j < maxCrops; j++)
-                {
-                    uint32_t k = (idx + j) % maxCrops;
-                    if (!used[k]) { idx = k; break; }
-                }
-            }
-
-            used[idx] = true;
-            idxs[picked++] = (uint16_t)idx;
-        }
-
-        // sort indices (tiny list)
-        for (uint8_t i = 1; i < picked; i++)
-        {
-            uint16_t key = idxs[i];
-            int8_t k = (int8_t)i - 1;
-            while (k >= 0 && idxs[k] > key)
-            {
-                idxs[k + 1] = idxs[k];
-                k--;
-            }
-            idxs[k + 1] = key;
-        }
+        // pick the crops, spread over the take (ai-workshop-wav.h)
+        uint32_t offsets[MAX_CROPS];
+        uint8_t picked = pickCrops(numSamples, NN_WINDOW_SIZE, numCrops, offsets,
+                                   [](uint32_t span) { return (uint32_t)random((long)span); });
 
         for (uint8_t i = 0; i < picked; i++)
         {
-            uint32_t offset = (uint32_t)idxs[i] * (uint32_t)CROP_OFFSET;
+            uint32_t offset = offsets[i];
 
-            // CHANGED: padZeros(offset, 5)
             String name = "/crops/" + baseName + "." + deviceName + padZeros(fileIndex, 6) + "_" + padZeros(offset, 5) + ".wav";
             writeCroppedFiles(name.c_str(), sampleBuffer, offset, NN_WINDOW_SIZE);
             Serial.println("Wrote file: " + name);
         }
-       
+
+        // after the crops: a subscriber may start the next take
+        if (written) publishTake(baseName, fileIndex, verdict);
+        return verdict;
     }
 };
 
@@ -0,0 +1,321 @@
+#ifndef WORKSHOP_SELFSOUND_H
+#define WORKSHOP_SELFSOUND_H
+
+#include "ai-workshop-main.h"
+#include "ai-workshop-mic.h"
+#include "ai-workshop-sound.h"
+#include "ai-workshop-trace.h"
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+
+#define SELFSOUND_MAX_HARMONICS 32   // harmonics of the square wave that are cancelled
+
+enum class SelfSoundMode : uint8_t
+{
+    Off,      // do nothing
+    Flag,     // leave the audio alone, only remember when we heard ourselves (see heardSelf)
+    Gate,     // silence the stream while our own tone plays
+    Cancel,   // subtract our own tone and its harmonics, other sounds stay
+};
+
+struct SelfSoundConfig
+{
+    SelfSoundMode mode = SelfSoundMode::Cancel;
+    uint8_t harmonics = SELFSOUND_MAX_HARMONICS;  // at most SELFSOUND_MAX_HARMONICS
+    float maxHz = 9000.0f;       // no harmonics above this frequency
+    uint8_t passes = 1;          // fitting rounds per block (2: a little deeper, twice the CPU)
+    int32_t latencyUs = 0;       // speaker + microphone delay, added to the tone times
+    uint32_t tailMs = 30;        // keep cancelling this long after a tone stopped (speaker ringing, echo)
+};
+
+struct SelfSoundStats
+{
+    uint32_t blocks = 0;          // stream blocks processed
+    uint32_t selfBlocks = 0;      // ...with our own tone in them
+    uint32_t selfSamples = 0;     // samples with our own tone
+    uint32_t tones = 0;           // tone changes followed
+    uint64_t busyUs = 0;          // time spent in the filter
+    uint64_t audioUs = 0;         // audio processed
+    double inPower = 0.0;         // signal power of the self sound samples before...
+    double outPower = 0.0;        // ...and after the filter
+
+    // how much weaker the stream is while we play (includes any other sounds)
+    float suppressionDb() const
+    {
+        return inPower > 0.0 ? (float)(10.0 * log10((inPower + 1.0) / (outPower + 1.0))) : 0.0f;
+    }
+};
+
+// Removes (or flags) the robot's own tones from the microphone stream, before the classifier sees them.
+//
+// startTone/stopTone publish every frequency change (ai-workshop-sound.h). This filter runs as a
+// stream hook: for every block it looks up which tone played during each sample and
+//   Flag   remembers the time, the sketch can skip results with heardSelf(),
+//   Gate   writes zeros over those samples,
+//   Cancel runs a harmonic canceller: for every stretch of one tone in the block it fits the
+//          amplitude and phase of the tone frequency and its harmonics (least squares against
+//          quadrature oscillators) and subtracts them. This works like narrow notches that follow
+//          the tone, the speaker and room response do not need to be known and other sounds
+//          mostly stay. The fit adapts every block, so it needs no time to lock on.
+// Attach it before other hooks (melody detector, direction finder) so they get the cleaned audio.
+// In stereo only the left channel (the one that goes into the slices) is processed.
+class SelfSoundFilter
+{
+private:
+    SelfSoundConfig _config;
+    bool _attached = false;
+
+    // canceller state
+    uint32_t _frequency = 0;       // tone being followed, 0 when idle
+    uint8_t _count = 0;            // harmonics in use
+    float _stepCos[SELFSOUND_MAX_HARMONICS];
+    float _stepSin[SELFSOUND_MAX_HARMONICS];
+    float _omega[SELFSOUND_MAX_HARMONICS];   // radians per sample
+
+    ToneEvent _events[TONE_HISTORY];
+
+    volatile int64_t _lastSelfUs = 0;
+    SelfSoundStats _stats;
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+
+    static void onBlock(float* samples, uint32_t count, int64_t timeUs, void* user)
+    {
+        static_cast<SelfSoundFilter*>(user)->process(samples, count, timeUs);
+    }
+
+    void followTone(uint32_t frequency)
+    {
+        _frequency = frequency;
+        _count = 0;
+        const float nyquist = SAMPLE_RATE * 0.5f;
+        for (uint8_t k = 0; k < _config.harmonics; k++) {
+            float f = frequency * (k + 1.0f);
+            if (f > _config.maxHz || f >= nyquist) break;
+            float w = 2.0f * (float)M_PI * f / SAMPLE_RATE;
+            _stepCos[k] = cosf(w);
+            _stepSin[k] = sinf(w);
+            _omega[k] = w;
+            _count++;
+        }
+    }
+
+    // Fit a * cos + b * sin of every harmonic to n samples (least squares) and subtract it.
+    // One harmonic at a time: over more than a period the harmonics are almost independent,
+    // another pass fixes what is left of the small overlap.
+    void cancel(float* samples, uint32_t n)
+    {
+        for (uint8_t pass = 0; pass < _config.passes; pass++) {
+            for (uint8_t k = 0; k < _count; k++) {
+                const float stepCos = _stepCos[k];
+                const float stepSin = _stepSin[k];
+
+                // correlations of the audio with the oscillator
+                float c = 1.0f, s = 0.0f;
+                float xc = 0.0f, xs = 0.0f;
+                for (uint32_t i = 0; i < n; i++) {
+                    float x = samples[i];
+                    xc += x * c;
+                    xs += x * s;
+                    float next = c * stepCos - s * stepSin;
+                    s = s * stepCos + c * stepSin;
+                    c = next;
+                }
+
+                // ...and of the oscillator with itself, these have a closed form
+                float w = _omega[k];
+                float ratio = sinf(n * w) / sinf(w);
+                float cc = 0.5f * (n + ratio * cosf((n - 1) * w));
+                float ss = 0.5f * (n - ratio * cosf((n - 1) * w));
+                float cs = 0.5f * ratio * sinf((n - 1) * w);
+
+                // solve the 2x2 normal equations (less than half a period: fit the cosine only)
+                float det = cc * ss - cs * cs;
+                float a, b;
+                if (det > 1e-3f * cc * ss) {
+                    a = (xc * ss - xs * cs) / det;
+                    b = (xs * cc - xc * cs) / det;
+                } else {
+                    a = cc > 0.0f ? xc / cc : 0.0f;
+                    b = 0.0f;
+                }
+
+                c = 1.0f;
+                s = 0.0f;
+                for (uint32_t i = 0; i < n; i++) {
+                    samples[i] -= a * c + b * s;
+                    float next = c * stepCos - s * stepSin;
+                    s = s * stepCos + c * stepSin;
+                    c = next;
+                }
+            }
+        }
+    }
+
+public:
+    bool attach(i2sMic& mic, const SelfSoundConfig& config = SelfSoundConfig())
+    {
+        setConfig(config);
+        if (!mic.addStreamHook(onBlock, this)) {
+            Serial.println("ERR: no free stream hook for the self sound filter");
+            return false;
+        }
+        _attached = true;
+        return true;
+    }
+
+    void detach(i2sMic& mic)
+    {
+        if (!_attached) return;
+        mic.removeStreamHook(onBlock, this);
+        _attached = false;
+    }
+
+    void setConfig(const SelfSoundConfig& config)
+    {
+        _config = config;
+        if (_config.harmonics > SELFSOUND_MAX_HARMONICS) _config.harmonics = SELFSOUND_MAX_HARMONICS;
+        _frequency = 0;
+        _count = 0;
+    }
+
+    // Change the mode while running (e.g. a button to compare Off and Cancel)
+    void setMode(SelfSoundMode mode)
+    {
+        _config.mode = mode;
+    }
+
+    SelfSoundMode getMode() const
+    {
+        return _config.mode;
+    }
+
+    // Filter one block in place. timeUs is the esp_timer time of the last sample (as in a stream hook).
+    void process(float* samples, uint32_t count, int64_t timeUs)
+    {
+        if (_config.mode == SelfSoundMode::Off || count == 0) return;
+        AIW_TRACE_SCOPE("self sound");
+        int64_t start = esp_timer_get_time();
+
+        const uint32_t events = copyToneHistory(_events, TONE_HISTORY);
+        const float samplePeriodUs = 1000000.0f / SAMPLE_RATE;
+        const int64_t tailUs = (int64_t)_config.tailMs * 1000;
+        // time of the first sample, moved back by the latency so it lines up with the tone times
+        const int64_t firstUs = timeUs - (int64_t)((count - 1) * samplePeriodUs) - _config.latencyUs;
+
+        double inPower = 0.0;
+        double outPower = 0.0;
+        uint32_t selfSamples = 0;
+        uint32_t tones = 0;
+        int64_t lastSelfUs = 0;
+
+        int32_t e = -1;   // the newest tone change at or before sample i
+        uint32_t i = 0;
+        while (i < count) {
+            int64_t t = firstUs + (int64_t)(i * samplePeriodUs);
+            while (e + 1 < (int32_t)events && _events[e + 1].timeUs <= t) e++;
+
+            // samples up to the next tone change share one state
+            uint32_t end = count;
+            if (e + 1 < (int32_t)events) {
+                uint32_t n = i + (uint32_t)ceilf((_events[e + 1].timeUs - t) / samplePeriodUs);
+                if (n < end) end = n;
+            }
+
+            uint32_t frequency = e >= 0 ? _events[e].frequency : 0;
+            bool self = frequency != 0;
+            if (!self && e >= 0 && _frequency != 0) {
+                // the speaker stopped: the last tone rings on for a while
+                int64_t quietUs = t - _events[e].timeUs;
+                if (quietUs < tailUs) {
+                    self = true;
+                    uint32_t tailEnd = i + (uint32_t)ceilf((tailUs - quietUs) / samplePeriodUs);
+                    if (tailEnd < end) end = tailEnd;
+                }
+            }
+
+            uint32_t n = end - i;
+            if (self) {
+                if (frequency != 0 && frequency != _frequency) {
+                    followTone(frequency);
+                    tones++;
+                }
+                float* block = samples + i;
+                for (uint32_t j = 0; j < n; j++) inPower += block[j] * block[j];
+
+                if (_config.mode == SelfSoundMode::Gate) {
+                    memset(block, 0, n * sizeof(float));
+                } else if (_config.mode == SelfSoundMode::Cancel) {
+                    cancel(block, n);
+                }
+                for (uint32_t j = 0; j < n; j++) outPower += block[j] * block[j];
+
+                selfSamples += n;
+                lastSelfUs = firstUs + (int64_t)((end - 1) * samplePeriodUs) + _config.latencyUs;
+            } else {
+                _frequency = 0;
+                _count = 0;
+            }
+
+            i = end;
+        }
+
+        if (selfSamples) _lastSelfUs = lastSelfUs;
+
+        uint32_t busy = (uint32_t)(esp_timer_get_time() - start);
+        portENTER_CRITICAL(&_lock);
+        _stats.blocks++;
+        if (selfSamples) _stats.selfBlocks++;
+        _stats.selfSamples += selfSamples;
+        _stats.tones += tones;
+        _stats.busyUs += busy;
+        _stats.audioUs += (uint64_t)count * 1000000ULL / SAMPLE_RATE;
+        _stats.inPower += inPower;
+        _stats.outPower += outPower;
+        portEXIT_CRITICAL(&_lock);
+    }
+
+    // Did the stream contain our own sound at or after sinceUs? Pass the start of the
+    // audio the classifier looked at (e.g. mic.getStreamStartTimeUs() minus the rest of the model window).
+    bool heardSelf(int64_t sinceUs) const
+    {
+        int64_t last = _lastSelfUs;
+        return last != 0 && last >= sinceUs;
+    }
+
+    int64_t lastSelfUs() const
+    {
+        return _lastSelfUs;
+    }
+
+    SelfSoundStats getStats()
+    {
+        portENTER_CRITICAL(&_lock);
+        SelfSoundStats copy = _stats;
+        portEXIT_CRITICAL(&_lock);
+        return copy;
+    }
+
+    void resetStats()
+    {
+        portENTER_CRITICAL(&_lock);
+        _stats = SelfSoundStats();
+        portEXIT_CRITICAL(&_lock);
+    }
+
+    void printStats(Print& out = Serial)
+    {
+        static const char* modes[] = { "off", "flag", "gate", "cancel" };
+        SelfSoundStats s = getStats();
+        char line[160];
+        int n = snprintf(line, sizeof(line),
+                         "self sound (%s): %u of %u blocks, %u tones, %.1f dB suppressed, %.2f%% CPU\n",
+                         modes[(uint8_t)_config.mode], (unsigned)s.selfBlocks, (unsigned)s.blocks, (unsigned)s.tones,
+                         s.suppressionDb(), s.audioUs ? 100.0f * s.busyUs / s.audioUs : 0.0f);
+        out.write((const uint8_t*)line, n);
+    }
+};
+
+#endif // WORKSHOP_SELFSOUND_H
@@ -2,12 +2,83 @@
 #define WORKSHOP_SOUND_H
 
 #include "ai-workshop-main.h"
+#include "ai-workshop-trace.h"
+#include "ai-workshop-events.h"
 
 #include <Arduino.h>
+#include <esp_timer.h>
+#include "freertos/FreeRTOS.h"
+
+#define TONE_HISTORY 32   // tone changes remembered for the microphone side (a few hundred ms of melody)
 
 // One shared variable (defined in exactly one .cpp/.ino)
 extern uint32_t randomness;
 
+// What the speaker played and when, so the microphone side can recognise its own sound.
+// startTone/stopTone publish every change; frequency is the real LEDC frequency
+// (including the random detune), 0 when the speaker went quiet.
+struct ToneEvent
+{
+    int64_t timeUs = 0;      // esp_timer time of the change
+    uint32_t frequency = 0;
+};
+
+struct ToneHistory
+{
+    ToneEvent events[TONE_HISTORY];
+    uint32_t count = 0;      // events published so far, the newest is at (count - 1) % TONE_HISTORY
+    portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+};
+
+// One history for the whole program (inline: the same object in every file)
+inline ToneHistory& toneHistory()
+{
+    static ToneHistory history;
+    return history;
+}
+
+inline void publishTone(uint32_t frequency, int64_t timeUs)
+{
+    ToneHistory& history = toneHistory();
+    portENTER_CRITICAL(&history.lock);
+    bool changed = history.count == 0 || history.events[(history.count - 1) % TONE_HISTORY].frequency != frequency;
+    if (changed) {
+        ToneEvent& event = history.events[history.count % TONE_HISTORY];
+        event.timeUs = timeUs;
+        event.frequency = frequency;
+        history.count++;
+    }
+    portEXIT_CRITICAL(&history.lock);
+
+    EventType type = frequency ? EventType::ToneStart : EventType::ToneStop;
+    if (changed && eventBus().wants(type)) {
+        Event event(type, EventSource::Sound, timeUs);
+        event.value = frequency;
+        eventBus().publish(event);
+    }
+}
+
+// Copy the newest events (oldest first) into out, returns how many. Safe from any task.
+inline uint32_t copyToneHistory(ToneEvent* out, uint32_t max)
+{
+    ToneHistory& history = toneHistory();
+    portENTER_CRITICAL(&history.lock);
+    uint32_t n = history.count < TONE_HISTORY ? history.count : TONE_HISTORY;
+    if (n > max) n = max;
+    for (uint32_t i = 0; i < n; i++) {
+        out[i] = history.events[(history.count - n + i) % TONE_HISTORY];
+    }
+    portEXIT_CRITICAL(&history.lock);
+    return n;
+}
+
+// The frequency playing right now, 0 when quiet
+inline uint32_t currentToneFrequency()
+{
+    ToneEvent last;
+    return copyToneHistory(&last, 1) ? last.frequency : 0;
+}
+
 static void Silence(uint32_t ms)
 {
     if (ms < randomness)
@@ -68,8 +139,12 @@ static void startTone(uint8_t pin, unsigned int frequency)
 
 #endif
 
-    ledcChangeFrequency(ch_pin, f, bits);
+    uint32_t actual = ledcChangeFrequency(ch_pin, f, bits);
     ledcWrite(ch_pin, duty);
+
+    // tell the microphone side what we play (the LEDC rounds the frequency a little)
+    publishTone(actual ? actual : f, esp_timer_get_time());
+    AIW_TRACE_COUNTER("tone", actual ? actual : f);
 }
 
 static void stopTone(uint8_t pin)
@@ -80,10 +155,14 @@ static void stopTone(uint8_t pin)
     const uint8_t ch = 7;
     ledcWrite(ch, 0);
 #endif
+
+    publishTone(0, esp_timer_get_time());
+    AIW_TRACE_COUNTER("tone", 0);
 }
 
 static void playTone(uint8_t pin, unsigned int frequency, unsigned long duration)
 {
+    AIW_TRACE_SCOPE("play tone");
     startTone(pin, frequency);
     Silence((uint32_t)duration);
     stopTone(pin);
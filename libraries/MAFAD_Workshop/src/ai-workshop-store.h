@@ -0,0 +1,446 @@
+#ifndef WORKSHOP_STORE_H
+#define WORKSHOP_STORE_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <LittleFS.h>
+
+#define STORE_MAX_KEYS 32         // settings and counters
+#define STORE_KEY_SIZE 16         // longest key + 1
+#define STORE_COMMIT_MS 30000     // changes wait at most this long in RAM before they go to flash
+#define STORE_PENDING_SIZE 512    // bytes of changes that can wait for a commit
+#define STORE_LOG_MAX 4096        // rewrite the settings log when it grows past this (bytes)
+#define STORE_EVENTS_MAX 32768    // start a new detection log past this, the previous one is kept (one)
+
+struct StoreStats
+{
+    uint32_t commits = 0;
+    uint32_t failedCommits = 0;
+    uint32_t records = 0;         // settings changes and detections written
+    uint32_t compactions = 0;     // settings log rewritten
+    uint64_t bytes = 0;           // written to flash
+    uint64_t commitUs = 0;        // time in commit()
+    uint32_t maxCommitUs = 0;
+    uint32_t sinceMs = 0;
+
+    float hours() const { return (millis() - sinceMs) / 3600000.0f; }
+    float commitsPerHour() const { return hours() > 0.0f ? commits / hours() : 0.0f; }
+    float bytesPerHour() const { return hours() > 0.0f ? bytes / hours() : 0.0f; }
+};
+
+// Settings, counters and a log of what the robot heard, kept in flash so they survive a reset.
+//
+//   store.begin();
+//   recordIndex = store.getUInt("index", 1);
+//   store.setUInt("index", recordIndex);      // waits in RAM...
+//   store.logDetection("hello_there", 0.93f);
+//   store.update();                           // ...in loop(): commits every STORE_COMMIT_MS
+//
+// Nothing is overwritten in place: every change is a small record (with a checksum) added to
+// the end of a file on LittleFS, which spreads its writes over the whole partition. A commit
+// adds all waiting records at once, so a robot that counts every detection still writes the
+// flash only a few times per hour. begin() reads the records back; the newest value of a key
+// wins. A commit that was cut off by a power loss is dropped as a whole (LittleFS only keeps a
+// file change once it is closed), and a broken record ends the replay and the log is rewritten.
+//
+// The settings log (/store/values.log) is rewritten with only the current values when it gets
+// long. The detections (/store/events.log) are kept until exportDetections() or
+// clearDetections(); when the log is full it becomes events.old (the one before that is
+// removed) and a new one starts.
+// Use the store from one task (e.g. loop()).
+class Store
+{
+private:
+    enum : uint8_t { RecordUInt = 'U', RecordFloat = 'F', RecordDetection = 'D' };
+
+    struct Entry
+    {
+        char key[STORE_KEY_SIZE];
+        uint8_t type;
+        uint32_t bits;
+    };
+
+    Entry _entries[STORE_MAX_KEYS];
+    uint8_t _count = 0;
+    bool _started = false;
+    uint16_t _boot = 0;
+
+    uint8_t _pendingValues[STORE_PENDING_SIZE];
+    uint16_t _valuesLength = 0;
+    uint8_t _pendingEvents[STORE_PENDING_SIZE];
+    uint16_t _eventsLength = 0;
+    uint32_t _pendingSinceMs = 0;
+
+    uint32_t _valuesSize = 0;     // bytes in the files now
+    uint32_t _eventsSize = 0;
+    StoreStats _stats;
+
+    static constexpr const char* _valuesPath = "/store/values.log";
+    static constexpr const char* _valuesTemp = "/store/values.tmp";
+    static constexpr const char* _eventsPath = "/store/events.log";
+    static constexpr const char* _eventsOld = "/store/events.old";
+    static constexpr const char* _eventsTemp = "/store/events.tmp";
+
+    // record: type, payload length, payload, crc16 of the three
+    static uint16_t packRecord(uint8_t* out, uint8_t type, const uint8_t* payload, uint8_t length)
+    {
+        out[0] = type;
+        out[1] = length;
+        memcpy(out + 2, payload, length);
+        uint16_t crc = crc16(out, 2 + length);
+        out[2 + length] = crc & 0xFF;
+        out[3 + length] = crc >> 8;
+        return 4 + length;
+    }
+
+    // next record of a file, false at the end or at a broken record
+    static bool readRecord(File& file, uint8_t& type, uint8_t* payload, uint8_t& length)
+    {
+        uint8_t head[2], tail[2];
+        if (file.read(head, 2) != 2) return false;
+        type = head[0];
+        length = head[1];
+        if (file.read(payload, length) != length || file.read(tail, 2) != 2) return false;
+        uint16_t crc = crc16(payload, length, crc16(head, 2));
+        return crc == (uint16_t)(tail[0] | (tail[1] << 8));
+    }
+
+    Entry* find(const char* key)
+    {
+        for (uint8_t i = 0; i < _count; i++) {
+            if (strcmp(_entries[i].key, key) == 0) return &_entries[i];
+        }
+        return nullptr;
+    }
+
+    bool apply(const char* key, uint8_t type, uint32_t bits)
+    {
+        Entry* entry = find(key);
+        if (!entry) {
+            if (_count >= STORE_MAX_KEYS) {
+                Serial.println("ERR: store is full (STORE_MAX_KEYS)");
+                return false;
+            }
+            entry = &_entries[_count++];
+            snprintf(entry->key, sizeof(entry->key), "%s", key);
+        }
+        entry->type = type;
+        entry->bits = bits;
+        return true;
+    }
+
+    bool set(const char* key, uint8_t type, uint32_t bits)
+    {
+        size_t keyLength = strlen(key);
+        if (keyLength == 0 || keyLength >= STORE_KEY_SIZE) {
+            Serial.println("ERR: store key too long");
+            return false;
+        }
+        Entry* entry = find(key);
+        if (entry && entry->type == type && entry->bits == bits) return true;   // nothing changed
+        if (!apply(key, type, bits)) return false;
+
+        uint8_t payload[4 + STORE_KEY_SIZE];
+        memcpy(payload, &bits, 4);
+        memcpy(payload + 4, key, keyLength);
+        return queue(_pendingValues, _valuesLength, type, payload, 4 + keyLength);
+    }
+
+    bool queue(uint8_t* buffer, uint16_t& used, uint8_t type, const uint8_t* payload, uint8_t length)
+    {
+        if (used + 4 + length > STORE_PENDING_SIZE && !commit()) return false;
+        if (_valuesLength == 0 && _eventsLength == 0) _pendingSinceMs = millis();
+        used += packRecord(buffer + used, type, payload, length);
+        _stats.records++;
+        return true;
+    }
+
+    bool append(const char* path, const uint8_t* data, uint16_t length)
+    {
+        File file = LittleFS.open(path, FILE_APPEND);
+        if (!file) return false;
+        bool ok = file.write(data, length) == length;
+        file.close();   // this is the moment the records are safe
+        _stats.bytes += length;
+        return ok;
+    }
+
+    // Write the current values to a new log and swap it in (rename replaces the old log at once)
+    bool compact()
+    {
+        File file = LittleFS.open(_valuesTemp, FILE_WRITE);
+        if (!file) return false;
+        uint8_t record[8 + STORE_KEY_SIZE];
+        uint32_t size = 0;
+        bool ok = true;
+        for (uint8_t i = 0; i < _count && ok; i++) {
+            uint8_t payload[4 + STORE_KEY_SIZE];
+            size_t keyLength = strlen(_entries[i].key);
+            memcpy(payload, &_entries[i].bits, 4);
+            memcpy(payload + 4, _entries[i].key, keyLength);
+            uint16_t length = packRecord(record, _entries[i].type, payload, 4 + keyLength);
+            ok = file.write(record, length) == length;
+            size += length;
+        }
+        file.close();
+        _stats.bytes += size;
+        if (!ok || !LittleFS.rename(_valuesTemp, _valuesPath)) {
+            LittleFS.remove(_valuesTemp);
+            return false;
+        }
+        _valuesSize = size;
+        _stats.compactions++;
+        return true;
+    }
+
+    // Cut the detection log back to its first size bytes (the records before a commit that a
+    // power loss cut off), through a copy so a second power loss cannot lose the rest
+    bool truncateEvents(uint32_t size)
+    {
+        File in = LittleFS.open(_eventsPath, FILE_READ);
+        File out = LittleFS.open(_eventsTemp, FILE_WRITE);
+        bool ok = in && out;
+        uint8_t buffer[256];
+        for (uint32_t done = 0; ok && done < size;) {
+            uint32_t n = size - done < sizeof(buffer) ? size - done : sizeof(buffer);
+            ok = in.read(buffer, n) == n && out.write(buffer, n) == n;
+            done += n;
+        }
+        if (in) in.close();
+        if (out) out.close();
+        if (!ok || !LittleFS.rename(_eventsTemp, _eventsPath)) {
+            LittleFS.remove(_eventsTemp);
+            return false;
+        }
+        _stats.bytes += size;
+        return true;
+    }
+
+    // Read a detection log back, only the part before a broken record
+    static uint32_t scanEvents(const char* path, Print* out)
+    {
+        File file = LittleFS.open(path, FILE_READ);
+        if (!file) return 0;
+        uint8_t type, length, payload[255];
+        uint32_t valid = 0;
+        while (readRecord(file, type, payload, length)) {
+            valid += 4 + length;
+            if (!out || type != RecordDetection || length < 7) continue;
+            uint16_t boot;
+            uint32_t timeMs;
+            memcpy(&boot, payload, 2);
+            memcpy(&timeMs, payload + 2, 4);
+            char line[80];
+            int n = snprintf(line, sizeof(line), "%u,%lu,%.*s,%.2f\n", (unsigned)boot, (unsigned long)timeMs, length - 7,
+                             (const char*)payload + 7, payload[6] / 255.0f);
+            out->write((const uint8_t*)line, n);
+        }
+        file.close();
+        return valid;
+    }
+
+public:
+    // CRC-16/CCITT of a record; other files kept in flash use it too (ai-workshop-enrol.h)
+    static uint16_t crc16(const uint8_t* data, size_t length, uint16_t crc = 0xFFFF)
+    {
+        for (size_t i = 0; i < length; i++) {
+            crc ^= (uint16_t)data[i] << 8;
+            for (uint8_t b = 0; b < 8; b++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+        return crc;
+    }
+
+    // Mount the flash file system (formatted the first time) and read the stored values back
+    bool begin()
+    {
+        if (!LittleFS.begin(true)) {
+            Serial.println("ERR: flash file system not mounted");
+            return false;
+        }
+        LittleFS.mkdir("/store");
+        LittleFS.remove(_valuesTemp);   // left by a power loss during compact()
+        _count = 0;
+        _valuesLength = _eventsLength = 0;
+
+        uint32_t valid = 0;
+        bool broken = false;
+        File file = LittleFS.open(_valuesPath, FILE_READ);
+        if (file) {
+            uint32_t size = file.size();
+            uint8_t type, length, payload[255];
+            while (readRecord(file, type, payload, length)) {
+                valid += 4 + length;
+                if ((type != RecordUInt && type != RecordFloat) || length <= 4 || length - 4 >= STORE_KEY_SIZE) continue;
+                char key[STORE_KEY_SIZE];
+                memcpy(key, payload + 4, length - 4);
+                key[length - 4] = 0;
+                uint32_t bits;
+                memcpy(&bits, payload, 4);
+                apply(key, type, bits);
+            }
+            broken = valid != size;
+            file.close();
+        }
+        _valuesSize = valid;
+
+        // a broken end of the detection log would hide everything written after it: cut it off
+        _stats = StoreStats();
+        _eventsSize = scanEvents(_eventsPath, nullptr);
+        file = LittleFS.open(_eventsPath, FILE_READ);
+        uint32_t eventsFile = file ? file.size() : 0;
+        if (file) file.close();
+        if (eventsFile != _eventsSize && !truncateEvents(_eventsSize)) {
+            // could not cut it: start a new log, the broken one stays readable as events.old
+            Serial.println("ERR: detection log could not be repaired");
+            LittleFS.remove(_eventsOld);
+            LittleFS.rename(_eventsPath, _eventsOld);
+            _eventsSize = 0;
+        }
+
+        _stats.sinceMs = millis();
+        _started = true;
+        if (broken && !compact()) Serial.println("ERR: store log could not be repaired");
+
+        _boot = (uint16_t)(getUInt("boots", 0) + 1);
+        setUInt("boots", _boot);
+        return true;
+    }
+
+    uint32_t getUInt(const char* key, uint32_t fallback = 0)
+    {
+        Entry* entry = find(key);
+        return entry && entry->type == RecordUInt ? entry->bits : fallback;
+    }
+
+    float getFloat(const char* key, float fallback = 0.0f)
+    {
+        Entry* entry = find(key);
+        if (!entry || entry->type != RecordFloat) return fallback;
+        float value;
+        memcpy(&value, &entry->bits, 4);
+        return value;
+    }
+
+    bool has(const char* key)
+    {
+        return find(key) != nullptr;
+    }
+
+    // Changes wait in RAM until the next commit (update() or commit())
+    bool setUInt(const char* key, uint32_t value)
+    {
+        return _started && set(key, RecordUInt, value);
+    }
+
+    bool setFloat(const char* key, float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, 4);
+        return _started && set(key, RecordFloat, bits);
+    }
+
+    // Add a line to the detection log: boot number, time since boot, label, score (0..1)
+    bool logDetection(const char* label, float score)
+    {
+        if (!_started) return false;
+        uint8_t payload[7 + 24];
+        uint32_t timeMs = millis();
+        size_t labelLength = strlen(label);
+        if (labelLength > 24) labelLength = 24;
+        memcpy(payload, &_boot, 2);
+        memcpy(payload + 2, &timeMs, 4);
+        payload[6] = (uint8_t)(constrain(score, 0.0f, 1.0f) * 255.0f + 0.5f);
+        memcpy(payload + 7, label, labelLength);
+        return queue(_pendingEvents, _eventsLength, RecordDetection, payload, 7 + labelLength);
+    }
+
+    // Call in loop(): commits when changes have waited STORE_COMMIT_MS
+    void update()
+    {
+        if ((_valuesLength || _eventsLength) && millis() - _pendingSinceMs >= STORE_COMMIT_MS) commit();
+    }
+
+    // Write all waiting changes to flash now (e.g. before the power may be switched off)
+    bool commit()
+    {
+        if (!_started) return false;
+        if (_valuesLength == 0 && _eventsLength == 0) return true;
+        uint32_t start = micros();
+        bool ok = true;
+
+        if (_eventsLength) {
+            if (_eventsSize + _eventsLength > STORE_EVENTS_MAX) {
+                // the full log becomes events.old; only the one before it is dropped
+                LittleFS.remove(_eventsOld);
+                LittleFS.rename(_eventsPath, _eventsOld);
+                _eventsSize = 0;
+            }
+            if (append(_eventsPath, _pendingEvents, _eventsLength)) {
+                _eventsSize += _eventsLength;
+                _eventsLength = 0;
+            } else {
+                ok = false;
+            }
+        }
+        if (_valuesLength) {
+            if (append(_valuesPath, _pendingValues, _valuesLength)) {
+                _valuesSize += _valuesLength;
+                _valuesLength = 0;
+                if (_valuesSize > STORE_LOG_MAX) ok = compact();
+            } else {
+                ok = false;
+            }
+        }
+
+        uint32_t us = micros() - start;
+        _stats.commits++;
+        _stats.commitUs += us;
+        if (us > _stats.maxCommitUs) _stats.maxCommitUs = us;
+        if (!ok) {
+            _stats.failedCommits++;
+            Serial.println("ERR: store commit failed");
+        }
+        return ok;
+    }
+
+    // Print the detection log as CSV (boot,time_ms,label,score), oldest first
+    void exportDetections(Print& out = Serial)
+    {
+        commit();
+        const char* header = "boot,time_ms,label,score\n";
+        out.write((const uint8_t*)header, strlen(header));
+        scanEvents(_eventsOld, &out);
+        scanEvents(_eventsPath, &out);
+    }
+
+    void clearDetections()
+    {
+        commit();
+        LittleFS.remove(_eventsOld);
+        LittleFS.remove(_eventsPath);
+        _eventsSize = 0;
+    }
+
+    uint16_t getBoot() const
+    {
+        return _boot;
+    }
+
+    const StoreStats& getStats() const
+    {
+        return _stats;
+    }
+
+    void printStats(Print& out = Serial)
+    {
+        const StoreStats& s = _stats;
+        char line[200];
+        int n = snprintf(line, sizeof(line),
+                         "store: %u commits (%.1f per hour, %.0f bytes per hour), commit %.1f ms avg %.1f ms max, %u records, %u rewrites, %u failed\n",
+                         (unsigned)s.commits, s.commitsPerHour(), s.bytesPerHour(), s.commits ? s.commitUs / 1000.0f / s.commits : 0.0f,
+                         s.maxCommitUs / 1000.0f, (unsigned)s.records, (unsigned)s.compactions, (unsigned)s.failedCommits);
+        out.write((const uint8_t*)line, n);
+    }
+};
+
+#endif // WORKSHOP_STORE_H
@@ -0,0 +1,238 @@
+#ifndef WORKSHOP_TELEMETRY_H
+#define WORKSHOP_TELEMETRY_H
+
+#include "ai-workshop-main.h"
+#include "ai-workshop-trace.h"
+
+#include <Arduino.h>
+#include <atomic>
+#include <cstring>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define TELEMETRY_MAX_LABELS 8           // score slots in one record
+#define TELEMETRY_RING_SIZE 64           // queued records before we start dropping (power of 2)
+#define TELEMETRY_LABEL_REPEAT_MS 5000   // resend the label names so a decoder can attach any time
+#define TELEMETRY_SCORE_ONE 4096         // scores are sent as Q4.12 (4096 = 1.0, max ~16.0)
+
+#define TELEMETRY_MAGIC 0x5AA5           // on the wire: A5 5A
+#define TELEMETRY_TYPE_RESULT 1
+#define TELEMETRY_TYPE_LABEL 2
+
+// One fixed-size record on the wire (36 bytes, little endian).
+// Decode on the computer with tools/telemetry_decode.py
+struct __attribute__((packed)) TelemetryRecord
+{
+    uint16_t magic;
+    uint8_t type;
+    uint8_t labelCount;     // RESULT: number of scores, LABEL: index of the label
+    uint32_t timestampMs;
+    uint32_t inferenceUs;   // time spent in the classifier for this result
+    uint16_t sequence;      // counts every result, also the dropped ones
+    uint8_t topLabel;       // 0xFF = no winner
+    uint8_t dropped;        // results lost right before this one (saturates at 255)
+    union {
+        uint16_t scores[TELEMETRY_MAX_LABELS];
+        char name[TELEMETRY_MAX_LABELS * 2];
+    };
+    uint16_t topScore;
+    uint16_t crc;           // CRC-16/CCITT of all bytes before it
+};
+
+static_assert(sizeof(TelemetryRecord) == 36, "TelemetryRecord layout is shared with the decoder");
+
+// Queues classifier results as binary records and sends them from a
+// low priority task, so the inference loop never waits for the serial port.
+// push() may be called from one task only (single producer).
+class Telemetry
+{
+private:
+    TelemetryRecord _ring[TELEMETRY_RING_SIZE];
+    std::atomic<uint32_t> _head{0};   // written by push()
+    std::atomic<uint32_t> _tail{0};   // written by the send task
+
+    Print *_out = nullptr;
+    TaskHandle_t _task = nullptr;
+    volatile bool _running = false;
+
+    const char *const *_labels = nullptr;
+    uint8_t _labelCount = 0;
+    uint32_t _labelTimer = 0;
+
+    uint16_t _sequence = 0;
+    uint32_t _droppedSinceLast = 0;
+
+    // statistics
+    volatile uint32_t _pushed = 0;
+    volatile uint32_t _dropped = 0;
+    volatile uint32_t _sent = 0;
+    volatile uint32_t _bytesSent = 0;
+
+    static uint16_t encodeScore(float value)
+    {
+        if (!(value > 0.0f)) return 0;   // also catches NaN
+        float q = value * TELEMETRY_SCORE_ONE + 0.5f;
+        if (q > 65535.0f) return 65535;
+        return (uint16_t)q;
+    }
+
+    static uint16_t crc16(const uint8_t *data, size_t length)
+    {
+        uint16_t crc = 0xFFFF;
+        for (size_t i = 0; i < length; i++)
+        {
+            crc ^= (uint16_t)data[i] << 8;
+            for (int bit = 0; bit < 8; bit++)
+            {
+                crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+            }
+        }
+        return crc;
+    }
+
+    void sendRecord(TelemetryRecord &record)
+    {
+        record.crc = crc16((const uint8_t *)&record, sizeof(TelemetryRecord) - sizeof(uint16_t));
+        _out->write((const uint8_t *)&record, sizeof(TelemetryRecord));
+        _bytesSent += sizeof(TelemetryRecord);
+    }
+
+    void sendLabels()
+    {
+        for (uint8_t i = 0; i < _labelCount; i++)
+        {
+            TelemetryRecord record;
+            memset(&record, 0, sizeof(record));
+            record.magic = TELEMETRY_MAGIC;
+            record.type = TELEMETRY_TYPE_LABEL;
+            record.labelCount = i;
+            record.timestampMs = millis();
+            record.topLabel = 0xFF;
+            strncpy(record.name, _labels[i], sizeof(record.name));
+            sendRecord(record);
+        }
+    }
+
+    static void sendTask(void *parameter)
+    {
+        AIW_TRACE_TASK("Telemetry");
+        Telemetry *telemetry = static_cast<Telemetry *>(parameter);
+
+        while (telemetry->_running)
+        {
+            if (telemetry->_labels && millis() - telemetry->_labelTimer >= TELEMETRY_LABEL_REPEAT_MS)
+            {
+                telemetry->_labelTimer = millis();
+                telemetry->sendLabels();
+            }
+
+            uint32_t tail = telemetry->_tail.load(std::memory_order_relaxed);
+            uint32_t head = telemetry->_head.load(std::memory_order_acquire);
+
+            if (tail == head)
+            {
+                ulTaskNotifyTake(pdTRUE, 10 / portTICK_PERIOD_MS);   // end() wakes it up
+                continue;
+            }
+
+            while (tail != head)
+            {
+                // copy out first, the slot is free for push() as soon as tail moves
+                TelemetryRecord record = telemetry->_ring[tail & (TELEMETRY_RING_SIZE - 1)];
+                tail++;
+                telemetry->_tail.store(tail, std::memory_order_release);
+
+                AIW_TRACE_BEGIN("telemetry send");
+                telemetry->sendRecord(record);
+                AIW_TRACE_END("telemetry send");
+                telemetry->_sent++;
+            }
+        }
+
+        AIW_TRACE_TASK_END();
+        telemetry->_task = nullptr;
+        vTaskDelete(nullptr);
+    }
+
+public:
+    // Constructor
+    Telemetry() {}
+
+    // labels must stay valid while telemetry runs (e.g. ei_classifier_inferencing_categories)
+    bool begin(const char *const *labels, uint8_t labelCount, Print &out = Serial, UBaseType_t priority = 1, BaseType_t core = 1)
+    {
+        if (_running) return false;
+        if (labelCount > TELEMETRY_MAX_LABELS) labelCount = TELEMETRY_MAX_LABELS;
+
+        _out = &out;
+        _labels = labels;
+        _labelCount = labels ? labelCount : 0;
+        _labelTimer = millis() - TELEMETRY_LABEL_REPEAT_MS;  // send the names right away
+
+        _running = true;
+        if (pdPASS != xTaskCreatePinnedToCore(sendTask, "Telemetry", 4096, this, priority, &_task, core))
+        {
+            _running = false;
+            _task = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+    // Returns when the task is gone (or after 200 ms), so the output and labels can go too
+    void end()
+    {
+        _running = false;
+        if (_task) xTaskNotifyGive(_task);
+        for (int i = 0; i < 200 && _task != nullptr; i++) delay(1);
+    }
+
+    // Queue one result. Never blocks: returns false (and counts a drop) when the ring is full.
+    // scores: one value per label, topLabel < 0 when there is no winner.
+    bool push(const float *scores, uint8_t count, int topLabel = -1, float topScore = 0.0f, uint32_t inferenceUs = 0)
+    {
+        uint16_t sequence = _sequence++;
+
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        uint32_t tail = _tail.load(std::memory_order_acquire);
+        if (head - tail >= TELEMETRY_RING_SIZE)
+        {
+            _droppedSinceLast++;
+            _dropped++;
+            return false;
+        }
+
+        if (count > TELEMETRY_MAX_LABELS) count = TELEMETRY_MAX_LABELS;
+
+        TelemetryRecord &record = _ring[head & (TELEMETRY_RING_SIZE - 1)];
+        record.magic = TELEMETRY_MAGIC;
+        record.type = TELEMETRY_TYPE_RESULT;
+        record.labelCount = count;
+        record.timestampMs = millis();
+        record.inferenceUs = inferenceUs;
+        record.sequence = sequence;
+        record.topLabel = (topLabel >= 0 && topLabel < 0xFF) ? (uint8_t)topLabel : 0xFF;
+        record.dropped = _droppedSinceLast > 255 ? 255 : (uint8_t)_droppedSinceLast;
+        for (uint8_t i = 0; i < TELEMETRY_MAX_LABELS; i++)
+        {
+            record.scores[i] = (i < count) ? encodeScore(scores[i]) : 0;
+        }
+        record.topScore = encodeScore(topScore);
+
+        _head.store(head + 1, std::memory_order_release);
+        _droppedSinceLast = 0;
+        _pushed++;
+        return true;
+    }
+
+    uint32_t getPushed() const { return _pushed; }
+    uint32_t getDropped() const { return _dropped; }
+    uint32_t getSent() const { return _sent; }
+    uint32_t getBytesSent() const { return _bytesSent; }
+    uint32_t getQueued() const
+    {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+    }
+};
+
+#endif // WORKSHOP_TELEMETRY_H
@@ -0,0 +1,373 @@
+#ifndef WORKSHOP_TRACE_H
+#define WORKSHOP_TRACE_H
+
+// Where does the time go? Tracing for the whole library.
+//
+// Off by default: every AIW_TRACE_* macro compiles to nothing. To switch it on, put
+//   #define AIW_TRACE 1
+// at the top of the sketch, before the AI Workshop includes, and call Trace::begin() in setup().
+//
+//   AIW_TRACE_SCOPE("name")          time from here to the end of the { } block
+//   AIW_TRACE_BEGIN("name") / AIW_TRACE_END("name")
+//   AIW_TRACE_COUNTER("name", value) a value over time (queue depth, free heap, ...)
+//   AIW_TRACE_INSTANT("name")        a single moment
+//   AIW_TRACE_TASK("name")           at the start of a task function: name it and sample its stack
+//   AIW_TRACE_TASK_END()             just before the task deletes itself
+//
+// Names must be string literals (only the pointer is stored). Every event stores the CPU cycle
+// counter in a ring buffer of the core it runs on, no locks. Trace::dump() prints the rings as
+// text (serial or a file on the SD card); tools/trace2chrome.py turns that into a Chrome trace /
+// Perfetto JSON file (open it in ui.perfetto.dev or chrome://tracing).
+
+#ifndef AIW_TRACE
+#define AIW_TRACE 0
+#endif
+
+#include <Arduino.h>
+
+#if AIW_TRACE
+
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <SD.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#if defined(ESP_ARDUINO_VERSION_MAJOR) && (ESP_ARDUINO_VERSION_MAJOR >= 3)
+#include <esp_cpu.h>
+#endif
+
+#ifndef AIW_TRACE_EVENTS
+#define AIW_TRACE_EVENTS 2048     // events per core (power of two), the oldest are overwritten
+#endif
+#define AIW_TRACE_MAX_TASKS 16     // tasks that can be named
+#define AIW_TRACE_SYNC_EVERY 256   // events between two time stamps (esp_timer) per core
+
+enum class TraceType : uint8_t
+{
+    Begin,
+    End,
+    Counter,
+    Instant,
+    Sync,      // cycle counter <-> esp_timer pair, to line up the cores
+};
+
+struct TraceEvent
+{
+    uint32_t cycles;
+    const char* name;
+    int32_t value;     // counter value; for Sync the esp_timer time (low 32 bits, microseconds)
+    TraceType type;
+    uint8_t task;      // index in the task table
+};
+
+class Trace
+{
+private:
+    struct Ring {
+        TraceEvent* events = nullptr;
+        uint32_t count = 0;           // events written, only ever grows
+        uint32_t lastCycles = 0;
+        TaskHandle_t lastTask = nullptr;
+        uint8_t lastTaskIndex = 0;
+    };
+
+    struct TaskInfo {
+        TaskHandle_t handle = nullptr;
+        char name[16] = "";
+        char stackName[24] = "";      // counter name for the stack high water mark
+        bool sampled = false;         // registered with AIW_TRACE_TASK and still alive
+    };
+
+    static Ring s_rings[portNUM_PROCESSORS];
+    static uint32_t s_mask;
+    static volatile bool s_running;
+    static TaskInfo s_tasks[AIW_TRACE_MAX_TASKS];
+    static volatile uint8_t s_taskCount;
+    static portMUX_TYPE s_taskLock;
+    static TaskHandle_t s_sampler;
+    static uint32_t s_sampleMs;
+
+    static inline uint32_t cycles()
+    {
+#if defined(ESP_ARDUINO_VERSION_MAJOR) && (ESP_ARDUINO_VERSION_MAJOR >= 3)
+        return (uint32_t)esp_cpu_get_cycle_count();
+#else
+        return ESP.getCycleCount();
+#endif
+    }
+
+    // index of a task in the table, added the first time it is seen; 0 is "other"
+    static uint8_t taskIndex(TaskHandle_t handle, const char* name = nullptr)
+    {
+        if (!handle) return 0;
+        uint8_t count = s_taskCount;
+        for (uint8_t i = 1; i < count; i++) {
+            if (s_tasks[i].handle == handle) return i;
+        }
+
+        portENTER_CRITICAL(&s_taskLock);
+        uint8_t index = 0;   // 0 is "other" when the table is full
+        for (index = 1; index < s_taskCount; index++) {
+            if (s_tasks[index].handle == handle) break;
+        }
+        if (index == s_taskCount && s_taskCount < AIW_TRACE_MAX_TASKS) {
+            TaskInfo& info = s_tasks[index];
+            const char* taskName = name ? name : pcTaskGetName(handle);
+            snprintf(info.name, sizeof(info.name), "%s", taskName);
+            snprintf(info.stackName, sizeof(info.stackName), "stack %.15s", taskName);
+            info.handle = handle;
+            s_taskCount = index + 1;
+        } else if (index == s_taskCount) {
+            index = 0;
+        }
+        portEXIT_CRITICAL(&s_taskLock);
+        return index;
+    }
+
+    static void write(Ring& ring, uint32_t now, const char* name, int32_t value, TraceType type, uint8_t task)
+    {
+        uint32_t slot = __atomic_fetch_add(&ring.count, 1, __ATOMIC_RELAXED);
+        TraceEvent& e = ring.events[slot & s_mask];
+        e.cycles = now;
+        e.name = name;
+        e.value = value;
+        e.type = type;
+        e.task = task;
+    }
+
+    static void samplerTask(void* parameter)
+    {
+        (void)parameter;
+        registerTask("TraceSampler");
+        while (s_running) {
+            sampleNow();
+            vTaskDelay(pdMS_TO_TICKS(s_sampleMs));
+        }
+        unregisterTask();
+        s_sampler = nullptr;
+        vTaskDelete(nullptr);
+    }
+
+public:
+    // Allocate the rings and start tracing. sampleMs > 0 starts a task that samples the
+    // stack high water marks of the registered tasks and the free heap every sampleMs.
+    static bool begin(uint32_t sampleMs = 100)
+    {
+        if (s_running) return true;
+        static_assert((AIW_TRACE_EVENTS & (AIW_TRACE_EVENTS - 1)) == 0, "AIW_TRACE_EVENTS must be a power of two");
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            Ring& ring = s_rings[core];
+            if (!ring.events) {
+                // internal RAM is faster to write; PSRAM when it does not fit
+                ring.events = (TraceEvent*)heap_caps_malloc(AIW_TRACE_EVENTS * sizeof(TraceEvent), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+                if (!ring.events) ring.events = (TraceEvent*)heap_caps_malloc(AIW_TRACE_EVENTS * sizeof(TraceEvent), MALLOC_CAP_SPIRAM);
+                if (!ring.events) {
+                    Serial.println("ERR: no memory for the trace buffers");
+                    return false;
+                }
+            }
+            ring.count = 0;
+            ring.lastTask = nullptr;
+        }
+        s_mask = AIW_TRACE_EVENTS - 1;
+        if (s_taskCount == 0) {
+            snprintf(s_tasks[0].name, sizeof(s_tasks[0].name), "other");
+            s_taskCount = 1;
+        }
+        s_running = true;
+
+        s_sampleMs = sampleMs;
+        if (sampleMs > 0 && !s_sampler) {
+            xTaskCreatePinnedToCore(samplerTask, "TraceSampler", 3072, nullptr, 1, &s_sampler, 0);
+        }
+        return true;
+    }
+
+    // Stop recording (the events stay until the next begin)
+    static void stop()
+    {
+        s_running = false;
+    }
+
+    static bool isRunning()
+    {
+        return s_running;
+    }
+
+    // One event, called by the macros. Costs a few hundred cycles.
+    static inline void event(TraceType type, const char* name, int32_t value = 0)
+    {
+        if (!s_running) return;
+        uint32_t now = cycles();
+        Ring& ring = s_rings[xPortGetCoreID()];
+
+        TaskHandle_t handle = xTaskGetCurrentTaskHandle();
+        uint8_t task = ring.lastTaskIndex;
+        if (handle != ring.lastTask) {
+            task = taskIndex(handle);
+            ring.lastTask = handle;
+            ring.lastTaskIndex = task;
+        }
+
+        // a time stamp before the first event, every AIW_TRACE_SYNC_EVERY events and after long
+        // pauses, so the cycle counter can be unwrapped and lined up with the other core
+        if ((ring.count & (AIW_TRACE_SYNC_EVERY - 1)) == 0 || now - ring.lastCycles > 0x40000000u) {
+            sync(ring, task);
+            now = cycles();
+        }
+        ring.lastCycles = now;
+        write(ring, now, name, value, type, task);
+    }
+
+    static void sync(Ring& ring, uint8_t task)
+    {
+        int64_t us = esp_timer_get_time();
+        write(ring, cycles(), "sync", (int32_t)(uint32_t)us, TraceType::Sync, task);
+    }
+
+    // Name the calling task and sample its stack (AIW_TRACE_TASK)
+    static void registerTask(const char* name)
+    {
+        TaskHandle_t handle = xTaskGetCurrentTaskHandle();
+        uint8_t index = taskIndex(handle, name);
+        if (index == 0) return;
+        s_tasks[index].sampled = true;
+    }
+
+    // The calling task is about to delete itself: stop sampling its stack (AIW_TRACE_TASK_END)
+    static void unregisterTask()
+    {
+        TaskHandle_t handle = xTaskGetCurrentTaskHandle();
+        portENTER_CRITICAL(&s_taskLock);
+        for (uint8_t i = 1; i < s_taskCount; i++) {
+            if (s_tasks[i].handle == handle) {
+                s_tasks[i].sampled = false;
+                // a new task may get the same handle, it should get a new entry
+                s_tasks[i].handle = (TaskHandle_t)nullptr;
+            }
+        }
+        portEXIT_CRITICAL(&s_taskLock);
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            if (s_rings[core].lastTask == handle) s_rings[core].lastTask = nullptr;
+        }
+    }
+
+    // Stack high water marks (bytes never used) of the registered tasks and the free heap, as counters.
+    // Called by the sampler task, or call it yourself when begin(0) was used.
+    static void sampleNow()
+    {
+        for (uint8_t i = 1; i < s_taskCount; i++) {
+            TaskInfo& info = s_tasks[i];
+            if (info.sampled && info.handle) {
+                event(TraceType::Counter, info.stackName, (int32_t)uxTaskGetStackHighWaterMark(info.handle));
+            }
+        }
+        event(TraceType::Counter, "heap internal free", (int32_t)heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+        event(TraceType::Counter, "heap internal min", (int32_t)heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL));
+        event(TraceType::Counter, "heap psram free", (int32_t)heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+    }
+
+    // Print the recorded events as text. Tracing is paused while printing.
+    static void dump(Print& out = Serial)
+    {
+        bool wasRunning = s_running;
+        s_running = false;
+        delay(2);   // let events that were being written finish
+
+        char line[128];
+        int n = snprintf(line, sizeof(line), "# aiw-trace 1\n# cpu_mhz %u\n", (unsigned)getCpuFrequencyMhz());
+        out.write((const uint8_t*)line, n);
+        for (uint8_t i = 0; i < s_taskCount; i++) {
+            n = snprintf(line, sizeof(line), "T %u %s\n", (unsigned)i, s_tasks[i].name);
+            out.write((const uint8_t*)line, n);
+        }
+
+        static const char types[] = { 'B', 'E', 'C', 'I', 'S' };
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            Ring& ring = s_rings[core];
+            if (!ring.events) continue;
+            uint32_t count = ring.count;
+            uint32_t first = count > AIW_TRACE_EVENTS ? count - AIW_TRACE_EVENTS : 0;
+            n = snprintf(line, sizeof(line), "# core %d: %u events, %u lost\n", core, (unsigned)(count - first), (unsigned)first);
+            out.write((const uint8_t*)line, n);
+            for (uint32_t i = first; i < count; i++) {
+                const TraceEvent& e = ring.events[i & s_mask];
+                n = snprintf(line, sizeof(line), "%c %d %u %u %ld %s\n", types[(uint8_t)e.type], core, (unsigned)e.cycles,
+                             (unsigned)e.task, e.type == TraceType::Sync ? (long)(uint32_t)e.value : (long)e.value, e.name);
+                out.write((const uint8_t*)line, n);
+            }
+        }
+        out.write((const uint8_t*)"# end\n", 6);
+
+        s_running = wasRunning;
+    }
+
+    // Write the trace to a file on the SD card (mount it first, e.g. with SDCard::setup)
+    static bool dumpToFile(const char* path)
+    {
+        File file = SD.open(path, FILE_WRITE);
+        if (!file) {
+            Serial.println("ERR: could not open the trace file");
+            return false;
+        }
+        dump(file);
+        file.close();
+        return true;
+    }
+};
+
+// Begin in the constructor, End in the destructor
+class TraceScope
+{
+private:
+    const char* _name;
+
+public:
+    explicit TraceScope(const char* name) : _name(name) { Trace::event(TraceType::Begin, name); }
+    ~TraceScope() { Trace::event(TraceType::End, _name); }
+};
+
+Trace::Ring Trace::s_rings[portNUM_PROCESSORS];
+uint32_t Trace::s_mask = AIW_TRACE_EVENTS - 1;
+volatile bool Trace::s_running = false;
+Trace::TaskInfo Trace::s_tasks[AIW_TRACE_MAX_TASKS];
+volatile uint8_t Trace::s_taskCount = 0;
+portMUX_TYPE Trace::s_taskLock = portMUX_INITIALIZER_UNLOCKED;
+TaskHandle_t Trace::s_sampler = nullptr;
+uint32_t Trace::s_sampleMs = 100;
+
+#define AIW_TRACE_JOIN2(a, b) a##b
+#define AIW_TRACE_JOIN(a, b) AIW_TRACE_JOIN2(a, b)
+#define AIW_TRACE_SCOPE(name) TraceScope AIW_TRACE_JOIN(_traceScope, __LINE__)(name)
+#define AIW_TRACE_BEGIN(name) Trace::event(TraceType::Begin, name)
+#define AIW_TRACE_END(name) Trace::event(TraceType::End, name)
+#define AIW_TRACE_COUNTER(name, value) Trace::event(TraceType::Counter, name, (int32_t)(value))
+#define AIW_TRACE_INSTANT(name) Trace::event(TraceType::Instant, name)
+#define AIW_TRACE_TASK(name) Trace::registerTask(name)
+#define AIW_TRACE_TASK_END() Trace::unregisterTask()
+
+#else // AIW_TRACE
+
+// Tracing is off: the same calls, doing nothing
+class Trace
+{
+public:
+    static bool begin(uint32_t sampleMs = 100) { (void)sampleMs; return false; }
+    static void stop() {}
+    static bool isRunning() { return false; }
+    static void sampleNow() {}
+    static void dump(Print& out = Serial) { (void)out; }
+    static bool dumpToFile(const char* path) { (void)path; return false; }
+};
+
+#define AIW_TRACE_SCOPE(name) do { } while (0)
+#define AIW_TRACE_BEGIN(name) do { } while (0)
+#define AIW_TRACE_END(name) do { } while (0)
+#define AIW_TRACE_COUNTER(name, value) do { } while (0)
+#define AIW_TRACE_INSTANT(name) do { } while (0)
+#define AIW_TRACE_TASK(name) do { } while (0)
+#define AIW_TRACE_TASK_END() do { } while (0)
+
+#endif // AIW_TRACE
+
+#endif // WORKSHOP_TRACE_H
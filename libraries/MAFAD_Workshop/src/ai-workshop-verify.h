@@ -0,0 +1,222 @@
+#ifndef WORKSHOP_VERIFY_H
+#define WORKSHOP_VERIFY_H
+
+#include "ai-workshop-main.h"
+#include "ai-workshop-scores.h"
+#include "ai-workshop-levels.h"
+#include "ai-workshop-trace.h"
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <string.h>
+
+// This helper expects the Edge Impulse model header to be included BEFORE it.
+// e.g. #include <MAFAD_Classifier_inferencing.h>
+#ifndef EI_CLASSIFIER_FREQUENCY
+#error "Include your Edge Impulse *_inferencing.h before ai-workshop-verify.h"
+#endif
+static_assert(EI_CLASSIFIER_FREQUENCY == SAMPLE_RATE, "the model must use the recording sample rate (SAMPLE_RATE)");
+static_assert(EI_CLASSIFIER_LABEL_COUNT <= SCORES_MAX_LABELS, "the model has more labels than SCORES_MAX_LABELS");
+
+struct VerifyConfig
+{
+    float smoothing = 0.5f;                    // as AiWorkshopInference::begin
+    float threshold = 0.6f;                    // smoothed score that counts as heard
+    const char* background = "noise,random";   // labels that are no melody: nothing should be heard
+};
+
+struct VerifyStats
+{
+    uint32_t takes = 0;        // takes verified
+    uint32_t agreed = 0;
+    uint32_t disagreed = 0;    // sent to /review
+    uint32_t unchecked = 0;    // label unknown to the model, take too short or classifier error
+    uint32_t slices = 0;
+    uint64_t verifyUs = 0;
+    uint32_t maxVerifyUs = 0;
+    uint64_t audioMs = 0;      // length of the verified takes
+
+    // verification time as a part of the take length (1.0 = as slow as real time)
+    float load() const { return audioMs ? verifyUs / 1000.0f / audioMs : 0.0f; }
+};
+
+// Runs the flashed model over a take that was just recorded, before it is saved, to catch
+// takes with the wrong label: another melody played, the melody cut off, random sounds that
+// sound like a melody. The take is in PSRAM already, so the slices go into the classifier
+// one after the other, as fast as it runs (no waiting for the microphone).
+//
+// It decides like tools/host/model_eval.cpp, so a take sent to /review here is one the
+// model gets wrong there: slices of EI_CLASSIFIER_SLICE_SIZE into run_classifier_continuous(),
+// scores smoothed (ScoreSmoother), "heard X" at the first slice where the smoothed score of
+// melody X reaches the threshold. A melody take agrees when its own label is heard first, a
+// background take when no melody is heard.
+//
+//   TakeCheck check;
+//   verifier.verify(mic.getRecordedData(), mic.getRecordedSamples(), "hello_there", check);
+//   sdCard.writeAudioFile(..., &levels, &check);   // disagreements go to /review
+//
+// The classifier keeps its state in globals: do not verify while AiWorkshopInference is running.
+class TakeVerifier
+{
+private:
+    VerifyConfig _config;
+    const int32_t* _slice = nullptr;   // the slice the classifier reads
+    VerifyStats _stats;
+
+    // label is one of the comma separated names in list
+    static bool inList(const char* list, const char* label)
+    {
+        size_t length = strlen(label);
+        while (list && *list)
+        {
+            const char* comma = strchr(list, ',');
+            size_t n = comma ? (size_t)(comma - list) : strlen(list);
+            if (n == length && strncmp(list, label, n) == 0) return true;
+            list = comma ? comma + 1 : nullptr;
+        }
+        return false;
+    }
+
+    static int labelIndex(const char* label)
+    {
+        for (int ix = 0; ix < EI_CLASSIFIER_LABEL_COUNT; ix++)
+        {
+            if (strcmp(ei_classifier_inferencing_categories[ix], label) == 0) return ix;
+        }
+        return -1;
+    }
+
+    // The samples as the WAV file gets them (16 bit), as floats for the classifier
+    int getData(size_t offset, size_t length, float* out)
+    {
+        for (size_t i = 0; i < length; i++)
+        {
+            int32_t v = _slice[offset + i] / 4096;
+            if (v > INT16_MAX) v = INT16_MAX;
+            if (v < INT16_MIN) v = INT16_MIN;
+            out[i] = (float)v;
+        }
+        return 0;
+    }
+
+    // The trampoline is only needed when EI is built with plain function pointers (one instance).
+    static TakeVerifier*& instance()
+    {
+        static TakeVerifier* s = nullptr;
+        return s;
+    }
+
+    static int getDataTrampoline(size_t offset, size_t length, float* out)
+    {
+        return instance()->getData(offset, length, out);
+    }
+
+    void addStats(const TakeCheck& check)
+    {
+        _stats.takes++;
+        if (!check.checked)
+        {
+            _stats.unchecked++;
+            return;
+        }
+        if (check.agrees) _stats.agreed++;
+        else _stats.disagreed++;
+        _stats.slices += check.slices;
+        _stats.verifyUs += check.verifyUs;
+        if (check.verifyUs > _stats.maxVerifyUs) _stats.maxVerifyUs = check.verifyUs;
+        _stats.audioMs += check.takeMs;
+    }
+
+public:
+    // Constructor
+    TakeVerifier() {}
+
+    void begin(const VerifyConfig& config = VerifyConfig())
+    {
+        _config = config;
+        _stats = VerifyStats();
+    }
+
+    // samples: raw microphone samples (mic.getRecordedData()), label: what was recorded.
+    // Fills check and returns true when the take was verified. False (check.checked false)
+    // when the model does not know the label (a new melody), the take is shorter than a slice
+    // or the classifier failed: there is nothing to say about the take then.
+    bool verify(const int32_t* samples, uint32_t count, const char* label, TakeCheck& check)
+    {
+        AIW_TRACE_SCOPE("verify take");
+        int64_t start = esp_timer_get_time();
+        check = TakeCheck();
+        if (samples == nullptr) count = 0;
+        check.takeMs = (uint32_t)((uint64_t)count * 1000 / SAMPLE_RATE);
+
+        bool background = inList(_config.background, label);
+        if (count < EI_CLASSIFIER_SLICE_SIZE || (!background && labelIndex(label) < 0))
+        {
+            Serial.printf("Not verified: '%s' is %s\n", label,
+                          count < EI_CLASSIFIER_SLICE_SIZE ? "shorter than a slice" : "not a label of the model");
+            addStats(check);
+            return false;
+        }
+
+        signal_t signal;
+        signal.total_length = EI_CLASSIFIER_SLICE_SIZE;
+#if EIDSP_SIGNAL_C_FN_POINTER
+        instance() = this;
+        signal.get_data = &getDataTrampoline;
+#else
+        signal.get_data = [this](size_t offset, size_t length, float* out) { return getData(offset, length, out); };
+#endif
+
+        run_classifier_init();
+        ScoreSmoother scores(_config.smoothing);
+        bool failed = false;
+        int heard = -1;
+        for (uint32_t at = 0; at + EI_CLASSIFIER_SLICE_SIZE <= count; at += EI_CLASSIFIER_SLICE_SIZE)
+        {
+            _slice = samples + at;
+            ei_impulse_result_t result = {};
+            if (run_classifier_continuous(&signal, &result, false) != EI_IMPULSE_OK)
+            {
+                failed = true;
+                break;
+            }
+            check.slices++;
+
+            scores.update(result, EI_CLASSIFIER_LABEL_COUNT);
+            int top = scores.topIndex();
+            if (top < 0 || inList(_config.background, ei_classifier_inferencing_categories[top])) continue;
+            if (scores.topScore() > check.confidence) check.confidence = scores.topScore();
+            if (scores.topScore() >= _config.threshold)
+            {
+                heard = top;
+                break;   // the first label heard decides, the rest of the take does not matter
+            }
+        }
+        _slice = nullptr;
+
+        check.checked = !failed;
+        if (heard >= 0) snprintf(check.heard, sizeof(check.heard), "%s", ei_classifier_inferencing_categories[heard]);
+        check.agrees = background ? heard < 0 : (heard >= 0 && strcmp(check.heard, label) == 0);
+        check.verifyUs = (uint32_t)(esp_timer_get_time() - start);
+        addStats(check);
+        if (failed) Serial.println("ERR: the classifier failed, take not verified");
+        return check.checked;
+    }
+
+    VerifyStats getStats() const { return _stats; }
+
+    // e.g. "verify: 14 takes, 12 agreed, 1 to review, 1 not verified | 412 ms per take (max 455) = 16% of the take length"
+    void printStats(Print& out = Serial)
+    {
+        const VerifyStats& s = _stats;
+        uint32_t verified = s.takes - s.unchecked;
+        char line[200];
+        snprintf(line, sizeof(line),
+                 "verify: %u takes, %u agreed, %u to review, %u not verified | %.0f ms per take (max %.0f) = %.0f%% of the take length\n",
+                 (unsigned)s.takes, (unsigned)s.agreed, (unsigned)s.disagreed, (unsigned)s.unchecked,
+                 verified ? s.verifyUs / 1000.0f / verified : 0.0f, s.maxVerifyUs / 1000.0f, 100.0f * s.load());
+        out.write((const uint8_t*)line, strlen(line));
+    }
+};
+
+#endif // WORKSHOP_VERIFY_H
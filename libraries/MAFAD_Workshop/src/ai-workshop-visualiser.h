@@ -0,0 +1,414 @@
+#ifndef WORKSHOP_VISUALISER_H
+#define WORKSHOP_VISUALISER_H
+
+#include "ai-workshop-main.h"
+#include "ai-workshop-mic.h"
+#include "ai-workshop-fft.h"
+#include "ai-workshop-ws2812.h"
+#include "ai-workshop-trace.h"
+
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define VIS_FFT_SIZE 512     // samples per spectrum (25.6 ms at 20 kHz, 39 Hz per bin)
+#define VIS_HOP 256          // a new spectrum every 12.8 ms
+#define VIS_RING 4096        // audio kept for the analysis (power of 2, more than a DMA block + a spectrum)
+#define VIS_MAX_BANDS 32
+#define VIS_FPS 60
+
+struct VisualiserConfig
+{
+    float lowHz = 150.0f;            // the first band starts here
+    float highHz = 6000.0f;          // the last band ends here, the bands in between are log spaced
+    float rangeDb = 40.0f;           // from dark to full brightness
+    float floorDb = -70.0f;          // the quietest sound that lights up (dB full scale): a quiet room stays dark
+    float agcFallDb = 6.0f;          // the loudest sound is forgotten this many dB per second (auto gain)
+    float fallPerSecond = 3.0f;      // a bar falls from full to dark in 1/3 s
+    uint16_t holdMs = 300;           // the peak of a band stays visible this long
+    float peakFallPerSecond = 1.0f;
+    float peakGlow = 0.3f;           // how bright a held peak is compared to the bar
+    uint8_t brightness = 96;         // 0 .. 255, the ring is bright
+    uint8_t hueLow = 0;              // red for the lowest band ...
+    uint8_t hueHigh = 170;           // ... to blue for the highest (Color::FromHSL hues)
+};
+
+struct VisualiserStats
+{
+    uint32_t frames = 0;          // frames pushed to the ring
+    uint32_t spectra = 0;         // hops analysed
+    uint32_t skipped = 0;         // hops skipped because the task fell behind the audio
+    uint32_t late = 0;            // frames that started more than a frame late
+    uint32_t ringBusy = 0;        // frames not pushed because the ring was still sending the last one
+    uint32_t blocks = 0;          // stream blocks copied by the hook
+    uint32_t maxHookUs = 0;
+    uint64_t totalHookUs = 0;     // time taken from the capture task
+    uint32_t maxFrameUs = 0;      // spectra + colors + push of one frame
+    uint64_t totalFrameUs = 0;
+    int64_t startUs = 0;
+};
+
+// A spectrum on the LED ring, from the microphone stream, next to the classifier.
+//
+// A stream hook only copies every block into a ring (a few us on the capture task, so the
+// stream never falls behind). A task of its own then, VIS_FPS times per second:
+//   - takes the audio in hops of VIS_HOP samples: a Hann windowed VIS_FFT_SIZE spectrum per hop,
+//     two hops per complex FFT (FFT::forwardRealPair)
+//   - sums the power in one log spaced band per LED, in dB against the loudest sound of the
+//     last seconds (auto gain), so loud and quiet rooms both fill the ring
+//   - bars jump up and fall slowly, the peak of every band is held for a moment
+//   - colors: Color::FromHSL, the hue goes from low to high bands, the brightness is the bar
+//   - pushes the ring with updateAsync(): the RMT sends it while the task sleeps
+// The microphone only gives audio once per DMA block (51 ms), so the display runs a block
+// behind the microphone: that way every frame has fresh audio and the animation is smooth.
+//
+//   visualiser.begin(mic, ledRing, NUM_LEDS);   // after mic.setup(), before mic.startStream()
+//   visualiser.setEnabled(false);               // hand the ring back to loop() for a moment
+class Visualiser
+{
+private:
+    VisualiserConfig _config;
+    WS2812* _ring = nullptr;
+    uint8_t _bands = 0;
+    TaskHandle_t _task = nullptr;
+    volatile bool _running = false;
+    volatile bool _enabled = true;
+    volatile bool _inFrame = false;
+
+    FFT _fft;
+    float* _audio = nullptr;      // VIS_RING samples written by the hook
+    float* _window = nullptr;
+    float* _frame = nullptr;      // complex: two hops, one in the real and one in the imaginary parts
+    float* _first = nullptr;      // spectra of the two hops (VIS_FFT_SIZE / 2 + 1 complex bins)
+    float* _second = nullptr;
+    uint16_t _edges[VIS_MAX_BANDS + 1];   // first bin of every band, and the end of the last one
+
+    // written by the hook
+    uint32_t _written = 0;        // samples written so far
+    int64_t _lastUs = 0;          // esp_timer time of the newest sample
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+
+    // task state
+    uint32_t _analysed = 0;       // end of the last hop that was analysed (in samples)
+    bool _started = false;
+    float _agcDb = -120.0f;
+    float _hopLevel[VIS_MAX_BANDS];   // loudest of the hops since the last frame, 0 .. 1
+    float _bar[VIS_MAX_BANDS];
+    float _peak[VIS_MAX_BANDS];
+    int64_t _peakUntil[VIS_MAX_BANDS];
+    VisualiserStats _stats;
+
+    static void streamHook(float* samples, uint32_t count, int64_t timeUs, void* user)
+    {
+        static_cast<Visualiser*>(user)->onBlock(samples, count, timeUs);
+    }
+
+    void onBlock(const float* samples, uint32_t count, int64_t timeUs)
+    {
+        int64_t start = esp_timer_get_time();
+        uint32_t pos = _written & (VIS_RING - 1);
+        uint32_t first = count < VIS_RING - pos ? count : VIS_RING - pos;
+        memcpy(_audio + pos, samples, first * sizeof(float));
+        memcpy(_audio, samples + first, (count - first) * sizeof(float));
+        uint32_t us = (uint32_t)(esp_timer_get_time() - start);
+
+        portENTER_CRITICAL(&_lock);
+        _written += count;
+        _lastUs = timeUs;
+        _stats.blocks++;
+        _stats.totalHookUs += us;
+        if (us > _stats.maxHookUs) _stats.maxHookUs = us;
+        portEXIT_CRITICAL(&_lock);
+    }
+
+    void release()
+    {
+        if (_audio) { heap_caps_free(_audio); _audio = nullptr; }
+        if (_window) { heap_caps_free(_window); _window = nullptr; }
+        if (_frame) { heap_caps_free(_frame); _frame = nullptr; }
+        if (_first) { heap_caps_free(_first); _first = nullptr; }
+        if (_second) { heap_caps_free(_second); _second = nullptr; }
+    }
+
+    void makeBands()
+    {
+        const float binHz = (float)SAMPLE_RATE / VIS_FFT_SIZE;
+        const float ratio = _config.highHz / _config.lowHz;
+        uint16_t previous = 0;
+        for (uint8_t b = 0; b <= _bands; b++) {
+            float hz = _config.lowHz * powf(ratio, (float)b / _bands);
+            uint16_t bin = (uint16_t)(hz / binHz + 0.5f);
+            if (bin < 1) bin = 1;   // no DC
+            if (b > 0 && bin <= previous) bin = previous + 1;   // at least one bin per band
+            if (bin > VIS_FFT_SIZE / 2) bin = VIS_FFT_SIZE / 2;
+            _edges[b] = previous = bin;
+        }
+    }
+
+    // copy the hop that ends at sample end (windowed) into the real or imaginary parts of the frame
+    void loadHop(uint32_t end, uint32_t part)
+    {
+        uint32_t pos = end - VIS_FFT_SIZE;
+        for (uint32_t i = 0; i < VIS_FFT_SIZE; i++) {
+            _frame[2 * i + part] = _audio[(pos + i) & (VIS_RING - 1)] * _window[i];
+        }
+    }
+
+    // band levels of one spectrum, the loudest per band is kept until the next frame
+    void addSpectrum(const float* spectrum, float dt)
+    {
+        // full scale sine in the middle of a bin: |X| = 32767 * VIS_FFT_SIZE / 4 (Hann)
+        const float fullScale = 32767.0f * VIS_FFT_SIZE / 4;
+        const float toDb = 1.0f / (fullScale * fullScale);
+        float db[VIS_MAX_BANDS];
+        float loudest = -120.0f;
+        for (uint8_t b = 0; b < _bands; b++) {
+            float power = 0.0f;
+            for (uint16_t k = _edges[b]; k < _edges[b + 1]; k++) {
+                power += spectrum[2 * k] * spectrum[2 * k] + spectrum[2 * k + 1] * spectrum[2 * k + 1];
+            }
+            db[b] = 10.0f * log10f(power * toDb + 1e-12f);
+            if (db[b] > loudest) loudest = db[b];
+        }
+
+        // auto gain: follows a loud sound at once, forgets it slowly, never below the floor
+        _agcDb -= _config.agcFallDb * dt;
+        if (loudest > _agcDb) _agcDb = loudest;
+        if (_agcDb < _config.floorDb + _config.rangeDb) _agcDb = _config.floorDb + _config.rangeDb;
+
+        for (uint8_t b = 0; b < _bands; b++) {
+            float level = (db[b] - (_agcDb - _config.rangeDb)) / _config.rangeDb;
+            level = level < 0.0f ? 0.0f : level > 1.0f ? 1.0f : level;
+            if (level > _hopLevel[b]) _hopLevel[b] = level;
+        }
+        _stats.spectra++;
+    }
+
+    // analyse the hops that are due for this frame, returns false when there is no audio (yet)
+    bool analyse(int64_t nowUs)
+    {
+        portENTER_CRITICAL(&_lock);
+        uint32_t written = _written;
+        int64_t lastUs = _lastUs;
+        portEXIT_CRITICAL(&_lock);
+        if (written < VIS_FFT_SIZE) return false;
+
+        // the sample that was heard one block ago: the display runs that far behind
+        const int64_t delayUs = (int64_t)DMA_BUFFER_SIZE * 1000000 / SAMPLE_RATE + 1000000 / VIS_FPS;
+        int64_t behind = (lastUs - (nowUs - delayUs)) * SAMPLE_RATE / 1000000;
+        if (behind < 0) behind = 0;
+        uint32_t due = behind >= (int64_t)written ? 0 : written - (uint32_t)behind;
+
+        // the newest VIS_RING - DMA_BUFFER_SIZE samples are safe from the next block
+        uint32_t oldest = written > VIS_RING - DMA_BUFFER_SIZE ? written - (VIS_RING - DMA_BUFFER_SIZE) : 0;
+        if (!_started || _analysed < oldest + VIS_FFT_SIZE) {
+            uint32_t restart = (due > oldest + VIS_FFT_SIZE ? due : oldest + VIS_FFT_SIZE) - VIS_HOP;
+            if (_started && restart > _analysed) _stats.skipped += (restart - _analysed) / VIS_HOP;
+            _analysed = restart;
+            _started = true;
+        }
+
+        const float dt = (float)VIS_HOP / SAMPLE_RATE;
+        while (_analysed + VIS_HOP <= due) {
+            bool pair = _analysed + 2 * VIS_HOP <= due;
+            loadHop(_analysed + VIS_HOP, 0);
+            if (pair) {
+                loadHop(_analysed + 2 * VIS_HOP, 1);
+            } else {
+                for (uint32_t i = 0; i < VIS_FFT_SIZE; i++) _frame[2 * i + 1] = 0.0f;
+            }
+            _fft.forwardRealPair(_frame, _first, _second);
+            addSpectrum(_first, dt);
+            _analysed += VIS_HOP;
+            if (pair) {
+                addSpectrum(_second, dt);
+                _analysed += VIS_HOP;
+            }
+        }
+        return true;
+    }
+
+    // bars, peaks and colors of one frame
+    void draw(float dt, int64_t nowUs)
+    {
+        for (uint8_t b = 0; b < _bands; b++) {
+            float bar = _bar[b] - _config.fallPerSecond * dt;
+            if (_hopLevel[b] > bar) bar = _hopLevel[b];
+            _bar[b] = bar > 0.0f ? bar : 0.0f;
+            _hopLevel[b] = 0.0f;
+
+            if (_bar[b] >= _peak[b]) {
+                _peak[b] = _bar[b];
+                _peakUntil[b] = nowUs + (int64_t)_config.holdMs * 1000;
+            } else if (nowUs > _peakUntil[b]) {
+                _peak[b] -= _config.peakFallPerSecond * dt;
+                if (_peak[b] < 0.0f) _peak[b] = 0.0f;
+            }
+
+            float value = _bar[b];
+            float glow = _peak[b] * _config.peakGlow;
+            if (glow > value) value = glow;
+            uint8_t hue = _config.hueLow + (int)(_config.hueHigh - _config.hueLow) * b / (_bands > 1 ? _bands - 1 : 1);
+            uint8_t light = (uint8_t)(_config.brightness * value * value);   // squared: looks more even to the eye
+            (*_ring)[b] = Color::FromHSL(hue, 255, light);
+        }
+    }
+
+    static void visualiserTask(void* param)
+    {
+        Visualiser* vis = (Visualiser*)param;
+        AIW_TRACE_TASK("Visualiser");
+        const int64_t frameUs = 1000000 / VIS_FPS;
+        int64_t next = esp_timer_get_time();
+        int64_t last = next;
+
+        while (vis->_running) {
+            int64_t now = esp_timer_get_time();
+            if (now > next + frameUs) {
+                vis->_stats.late++;
+                next = now;   // do not try to catch up
+            }
+
+            vis->_inFrame = true;
+            if (vis->_enabled) {
+                AIW_TRACE_SCOPE("visualiser frame");
+                vis->analyse(now);
+                vis->draw((now - last) / 1e6f, now);
+                if (vis->_ring->updateAsync()) {
+                    vis->_stats.frames++;
+                } else {
+                    vis->_stats.ringBusy++;
+                }
+                uint32_t us = (uint32_t)(esp_timer_get_time() - now);
+                portENTER_CRITICAL(&vis->_lock);
+                vis->_stats.totalFrameUs += us;
+                if (us > vis->_stats.maxFrameUs) vis->_stats.maxFrameUs = us;
+                portEXIT_CRITICAL(&vis->_lock);
+            } else {
+                vis->_started = false;   // start again at the newest audio
+            }
+            vis->_inFrame = false;
+            last = now;
+
+            next += frameUs;
+            int64_t wait = next - esp_timer_get_time();
+            vTaskDelay(wait > 1000 ? pdMS_TO_TICKS(wait / 1000) : 1);
+        }
+        AIW_TRACE_TASK_END();
+        vis->_task = nullptr;
+        vTaskDelete(nullptr);
+    }
+
+public:
+    // Constructor
+    Visualiser() {}
+
+    // Call after mic.setup() and ledRing.init(). bands: one per LED (up to VIS_MAX_BANDS).
+    // The task should not run on the core of the inference task: core 1 (with loop()) by default.
+    bool begin(i2sMic& mic, WS2812& ring, uint8_t bands, const VisualiserConfig& config = VisualiserConfig(),
+               UBaseType_t priority = 1, BaseType_t core = 1)
+    {
+        if (_running) return false;
+        if (bands == 0 || bands > VIS_MAX_BANDS) {
+            Serial.println("ERR: Visualiser needs 1 .. VIS_MAX_BANDS bands");
+            return false;
+        }
+        _config = config;
+        _ring = &ring;
+        _bands = bands;
+        if (!_fft.begin(VIS_FFT_SIZE)) return false;
+
+        const uint32_t caps = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+        _audio = (float*)heap_caps_calloc(VIS_RING, sizeof(float), caps);
+        _window = (float*)heap_caps_malloc(VIS_FFT_SIZE * sizeof(float), caps);
+        _frame = (float*)heap_caps_malloc(2 * VIS_FFT_SIZE * sizeof(float), caps);
+        _first = (float*)heap_caps_malloc((VIS_FFT_SIZE + 2) * sizeof(float), caps);
+        _second = (float*)heap_caps_malloc((VIS_FFT_SIZE + 2) * sizeof(float), caps);
+        if (!_audio || !_window || !_frame || !_first || !_second) {
+            Serial.println("ERR: Visualiser alloc failed");
+            release();
+            return false;
+        }
+        FFT::hannWindow(_window, VIS_FFT_SIZE);
+        makeBands();
+
+        for (uint8_t b = 0; b < VIS_MAX_BANDS; b++) {
+            _hopLevel[b] = _bar[b] = _peak[b] = 0.0f;
+            _peakUntil[b] = 0;
+        }
+        _written = 0;
+        _started = false;
+        _agcDb = -120.0f;
+        _stats = VisualiserStats();
+        _stats.startUs = esp_timer_get_time();
+
+        if (!mic.addStreamHook(streamHook, this)) {
+            release();
+            return false;
+        }
+        _running = true;
+        if (pdPASS != xTaskCreatePinnedToCore(visualiserTask, "Visualiser", 4096, this, priority, &_task, core)) {
+            _running = false;
+            mic.removeStreamHook(streamHook, this);
+            release();
+            return false;
+        }
+        return true;
+    }
+
+    void end(i2sMic& mic)
+    {
+        mic.removeStreamHook(streamHook, this);
+        _running = false;
+        for (int i = 0; i < 200 && _task != nullptr; i++) delay(1);
+        if (_task == nullptr) release();
+    }
+
+    // Switch the display off (false) to use the ring for something else, and on again.
+    // Waits until the frame that is being drawn is done.
+    void setEnabled(bool enabled)
+    {
+        _enabled = enabled;
+        while (!enabled && _inFrame) delay(1);
+    }
+
+    bool isEnabled() const { return _enabled; }
+
+    // The bar of a band now, 0 .. 1 (to make the robot dance to the bass, for example)
+    float getBand(uint8_t band) const
+    {
+        return band < _bands ? _bar[band] : 0.0f;
+    }
+
+    // The frequencies of a band (Hz)
+    float getBandLowHz(uint8_t band) const { return band < _bands ? _edges[band] * (float)SAMPLE_RATE / VIS_FFT_SIZE : 0.0f; }
+    float getBandHighHz(uint8_t band) const { return band < _bands ? _edges[band + 1] * (float)SAMPLE_RATE / VIS_FFT_SIZE : 0.0f; }
+
+    VisualiserStats getStats()
+    {
+        portENTER_CRITICAL(&_lock);
+        VisualiserStats s = _stats;
+        portEXIT_CRITICAL(&_lock);
+        return s;
+    }
+
+    void printStats(Print& out = Serial)
+    {
+        VisualiserStats s = getStats();
+        float seconds = (esp_timer_get_time() - s.startUs) / 1e6f;
+        float frameUs = s.frames ? (float)s.totalFrameUs / s.frames : 0.0f;
+        float hookUs = s.blocks ? (float)s.totalHookUs / s.blocks : 0.0f;
+        float cpu = seconds > 0.0f ? (s.totalFrameUs + s.totalHookUs) / (seconds * 1e4f) : 0.0f;
+        char line[200];
+        int n = snprintf(line, sizeof(line),
+                         "visualiser: %.1f fps, %u spectra, %u late, %u skipped, %u ring busy | frame %.0f us (max %u), hook %.1f us per block (max %u) = %.2f%% cpu\r\n",
+                         seconds > 0.0f ? s.frames / seconds : 0.0f, (unsigned)s.spectra, (unsigned)s.late, (unsigned)s.skipped,
+                         (unsigned)s.ringBusy, frameUs, (unsigned)s.maxFrameUs, hookUs, (unsigned)s.maxHookUs, cpu);
+        out.write((const uint8_t*)line, n);
+    }
+};
+
+#endif // WORKSHOP_VISUALISER_H
@@ -0,0 +1,190 @@
+#ifndef WORKSHOP_WAV_H
+#define WORKSHOP_WAV_H
+
+// WAV headers and the choice of crops, shared by SDCard (on the robot) and the
+// host tools (tools/host/dataset_builder.cpp). Plain C++, no Arduino needed.
+
+#include <stdint.h>
+#include <string.h>
+
+#define CROP_OFFSET 2000          // size of crop offset (samples)
+#define MAX_CROPS 24              // crops that fit in a 3 second take, one every CROP_OFFSET
+#define WAV_HEADER_SIZE 44
+
+// A 44 byte header for 16 bit PCM audio. extraBytes: chunks after the samples (fillWavInfoChunk)
+static inline void fillWavHeader(uint8_t* header, uint32_t numSamples, uint32_t sampleRate, uint16_t channels = 1,
+                                 uint32_t extraBytes = 0)
+{
+    uint32_t b4;
+    uint16_t b2;
+    memcpy(header, "RIFF", 4);
+    b4 = numSamples * 2 * channels + WAV_HEADER_SIZE - 8 + extraBytes; // exclude 'RIFF' and filesize field
+    memcpy(header + 4, &b4, 4);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    b4 = 16;
+    memcpy(header + 16, &b4, 4); // fmt size
+    b2 = 1;
+    memcpy(header + 20, &b2, 2); // 1=PCM
+    memcpy(header + 22, &channels, 2);
+    memcpy(header + 24, &sampleRate, 4);
+    b4 = sampleRate * 2 * channels;
+    memcpy(header + 28, &b4, 4); // Sample Rate * BitsPerSample * Channels) / 8.
+    b2 = 2 * channels;
+    memcpy(header + 32, &b2, 2); // bytes per frame
+    b2 = 16;
+    memcpy(header + 34, &b2, 2); // bits per sample
+    memcpy(header + 36, "data", 4);
+    b4 = numSamples * 2 * channels;
+    memcpy(header + 40, &b4, 4); // data length in bytes
+}
+
+// A LIST/INFO chunk with a comment (ICMT), to write after the samples: players and
+// Edge Impulse skip it, the comment shows in the file properties. Returns its size in
+// bytes (even), 0 when it does not fit in capacity.
+static inline uint32_t fillWavInfoChunk(uint8_t* out, uint32_t capacity, const char* comment)
+{
+    uint32_t text = (uint32_t)strlen(comment) + 1;   // with the 0 at the end
+    uint32_t padded = text + (text & 1);
+    uint32_t size = 8 + 4 + 8 + padded;
+    if (size > capacity) return 0;
+    uint32_t b4;
+    memcpy(out, "LIST", 4);
+    b4 = size - 8;
+    memcpy(out + 4, &b4, 4);
+    memcpy(out + 8, "INFOICMT", 8);
+    memcpy(out + 16, &text, 4);
+    memcpy(out + 20, comment, text);
+    if (padded != text) out[20 + text] = 0;
+    return size;
+}
+
+struct WavInfo
+{
+    uint32_t sampleRate = 0;
+    uint16_t channels = 0;
+    uint32_t dataOffset = 0;   // bytes from the start of the file
+    uint32_t dataBytes = 0;    // length of the data chunk, as its header says
+    uint32_t numSamples = 0;   // per channel (in the bytes parseWavHeader() was given)
+};
+
+// Read the header of a 16 bit PCM WAV file (size bytes at data). Skips chunks other
+// than "fmt " and "data", so files from other programs work too.
+static inline bool parseWavHeader(const uint8_t* data, uint32_t size, WavInfo& info)
+{
+    if (size < 12 || memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0) return false;
+    bool haveFormat = false;
+    uint32_t pos = 12;
+    while (pos + 8 <= size) {
+        uint32_t chunk;
+        memcpy(&chunk, data + pos + 4, 4);
+        if (memcmp(data + pos, "fmt ", 4) == 0 && chunk >= 16 && pos + 8 + 16 <= size) {
+            uint16_t format, bits;
+            memcpy(&format, data + pos + 8, 2);
+            memcpy(&info.channels, data + pos + 10, 2);
+            memcpy(&info.sampleRate, data + pos + 12, 4);
+            memcpy(&bits, data + pos + 22, 2);
+            if (format != 1 || bits != 16 || info.channels == 0) return false;
+            haveFormat = true;
+        } else if (memcmp(data + pos, "data", 4) == 0) {
+            if (!haveFormat) return false;
+            info.dataOffset = pos + 8;
+            info.dataBytes = chunk;
+            if (chunk > size - info.dataOffset) chunk = size - info.dataOffset;   // cut short
+            info.numSamples = chunk / (2 * info.channels);
+            return true;
+        }
+        pos += 8 + chunk + (chunk & 1);
+    }
+    return false;
+}
+
+// Bytes of samples in a file of fileSize bytes whose header parseWavHeader() read: the
+// length of the data chunk, or up to the end of the file when the recording was cut short.
+// Chunks after the samples (LIST/INFO) are not included.
+static inline uint32_t wavDataBytes(const WavInfo& info, uint32_t fileSize)
+{
+    uint32_t fileBytes = fileSize > info.dataOffset ? fileSize - info.dataOffset : 0;
+    return info.dataBytes < fileBytes ? info.dataBytes : fileBytes;
+}
+
+// Where to cut numCrops windows of windowSamples out of a take of numSamples.
+// The possible starts are every CROP_OFFSET samples; they are split into numCrops bins
+// and one random start is taken from each bin, so the crops spread over the take.
+// random(n) must return 0 .. n-1. Writes the offsets (in samples, sorted) and returns how many.
+template <typename Random>
+static uint8_t pickCrops(uint32_t numSamples, uint32_t windowSamples, uint8_t numCrops, uint32_t* offsets, Random random)
+{
+    // Edge case: not enough audio to make a crop
+    if (numSamples < windowSamples || numCrops == 0) {
+        return 0;
+    }
+
+    uint32_t sampleMargin = numSamples - windowSamples;
+    uint32_t maxCrops = sampleMargin / CROP_OFFSET + 1;
+    if (maxCrops > MAX_CROPS) maxCrops = MAX_CROPS;
+
+    // pick numCrops crops within maxCrops
+    if (numCrops > maxCrops) numCrops = maxCrops;
+
+    // one crop (asked for, or all that fits): the middle of the take
+    if (numCrops <= 1) {
+        offsets[0] = sampleMargin / 2;
+        return 1;
+    }
+
+    bool used[MAX_CROPS] = { false };
+    uint16_t idxs[MAX_CROPS] = { 0 };
+    uint8_t picked = 0;
+
+    for (uint8_t b = 0; b < numCrops; b++)
+    {
+        uint32_t start = (uint32_t)b * maxCrops / numCrops;
+        uint32_t end   = (uint32_t)(b + 1) * maxCrops / numCrops;
+        if (end == 0) continue;
+        end -= 1;
+
+        if (end >= maxCrops) end = maxCrops - 1;
+        if (start > end) start = end;
+
+        uint32_t span = end - start + 1;
+        uint32_t idx = start + (uint32_t)random(span);
+
+        // avoid duplicates (wrap inside bin)
+        for (uint32_t tries = 0; tries < span && used[idx]; tries++)
+        {
+            idx++;
+            if (idx > end) idx = start;
+        }
+
+        // fallback: global search forward
+        if (used[idx])
+        {
+            for (uint32_t j = 0; j < maxCrops; j++)
+            {
+                uint32_t k = (idx + j) % maxCrops;
+                if (!used[k]) { idx = k; break; }
+            }
+        }
+
+        used[idx] = true;
+        idxs[picked++] = (uint16_t)idx;
+    }
+
+    // sort indices (tiny list)
+    for (uint8_t i = 1; i < picked; i++)
+    {
+        uint16_t key = idxs[i];
+        int8_t k = (int8_t)i - 1;
+        while (k >= 0 && idxs[k] > key)
+        {
+            idxs[k + 1] = idxs[k];
+            k--;
+        }
+        idxs[k + 1] = key;
+    }
+
+    for (uint8_t i = 0; i < picked; i++) offsets[i] = (uint32_t)idxs[i] * CROP_OFFSET;
+    return picked;
+}
+
+#endif // WORKSHOP_WAV_H
@@ -12,6 +12,7 @@
 #include <Arduino.h>
 #include <soc/soc_caps.h>   // for SOC_RMT_SUPPORTED
 #include "esp32-hal-rmt.h"  // for rmtInit/rmtWrite/rmt_data_t
+#include "ai-workshop-trace.h"
 
 class Color {
 public:
@@ -117,6 +118,7 @@ private:
   
   void update() {
     if (!initialized) return;
+    AIW_TRACE_SCOPE("led update");
     
     #if SOC_RMT_SUPPORTED
   
@@ -166,13 +168,37 @@ private:
   uint16_t numLeds;
   bool initialized;
   uint8_t pin;
+  rmt_data_t* asyncData;  // symbols of updateAsync(), they must stay until the RMT has sent them
+
+  #if SOC_RMT_SUPPORTED
+  // 24 symbols per led (g, r, b, highest bit first), a table lookup instead of a branch per bit
+  void encode(rmt_data_t* led_data) {
+    rmt_data_t bits[2];
+    bits[0].level0 = 1; bits[0].duration0 = 4; bits[0].level1 = 0; bits[0].duration1 = 8;  // 0: 0.4us high, 0.8us low
+    bits[1].level0 = 1; bits[1].duration0 = 8; bits[1].level1 = 0; bits[1].duration1 = 4;  // 1: 0.8us high, 0.4us low
+
+    for (uint16_t l = 0; l < numLeds; l++) {
+      uint32_t grb = (uint32_t)leds[l].g << 16 | (uint32_t)leds[l].r << 8 | leds[l].b;
+      for (int bit = 23; bit >= 0; bit--) {
+        *led_data++ = bits[(grb >> bit) & 1];
+      }
+    }
+  }
+  #endif
   
 public:
-  WS2812() : pin(0), leds(nullptr), numLeds(0), initialized(false) {}
+  WS2812() : pin(0), leds(nullptr), numLeds(0), initialized(false), asyncData(nullptr) {}
 
   Color* leds;
 
   void init(uint8_t datapin, Color* ledArray, uint16_t count) {
+    #if SOC_RMT_SUPPORTED
+    if (asyncData != nullptr && count != numLeds) {
+      while (!rmtTransmitCompleted(pin)) delay(1);
+      delete[] asyncData;
+      asyncData = nullptr;
+    }
+    #endif
     pin = datapin;
     leds = ledArray;
     numLeds = count;
@@ -190,38 +216,47 @@ public:
   
   void update() {
     if (!initialized || leds == nullptr) return;
+    AIW_TRACE_SCOPE("ledring update");
     
     #if SOC_RMT_SUPPORTED
   
+    // wait for an updateAsync() that is still being sent
+    while (asyncData != nullptr && !rmtTransmitCompleted(pin)) delay(1);
+
     rmt_data_t led_data[24*numLeds];
-    int led_data_index = 0;
-    uint8_t led_data_value=0;
+    encode(led_data);
 
-    for (uint16_t l = 0; l < numLeds; l++) {
-      for (int c = 0; c < 3; c++) {
-        for (int bit = 0; bit < 8; bit++) {
-          if (c==1) led_data_value = leds[l].r;
-          if (c==0) led_data_value = leds[l].g;
-          if (c==2) led_data_value = leds[l].b;
+    // Write the data to the LEDRING
+    rmtWrite(pin, led_data, RMT_SYMBOLS_OF(led_data), RMT_WAIT_FOR_EVER);
+    #endif
+  }
 
-          if (led_data_value & (1 << (7 - bit))) {
-            led_data[led_data_index].level0 = 1; // HIGH bit
-            led_data[led_data_index].duration0 = 8; // 0.8us
-            led_data[led_data_index].level1 = 0; // LOW bit
-            led_data[led_data_index].duration1 = 4; // 0.4us
-          } else {
-            led_data[led_data_index].level0 = 1; // LOW bit
-            led_data[led_data_index].duration0 = 4; // 0.4us
-            led_data[led_data_index].level1 = 0; // HIGH bit
-            led_data[led_data_index].duration1 = 8; // 0.8us
-          }
-          led_data_index++;
-        }
-      }
+  // The same as update(), but returns at once: the RMT sends the colors in the background
+  // (about 30us per led). Returns false while the last update is still being sent, so a
+  // task that updates often (an animation) never waits for the ring.
+  bool updateAsync() {
+    if (!initialized || leds == nullptr) return false;
+    AIW_TRACE_SCOPE("ledring update async");
+
+    #if SOC_RMT_SUPPORTED
+    if (asyncData == nullptr) {
+      asyncData = new rmt_data_t[24 * numLeds];
+    } else if (!rmtTransmitCompleted(pin)) {
+      return false;
     }
+    encode(asyncData);
+    return rmtWriteAsync(pin, asyncData, 24 * numLeds);
+    #else
+    return false;
+    #endif
+  }
 
-    // Write the data to the LEDRING
-    rmtWrite(pin, led_data, RMT_SYMBOLS_OF(led_data), RMT_WAIT_FOR_EVER);
+  // True while an updateAsync() is being sent
+  bool isBusy() {
+    #if SOC_RMT_SUPPORTED
+    return initialized && asyncData != nullptr && !rmtTransmitCompleted(pin);
+    #else
+    return false;
     #endif
   }
   
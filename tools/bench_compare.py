@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+"""Compare two runs of the host benchmarks (tools/host/bench.cpp).
+
+Reads the JSON files written with --benchmark_out=<file> --benchmark_out_format=json
+and prints the time of every benchmark in both runs and the change. With
+--benchmark_repetitions the median of the repetitions is used.
+
+    python3 tools/bench_compare.py before.json after.json
+    python3 tools/bench_compare.py before.json after.json --threshold 10
+
+Exits with 1 when a benchmark got slower by more than --threshold percent, so a
+script can stop on a regression. Only compare runs made on the same machine.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    """name -> cpu time in ns (the median when the run has repetitions)"""
+    with open(path) as f:
+        data = json.load(f)
+    scale = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+    plain = {}
+    medians = {}
+    for b in data.get("benchmarks", []):
+        if b.get("error_occurred"):
+            continue
+        ns = b["cpu_time"] * scale[b.get("time_unit", "ns")]
+        name = b.get("run_name", b["name"])
+        if b.get("run_type") == "aggregate":
+            if b.get("aggregate_name") == "median":
+                medians[name] = ns
+        else:
+            plain.setdefault(name, ns)
+    plain.update(medians)
+    return plain
+
+
+def pretty(ns):
+    for unit, size in (("s", 1e9), ("ms", 1e6), ("us", 1e3)):
+        if ns >= size:
+            return "%.2f %s" % (ns / size, unit)
+    return "%.1f ns" % ns
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("before")
+    parser.add_argument("after")
+    parser.add_argument("--threshold", type=float, default=5.0,
+                        help="percent slower that counts as a regression (default 5)")
+    args = parser.parse_args()
+
+    before = load(args.before)
+    after = load(args.after)
+
+    width = max([len(n) for n in before] + [len(n) for n in after] + [9])
+    print("%-*s %12s %12s %9s" % (width, "benchmark", "before", "after", "change"))
+    slower = []
+    for name in before:
+        if name not in after:
+            print("%-*s %12s %12s %9s" % (width, name, pretty(before[name]), "-", "gone"))
+            continue
+        change = (after[name] / before[name] - 1.0) * 100.0
+        mark = ""
+        if change > args.threshold:
+            mark = "  slower"
+            slower.append(name)
+        elif change < -args.threshold:
+            mark = "  faster"
+        print("%-*s %12s %12s %+8.1f%%%s" % (width, name, pretty(before[name]), pretty(after[name]), change, mark))
+    for name in after:
+        if name not in before:
+            print("%-*s %12s %12s %9s" % (width, name, "-", pretty(after[name]), "new"))
+
+    if slower:
+        print("%d benchmark(s) more than %.0f%% slower" % (len(slower), args.threshold))
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
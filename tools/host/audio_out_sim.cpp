@@ -0,0 +1,288 @@
+// Audio output check of AudioOut (ai-workshop-audio-out.h) on the host stand-in.
+//
+// The I2S stand-in drains its DMA queue at the sample rate and hands every block to a sink,
+// so the sound the speaker would play is captured here and measured:
+//   - pitch of a note, attack and release of the envelope, a chord of three voices
+//   - a melody: the notes in order, and the publishTone() times line up with the audio
+//   - WAV files from the "SD card": a 20 kHz recording plays sample for sample, a 16 kHz
+//     file is resampled (pitch and length right)
+//   - no underruns while other threads keep every core busy (inference, at a lower priority
+//     than the render task as on the robot: SCHED_IDLE here), and the CPU cost
+//   - a stall longer than the queue is counted as an underrun
+//   - nothing is rendered while quiet, stop() stops at once
+//
+//   g++ -std=gnu++17 -O2 -pthread -I tools/host/include -I libraries/MAFAD_Workshop/src tools/host/audio_out_sim.cpp -o audio_out_sim
+//   ./audio_out_sim
+
+#include <Arduino.h>
+#include <ai-workshop-main.h>
+#include <ai-workshop-pitches.h>
+#include <ai-workshop-audio-out.h>
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <thread>
+#include <vector>
+
+uint32_t randomness = 0;
+
+// What the speaker played, with the esp_timer time of the first sample of every write
+struct Capture
+{
+    std::mutex m;
+    std::vector<int16_t> samples;
+    std::vector<std::pair<size_t, int64_t>> writes;   // first sample, play time
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(m);
+        samples.clear();
+        writes.clear();
+    }
+    // the samples from the first one that is not silent (and its play time)
+    std::vector<int16_t> sound(int64_t* startUs = nullptr)
+    {
+        std::lock_guard<std::mutex> lock(m);
+        size_t first = 0;
+        while (first < samples.size() && samples[first] == 0) first++;
+        if (startUs) {
+            *startUs = 0;
+            for (auto& w : writes) {
+                if (w.first <= first) *startUs = w.second + (int64_t)(first - w.first) * 1000000 / SAMPLE_RATE;
+            }
+        }
+        size_t last = samples.size();
+        while (last > first && samples[last - 1] == 0) last--;
+        return std::vector<int16_t>(samples.begin() + first, samples.begin() + last);
+    }
+};
+
+static Capture capture;
+static std::atomic<int> stallMs{ 0 };   // the next write waits this long (a task that hogs the core)
+static AudioOut audio;
+static bool ok = true;
+
+static void check(bool condition, const char* what)
+{
+    if (!condition) {
+        printf("FAIL: %s\n", what);
+        ok = false;
+    }
+}
+
+// frequency from the rising zero crossings (interpolated) in [from, to)
+static double pitch(const std::vector<int16_t>& s, size_t from, size_t to)
+{
+    double first = -1, last = -1;
+    int crossings = 0;
+    for (size_t i = from + 1; i < to && i < s.size(); i++) {
+        if (s[i - 1] < 0 && s[i] >= 0) {
+            double t = i - 1 + (double)-s[i - 1] / (s[i] - s[i - 1]);
+            if (first < 0) first = t;
+            last = t;
+            crossings++;
+        }
+    }
+    return crossings > 1 ? (crossings - 1) * (double)SAMPLE_RATE / (last - first) : 0.0;
+}
+
+static double rms(const std::vector<int16_t>& s, size_t from, size_t count)
+{
+    double sum = 0;
+    size_t n = 0;
+    for (size_t i = from; i < from + count && i < s.size(); i++, n++) sum += (double)s[i] * s[i];
+    return n ? sqrt(sum / n) : 0.0;
+}
+
+static double goertzel(const std::vector<int16_t>& s, double frequency)
+{
+    double w = 2 * M_PI * frequency / SAMPLE_RATE, c = 2 * cos(w), a = 0, b = 0;
+    for (int16_t x : s) {
+        double y = x + c * a - b;
+        b = a;
+        a = y;
+    }
+    return sqrt(a * a + b * b - c * a * b) / s.size();
+}
+
+static void writeWav(const char* path, const std::vector<int16_t>& samples, uint32_t rate)
+{
+    File f = SD.open(path, FILE_WRITE);
+    uint8_t header[WAV_HEADER_SIZE];
+    fillWavHeader(header, samples.size(), rate);
+    f.write(header, sizeof(header));
+    f.write((const uint8_t*)samples.data(), samples.size() * 2);
+    f.close();
+}
+
+static void playAndWait()
+{
+    delay(5);
+    audio.wait(20000);
+    delay(30);
+}
+
+int main()
+{
+    hostSdRoot() = "audio_out_sd";
+    SD.begin();
+    hostI2sSetSink(I2S_NUM_0, [](const void* data, size_t bytes) {
+        std::lock_guard<std::mutex> lock(capture.m);
+        capture.writes.push_back({ capture.samples.size(), hostI2sPort(I2S_NUM_0).writePlayUs.load() });
+        const int16_t* s = (const int16_t*)data;
+        capture.samples.insert(capture.samples.end(), s, s + bytes / 2);
+        if (int ms = stallMs.exchange(0)) delay(ms);
+    });
+    if (!audio.begin(11)) return 1;
+    AudioEnvelope envelope;
+    envelope.attackMs = 5;
+    envelope.decayMs = 20;
+    envelope.sustain = 0.5f;
+    envelope.releaseMs = 40;
+    audio.setEnvelope(envelope);
+
+    // one note
+    capture.clear();
+    audio.playNote(NOTE_A4, 500, AudioWave::Sine);
+    playAndWait();
+    std::vector<int16_t> note = capture.sound();
+    double a4 = pitch(note, 2000, 9000);
+    double attack = rms(note, 0, 40), top = rms(note, 95, 20), held = rms(note, 3000, 2000);
+    double length = note.size() * 1000.0 / SAMPLE_RATE;
+    printf("note: A4 (%d Hz) played at %.2f Hz, %.0f ms with the release | attack %.0f, peak %.0f, sustain %.0f rms\n",
+           NOTE_A4, a4, length, attack, top, held);
+    check(fabs(a4 - NOTE_A4) < NOTE_A4 * 0.002, "the note has the wrong pitch");
+    check(fabs(length - 540) < 5, "the note is not 500 ms plus a 40 ms release");
+    check(attack < top * 0.5 && fabs(held / top - 0.5) < 0.1, "the envelope does not rise to full and decay to the sustain level");
+
+    // a chord
+    capture.clear();
+    audio.playNote(NOTE_C4, 300, AudioWave::Sine, 0.3f);
+    audio.playNote(NOTE_E4, 300, AudioWave::Sine, 0.3f);
+    audio.playNote(NOTE_G4, 300, AudioWave::Sine, 0.3f);
+    playAndWait();
+    std::vector<int16_t> chord = capture.sound();
+    double c = goertzel(chord, NOTE_C4), e = goertzel(chord, NOTE_E4), g = goertzel(chord, NOTE_G4), off = goertzel(chord, NOTE_A4);
+    printf("chord: C4 %.0f, E4 %.0f, G4 %.0f, A4 (not played) %.0f\n", c, e, g, off);
+    check(c > 20 * off && e > 20 * off && g > 20 * off && fabs(c / e - 1) < 0.2 && fabs(c / g - 1) < 0.2, "the chord does not have three equal notes");
+
+    // a melody, and the tone history the self sound filter reads
+    static const MelodyNote hello[] = { { NOTE_C3, 60 }, { NOTE_C4, 60 }, { 0, 30 }, { NOTE_D3, 60 }, { NOTE_D4, 60 }, { 0, 30 },
+                                        { NOTE_DS3, 60 }, { NOTE_DS4, 60 } };
+    capture.clear();
+    uint32_t before = toneHistory().count;
+    audio.playMelody(hello, sizeof(hello) / sizeof(hello[0]));
+    playAndWait();
+    int64_t soundUs;
+    std::vector<int16_t> melody = capture.sound(&soundUs);
+    ToneEvent events[TONE_HISTORY];
+    uint32_t n = copyToneHistory(events, toneHistory().count - before);
+    const uint32_t expected[] = { NOTE_C3, NOTE_C4, 0, NOTE_D3, NOTE_D4, 0, NOTE_DS3, NOTE_DS4, 0 };
+    const int32_t expectedMs[] = { 0, 60, 120, 150, 210, 270, 300, 360, 420 };
+    // the render task places the blocks in time from where the DMA queue is (esp_timer), and
+    // corrects that by less than one DMA buffer: the tone times are that close, however the
+    // host schedules the threads
+    const int64_t dmaUs = (int64_t)AUDIO_OUT_DMA_LEN * 1000000 / SAMPLE_RATE;
+    bool order = n == 9, times = n == 9;
+    int64_t worstUs = 0;
+    for (uint32_t i = 0; i < n && i < 9; i++) {
+        order = order && events[i].frequency == expected[i];
+        worstUs = std::max<int64_t>(worstUs, llabs(events[i].timeUs - events[0].timeUs - expectedMs[i] * 1000));
+    }
+    times = times && worstUs < dmaUs;
+    int64_t offsetUs = n ? events[0].timeUs - soundUs : 0;
+    printf("melody: %u tone events, at most %.1f ms from the note times, first one %+.1f ms from the sound leaving the speaker, %zu ms of audio\n",
+           n, worstUs / 1000.0, offsetUs / 1000.0, melody.size() * 1000 / SAMPLE_RATE);
+    check(order, "the tone history does not have the melody notes in order");
+    check(times, "the tone history times are more than one DMA buffer from the note times");
+    check(llabs(offsetUs) < 3500, "the tone history is more than 3.5 ms from the audio");
+
+    // WAV files
+    std::vector<int16_t> recording(20000);
+    for (size_t i = 0; i < recording.size(); i++) recording[i] = (int16_t)(8000 * sin(i * 0.05) + 3000 * sin(i * 0.71) + 1000);
+    writeWav("/take.wav", recording, SAMPLE_RATE);
+    capture.clear();
+    check(audio.playFile("/take.wav"), "playFile() failed");
+    playAndWait();
+    std::vector<int16_t> played = capture.sound();
+    int worst = 0;
+    for (size_t i = 0; i < played.size() && i < recording.size(); i++) worst = std::max(worst, abs(played[i] - recording[i]));
+    printf("wav 20 kHz: %zu of %zu samples, largest difference %d\n", played.size(), recording.size(), worst);
+    check(played.size() == recording.size() && worst <= 2, "the 20 kHz recording does not play sample for sample");
+
+    std::vector<int16_t> tone16(16000);
+    for (size_t i = 0; i < tone16.size(); i++) tone16[i] = (int16_t)(10000 * sin(2 * M_PI * 1000 * i / 16000.0));
+    writeWav("/tone16k.wav", tone16, 16000);
+    capture.clear();
+    audio.playFile("/tone16k.wav");
+    playAndWait();
+    played = capture.sound();
+    double resampled = pitch(played, 1000, 19000);
+    printf("wav 16 kHz: 1000 Hz tone played at %.2f Hz, %zu samples (expected 20000)\n", resampled, played.size());
+    check(fabs(resampled - 1000) < 1 && llabs((long long)played.size() - 20000) <= 3, "the 16 kHz file is not resampled to 20 kHz");
+    check(!audio.playFile("/missing.wav"), "playFile() of a missing file did not fail");
+
+    // every core busy (the classifier and more) while a melody and a file play for 4 s
+    std::atomic<bool> busy{ true };
+    std::vector<std::thread> load;
+    unsigned cores = std::thread::hardware_concurrency();
+    for (unsigned i = 0; i < (cores ? cores : 2); i++) {
+        load.emplace_back([&] {
+            sched_param idle = {};
+            pthread_setschedparam(pthread_self(), SCHED_IDLE, &idle);   // below the render task
+            volatile uint32_t x = 0;
+            while (busy) x = x * 1664525u + 1013904223u;
+        });
+    }
+    std::vector<MelodyNote> song;
+    for (int i = 0; i < 40; i++) song.push_back({ (uint16_t)(NOTE_C4 + 37 * (i % 12)), 100 });
+    uint32_t stubBefore = hostI2sPort(I2S_NUM_0).underruns;
+    AudioOutStats s0 = audio.getStats();
+    audio.playMelody(song.data(), song.size(), AudioWave::Saw, 0.5f);
+    audio.playNote(NOTE_C3, 3500, AudioWave::Triangle, 0.3f);
+    audio.playFile("/take.wav", 0.3f);
+    playAndWait();
+    busy = false;
+    for (auto& t : load) t.join();
+    AudioOutStats s1 = audio.getStats();
+    uint32_t blocks = s1.blocks - s0.blocks;
+    float usPerBlock = blocks ? (float)(s1.totalRenderUs - s0.totalRenderUs) / blocks : 0.0f;
+    printf("under load (%u busy threads): %u blocks, %u underruns (queue ran dry %u times, once at the start), %.1f us per block = %.2f%% of the audio time\n",
+           cores, blocks, s1.underruns - s0.underruns, hostI2sPort(I2S_NUM_0).underruns - stubBefore, usPerBlock,
+           100.0f * usPerBlock / (1e6f * AUDIO_OUT_BLOCK / SAMPLE_RATE));
+    // the stand-in also counts the start after the quiet time as the queue running dry
+    check(s1.underruns == s0.underruns && hostI2sPort(I2S_NUM_0).underruns - stubBefore <= 1, "underruns while the CPU was busy");
+    check(blocks > 3.5 * SAMPLE_RATE / AUDIO_OUT_BLOCK, "fewer blocks than 4 s of audio");
+
+    // the counter works: one stall longer than the queue is one underrun
+    s0 = audio.getStats();
+    audio.playNote(NOTE_A4, 400);
+    delay(150);
+    stallMs = 40;
+    playAndWait();
+    uint32_t stalled = audio.getStats().underruns - s0.underruns;
+    printf("a 40 ms stall of the render task: %u underrun\n", stalled);
+    check(stalled == 1, "a stall longer than the queue is not counted as one underrun");
+
+    // quiet: nothing rendered; stop() ends a long note
+    AudioOutStats quiet0 = audio.getStats();
+    delay(300);
+    check(audio.getStats().blocks == quiet0.blocks, "blocks rendered while nothing plays");
+    audio.playNote(NOTE_A4, 5000);
+    delay(100);
+    int64_t stopped = esp_timer_get_time();
+    audio.stop();
+    audio.wait(1000);
+    float stopMs = (esp_timer_get_time() - stopped) / 1000.0f;
+    printf("stop(): quiet after %.1f ms\n", stopMs);
+    check(stopMs < 40, "stop() took longer than the DMA queue");
+
+    audio.printStats(Serial);
+    audio.end();
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,260 @@
+// Dataset augmentation check of Augmenter (ai-workshop-augment.h) on the host stand-in.
+//
+// Synthesises a take of each workshop melody and a noise take, writes augmented variants
+// to the SD card folder (./sdcard/augment) and reads them back:
+//   - every file is a valid WAV of the same length as the take
+//   - the same seed gives the same files
+//   - the level spread reaches the soft takes we are short of
+//   - the MelodyDetector still hears the right melody in most variants (the label still fits)
+//   - loadNoise() only takes 16 bit mono noise files at the model rate, and only their samples
+//     (not the LIST/INFO chunk of a master file)
+// and prints variants per second and the (host) write speed.
+//
+//   g++ -std=gnu++17 -O2 -pthread -I tools/host/include -I libraries/MAFAD_Workshop/src tools/host/augment_sim.cpp -o augment_sim
+//   ./augment_sim [variants per take]
+
+#include <Arduino.h>
+#include <ai-workshop-main.h>
+#include <ai-workshop-pitches.h>
+#include <ai-workshop-melody.h>
+#include <ai-workshop-augment.h>
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+static const char* labels[3] = { "hello_there", "i_love_cake", "get_bonus" };
+
+static std::vector<MelodyNote> melody(int label)
+{
+    std::vector<MelodyNote> m;
+    if (label == 0) {
+        const uint16_t pairs[][2] = { { NOTE_C3, NOTE_C4 }, { NOTE_D3, NOTE_D4 }, { NOTE_DS3, NOTE_DS4 }, { NOTE_F3, NOTE_F4 },
+                                      { NOTE_G3, NOTE_G4 }, { NOTE_GS3, NOTE_GS4 }, { NOTE_AS3, NOTE_AS4 }, { NOTE_C4, NOTE_C5 } };
+        for (int i = 0; i < 8; i++) {
+            m.push_back({ pairs[i][0], 60 });
+            m.push_back({ pairs[i][1], 60 });
+            if (i < 7) m.push_back({ 0, 30 });
+        }
+    } else if (label == 1) {
+        for (int loop = 0; loop < 50; loop++) {
+            m.push_back({ (uint16_t)(800 - loop * 5), 15 });
+            m.push_back({ 0, 15 });
+        }
+    } else {
+        for (int part = 0; part < 2; part++) {
+            for (int loop = 0; loop < 3; loop++) {
+                m.push_back({ NOTE_C4, 30 });
+                m.push_back({ NOTE_DS4, 30 });
+                m.push_back({ NOTE_G4, 30 });
+            }
+            m.push_back({ 0, 30 });
+            m.push_back({ NOTE_C2, 90 });
+            m.push_back({ 0, 30 });
+        }
+        for (int loop = 0; loop < 8; loop++) {
+            m.push_back({ NOTE_C5, 30 });
+            m.push_back({ NOTE_AS4, 30 });
+            m.push_back({ NOTE_G5, 30 });
+        }
+    }
+    return m;
+}
+
+// A take like record_dataset makes: ~400 ms of room noise, the melody, 400 ms more (16 bit value * 4096)
+static std::vector<int32_t> makeTake(int label, std::mt19937& rng, uint32_t& lengthMs)
+{
+    std::normal_distribution<float> gauss(0.0f, 1.0f);
+    std::vector<MelodyNote> notes = label >= 0 ? melody(label) : std::vector<MelodyNote>{ { 0, 3000 } };
+    uint32_t ms = label >= 0 ? 400 : 0;
+    for (const MelodyNote& n : notes) ms += n.ms;
+    if (label >= 0) ms += 400;
+    lengthMs = ms;
+
+    std::vector<int32_t> take((size_t)ms * SAMPLE_RATE / 1000);
+    size_t pos = (size_t)400 * SAMPLE_RATE / 1000;
+    if (label < 0) pos = 0;
+    double phase = 0.0;
+    std::vector<float> audio(take.size(), 0.0f);
+    for (const MelodyNote& n : notes) {
+        size_t count = (size_t)n.ms * SAMPLE_RATE / 1000;
+        for (size_t i = 0; i < count && pos < audio.size(); i++, pos++) {
+            if (n.frequency == 0 || label < 0) continue;
+            phase += (double)n.frequency / SAMPLE_RATE;
+            phase -= floor(phase);
+            audio[pos] = phase < 0.49 ? 6000.0f : -6000.0f;
+        }
+    }
+    // a small speaker: soft above ~5 kHz, plus room noise (a hum and hiss)
+    float lp = 0.0f;
+    const float b = expf(-2.0f * (float)M_PI * 5000.0f / SAMPLE_RATE);
+    for (size_t i = 0; i < take.size(); i++) {
+        lp = b * lp + (1.0f - b) * audio[i];
+        float v = lp + 40.0f * gauss(rng) + (label < 0 ? 300.0f * sinf(2.0f * (float)M_PI * 100.0f * i / SAMPLE_RATE) : 0.0f);
+        take[i] = (int32_t)clip32((int32_t)v) * 4096;
+    }
+    return take;
+}
+
+static bool readWav(const std::string& path, std::vector<int16_t>& samples)
+{
+    std::ifstream in(path, std::ios::binary);
+    char header[44];
+    if (!in.read(header, sizeof(header)) || memcmp(header, "RIFF", 4) != 0 || memcmp(header + 36, "data", 4) != 0) return false;
+    uint32_t bytes, riff;
+    memcpy(&bytes, header + 40, 4);
+    memcpy(&riff, header + 4, 4);
+    if (riff != bytes + 36) return false;
+    samples.resize(bytes / 2);
+    return (bool)in.read((char*)samples.data(), bytes);
+}
+
+// a noise file for loadNoise(): channels * count samples of hum, bits only written into the header,
+// a LIST/INFO chunk after the samples when there is a comment (as the master files have)
+static void writeNoiseFile(const std::string& path, uint32_t count, uint32_t rate, uint16_t channels, uint16_t bits = 16,
+                           const char* comment = nullptr)
+{
+    uint8_t info[256];
+    uint32_t infoBytes = comment ? fillWavInfoChunk(info, sizeof(info), comment) : 0;
+    uint8_t header[WAV_HEADER_SIZE];
+    fillWavHeader(header, count, rate, channels, infoBytes);
+    memcpy(header + 34, &bits, 2);
+    std::vector<int16_t> samples((size_t)count * channels);
+    for (size_t i = 0; i < samples.size(); i++) samples[i] = (int16_t)(300.0f * sinf(2.0f * (float)M_PI * 100.0f * i / rate));
+    std::ofstream out(path, std::ios::binary);
+    out.write((const char*)header, sizeof(header));
+    out.write((const char*)samples.data(), samples.size() * sizeof(int16_t));
+    out.write((const char*)info, infoBytes);
+}
+
+static std::string readFile(const std::string& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static float rmsDb(const int16_t* s, size_t n)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++) sum += (double)s[i] * s[i];
+    return 10.0f * log10f((float)(sum / n) + 1e-9f);
+}
+
+int main(int argc, char** argv)
+{
+    const int variants = argc > 1 ? atoi(argv[1]) : 8;
+    std::mt19937 rng(5);
+    SD.begin();
+    SDCard sdCard;
+
+    uint32_t noiseMs;
+    std::vector<int32_t> noise = makeTake(-1, rng, noiseMs);
+    std::vector<int32_t> takes[3];
+    uint32_t takeMs[3];
+    for (int label = 0; label < 3; label++) takes[label] = makeTake(label, rng, takeMs[label]);
+
+    bool ok = true;
+    std::vector<MelodyNote> melodies[3] = { melody(0), melody(1), melody(2) };
+
+    // twice with the same seed: the files must be the same
+    std::string folders[2] = { "/augment", "/augment_again" };
+    AugmentStats stats;
+    for (int run = 0; run < 2; run++) {
+        AugmentConfig config;
+        config.variants = variants;
+        config.folder = folders[run].c_str();
+        config.seed = 42;
+        Augmenter augmenter;
+        if (!augmenter.begin(config)) return 1;
+        augmenter.addNoise(noise.data(), noise.size());
+        for (int label = 0; label < 3; label++) {
+            if (augmenter.writeVariants(sdCard, takes[label].data(), takeMs[label], labels[label], "SIM", 1) != variants) {
+                printf("FAIL: not all variants written\n");
+                ok = false;
+            }
+        }
+        if (run == 0) {
+            augmenter.printStats();
+            stats = augmenter.getStats();
+        }
+    }
+
+    int heard = 0, files = 0, soft = 0;
+    float minDb = 1e9f, maxDb = -1e9f;
+    for (int label = 0; label < 3; label++) {
+        const size_t count = takes[label].size();
+        std::vector<int16_t> original(count);
+        for (size_t i = 0; i < count; i++) original[i] = clip32(takes[label][i] / 4096);
+        float originalDb = rmsDb(original.data(), count);
+
+        for (int k = 1; k <= variants; k++) {
+            char name[128];
+            snprintf(name, sizeof(name), "%s.SIM000001_a%d.wav", labels[label], k);
+            std::string path = hostSdRoot() + folders[0] + "/" + name;
+            std::vector<int16_t> samples;
+            if (!readWav(path, samples) || samples.size() != count) {
+                printf("FAIL: %s is not a WAV of %u samples\n", name, (unsigned)count);
+                ok = false;
+                continue;
+            }
+            if (readFile(path) != readFile(hostSdRoot() + folders[1] + "/" + name)) {
+                printf("FAIL: %s differs between two runs with the same seed\n", name);
+                ok = false;
+            }
+            files++;
+
+            float db = rmsDb(samples.data(), count) - originalDb;
+            minDb = std::min(minDb, db);
+            maxDb = std::max(maxDb, db);
+            if (db < -10.0f) soft++;
+
+            MelodyDetector detector;
+            detector.begin();
+            for (int i = 0; i < 3; i++) detector.addMelody(labels[i], melodies[i].data(), melodies[i].size());
+            for (size_t at = 0; at + 1024 <= count; at += 1024) detector.process(samples.data() + at, 1024, (int64_t)at * 50);
+            MelodyMatch match;
+            bool right = false;
+            while (detector.getMatch(match)) right |= strcmp(match.name, labels[label]) == 0;
+            if (right) heard++;
+        }
+    }
+
+    // loadNoise(): only 16 bit mono files at the model rate
+    SD.mkdir("/noise_load");
+    const std::string noiseFolder = hostSdRoot() + "/noise_load/";
+    writeNoiseFile(noiseFolder + "noise_ok.wav", SAMPLE_RATE, SAMPLE_RATE, 1, 16, "device=SIM gain=12 level=-30dB (a master file)");
+    writeNoiseFile(noiseFolder + "noise_stereo.wav", SAMPLE_RATE, SAMPLE_RATE, 2);
+    writeNoiseFile(noiseFolder + "noise_16k.wav", 16000, 16000, 1);
+    writeNoiseFile(noiseFolder + "noise_8bit.wav", SAMPLE_RATE, SAMPLE_RATE, 1, 8);
+    {
+        Augmenter augmenter;
+        augmenter.begin();
+        uint8_t loaded = augmenter.loadNoise("/noise_load");
+        printf("loadNoise: %u of 4 noise files loaded (stereo, 16 kHz and 8 bit refused), %u samples\n", (unsigned)loaded,
+               (unsigned)augmenter.getNoiseLength(0));
+        if (loaded != 1 || augmenter.getNoiseCount() != 1) {
+            printf("FAIL: loadNoise should only load the 16 bit mono file at %u Hz\n", (unsigned)SAMPLE_RATE);
+            ok = false;
+        } else if (augmenter.getNoiseLength(0) != SAMPLE_RATE) {
+            printf("FAIL: the noise take should be the %u samples of the data chunk, not the INFO chunk after it\n", (unsigned)SAMPLE_RATE);
+            ok = false;
+        }
+    }
+
+    printf("%d files, level %.1f to %+.1f dB from the take, %d soft (below -10 dB)\n", files, minDb, maxDb, soft);
+    printf("melody still heard in %d of %d variants\n", heard, files);
+    printf("%.1f variants per second, %.0f KB/s written (host)\n", stats.variantsPerSecond(), stats.sdKBps());
+    if (soft == 0) {
+        printf("FAIL: no soft variants\n");
+        ok = false;
+    }
+    if (heard < files * 8 / 10) {
+        printf("FAIL: too many variants no longer sound like their label\n");
+        ok = false;
+    }
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
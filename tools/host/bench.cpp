@@ -0,0 +1,254 @@
+// Micro-benchmarks of the hot code of the library, on the host stand-in (Google Benchmark).
+//
+// The sizes are those of the robot: DMA blocks of 1024 samples, 20000 sample windows,
+// 3 s takes, 8 to 300 LEDs. The numbers are for this machine, not for the ESP32-S3: use
+// them to see whether a change makes a kernel faster or slower, compared with a baseline
+// run of the same build on the same machine.
+//
+//   g++ -std=gnu++17 -O2 -pthread -I tools/host/include -I libraries/MAFAD_Workshop/src tools/host/bench.cpp -lbenchmark -o bench
+//   ./bench --benchmark_out=before.json --benchmark_out_format=json
+//   (change the library, build again)
+//   ./bench --benchmark_out=after.json --benchmark_out_format=json
+//   python3 tools/bench_compare.py before.json after.json
+//
+// --benchmark_filter=Led runs only the benchmarks with "Led" in their name.
+
+#include <Arduino.h>
+#include <ai-workshop-main.h>
+#include <ai-workshop-mic.h>
+#include <ai-workshop-levels.h>
+#include <ai-workshop-wav.h>
+#include <ai-workshop-sdcard.h>
+#include <ai-workshop-ws2812.h>
+#include <ai-workshop-scores.h>
+#include <ai-workshop-fft.h>
+
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+// microphone samples as they come from the DMA: 16 bit value * 4096, a few of them past full scale
+static std::vector<int32_t> dmaSamples(size_t count, uint32_t seed = 1)
+{
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> noise(0.0f, 6000.0f);
+    std::vector<int32_t> samples(count);
+    for (size_t i = 0; i < count; i++) {
+        float v = 9000.0f * sinf(i * 0.07f) + noise(rng);
+        samples[i] = (int32_t)(v * 4096.0f);
+    }
+    return samples;
+}
+
+// --- sample conversion --------------------------------------------------------------------
+
+static void BM_Clip(benchmark::State& state)
+{
+    std::vector<int32_t> in = dmaSamples(state.range(0));
+    std::vector<int32_t> out(in.size());
+    for (auto _ : state) {
+        for (size_t i = 0; i < in.size(); i++) out[i] = clip(in[i] / 4096);
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * in.size());
+}
+BENCHMARK(BM_Clip)->Arg(DMA_BUFFER_SIZE);
+
+static void BM_Clip32(benchmark::State& state)
+{
+    std::vector<int32_t> in = dmaSamples(state.range(0));
+    std::vector<int16_t> out(in.size());
+    for (auto _ : state) {
+        for (size_t i = 0; i < in.size(); i++) out[i] = clip32(in[i] / 4096);
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * in.size());
+}
+BENCHMARK(BM_Clip32)->Arg(DMA_BUFFER_SIZE)->Arg(NN_WINDOW_SIZE);
+
+// one DMA block to the floats of the stream (i2sMic capture task)
+static void BM_ConvertMono(benchmark::State& state)
+{
+    std::vector<int32_t> in = dmaSamples(state.range(0));
+    std::vector<float> out(in.size());
+    for (auto _ : state) {
+        i2sMic::convertMono(in.data(), out.data(), in.size());
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * in.size());
+}
+BENCHMARK(BM_ConvertMono)->Arg(DMA_BUFFER_SIZE);
+
+static void BM_Deinterleave(benchmark::State& state)
+{
+    std::vector<int32_t> in = dmaSamples(2 * state.range(0));
+    std::vector<float> left(state.range(0)), right(state.range(0));
+    for (auto _ : state) {
+        i2sMic::deinterleave(in.data(), left.data(), right.data(), left.size());
+        benchmark::DoNotOptimize(left.data());
+        benchmark::DoNotOptimize(right.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * left.size());
+}
+BENCHMARK(BM_Deinterleave)->Arg(DMA_BUFFER_SIZE);
+
+// levels of one DMA block (recording and stream, ai-workshop-levels.h)
+static void BM_LevelMeter(benchmark::State& state)
+{
+    std::vector<int32_t> in = dmaSamples(state.range(0));
+    LevelMeter meter;
+    for (auto _ : state) {
+        meter.addRaw(in.data(), in.size());
+        benchmark::DoNotOptimize(meter);
+    }
+    benchmark::DoNotOptimize(meter.stats());
+    state.SetItemsProcessed(state.iterations() * in.size());
+}
+BENCHMARK(BM_LevelMeter)->Arg(DMA_BUFFER_SIZE);
+
+// --- WAV files ------------------------------------------------------------------------------
+
+static void BM_WavHeader(benchmark::State& state)
+{
+    uint8_t header[WAV_HEADER_SIZE];
+    for (auto _ : state) {
+        fillWavHeader(header, SAMPLE_BUFFER_SIZE, SAMPLE_RATE);
+        benchmark::DoNotOptimize(header);
+    }
+}
+BENCHMARK(BM_WavHeader);
+
+// a master file written the way SDCard does (header, then sample by sample), to a file on the
+// host: the time is mostly the calls per sample, the host disk is much faster than an SD card
+static void BM_WriteMasterFile(benchmark::State& state)
+{
+    hostSdRoot() = "/tmp/aiw_bench_sd";
+    SD.begin();
+    Serial.setOutput(nullptr);   // no "Wrote file" lines between the results
+    std::vector<int32_t> take = dmaSamples(SAMPLE_BUFFER_SIZE);
+    SDCard sdCard;
+    uint32_t ms = state.range(0) * 1000 / SAMPLE_RATE;
+    for (auto _ : state) {
+        sdCard.writeAudioFile(take.data(), ms, "bench", "HOST", 0, 0);
+    }
+    Serial.setOutput(stdout);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * (state.range(0) * 2 + WAV_HEADER_SIZE));
+}
+BENCHMARK(BM_WriteMasterFile)->Arg(NN_WINDOW_SIZE)->Arg(SAMPLE_BUFFER_SIZE)->Unit(benchmark::kMicrosecond);
+
+// the crops of a 3 s take (writeAudioFile)
+static void BM_PickCrops(benchmark::State& state)
+{
+    uint32_t offsets[MAX_CROPS];
+    uint32_t seed = 1;
+    for (auto _ : state) {
+        uint8_t n = pickCrops(SAMPLE_BUFFER_SIZE, NN_WINDOW_SIZE, (uint8_t)state.range(0), offsets, [&](uint32_t span) {
+            seed = seed * 1664525u + 1013904223u;
+            return (seed >> 8) % span;
+        });
+        benchmark::DoNotOptimize(n);
+        benchmark::DoNotOptimize(offsets);
+    }
+}
+BENCHMARK(BM_PickCrops)->Arg(1)->Arg(8)->Arg(MAX_CROPS);
+
+// --- LED ring -------------------------------------------------------------------------------
+
+static void BM_FromHSL(benchmark::State& state)
+{
+    Color out[256];
+    for (auto _ : state) {
+        for (int h = 0; h < 256; h++) out[h] = Color::FromHSL((uint8_t)h, 255, 96);
+        benchmark::DoNotOptimize(out);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * 256);
+}
+BENCHMARK(BM_FromHSL);
+
+// update(): the RMT symbols of every LED (the host RMT does not wait for the wire)
+static void BM_LedUpdate(benchmark::State& state)
+{
+    hostRmt().realTime = false;
+    std::vector<Color> leds(state.range(0));
+    for (size_t l = 0; l < leds.size(); l++) leds[l] = Color::FromHSL((uint8_t)(l * 7), 255, 128);
+    WS2812 ring;
+    ring.init(38, leds.data(), leds.size());
+    for (auto _ : state) {
+        ring.update();
+    }
+    state.SetItemsProcessed(state.iterations() * leds.size());
+}
+BENCHMARK(BM_LedUpdate)->Arg(8)->Arg(24)->Arg(60)->Arg(144)->Arg(300);
+
+static void BM_LedUpdateAsync(benchmark::State& state)
+{
+    std::vector<Color> leds(state.range(0));
+    for (size_t l = 0; l < leds.size(); l++) leds[l] = Color::FromHSL((uint8_t)(l * 7), 255, 128);
+    WS2812 ring;
+    ring.init(38, leds.data(), leds.size());
+    for (auto _ : state) {
+        hostRmt().busyUntil = {};   // the last frame is sent
+        benchmark::DoNotOptimize(ring.updateAsync());
+    }
+    state.SetItemsProcessed(state.iterations() * leds.size());
+}
+BENCHMARK(BM_LedUpdateAsync)->Arg(8)->Arg(300);
+
+// --- classifier scores ----------------------------------------------------------------------
+
+struct BenchResult
+{
+    struct { float value; } classification[SCORES_MAX_LABELS];
+};
+
+// the moving average of AiWorkshopInference::tick(), once per classifier result
+static void BM_ScoreSmoother(benchmark::State& state)
+{
+    const size_t labels = state.range(0);
+    BenchResult results[16];
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> score(0.0f, 1.0f);
+    for (BenchResult& r : results) {
+        for (size_t i = 0; i < SCORES_MAX_LABELS; i++) r.classification[i].value = score(rng);
+    }
+    ScoreSmoother smoother(0.5f);
+    size_t n = 0;
+    for (auto _ : state) {
+        smoother.update(results[n++ & 15], labels);
+        benchmark::DoNotOptimize(smoother.topIndex());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ScoreSmoother)->Arg(4)->Arg(SCORES_MAX_LABELS);
+
+// --- spectra --------------------------------------------------------------------------------
+
+// two real frames in one complex FFT (visualiser, direction finder)
+static void BM_FftRealPair(benchmark::State& state)
+{
+    const uint32_t n = state.range(0);
+    FFT fft;
+    fft.begin(n);
+    std::vector<int32_t> in = dmaSamples(2 * n);
+    std::vector<float> audio(2 * n), frame(2 * n), X(n + 2), Y(n + 2);
+    i2sMic::convertMono(in.data(), audio.data(), 2 * n);
+    for (auto _ : state) {
+        // the FFT works in place: a fresh copy every time (a few % of the time)
+        memcpy(frame.data(), audio.data(), 2 * n * sizeof(float));
+        fft.forwardRealPair(frame.data(), X.data(), Y.data());
+        benchmark::DoNotOptimize(X.data());
+        benchmark::DoNotOptimize(Y.data());
+    }
+    state.SetItemsProcessed(state.iterations() * 2);   // frames
+}
+BENCHMARK(BM_FftRealPair)->Arg(512)->Arg(1024);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,157 @@
+// Boot timeline check of Boot (ai-workshop-boot.h) on the host stand-in.
+//
+// The steps of a robot start are played with sleeps of about their real length (microphone,
+// classifier, LED ring, flash storage, and an SD card that mounts or times out without a
+// card). The first result needs the microphone, the classifier and one 200 ms slice of audio.
+// Starts the robot twice, everything one after the other (as setup() used to) and with the
+// slow steps in the background, and checks:
+//   - the first result comes earlier by about the SD card time
+//   - wait() returns when the background step is done, with its result
+//   - the timeline has every step, the marks and the failed SD card
+//   - tasks that mark the same new moment at the same time give one mark on the timeline
+//
+//   g++ -std=gnu++17 -O2 -pthread -I tools/host/include -I libraries/MAFAD_Workshop/src tools/host/boot_sim.cpp -o boot_sim
+//   ./boot_sim
+
+#include <Arduino.h>
+#include <ai-workshop-boot.h>
+
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+static bool sdCardPresent = true;
+static std::atomic<int64_t> listeningUs{ 0 };
+
+static void sleepMs(uint32_t ms)
+{
+    vTaskDelay(ms);
+}
+
+static bool microphone() { sleepMs(15); listeningUs = esp_timer_get_time(); return true; }
+static bool classifier() { sleepMs(40); return true; }
+static bool ledRing() { sleepMs(5); return true; }
+static bool flashStorage() { sleepMs(80); return true; }
+static bool sdCard()
+{
+    sleepMs(sdCardPresent ? 350 : 1200);   // without a card SD.begin() waits for a timeout
+    return sdCardPresent;
+}
+
+// the first result: one slice of audio after the microphone started, then the classifier
+static void waitFirstResult(Boot& boot)
+{
+    int64_t due = listeningUs + 200000;
+    while (esp_timer_get_time() < due) sleepMs(1);
+    sleepMs(12);
+    boot.mark("first result");
+}
+
+static float startRobot(bool background, bool& sdOk, Print& out)
+{
+    Boot boot;
+    boot.begin();
+    if (background) {
+        boot.start("sd card", sdCard);
+        boot.run("microphone", microphone);
+        boot.run("classifier", classifier);
+        boot.start("flash storage", flashStorage);
+        boot.run("led ring", ledRing);
+    } else {
+        boot.run("sd card", sdCard);
+        boot.run("flash storage", flashStorage);
+        boot.run("led ring", ledRing);
+        boot.run("microphone", microphone);
+        boot.run("classifier", classifier);
+    }
+    boot.mark("setup done");
+    waitFirstResult(boot);
+    sdOk = boot.wait("sd card", 5000);
+    while (!boot.isComplete()) sleepMs(1);
+    boot.printTimeline(out);
+    return boot.getMs("first result");   // since the program started (power on)
+}
+
+class Capture : public Print {
+public:
+    std::string text;
+    size_t write(uint8_t c) override
+    {
+        text += (char)c;
+        return 1;
+    }
+    size_t write(const uint8_t* data, size_t length) override
+    {
+        text.append((const char*)data, length);
+        return length;
+    }
+};
+
+int main()
+{
+    bool ok = true;
+    for (int card = 1; card >= 0; card--) {
+        sdCardPresent = card;
+        bool sdSerial, sdBackground;
+        Capture serialLog, backgroundLog;
+        int64_t t0 = esp_timer_get_time();
+        float serial = startRobot(false, sdSerial, serialLog) - t0 / 1000.0f;
+        t0 = esp_timer_get_time();
+        float background = startRobot(true, sdBackground, backgroundLog) - t0 / 1000.0f;
+        printf("%s: first result %.0f ms after setup() one by one, %.0f ms with the slow steps in the background\n",
+               card ? "with SD card" : "without SD card", serial, background);
+        if (card == 0) printf("%s", backgroundLog.text.c_str());
+
+        float saved = serial - background;
+        float expected = card ? 350.0f + 80.0f : 1200.0f + 80.0f;
+        if (saved < expected * 0.8f) {
+            printf("FAIL: only %.0f ms earlier, expected about %.0f ms\n", saved, expected);
+            ok = false;
+        }
+        if (sdSerial != (bool)card || sdBackground != (bool)card) {
+            printf("FAIL: wait() does not give the result of the SD card step\n");
+            ok = false;
+        }
+        for (const char* name : { "sd card", "microphone", "classifier", "flash storage", "led ring", "* first result", "(background)" }) {
+            if (backgroundLog.text.find(name) == std::string::npos) {
+                printf("FAIL: '%s' missing from the timeline\n", name);
+                ok = false;
+            }
+        }
+        if ((backgroundLog.text.find("FAILED") != std::string::npos) == (bool)card) {
+            printf("FAIL: the SD card step is %s FAILED in the timeline\n", card ? "wrongly" : "not");
+            ok = false;
+        }
+    }
+    // four tasks marking the same moments at the same time (e.g. "first result" from the
+    // inference task and loop()): every name once on the timeline
+    const int rounds = 2000, tasks = 4, names = 8;
+    static const char* moments[names] = { "m0", "m1", "m2", "m3", "m4", "m5", "m6", "m7" };
+    int duplicates = 0;
+    for (int round = 0; round < rounds; round++) {
+        Boot boot;
+        boot.begin();
+        std::atomic<int> ready{ 0 };
+        std::vector<std::thread> threads;
+        for (int t = 0; t < tasks; t++) {
+            threads.emplace_back([&] {
+                ready++;
+                while (ready.load() < tasks) std::this_thread::yield();
+                for (const char* name : moments) boot.mark(name);
+            });
+        }
+        for (std::thread& thread : threads) thread.join();
+        Capture timeline;
+        boot.printTimeline(timeline);
+        size_t lines = 0;
+        for (char c : timeline.text) lines += c == '\n';
+        if (lines != 1 + names) duplicates++;
+    }
+    printf("%d tasks marking the same %d moments, %d times: %d timelines with a moment twice\n", tasks, names, rounds, duplicates);
+    if (duplicates) {
+        printf("FAIL: a mark made at the same time by two tasks is on the timeline twice\n");
+        ok = false;
+    }
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,49 @@
+#!/bin/sh
+# Builds model_eval against an exported Edge Impulse Arduino library (folder or .zip).
+#   tools/host/build_model_eval.sh MAFAD_Classifier_inferencing.zip [model_eval]
+# The SDK sources are compiled once per model into <output>.obj/, on all cores.
+set -e
+
+if [ $# -lt 1 ]; then
+    echo "usage: $0 <exported Arduino library folder or zip> [output]" >&2
+    exit 2
+fi
+library=$1
+output=${2:-model_eval}
+here=$(cd "$(dirname "$0")" && pwd)
+repo=$(cd "$here/../.." && pwd)
+objects="$output.obj"
+
+case "$library" in
+*.zip)
+    rm -rf "$objects/library"
+    mkdir -p "$objects/library"
+    unzip -q "$library" -d "$objects/library"
+    library=$(dirname "$(find "$objects/library" -path '*/src/*_inferencing.h' | head -n 1)")/..
+    ;;
+esac
+
+header=$(cd "$library/src" 2>/dev/null && ls *_inferencing.h 2>/dev/null | head -n 1)
+if [ -z "$header" ]; then
+    echo "ERR: no src/*_inferencing.h in $library" >&2
+    exit 1
+fi
+src=$(cd "$library/src" && pwd)
+jobs=$(getconf _NPROCESSORS_ONLN 2>/dev/null || echo 4)
+flags="-O2 -DNDEBUG -DEI_CLASSIFIER_ENABLE_DETECTION_POSTPROCESS_OP=1 -I $src"
+mkdir -p "$objects"
+
+# the SDK has ports for many boards; the EI_PORTING_* defaults pick the POSIX one
+echo "compiling $header ($jobs jobs)"
+(cd "$src" && find . -name '*.c' -o -name '*.cc' -o -name '*.cpp') | sed 's|^\./||' | sort |
+    CC=${CC:-cc} CXX=${CXX:-c++} FLAGS="$flags" SRC="$src" OBJ="$objects" xargs -P "$jobs" -I {} sh -c '
+        o="$OBJ/$(echo "{}" | tr / _).o"
+        [ "$o" -nt "$SRC/{}" ] && exit 0
+        case "{}" in
+        *.c) $CC -std=gnu11 $FLAGS -c "$SRC/{}" -o "$o" ;;
+        *)   $CXX -std=gnu++17 $FLAGS -c "$SRC/{}" -o "$o" ;;
+        esac'
+
+${CXX:-c++} -std=gnu++17 $flags -I "$repo/libraries/MAFAD_Workshop/src" "-DMODEL_HEADER=\"$header\"" \
+    "$here/model_eval.cpp" "$objects"/*.o -o "$output" -lm
+echo "built $output"
@@ -0,0 +1,155 @@
+// Capture profiles and the auto tuner of i2sMic on the host stand-in (legacy driver: the
+// timing model is the one of a task in i2s_read).
+//
+// The microphone plays a counter, a stream hook stands for the work on every block and can
+// stall now and then (an SD card write, a busy core). The host I2S hands out audio in whole
+// DMA buffers and drops the oldest ones when the capture task stays away longer than the
+// buffers last, like the driver. Runs:
+//   - autoTune() with a light load and a 60 ms budget: the cheapest config (LowPower) is chosen
+//   - autoTune() with a 5 ms budget: only LowLatency fits
+//   - autoTune() with an 18 ms stall every 250 ms and a 10 ms budget: LowLatency (16 ms of
+//     headroom) is skipped, the small blocks with more DMA buffers are chosen
+//   - LowLatency forced with 30 ms stalls: the overruns the meter counts are the ones the
+//     driver had, and the frames it thinks are lost are the frames the driver dropped
+// Checks the chosen configs, that the measured latency is the latency of the config, and
+// that a config with enough headroom keeps the slices consecutive through the stalls.
+//
+//   g++ -std=gnu++17 -O2 -pthread -I tools/host/include -I libraries/MAFAD_Workshop/src tools/host/capture_tune_sim.cpp -o capture_tune_sim
+//   ./capture_tune_sim
+
+#include <Arduino.h>
+#include <ai-workshop-main.h>
+#include <ai-workshop-mic.h>
+
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+#define COUNTER_SPAN 50000   // the counter runs from -COUNTER_SPAN / 2 up, then wraps
+
+static void counter(int32_t* out, size_t count, uint32_t channels, uint64_t frameIndex)
+{
+    for (size_t i = 0; i < count; i++) {
+        for (uint32_t c = 0; c < channels; c++) out[i * channels + c] = ((int32_t)((frameIndex + i) % COUNTER_SPAN) - COUNTER_SPAN / 2) * 4096;
+    }
+}
+
+static bool follows(int32_t previous, int32_t next)
+{
+    return next == previous + 1 || (previous == COUNTER_SPAN / 2 - 1 && next == -COUNTER_SPAN / 2);
+}
+
+i2sMic mic;
+
+// the load next to the capture: a stall of stallMs every stallEveryMs
+static std::atomic<uint32_t> stallMs{ 0 };
+static std::atomic<uint32_t> stallEveryMs{ 250 };
+static int64_t lastStallUs = 0;   // only used by the capture task
+
+static void loadHook(float* samples, uint32_t count, int64_t timeUs, void* user)
+{
+    (void)samples; (void)count; (void)timeUs; (void)user;
+    delayMicroseconds(100);   // filters, levels, ...
+    int64_t now = esp_timer_get_time();
+    if (stallMs.load() > 0 && now - lastStallUs > (int64_t)stallEveryMs.load() * 1000) {
+        lastStallUs = now;
+        delay(stallMs.load());
+    }
+}
+
+static uint32_t errors = 0;
+
+static void fail(const char* what)
+{
+    if (errors++ < 10) printf("FAIL: %s\n", what);
+}
+
+static void print(const char* title, const CaptureConfig& config)
+{
+    char line[160];
+    config.format(line, sizeof(line), SAMPLE_RATE);
+    printf("%s: %s\n", title, line);
+}
+
+// streams for ms, reading every slice; false when a slice was not consecutive
+static bool streamChecked(uint32_t ms, uint32_t sliceSamples)
+{
+    std::vector<float> slice(sliceSamples);
+    bool ok = true;
+    if (!mic.startStream(sliceSamples)) return false;
+    int64_t end = esp_timer_get_time() + (int64_t)ms * 1000;
+    while (esp_timer_get_time() < end) {
+        if (!mic.isStreamReady()) {
+            delay(1);
+            continue;
+        }
+        mic.readStream(0, sliceSamples, slice.data());
+        mic.consumeStream();
+        for (uint32_t i = 1; i < sliceSamples; i++) ok &= follows((int32_t)slice[i - 1], (int32_t)slice[i]);
+    }
+    mic.stopStream();
+    return ok;
+}
+
+int main()
+{
+    hostI2sSetSource(I2S_NUM_0, counter);
+    if (!mic.setup(1, 7, 10)) return 1;
+    mic.addStreamHook(loadHook);
+    if (!mic.reserveStream(4000)) return 1;
+    delay(100);   // warmup of the capture task
+
+    if (mic.setCapture(CaptureConfig(1, 64, 64))) fail("a config with one DMA buffer was accepted");
+    if (mic.setCapture(CaptureConfig(8, 128, 2048))) fail("a read larger than DMA_BUFFER_SIZE was accepted");
+
+    // 1. light load, a relaxed budget: the fewest wakeups
+    printf("--- light load, 60 ms budget\n");
+    if (!mic.autoTune(60.0f, 500)) fail("nothing kept up with a light load");
+    print("chosen", mic.getCapture());
+    if (!(mic.getCapture() == CaptureConfig::forProfile(CaptureProfile::LowPower))) fail("light load: LowPower not chosen");
+
+    // the measured latency is the latency of the config
+    streamChecked(500, 4000);
+    CaptureTiming timing = mic.getCaptureTiming();
+    float configMs = mic.getCapture().latencyMs(SAMPLE_RATE);
+    printf("measured latency %.1f ms for a config of %.1f ms, jitter %.0f us, %.1f blocks/s\n",
+           timing.meanLatencyUs / 1000.0f, configMs, timing.jitterUs, timing.blocksPerSecond());
+    if (fabsf(timing.meanLatencyUs / 1000.0f - configMs) > 2.0f) fail("measured latency is not the config latency");
+    if (fabsf(timing.blocksPerSecond() - mic.getCapture().readsPerSecond(SAMPLE_RATE)) > 2.0f) fail("blocks per second off");
+
+    // 2. a tight budget
+    printf("--- light load, 5 ms budget\n");
+    if (!mic.autoTune(5.0f, 300)) fail("nothing kept up with a 5 ms budget");
+    if (!(mic.getCapture() == CaptureConfig::forProfile(CaptureProfile::LowLatency))) fail("5 ms budget: LowLatency not chosen");
+
+    // 3. stalls longer than the headroom of LowLatency
+    printf("--- 18 ms stall every 250 ms, 10 ms budget\n");
+    stallMs = 18;
+    if (!mic.autoTune(10.0f, 600)) fail("nothing kept up with the stalls");
+    if (!(mic.getCapture() == CaptureConfig(16, 64, 128))) fail("stalls: 16 x 64 not chosen");
+    HostI2sPort& port = hostI2sPort(I2S_NUM_0);
+    uint32_t overflowsBefore = port.overflows.load();
+    if (!streamChecked(1000, 2000)) fail("slices not consecutive with enough headroom");
+    if (port.overflows.load() != overflowsBefore) fail("the driver dropped audio with the chosen config");
+
+    // 4. LowLatency forced with stalls it cannot take: the meter sees what the driver dropped
+    printf("--- LowLatency forced, 30 ms stalls\n");
+    stallMs = 30;
+    mic.setCapture(CaptureProfile::LowLatency);
+    overflowsBefore = port.overflows.load();
+    uint64_t lostBefore = port.lostFrames.load();
+    streamChecked(1200, 2000);
+    timing = mic.getCaptureTiming();
+    uint32_t overflows = port.overflows.load() - overflowsBefore;
+    uint64_t lost = port.lostFrames.load() - lostBefore;
+    printf("driver: %u overflows, %u frames dropped; meter: %u overruns, %u frames lost\n",
+           (unsigned)overflows, (unsigned)lost, (unsigned)timing.overruns, (unsigned)timing.lostFrames);
+    if (overflows == 0) fail("no stall was longer than the DMA buffers");
+    if (timing.overruns != overflows) fail("overruns of the meter are not the ones of the driver");
+    if (fabs((double)timing.lostFrames - (double)lost) > 64.0 * overflows + 0.1 * lost) fail("lost frames of the meter off");
+    stallMs = 0;
+
+    mic.printStats();
+    printf("%s\n", errors == 0 ? "OK" : "FAILED");
+    return errors == 0 ? 0 : 1;
+}
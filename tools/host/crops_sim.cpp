@@ -0,0 +1,135 @@
+// Crop choice check of pickCrops (ai-workshop-wav.h), the code SDCard and the dataset builder share.
+//
+//   - a take just longer than one window: one crop, in the middle, however many were asked for
+//   - one crop asked for: the middle of the take
+//   - a take of exactly one window: one crop at 0, a shorter take: none
+//   - every length from one window to a full take and 2 .. MAX_CROPS crops: as many crops as
+//     fit, sorted, distinct, on the CROP_OFFSET grid, inside the take, and the same offsets as
+//     the crop loop SDCard::writeAudioFile had before it moved to ai-workshop-wav.h
+//
+//   g++ -std=gnu++17 -O2 -I libraries/MAFAD_Workshop/src tools/host/crops_sim.cpp -o crops_sim
+//   ./crops_sim
+
+#include <ai-workshop-wav.h>
+
+#include <cstdio>
+#include <random>
+
+static const uint32_t window = 20000;      // NN_WINDOW_SIZE
+static const uint32_t takeSamples = 60000; // SAMPLE_BUFFER_SIZE: a 3 s take
+
+static bool ok = true;
+
+static void check(bool condition, const char* what)
+{
+    if (!condition) {
+        printf("FAIL: %s\n", what);
+        ok = false;
+    }
+}
+
+// The crop loop of SDCard::writeAudioFile before it moved to pickCrops (numCrops > 0)
+template <typename Random>
+static uint8_t referenceCrops(uint32_t numSamples, uint8_t numCrops, uint32_t* offsets, Random random)
+{
+    if (numSamples < window) return 0;
+    uint32_t sampleMargin = numSamples - window;
+    uint32_t maxCrops = sampleMargin / CROP_OFFSET + 1;
+    bool used[24] = { false };
+    uint16_t idxs[24] = { 0 };
+    uint8_t picked = 0;
+    if (maxCrops > 24) maxCrops = 24;
+    if (numCrops > maxCrops) numCrops = maxCrops;
+    if (numCrops <= 1) {
+        offsets[0] = sampleMargin / 2;
+        return 1;
+    }
+    for (uint8_t b = 0; b < numCrops; b++) {
+        uint32_t start = (uint32_t)b * maxCrops / numCrops;
+        uint32_t end = (uint32_t)(b + 1) * maxCrops / numCrops;
+        if (end == 0) continue;
+        end -= 1;
+        if (end >= maxCrops) end = maxCrops - 1;
+        if (start > end) start = end;
+        uint32_t span = end - start + 1;
+        uint32_t idx = start + (uint32_t)random(span);
+        for (uint32_t tries = 0; tries < span && used[idx]; tries++) {
+            idx++;
+            if (idx > end) idx = start;
+        }
+        if (used[idx]) {
+            for (uint32_t j = 0; j < maxCrops; j++) {
+                uint32_t k = (idx + j) % maxCrops;
+                if (!used[k]) { idx = k; break; }
+            }
+        }
+        used[idx] = true;
+        idxs[picked++] = (uint16_t)idx;
+    }
+    for (uint8_t i = 1; i < picked; i++) {
+        uint16_t key = idxs[i];
+        int8_t k = (int8_t)i - 1;
+        while (k >= 0 && idxs[k] > key) {
+            idxs[k + 1] = idxs[k];
+            k--;
+        }
+        idxs[k + 1] = key;
+    }
+    for (uint8_t i = 0; i < picked; i++) offsets[i] = (uint32_t)idxs[i] * CROP_OFFSET;
+    return picked;
+}
+
+int main()
+{
+    uint32_t offsets[MAX_CROPS];
+    auto never = [](uint32_t) -> uint32_t { printf("FAIL: random() called for a single crop\n"); ok = false; return 0; };
+
+    // only one crop fits (the margin is less than CROP_OFFSET): the middle, even when 8 are asked for
+    const uint32_t justAbove = window + 1500;
+    uint8_t n = pickCrops(justAbove, window, 8, offsets, never);
+    printf("%u samples, 8 crops asked: %u crop at %u (margin %u)\n", (unsigned)justAbove, (unsigned)n, (unsigned)offsets[0],
+           (unsigned)(justAbove - window));
+    check(n == 1 && offsets[0] == (justAbove - window) / 2, "one crop that fits is centred");
+
+    // one crop asked for: the middle of a full take
+    n = pickCrops(takeSamples, window, 1, offsets, never);
+    printf("%u samples, 1 crop asked: %u crop at %u\n", (unsigned)takeSamples, (unsigned)n, (unsigned)offsets[0]);
+    check(n == 1 && offsets[0] == (takeSamples - window) / 2, "a single crop is centred");
+
+    n = pickCrops(window, window, 8, offsets, never);
+    check(n == 1 && offsets[0] == 0, "a take of one window: one crop at 0");
+    check(pickCrops(window - 1, window, 8, offsets, never) == 0, "a take shorter than a window: no crop");
+    check(pickCrops(takeSamples, window, 0, offsets, never) == 0, "no crops asked: none");
+
+    // every length and crop count against the old SDCard loop, with the same random numbers
+    uint32_t cases = 0, crops = 0;
+    for (uint32_t samples = window; samples <= takeSamples; samples += 97) {
+        for (uint8_t asked = 1; asked <= MAX_CROPS; asked++) {
+            std::mt19937 a(samples * 31 + asked), b(samples * 31 + asked);
+            auto randomA = [&](uint32_t span) { return (uint32_t)(a() % span); };
+            auto randomB = [&](uint32_t span) { return (uint32_t)(b() % span); };
+            uint32_t expected[24];
+            uint8_t got = pickCrops(samples, window, asked, offsets, randomA);
+            uint8_t want = referenceCrops(samples, asked, expected, randomB);
+            uint32_t fit = (samples - window) / CROP_OFFSET + 1;
+            if (fit > MAX_CROPS) fit = MAX_CROPS;
+
+            bool good = got == want && got == (asked < fit ? asked : fit);
+            for (uint8_t i = 0; i < got && good; i++) {
+                good = offsets[i] == expected[i] && offsets[i] + window <= samples &&
+                       (got == 1 || offsets[i] % CROP_OFFSET == 0) && (i == 0 || offsets[i] > offsets[i - 1]);
+            }
+            if (!good) {
+                printf("FAIL: %u samples, %u crops asked: %u crops, the old loop made %u\n", (unsigned)samples, (unsigned)asked,
+                       (unsigned)got, (unsigned)want);
+                ok = false;
+            }
+            cases++;
+            crops += got;
+        }
+    }
+    printf("%u lengths and crop counts, %u crops: the same as the old SDCard loop\n", (unsigned)cases, (unsigned)crops);
+
+    printf(ok ? "OK\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
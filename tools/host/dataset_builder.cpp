@@ -0,0 +1,389 @@
+// Builds a dataset from the recordings of a workshop, on a computer.
+//
+// Reads the master recordings (label.DEVICEnnnnnn.wav, as written by SDCard::writeAudioFile)
+// from a folder or a mounted SD card (all subfolders are searched; crops, and the takes kept
+// apart in /flagged and /review until someone listened to them, are skipped), cuts
+// them into 1 second crops with the same crop choice as the robot (pickCrops in
+// ai-workshop-wav.h), and splits them into train / validation / test. All takes of one
+// device and record index (one button press) go into the same split, so no part of a take can
+// end up in both training and testing. Augmented copies (label.DEVICEnnnnnn_a1.wav) go with
+// their take, and only into train unless --augmented-everywhere is given.
+//
+// Output:
+//   <out>/train/..., <out>/validation/..., <out>/test/...   the crops
+//   <out>/manifest.csv                                      one line per crop
+//   <out>/info.labels                                       for the Edge Impulse uploader
+//                                                           (validation is uploaded as training)
+//
+// The files are memory mapped and processed by all cores.
+//
+//   g++ -std=gnu++17 -O2 -pthread -I libraries/MAFAD_Workshop/src tools/host/dataset_builder.cpp -o dataset_builder
+//   ./dataset_builder /media/sdcard dataset
+//   ./dataset_builder recordings dataset --crops 4 --split 70,15,15 --group device
+//   edge-impulse-uploader --info-file dataset/info.labels
+
+#include <ai-workshop-wav.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char* splitNames[3] = { "train", "validation", "test" };
+
+struct Options {
+    std::string input;
+    std::string output;
+    uint32_t crops = 8;
+    uint32_t window = 20000;       // NN_WINDOW_SIZE
+    uint32_t sampleRate = 20000;   // SAMPLE_RATE
+    float fractions[3] = { 0.8f, 0.1f, 0.1f };
+    bool groupByDevice = false;
+    bool augmentedEverywhere = false;
+    uint64_t seed = 1;
+    unsigned threads = 0;
+};
+
+struct Recording {
+    std::string path;      // on this computer
+    std::string stem;      // file name without .wav
+    std::string label;
+    std::string device;
+    uint32_t take = 0;
+    bool augmented = false;
+    int split = 0;
+};
+
+struct Crop {
+    std::string file;      // relative to the output folder
+    uint32_t offset;
+};
+
+struct Result {
+    std::vector<Crop> crops;
+    uint64_t bytesRead = 0;
+    uint64_t bytesWritten = 0;
+    std::string error;
+};
+
+static uint64_t fnv1a(const std::string& text, uint64_t seed)
+{
+    uint64_t hash = 1469598103934665603ULL ^ seed;
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// label.DEVICEnnnnnn.wav, label.DEVICEnnnnnn_a1.wav (augmented); crops (_nnnnn) are skipped
+static bool parseName(const std::string& name, Recording& r)
+{
+    if (name.size() < 5 || name.compare(name.size() - 4, 4, ".wav") != 0) return false;
+    r.stem = name.substr(0, name.size() - 4);
+    size_t dot = r.stem.find('.');
+    if (dot == std::string::npos || dot == 0) return false;
+    r.label = r.stem.substr(0, dot);
+
+    std::string rest = r.stem.substr(dot + 1);
+    size_t digits = rest.find_first_of("0123456789");
+    if (digits == std::string::npos || digits == 0) return false;
+    r.device = rest.substr(0, digits);
+    size_t end = rest.find_first_not_of("0123456789", digits);
+    r.take = (uint32_t)strtoul(rest.substr(digits, end - digits).c_str(), nullptr, 10);
+
+    std::string suffix = end == std::string::npos ? "" : rest.substr(end);
+    if (suffix.empty()) return true;
+    if (suffix.size() > 2 && suffix[0] == '_' && suffix[1] == 'a') {
+        r.augmented = true;
+        return true;
+    }
+    return false;   // a crop or something else
+}
+
+static void scan(const std::string& dir, std::vector<Recording>& out)
+{
+    DIR* d = opendir(dir.c_str());
+    if (!d) return;
+    while (struct dirent* e = readdir(d)) {
+        if (e->d_name[0] == '.') continue;
+        std::string path = dir + "/" + e->d_name;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            if (strcmp(e->d_name, "crops") != 0 && strcmp(e->d_name, "flagged") != 0 && strcmp(e->d_name, "review") != 0) scan(path, out);
+            continue;
+        }
+        Recording r;
+        if (parseName(e->d_name, r)) {
+            r.path = path;
+            out.push_back(r);
+        }
+    }
+    closedir(d);
+}
+
+// Whole groups (a take of a device, or a device) go to one split; the groups are shuffled
+// with the seed and dealt out so the splits get close to the fractions.
+static void assignSplits(std::vector<Recording>& recordings, const Options& options)
+{
+    std::map<std::string, std::vector<Recording*>> groups;
+    for (Recording& r : recordings) {
+        std::string key = options.groupByDevice ? r.device : r.device + ":" + std::to_string(r.take);
+        groups[key].push_back(&r);
+    }
+
+    std::vector<std::string> keys;
+    for (auto& g : groups) keys.push_back(g.first);
+    std::sort(keys.begin(), keys.end(), [&](const std::string& a, const std::string& b) {
+        return fnv1a(a, options.seed) < fnv1a(b, options.seed);
+    });
+
+    float total = options.fractions[0] + options.fractions[1] + options.fractions[2];
+    size_t count = keys.size();
+    size_t trainEnd = (size_t)(count * options.fractions[0] / total + 0.5f);
+    size_t validationEnd = (size_t)(count * (options.fractions[0] + options.fractions[1]) / total + 0.5f);
+    for (size_t i = 0; i < count; i++) {
+        int split = i < trainEnd ? 0 : i < validationEnd ? 1 : 2;
+        for (Recording* r : groups[keys[i]]) r->split = split;
+    }
+}
+
+static bool writeAll(int fd, const void* data, size_t size)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n <= 0) return false;
+        p += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+static Result process(const Recording& r, const Options& options)
+{
+    Result result;
+    int fd = open(r.path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        result.error = "cannot open";
+        return result;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    size_t size = (size_t)st.st_size;
+    if (size < WAV_HEADER_SIZE) {
+        close(fd);
+        result.error = "too short";
+        return result;
+    }
+    const uint8_t* data = (const uint8_t*)mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        result.error = "cannot map";
+        return result;
+    }
+    madvise((void*)data, size, MADV_SEQUENTIAL);
+
+    WavInfo info;
+    if (!parseWavHeader(data, (uint32_t)size, info)) {
+        result.error = "not a 16 bit PCM WAV file";
+    } else if (info.channels != 1 || info.sampleRate != options.sampleRate) {
+        result.error = "not mono at " + std::to_string(options.sampleRate) + " Hz";
+    } else {
+        // the same crops every run, whatever thread gets the file
+        std::mt19937_64 rng(fnv1a(r.stem, options.seed));
+        auto random = [&rng](uint32_t span) { return (uint32_t)(rng() % span); };
+
+        uint32_t offsets[MAX_CROPS];
+        uint8_t picked = 0;
+        uint32_t length = options.window;
+        if (options.crops == 0) {
+            offsets[0] = 0;   // the whole take
+            picked = 1;
+            length = info.numSamples;
+        } else {
+            picked = pickCrops(info.numSamples, options.window, (uint8_t)std::min<uint32_t>(options.crops, MAX_CROPS), offsets, random);
+        }
+
+        const int16_t* samples = (const int16_t*)(data + info.dataOffset);
+        for (uint8_t i = 0; i < picked; i++) {
+            char name[64];
+            snprintf(name, sizeof(name), "_%05u", (unsigned)offsets[i]);
+            std::string file = std::string(splitNames[r.split]) + "/" + r.stem + (options.crops ? name : "") + ".wav";
+
+            uint8_t header[WAV_HEADER_SIZE];
+            fillWavHeader(header, length, info.sampleRate);
+            int out = open((options.output + "/" + file).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            bool ok = out >= 0 && writeAll(out, header, sizeof(header)) &&
+                      writeAll(out, samples + offsets[i], (size_t)length * sizeof(int16_t));
+            if (out >= 0) close(out);
+            if (!ok) {
+                result.error = "cannot write " + file;
+                break;
+            }
+            result.crops.push_back({ file, offsets[i] });
+            result.bytesWritten += sizeof(header) + (uint64_t)length * sizeof(int16_t);
+        }
+        result.bytesRead = info.dataOffset + (uint64_t)info.numSamples * 2;
+    }
+    munmap((void*)data, size);
+    return result;
+}
+
+static void usage()
+{
+    fprintf(stderr,
+            "usage: dataset_builder <recordings folder> <output folder> [options]\n"
+            "  --crops N               crops per take (default 8, 0 = whole takes)\n"
+            "  --window N              crop length in samples (default 20000)\n"
+            "  --rate N                sample rate of the recordings (default 20000)\n"
+            "  --split T,V,T           train, validation, test percentages (default 80,10,10)\n"
+            "  --group take|device     keep takes or whole devices together (default take)\n"
+            "  --augmented-everywhere  also put augmented copies in validation and test\n"
+            "  --seed N                other splits and crops (default 1)\n"
+            "  --threads N             (default all cores)\n");
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                usage();
+                exit(2);
+            }
+            return argv[++i];
+        };
+        if (arg == "--crops") options.crops = (uint32_t)atoi(value());
+        else if (arg == "--window") options.window = (uint32_t)atoi(value());
+        else if (arg == "--rate") options.sampleRate = (uint32_t)atoi(value());
+        else if (arg == "--split") {
+            if (sscanf(value(), "%f,%f,%f", &options.fractions[0], &options.fractions[1], &options.fractions[2]) != 3) {
+                usage();
+                return 2;
+            }
+        } else if (arg == "--group") options.groupByDevice = strcmp(value(), "device") == 0;
+        else if (arg == "--augmented-everywhere") options.augmentedEverywhere = true;
+        else if (arg == "--seed") options.seed = strtoull(value(), nullptr, 10);
+        else if (arg == "--threads") options.threads = (unsigned)atoi(value());
+        else if (arg == "-h" || arg == "--help") {
+            usage();
+            return 0;
+        } else positional.push_back(arg);
+    }
+    if (positional.size() != 2) {
+        usage();
+        return 2;
+    }
+    options.input = positional[0];
+    options.output = positional[1];
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<Recording> recordings;
+    scan(options.input, recordings);
+    if (recordings.empty()) {
+        fprintf(stderr, "no recordings (label.DEVICEnnnnnn.wav) in %s\n", options.input.c_str());
+        return 1;
+    }
+    std::sort(recordings.begin(), recordings.end(), [](const Recording& a, const Recording& b) { return a.stem < b.stem; });
+    assignSplits(recordings, options);
+
+    // augmented copies only train, unless asked otherwise
+    std::vector<Recording> work;
+    uint32_t skippedAugmented = 0;
+    for (const Recording& r : recordings) {
+        if (r.augmented && r.split != 0 && !options.augmentedEverywhere) {
+            skippedAugmented++;
+            continue;
+        }
+        work.push_back(r);
+    }
+
+    mkdir(options.output.c_str(), 0755);
+    for (const char* split : splitNames) mkdir((options.output + "/" + split).c_str(), 0755);
+
+    unsigned threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<Result> results(work.size());
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; t++) {
+        pool.emplace_back([&]() {
+            for (size_t i = next++; i < work.size(); i = next++) results[i] = process(work[i], options);
+        });
+    }
+    for (std::thread& t : pool) t.join();
+
+    // manifests, in file name order
+    FILE* csv = fopen((options.output + "/manifest.csv").c_str(), "w");
+    FILE* labels = fopen((options.output + "/info.labels").c_str(), "w");
+    if (!csv || !labels) {
+        fprintf(stderr, "cannot write the manifests in %s\n", options.output.c_str());
+        return 1;
+    }
+    fprintf(csv, "path,label,device,take,augmented,split,offset,source\n");
+    fprintf(labels, "{\"version\":1,\"files\":[");
+
+    uint64_t bytesRead = 0, bytesWritten = 0;
+    size_t crops = 0, errors = 0;
+    std::map<std::string, size_t> table[3];   // label -> crops, per split
+    bool first = true;
+    for (size_t i = 0; i < work.size(); i++) {
+        const Recording& r = work[i];
+        const Result& result = results[i];
+        if (!result.error.empty()) {
+            fprintf(stderr, "%s: %s\n", r.path.c_str(), result.error.c_str());
+            errors++;
+        }
+        bytesRead += result.bytesRead;
+        bytesWritten += result.bytesWritten;
+        for (const Crop& crop : result.crops) {
+            fprintf(csv, "%s,%s,%s,%u,%d,%s,%u,%s\n", crop.file.c_str(), r.label.c_str(), r.device.c_str(), (unsigned)r.take,
+                    r.augmented ? 1 : 0, splitNames[r.split], (unsigned)crop.offset, r.path.c_str());
+            size_t slash = crop.file.rfind('/');
+            std::string name = crop.file.substr(slash + 1, crop.file.size() - slash - 5);
+            fprintf(labels, "%s{\"path\":\"%s\",\"name\":\"%s\",\"category\":\"%s\",\"label\":{\"type\":\"label\",\"label\":\"%s\"},"
+                            "\"metadata\":{\"device\":\"%s\",\"take\":\"%u\",\"split\":\"%s\"}}",
+                    first ? "" : ",", crop.file.c_str(), name.c_str(), r.split == 2 ? "testing" : "training", r.label.c_str(),
+                    r.device.c_str(), (unsigned)r.take, splitNames[r.split]);
+            first = false;
+            table[r.split][r.label]++;
+            crops++;
+        }
+    }
+    fprintf(labels, "]}\n");
+    fclose(csv);
+    fclose(labels);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::map<std::string, bool> allLabels;
+    for (auto& split : table)
+        for (auto& entry : split) allLabels[entry.first] = true;
+    printf("%-16s %8s %10s %8s\n", "label", "train", "validation", "test");
+    for (auto& entry : allLabels) {
+        printf("%-16s %8zu %10zu %8zu\n", entry.first.c_str(), table[0][entry.first], table[1][entry.first], table[2][entry.first]);
+    }
+    printf("%zu recordings (%u augmented copies left out of validation/test), %zu crops, %zu errors\n",
+           work.size(), (unsigned)skippedAugmented, crops, errors);
+    printf("%.2f s on %u threads, %.1f MB read, %.1f MB written, %.0f MB/s\n", seconds, threads, bytesRead / 1e6,
+           bytesWritten / 1e6, seconds > 0 ? (bytesRead + bytesWritten) / 1e6 / seconds : 0.0);
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,116 @@
+// Direction of arrival check of DirectionFinder (ai-workshop-doa.h) on the host stand-in.
+//
+// Plays short broadband sounds from known angles through a simulated stereo
+// microphone pair (the far microphone gets a fractional delay) and checks the
+// estimated angles. Also prints the cost of one estimate on this machine.
+//
+//   g++ -std=gnu++17 -O2 -pthread -I tools/host/include -I libraries/MAFAD_Workshop/src tools/host/doa_sim.cpp -o doa_sim
+//   ./doa_sim
+
+#include <Arduino.h>
+#include <ai-workshop-main.h>
+#include <ai-workshop-mic.h>
+#include <ai-workshop-doa.h>
+
+#include <cmath>
+#include <vector>
+
+static const float angles[] = { -60.0f, -30.0f, 0.0f, 20.0f, 45.0f, 70.0f };
+static const int numEvents = sizeof(angles) / sizeof(angles[0]);
+static const float eventSpacingS = 1.0f;
+static const float eventLengthS = 0.15f;
+static const float amplitude = 3000.0f;
+static const float noiseAmplitude = 10.0f;
+
+static DoaConfig config;
+
+// a band limited sound: a sum of tones with fixed random phases, so it can be evaluated at any time
+struct Tone { float frequency; float phase; };
+static std::vector<Tone> tones;
+
+static float sound(double t)
+{
+    if (t < 0.0 || t > eventLengthS) return 0.0f;
+    float v = 0.0f;
+    for (const Tone& tone : tones) v += sinf((float)(2.0 * M_PI * tone.frequency * t) + tone.phase);
+    // short fade in and out
+    float fade = (float)std::min(1.0, std::min(t, eventLengthS - t) / 0.005);
+    return amplitude * fade * v / sqrtf((float)tones.size());
+}
+
+static void stereoAudio(int32_t* out, size_t count, uint32_t channels, uint64_t frameIndex)
+{
+    static uint32_t lcg = 777;
+    for (size_t i = 0; i < count; i++) {
+        double t = (double)(frameIndex + i) / SAMPLE_RATE;
+        int event = (int)(t / eventSpacingS) - 1;
+        float left = 0.0f, right = 0.0f;
+        if (event >= 0 && event < numEvents) {
+            // positive angles are on the right: the sound reaches the left microphone later
+            double delay = config.micDistanceM * sin(angles[event] * M_PI / 180.0) / config.speedOfSound;
+            double local = t - (event + 1) * eventSpacingS;
+            left = sound(local - delay / 2);
+            right = sound(local + delay / 2);
+        }
+        lcg = lcg * 1664525u + 1013904223u;
+        left += ((int32_t)(lcg >> 16) - 32768) / 32768.0f * noiseAmplitude;
+        lcg = lcg * 1664525u + 1013904223u;
+        right += ((int32_t)(lcg >> 16) - 32768) / 32768.0f * noiseAmplitude;
+
+        out[i * channels] = (int32_t)left * 4096;
+        if (channels == 2) out[i * channels + 1] = (int32_t)right * 4096;
+    }
+}
+
+i2sMic mic;
+DirectionFinder doa;
+
+int main()
+{
+    uint32_t lcg = 99;
+    for (int i = 0; i < 48; i++) {
+        lcg = lcg * 1664525u + 1013904223u;
+        float f = 300.0f + (lcg >> 8) % 4700;
+        tones.push_back({ f, (float)((lcg >> 4) % 6283) / 1000.0f });
+    }
+
+    hostI2sSetSource(I2S_NUM_0, stereoAudio);
+    mic.setup(1, 7, 10, I2S_NUM_0, MicChannels::Stereo);
+    if (!doa.begin(mic, config)) return 1;
+    mic.startStream(4000);
+
+    bool ok = true;
+    uint32_t seen = 0;
+    int64_t start = esp_timer_get_time();
+    int64_t lengthUs = (int64_t)((numEvents + 1.5f) * eventSpacingS * 1e6f);
+    while (esp_timer_get_time() - start < lengthUs) {
+        if (mic.isStreamReady()) mic.consumeStream();
+
+        if (doa.getResultCount() != seen) {
+            seen = doa.getResultCount();
+            DoaResult r;
+            doa.latest(r);
+            int event = (int)((r.timeUs - start) / 1e6f / eventSpacingS) - 1;
+            float expected = (event >= 0 && event < numEvents) ? angles[event] : NAN;
+            float error = fabsf(r.angleDeg - expected);
+            printf("event %d: expected %6.1f, estimated %6.1f deg (delay %6.1f us, confidence %.2f, %u us)%s\n",
+                   event, expected, r.angleDeg, r.delayUs, r.confidence, (unsigned)r.computeUs,
+                   error <= 8.0f ? "" : "  <-- off");
+            if (!(error <= 8.0f)) ok = false;
+        }
+        delay(5);
+    }
+
+    doa.printStats();
+    DoaStats stats = doa.getStats();
+    if ((int)stats.estimates != numEvents) {
+        printf("FAIL: %u estimates for %d sounds\n", (unsigned)stats.estimates, numEvents);
+        ok = false;
+    }
+    printf("%s\n", ok ? "OK" : "FAILED");
+
+    mic.stopStream();
+    doa.end(mic);
+    delay(100);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,331 @@
+// Few-shot melody enrolment (ai-workshop-enrol.h) on synthetic takes.
+//
+// The detector knows one melody (hello_there, as record_dataset plays it). A student enrols
+// three new ones by playing each three times: square waves with jitter, a few percent faster
+// or slower every time, a small speaker and background noise (as melody_eval --synth makes
+// them), fed in DMA_BUFFER_SIZE blocks the way the stream does, update() called after every
+// block like loop() would. Then:
+//   - 20 new takes of every melody, 20 random takes and 20 noise takes: recognised, and what
+//     the matcher costs per slice of 4000 samples with 1 and with 4 templates
+//   - enrolling three different melodies as one: refused (the takes do not agree)
+//   - enrolling hello_there under another name: refused (too much like a known melody)
+//   - a clap (too short for a take) before the first take: ignored
+//   - a melody enrolled again: replaced; when the detector is full: refused, the old one kept
+//   - a new detector and enroller after a "restart": the melodies come back from the flash,
+//     forget() removes one for good, a broken file is not loaded
+//
+//   g++ -std=gnu++17 -O2 -pthread -I tools/host/include -I libraries/MAFAD_Workshop/src tools/host/enrol_sim.cpp -o enrol_sim
+//   ./enrol_sim
+
+#include <Arduino.h>
+#include <ai-workshop-main.h>
+#include <ai-workshop-pitches.h>
+#include <ai-workshop-melody.h>
+#include <ai-workshop-enrol.h>
+
+#include <cmath>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+static std::vector<MelodyNote> helloThere()
+{
+    std::vector<MelodyNote> m;
+    const uint16_t pairs[][2] = { { NOTE_C3, NOTE_C4 }, { NOTE_D3, NOTE_D4 }, { NOTE_DS3, NOTE_DS4 }, { NOTE_F3, NOTE_F4 },
+                                  { NOTE_G3, NOTE_G4 }, { NOTE_GS3, NOTE_GS4 }, { NOTE_AS3, NOTE_AS4 }, { NOTE_C4, NOTE_C5 } };
+    for (int i = 0; i < 8; i++) {
+        m.push_back({ pairs[i][0], 60 });
+        m.push_back({ pairs[i][1], 60 });
+        if (i < 7) m.push_back({ 0, 30 });
+    }
+    return m;
+}
+
+// what students play: short tunes of a second or two
+static std::vector<MelodyNote> twinkle()
+{
+    std::vector<MelodyNote> m;
+    for (uint16_t note : { NOTE_C4, NOTE_C4, NOTE_G4, NOTE_G4, NOTE_A4, NOTE_A4, NOTE_G4 }) {
+        m.push_back({ note, 150 });
+        m.push_back({ 0, 40 });
+    }
+    return m;
+}
+
+static std::vector<MelodyNote> siren()
+{
+    std::vector<MelodyNote> m;
+    for (int i = 0; i < 4; i++) {
+        m.push_back({ NOTE_A4, 200 });
+        m.push_back({ NOTE_E5, 200 });
+    }
+    return m;
+}
+
+static std::vector<MelodyNote> scaleDown()
+{
+    std::vector<MelodyNote> m;
+    for (uint16_t note : { NOTE_C6, NOTE_B5, NOTE_A5, NOTE_G5, NOTE_F5, NOTE_E5, NOTE_D5, NOTE_C5 }) m.push_back({ note, 110 });
+    return m;
+}
+
+// A small speaker and microphone: no bass below ~300 Hz, soft above ~5 kHz.
+struct Speaker {
+    float hp = 0.0f, lastIn = 0.0f, lp = 0.0f;
+    float step(float x)
+    {
+        const float a = expf(-2.0f * (float)M_PI * 300.0f / SAMPLE_RATE);
+        hp = a * (hp + x - lastIn);
+        lastIn = x;
+        const float b = expf(-2.0f * (float)M_PI * 5000.0f / SAMPLE_RATE);
+        lp = b * lp + (1.0f - b) * hp;
+        return lp;
+    }
+};
+
+static std::mt19937 rng(4321);
+
+// one take: silence, the melody (tempo 0.92 .. 1.08, notes detuned a little), silence
+static std::vector<float> render(const std::vector<MelodyNote>& melody, bool vary = true)
+{
+    std::uniform_real_distribution<float> uni(0.0f, 1.0f);
+    std::normal_distribution<float> gauss(0.0f, 1.0f);
+    float tempo = vary ? 0.92f + 0.16f * uni(rng) : 1.0f;
+    float gain = 2000.0f + 6000.0f * uni(rng);
+    float noise = 10.0f + 50.0f * uni(rng);
+
+    size_t pos = (size_t)(100 + 200 * uni(rng)) * SAMPLE_RATE / 1000;
+    size_t length = 0;
+    for (const MelodyNote& note : melody) length += (size_t)(note.ms * tempo * SAMPLE_RATE / 1000);
+    std::vector<float> audio(pos + length + (size_t)800 * SAMPLE_RATE / 1000, 0.0f);
+    double phase = 0.0;
+    for (const MelodyNote& note : melody) {
+        size_t n = (size_t)(note.ms * tempo * SAMPLE_RATE / 1000);
+        float f = note.frequency ? note.frequency + 6.0f * (2.0f * uni(rng) - 1.0f) : 0.0f;
+        for (size_t i = 0; i < n; i++, pos++) {
+            if (f <= 0.0f) continue;
+            phase += f / SAMPLE_RATE;
+            phase -= floor(phase);
+            audio[pos] = gain * (phase < 0.49 ? 1.0f : -1.0f);
+        }
+    }
+    Speaker speaker;
+    for (float& v : audio) v = std::max(-32768.0f, std::min(32767.0f, speaker.step(v) + noise * gauss(rng)));
+    return audio;
+}
+
+static std::vector<MelodyNote> randomSounds()
+{
+    std::uniform_real_distribution<float> uni(0.0f, 1.0f);
+    std::vector<MelodyNote> random;
+    int tones = 2 + (int)(uni(rng) * 6);
+    for (int i = 0; i < tones; i++) {
+        random.push_back({ 0, (uint16_t)(50 + uni(rng) * 300) });
+        random.push_back({ (uint16_t)(70 + uni(rng) * 1930), (uint16_t)(10 + uni(rng) * 400) });
+    }
+    return random;
+}
+
+static int64_t audioUs = 0;   // stream time
+
+// feeds audio like the stream; update() after every block like loop()
+static void feed(MelodyDetector& detector, MelodyEnroller* enroller, const std::vector<float>& audio)
+{
+    for (size_t at = 0; at < audio.size(); at += DMA_BUFFER_SIZE) {
+        uint32_t n = (uint32_t)std::min((size_t)DMA_BUFFER_SIZE, audio.size() - at);
+        audioUs += (int64_t)n * 1000000 / SAMPLE_RATE;
+        detector.process(&audio[at], n, audioUs);
+        if (enroller) enroller->update();
+    }
+}
+
+// the best match of a take, "-" for none
+static std::string heard(MelodyDetector& detector, const std::vector<float>& audio)
+{
+    std::vector<float> tail(MELODY_FRAME_SIZE * 4, 0.0f);
+    feed(detector, nullptr, audio);
+    feed(detector, nullptr, tail);
+    std::string name = "-";
+    float best = 1e30f;
+    MelodyMatch m;
+    while (detector.getMatch(m)) {
+        if (m.cost < best) {
+            best = m.cost;
+            name = m.name;
+        }
+    }
+    return name;
+}
+
+static bool ok = true;
+
+static void check(bool condition, const char* what)
+{
+    if (!condition) {
+        printf("FAIL: %s\n", what);
+        ok = false;
+    }
+}
+
+// plays the takes; returns the state enrolment ended in and the audio it took
+static EnrolState enrol(MelodyDetector& detector, MelodyEnroller& enroller, const char* name,
+                        const std::vector<std::vector<MelodyNote>>& takes, float& seconds)
+{
+    int64_t start = audioUs;
+    enroller.start(name);
+    for (const std::vector<MelodyNote>& take : takes) feed(detector, &enroller, render(take));
+    seconds = (audioUs - start) / 1e6f;
+    EnrolState state = enroller.update();
+    EnrolStats stats = enroller.getStats();
+    if (state == EnrolState::Complete) {
+        printf("  %-12s enrolled after %.1f s of audio, %u takes, spread %.2f, template built in %.2f ms\n", name, seconds,
+               (unsigned)enroller.takesHeard(), stats.lastSpread, stats.lastBuildUs / 1000.0f);
+    } else {
+        printf("  %-12s not enrolled after %.1f s of audio, %u takes: %s\n", name, seconds, (unsigned)enroller.takesHeard(),
+               state == EnrolState::Failed ? enroller.failReason() : "unfinished");
+    }
+    return state;
+}
+
+int main()
+{
+    hostFlashRoot() = "enrol_flash";
+    system("rm -rf enrol_flash");
+
+    const std::vector<MelodyNote> hello = helloThere();
+    const char* names[] = { "twinkle", "siren", "scale_down" };
+    const std::vector<MelodyNote> melodies[] = { twinkle(), siren(), scaleDown() };
+
+    MelodyDetector detector;
+    detector.begin();
+    detector.addMelody("hello_there", hello.data(), hello.size());
+    MelodyEnroller enroller;
+    check(enroller.begin(detector), "begin");
+
+    // the matcher with the built in melody only
+    for (int i = 0; i < 10; i++) heard(detector, render(hello));
+    float matchUsBefore = detector.getMatchUs(4000);
+
+    // 1. enrol, with a clap before the first take
+    printf("enrolling (3 takes each):\n");
+    std::vector<MelodyNote> clap = { { NOTE_A5, 60 } };
+    enroller.start("twinkle");
+    feed(detector, &enroller, render(clap, false));
+    check(enroller.takesHeard() == 0, "a clap counted as a take");
+    float seconds;
+    for (int m = 0; m < 3; m++) {
+        EnrolState state = enrol(detector, enroller, names[m], { melodies[m], melodies[m], melodies[m] }, seconds);
+        check(state == EnrolState::Complete, "a melody was not enrolled");
+        check(seconds < 15.0f, "enrolment took longer than 15 s of playing");
+    }
+    check(detector.matcher().size() == 4 && enroller.size() == 3, "the detector does not have the enrolled melodies");
+
+    // 2. refused
+    printf("refusing:\n");
+    EnrolState state = enrol(detector, enroller, "mixed", { melodies[0], melodies[1], melodies[2] }, seconds);
+    check(state == EnrolState::Failed, "takes of different melodies were enrolled");
+    state = enrol(detector, enroller, "hello_again", { hello, hello, hello }, seconds);
+    check(state == EnrolState::Failed, "a melody the detector knows was enrolled again");
+    check(detector.matcher().size() == 4 && enroller.size() == 3, "a refused melody was added");
+
+    // 3. recognition
+    const int tests = 20;
+    std::map<std::string, std::map<std::string, int>> confusion;
+    std::vector<std::string> truths = { names[0], names[1], names[2], "hello_there", "random", "noise" };
+    int correct = 0, total = 0;
+    for (int t = 0; t < tests; t++) {
+        for (size_t k = 0; k < truths.size(); k++) {
+            const std::string& truth = truths[k];
+            std::vector<float> audio;
+            if (truth == "random") audio = render(randomSounds());
+            else if (truth == "noise") audio = render({ { 0, 1000 } });
+            else if (truth == "hello_there") audio = render(hello);
+            else audio = render(melodies[k]);
+            std::string got = heard(detector, audio);
+            bool right = got == truth || (got == "-" && (truth == "random" || truth == "noise"));
+            confusion[truth][right && got == "-" ? truth : got]++;
+            correct += right;
+            total++;
+        }
+    }
+
+    printf("\n%-12s", "truth \\ got");
+    std::vector<std::string> columns = { names[0], names[1], names[2], "hello_there", "-" };
+    for (const std::string& c : columns) printf(" %11s", c.c_str());
+    printf("\n");
+    int falsePositives = 0;
+    for (const std::string& truth : truths) {
+        printf("%-12s", truth.c_str());
+        for (const std::string& c : columns) {
+            int n = c == "-" ? confusion[truth][truth] * (truth == "random" || truth == "noise") + confusion[truth]["-"] : confusion[truth][c];
+            printf(" %11d", n);
+            if ((truth == "random" || truth == "noise") && c != "-") falsePositives += n;
+        }
+        printf("\n");
+    }
+    float accuracy = 100.0f * correct / total;
+    printf("\naccuracy %.1f%% (%d of %d takes), %d false matches on random and noise takes\n", accuracy, correct, total, falsePositives);
+    for (int m = 0; m < 3; m++) check(confusion[names[m]][names[m]] >= tests * 9 / 10, "an enrolled melody is recognised in less than 90% of its takes");
+    check(falsePositives <= 2, "more than 2 false matches on random and noise takes");
+
+    float matchUsAfter = detector.getMatchUs(4000);
+    printf("matcher: %.1f us per slice of 4000 samples with 1 template, %.1f with 4 (this machine); detector %.2f%% of real time\n",
+           matchUsBefore, matchUsAfter, 100.0f * detector.getLoad());
+    enroller.printStats();
+
+    // 4. enrolled again: replaced, and kept when the detector has no room for the new template
+    printf("enrolling again:\n");
+    state = enrol(detector, enroller, names[0], { melodies[0], melodies[0], melodies[0] }, seconds);
+    check(state == EnrolState::Complete, "a melody was not enrolled again");
+    check(detector.matcher().size() == 4 && enroller.size() == 3 && detector.matcher().find(names[0]) >= 0,
+          "enrolling again did not replace the template");
+    const char* fillers[] = { "filler_1", "filler_2", "filler_3", "filler_4" };
+    for (const char* filler : fillers) detector.addMelody(filler, clap.data(), clap.size());
+    check(detector.matcher().size() == MELODY_MAX_TEMPLATES, "the detector is not full");
+    state = enrol(detector, enroller, names[1], { melodies[1], melodies[1], melodies[1] }, seconds);
+    check(state == EnrolState::Failed, "enrolled again into a full detector");
+    check(detector.matcher().find(names[1]) >= 0 && enroller.size() == 3, "a failed enrolment lost the old template");
+    for (const char* filler : fillers) detector.removeTemplate(filler);
+    check(detector.matcher().size() == 4, "the fillers were not removed");
+
+    // 5. after a restart
+    {
+        MelodyDetector restarted;
+        restarted.begin();
+        restarted.addMelody("hello_there", hello.data(), hello.size());
+        MelodyEnroller again;
+        check(again.begin(restarted), "begin after the restart");
+        check(again.size() == 3 && restarted.matcher().size() == 4, "the enrolled melodies did not come back from the flash");
+        for (int m = 0; m < 3; m++) check(heard(restarted, render(melodies[m])) == names[m], "a reloaded melody is not recognised");
+        unsigned reloaded = again.size();
+        check(again.forget("siren") && again.size() == 2 && restarted.matcher().size() == 3, "forget()");
+        check(heard(restarted, render(melodies[1])) == "-", "a forgotten melody is still recognised");
+        printf("after a restart: %u melodies back from the flash, %u after forget(\"siren\")\n", reloaded, (unsigned)again.size());
+    }
+    {
+        MelodyDetector restarted;
+        restarted.begin();
+        MelodyEnroller again;
+        again.begin(restarted);
+        check(again.size() == 2 && again.name(0) && again.name(1), "forget() was not saved");
+    }
+    {
+        // one bit flipped in the flash
+        std::string path = hostFlashRoot() + "/enrol/melodies.bin";
+        FILE* f = fopen(path.c_str(), "r+b");
+        fseek(f, 20, SEEK_SET);
+        int c = fgetc(f);
+        fseek(f, 20, SEEK_SET);
+        fputc(c ^ 0x10, f);
+        fclose(f);
+        MelodyDetector restarted;
+        restarted.begin();
+        MelodyEnroller again;
+        again.begin(restarted);
+        check(again.size() == 0 && restarted.matcher().size() == 0, "a broken file was loaded");
+    }
+
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,343 @@
+// The event bus (ai-workshop-events.h) on the host stand-in.
+//
+//   - four tasks publish as fast as they can to a handler and a polled subscriber: every
+//     event arrives once and in the order its publisher sent it, or is counted as dropped;
+//     a publisher never waits (max publish() time)
+//   - the same paced (one event per 100 us each): the fast handler gets all of them, a
+//     handler that takes 2 ms per event only loses its own
+//   - the library publishes: i2sMic slices (SliceReady), AiWorkshopInference onset and offset
+//     of a tone the microphone hears for 1.2 s (with a stand-in classifier; "noise" before and
+//     after it is a label as well, so it has onsets of its own), startTone() /
+//     stopTone(), a take written by SDCard (TakeSaved) and one it cannot write (SdError)
+// Prints the latency of every event type from what happened (Event::timeUs) to the handler.
+// The host runs every task as a thread, so on a machine with few cores a publisher is sometimes
+// taken off the cpu halfway a publish(): max publish() is that as well.
+// Build it with -fsanitize=thread as well: it must stay clean.
+//
+//   g++ -std=gnu++17 -O2 -pthread -I tools/host/include -I libraries/MAFAD_Workshop/src tools/host/events_sim.cpp -o events_sim
+//   ./events_sim
+
+#include <Arduino.h>
+
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// --- a minimal stand-in for the Edge Impulse *_inferencing.h header ---
+#define EI_CLASSIFIER_FREQUENCY 20000
+#define EI_CLASSIFIER_LABEL_COUNT 2
+#define EI_CLASSIFIER_SLICE_SIZE 4000
+#define EI_CLASSIFIER_SLICES_PER_MODEL_WINDOW 5
+
+typedef struct { const char* label; float value; } ei_impulse_result_classification_t;
+typedef struct { ei_impulse_result_classification_t classification[EI_CLASSIFIER_LABEL_COUNT]; } ei_impulse_result_t;
+typedef struct { std::function<int(size_t, size_t, float*)> get_data; size_t total_length; } signal_t;
+typedef enum { EI_IMPULSE_OK = 0, EI_IMPULSE_ERR = -1 } EI_IMPULSE_ERROR;
+namespace numpy {
+static inline int int16_to_float(const int16_t* in, float* out, size_t n) { for (size_t i = 0; i < n; i++) out[i] = in[i]; return 0; }
+}
+
+static void run_classifier_init() {}
+
+// "tone" when the slice is loud, 15 ms per slice
+static EI_IMPULSE_ERROR run_classifier_continuous(signal_t* signal, ei_impulse_result_t* result, bool)
+{
+    std::vector<float> x(signal->total_length);
+    signal->get_data(0, x.size(), x.data());
+    double energy = 0.0;
+    for (float v : x) energy += v * v;
+    bool loud = sqrt(energy / x.size()) > 1000.0;
+    result->classification[0] = { "tone", loud ? 0.95f : 0.05f };
+    result->classification[1] = { "noise", loud ? 0.05f : 0.95f };
+    delay(15);
+    return EI_IMPULSE_OK;
+}
+// --- end of the stand-in ---
+
+#include <ai-workshop-main.h>
+#include <ai-workshop-events.h>
+#include <ai-workshop-mic.h>
+#include <ai-workshop-sound.h>
+#include <ai-workshop-sdcard.h>
+#include <ai-workshop-inference.h>
+
+uint32_t randomness = 0;
+
+static bool ok = true;
+
+static void check(bool condition, const char* what)
+{
+    if (!condition) {
+        printf("FAIL: %s\n", what);
+        ok = false;
+    }
+}
+
+// --- 1. and 2.: User events from several tasks ---
+
+#define PRODUCERS 4
+
+// value: producer << 24 | number; added to by one subscriber, read by main()
+class OrderCheck {
+public:
+    void add(const Event& event)
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+        uint32_t producer = event.value >> 24, number = event.value & 0xFFFFFF;
+        if (producer >= PRODUCERS || number <= _last[producer]) _outOfOrder++;
+        else _last[producer] = number;
+        _received++;
+    }
+
+    void reset()
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+        for (uint32_t& last : _last) last = 0;
+        _received = _outOfOrder = 0;
+    }
+
+    uint32_t received() { std::lock_guard<std::mutex> guard(_mutex); return _received; }
+    uint32_t outOfOrder() { std::lock_guard<std::mutex> guard(_mutex); return _outOfOrder; }
+
+private:
+    std::mutex _mutex;
+    uint32_t _last[PRODUCERS] = { 0 };
+    uint32_t _received = 0;
+    uint32_t _outOfOrder = 0;
+};
+
+static OrderCheck fastOrder, slowOrder;
+static std::atomic<uint32_t> slowDelayMs{ 0 };
+
+static void onFast(const Event& event, void*) { fastOrder.add(event); }
+
+static void onSlow(const Event& event, void*)
+{
+    slowOrder.add(event);
+    if (slowDelayMs.load()) delay(slowDelayMs.load());
+}
+
+struct Producer {
+    uint32_t index;
+    uint32_t count;
+    uint32_t pauseUs;
+    std::atomic<bool> done{ false };
+    uint32_t maxPublishUs = 0;
+};
+
+static void produce(void* parameter)
+{
+    Producer& p = *static_cast<Producer*>(parameter);
+    for (uint32_t n = 1; n <= p.count; n++) {
+        Event event(EventType::User, EventSource::Sketch);
+        event.value = p.index << 24 | n;
+        int64_t start = esp_timer_get_time();
+        eventBus().publish(event);
+        uint32_t us = (uint32_t)(esp_timer_get_time() - start);
+        if (us > p.maxPublishUs) p.maxPublishUs = us;
+        if (p.pauseUs) delayMicroseconds(p.pauseUs);
+    }
+    p.done = true;
+    vTaskDelete(nullptr);
+}
+
+// runs the producers, drains the polled subscriber meanwhile; returns the max publish() time
+static uint32_t runProducers(int polled, uint32_t count, uint32_t pauseUs, OrderCheck& polledOrder)
+{
+    Producer producers[PRODUCERS];
+    for (uint32_t i = 0; i < PRODUCERS; i++) {
+        producers[i].index = i;
+        producers[i].count = count;
+        producers[i].pauseUs = pauseUs;
+        xTaskCreatePinnedToCore(produce, "producer", 4096, &producers[i], 3, nullptr, i % 2);
+    }
+    Event event;
+    while (true) {
+        bool done = true;
+        for (Producer& p : producers) done &= p.done.load();
+        while (eventBus().next(polled, event)) polledOrder.add(event);
+        if (done) break;
+        if (eventBus().wait(polled, event, 5)) polledOrder.add(event);
+    }
+    delay(50);
+    while (eventBus().next(polled, event)) polledOrder.add(event);
+    uint32_t maxUs = 0;
+    for (Producer& p : producers) maxUs = std::max(maxUs, p.maxPublishUs);
+    return maxUs;
+}
+
+// --- 3.: what the library publishes ---
+
+struct Seen {
+    std::atomic<uint32_t> count[EVENT_TYPES];
+    std::atomic<uint32_t> toneOnsets{ 0 }, toneOffsets{ 0 };
+    std::atomic<int> detected{ -1 };
+    std::atomic<uint32_t> badDetections{ 0 };
+    std::atomic<uint32_t> sliceSamples{ 0 };
+    std::atomic<uint32_t> toneHz{ 0 };
+    Seen() { for (auto& c : count) c = 0; }
+};
+static Seen seen;
+
+static void onLibrary(const Event& event, void*)
+{
+    seen.count[(uint8_t)event.type]++;
+    switch (event.type) {
+    case EventType::SliceReady:
+        if (event.source == EventSource::Mic) seen.sliceSamples = event.value;
+        break;
+    case EventType::DetectionOnset:
+        if (seen.detected.load() != -1 || event.score < 0.6f) seen.badDetections++;
+        if (strcmp(event.name, "tone") == 0) seen.toneOnsets++;
+        seen.detected = event.label;
+        break;
+    case EventType::DetectionOffset:
+        if (seen.detected.load() != event.label) seen.badDetections++;
+        if (strcmp(event.name, "tone") == 0) seen.toneOffsets++;
+        seen.detected = -1;
+        break;
+    case EventType::ToneStart:
+        seen.toneHz = event.value;
+        break;
+    default:
+        break;
+    }
+}
+
+// I2S_NUM_1 (the classifier): a loud 1 kHz tone from 1.0 to 2.2 s, quiet noise around it
+static void toneAudio(int32_t* out, size_t count, uint32_t channels, uint64_t frameIndex)
+{
+    for (size_t i = 0; i < count; i++) {
+        uint64_t frame = frameIndex + i;
+        bool loud = frame >= 20000 && frame < 44000;
+        float v = loud ? 8000.0f * sinf(2.0f * (float)M_PI * 1000.0f * frame / SAMPLE_RATE) : (float)((frame * 7919) % 200) - 100.0f;
+        for (uint32_t c = 0; c < channels; c++) out[i * channels + c] = (int32_t)v * 4096;
+    }
+}
+
+static void quietAudio(int32_t* out, size_t count, uint32_t channels, uint64_t)
+{
+    for (size_t i = 0; i < count * channels; i++) out[i] = 0;
+}
+
+int main()
+{
+    const uint32_t userMask = eventMask(EventType::User);
+    const uint32_t libraryMask = EVENTS_ALL & ~userMask;
+
+    // nobody listens yet: publish() is a load and a compare
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < 1000000; i++) eventBus().publish(Event(EventType::ToneStart, EventSource::Sound, 0));
+    float idleNs = (esp_timer_get_time() - start) * 1000.0f / 1000000;
+    check(eventBus().getPublished(EventType::ToneStart) == 0, "events counted without a subscriber");
+
+    SubscriberConfig fastConfig;
+    fastConfig.name = "fast";
+    SubscriberConfig slowConfig;
+    slowConfig.name = "slow";
+    slowConfig.core = 0;
+    SubscriberConfig libraryConfig;
+    libraryConfig.name = "library";
+    int fast = eventBus().subscribe(userMask, onFast, nullptr, fastConfig);
+    int slow = eventBus().subscribe(userMask, onSlow, nullptr, slowConfig);
+    int polled = eventBus().subscribe(userMask, "loop");
+    int library = eventBus().subscribe(libraryMask, onLibrary, nullptr, libraryConfig);
+    check(fast >= 0 && slow >= 0 && polled >= 0 && library >= 0, "subscribe");
+    check(eventBus().subscribe(userMask, "one too many") < 0, "more subscribers than EVENTS_MAX_SUBSCRIBERS");
+
+    // 1. flat out
+    const uint32_t burst = 20000;
+    static OrderCheck polledOrder;
+    uint32_t maxPublishUs = runProducers(polled, burst, 0, polledOrder);
+    delay(100);
+    uint32_t published = eventBus().getPublished(EventType::User);
+    printf("flat out: %u published, fast got %u (%u dropped), slow %u (%u), polled %u (%u), max publish() %u us\n",
+           (unsigned)published, (unsigned)fastOrder.received(), (unsigned)eventBus().getDropped(fast), (unsigned)slowOrder.received(),
+           (unsigned)eventBus().getDropped(slow), (unsigned)polledOrder.received(), (unsigned)eventBus().getDropped(polled),
+           (unsigned)maxPublishUs);
+    check(published == PRODUCERS * burst, "not every publish() counted");
+    check(fastOrder.received() + eventBus().getDropped(fast) == published, "fast: events lost without being counted");
+    check(slowOrder.received() + eventBus().getDropped(slow) == published, "slow: events lost without being counted");
+    check(polledOrder.received() + eventBus().getDropped(polled) == published, "polled: events lost without being counted");
+    check(fastOrder.outOfOrder() == 0 && slowOrder.outOfOrder() == 0 && polledOrder.outOfOrder() == 0,
+          "events of one publisher arrived out of order or twice");
+
+    // 2. paced, with a slow handler
+    eventBus().resetStats();
+    fastOrder.reset();
+    slowOrder.reset();
+    polledOrder.reset();
+    slowDelayMs = 2;
+    const uint32_t paced = 2000;
+    maxPublishUs = runProducers(polled, paced, 100, polledOrder);
+    delay(300);
+    published = eventBus().getPublished(EventType::User);
+    printf("paced: %u published, fast got %u (%u dropped), 2 ms handler %u (%u dropped), polled %u (%u), max publish() %u us\n",
+           (unsigned)published, (unsigned)fastOrder.received(), (unsigned)eventBus().getDropped(fast), (unsigned)slowOrder.received(),
+           (unsigned)eventBus().getDropped(slow), (unsigned)polledOrder.received(), (unsigned)eventBus().getDropped(polled),
+           (unsigned)maxPublishUs);
+    check(fastOrder.received() == published && eventBus().getDropped(fast) == 0, "the fast handler lost events");
+    check(polledOrder.received() + eventBus().getDropped(polled) == published, "polled: events lost without being counted");
+    check(eventBus().getDropped(slow) > 0 && slowOrder.received() + eventBus().getDropped(slow) == published,
+          "the slow handler should lose (only) its own events");
+    check(fastOrder.outOfOrder() == 0 && slowOrder.outOfOrder() == 0 && polledOrder.outOfOrder() == 0,
+          "events of one publisher arrived out of order or twice");
+    slowDelayMs = 0;
+    eventBus().unsubscribe(fast);
+    eventBus().unsubscribe(slow);
+    eventBus().unsubscribe(polled);
+    eventBus().resetStats();
+
+    // 3. the library
+    hostSdRoot() = "events_sd";
+    system("rm -rf events_sd");
+    hostI2sSetSource(I2S_NUM_0, quietAudio);
+    hostI2sSetSource(I2S_NUM_1, toneAudio);
+
+    i2sMic mic;
+    check(mic.setup(1, 7, 10), "mic setup");
+    check(mic.startStream(4000), "startStream");
+    AiWorkshopInference inference;
+    check(inference.begin(1, 2, 3), "inference begin");
+
+    startTone(11, 440);
+    delay(100);
+    stopTone(11);
+
+    ei_impulse_result_t result;
+    int64_t end = esp_timer_get_time() + 3500000;
+    while (esp_timer_get_time() < end) {
+        inference.tick(result);
+        if (mic.isStreamReady()) mic.consumeStream();
+    }
+    mic.stopStream();
+
+    SD.begin();
+    SDCard sdCard;
+    std::vector<int32_t> take(SAMPLE_RATE, 0);
+    sdCard.writeAudioFile(take.data(), 1000, "hello_there", "SIM", 7, 0);
+    sdCard.writeAudioFile(take.data(), 1000, "no_such_folder/hello_there", "SIM", 8, 0);
+    delay(100);
+
+    printf("library: %u slices of the mic and the classifier, %u onsets, %u offsets, %u tone starts (%u Hz), %u stops, %u takes saved, %u SD errors\n",
+           (unsigned)seen.count[(uint8_t)EventType::SliceReady].load(), (unsigned)seen.count[(uint8_t)EventType::DetectionOnset].load(),
+           (unsigned)seen.count[(uint8_t)EventType::DetectionOffset].load(), (unsigned)seen.count[(uint8_t)EventType::ToneStart].load(),
+           (unsigned)seen.toneHz.load(), (unsigned)seen.count[(uint8_t)EventType::ToneStop].load(),
+           (unsigned)seen.count[(uint8_t)EventType::TakeSaved].load(), (unsigned)seen.count[(uint8_t)EventType::SdError].load());
+    check(seen.count[(uint8_t)EventType::SliceReady] >= 25 && seen.sliceSamples == 4000, "slices missing");
+    check(seen.toneOnsets == 1 && seen.toneOffsets == 1 && seen.badDetections == 0,
+          "expected one onset of 'tone' and its offset, never two labels at once");
+    check(seen.count[(uint8_t)EventType::ToneStart] == 1 && seen.toneHz == 440 && seen.count[(uint8_t)EventType::ToneStop] == 1,
+          "tone start and stop");
+    check(seen.count[(uint8_t)EventType::TakeSaved] == 1 && seen.count[(uint8_t)EventType::SdError] == 1, "take saved and SD error");
+
+    EventLatency onset = eventBus().getLatency(library, EventType::DetectionOnset);
+    check(onset.maxUs < 200000, "an onset came later than a slice after its audio");
+    printf("publish() without subscribers: %.1f ns\n", idleNs);
+    eventBus().printStats();
+
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
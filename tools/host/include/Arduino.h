@@ -0,0 +1,288 @@
+// Host stand-in for the Arduino-ESP32 core (see tools/host/README.md).
+// Only what the MAFAD_Workshop headers use is provided. Time is real time,
+// Serial goes to stdout (or nowhere, see HostSerial::setOutput).
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/types.h>
+
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define ESP_ARDUINO_VERSION_MAJOR 3
+#define ARDUINO_ARCH_ESP32 1
+
+#define IRAM_ATTR
+#define ARDUINO_ISR_ATTR
+#define DRAM_ATTR
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define INPUT_PULLDOWN 0x09
+
+typedef uint8_t byte;
+
+static inline unsigned long millis() { return (unsigned long)(esp_timer_get_time() / 1000); }
+static inline unsigned long micros() { return (unsigned long)esp_timer_get_time(); }
+static inline void delay(uint32_t ms) { vTaskDelay(ms); }
+static inline void delayMicroseconds(uint32_t us)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+static inline void yield() { std::this_thread::yield(); }
+
+static inline void randomSeed(unsigned long) {}
+static inline long random(long howbig) { return howbig <= 0 ? 0 : (long)(esp_random() % (uint32_t)howbig); }
+static inline long random(long howsmall, long howbig)
+{
+    return howsmall >= howbig ? howsmall : howsmall + random(howbig - howsmall);
+}
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+// Pins: analogRead returns whatever the test put into hostAnalogValue(pin).
+static inline int& hostAnalogValue(uint8_t pin)
+{
+    static int values[64] = {0};
+    return values[pin & 63];
+}
+static inline void pinMode(uint8_t, uint8_t) {}
+static inline void digitalWrite(uint8_t, uint8_t) {}
+static inline int digitalRead(uint8_t) { return LOW; }
+static inline uint16_t analogRead(uint8_t pin) { return (uint16_t)hostAnalogValue(pin); }
+
+// ADC continuous mode: a thread calls the conversion callback at the frame rate,
+// every frame reports the current hostAnalogValue() of each pin.
+typedef struct {
+    uint8_t pin;
+    uint8_t channel;
+    int avg_read_raw;
+    int avg_read_mvolts;
+} adc_continuous_data_t;
+
+struct HostAdcContinuous {
+    uint8_t pins[8] = {0};
+    size_t count = 0;
+    uint32_t frameUs = 0;
+    void (*callback)(void) = nullptr;
+    std::atomic<bool> running{false};
+    adc_continuous_data_t result[8] = {};
+};
+static inline HostAdcContinuous& hostAdc()
+{
+    static HostAdcContinuous a;
+    return a;
+}
+static inline bool analogContinuous(const uint8_t pins[], size_t count, uint32_t conversionsPerPin,
+                                    uint32_t samplingFreqHz, void (*callback)(void))
+{
+    HostAdcContinuous& a = hostAdc();
+    if (count == 0 || count > 8 || samplingFreqHz < 611 || samplingFreqHz > 83333) return false;
+    for (size_t i = 0; i < count; i++) a.pins[i] = pins[i];
+    a.count = count;
+    a.frameUs = (uint32_t)(1000000ull * conversionsPerPin * count / samplingFreqHz);
+    a.callback = callback;
+    return true;
+}
+static inline bool analogContinuousStart()
+{
+    HostAdcContinuous& a = hostAdc();
+    if (a.count == 0 || a.running) return false;
+    a.running = true;
+    std::thread([&a]() {
+        while (a.running) {
+            std::this_thread::sleep_for(std::chrono::microseconds(a.frameUs));
+            if (a.running && a.callback) a.callback();
+        }
+    }).detach();
+    return true;
+}
+static inline bool analogContinuousStop()
+{
+    hostAdc().running = false;
+    return true;
+}
+static inline bool analogContinuousDeinit()
+{
+    hostAdc().count = 0;
+    return true;
+}
+static inline bool analogContinuousRead(adc_continuous_data_t** buffer, uint32_t)
+{
+    HostAdcContinuous& a = hostAdc();
+    for (size_t i = 0; i < a.count; i++) {
+        a.result[i].pin = a.pins[i];
+        a.result[i].avg_read_raw = hostAnalogValue(a.pins[i]);
+        a.result[i].avg_read_mvolts = hostAnalogValue(a.pins[i]) * 3100 / 4095;
+    }
+    *buffer = a.result;
+    return a.count > 0;
+}
+
+// CPU clock: only remembered (and counted) so tests can follow the power states.
+struct HostCpu {
+    std::atomic<uint32_t> mhz{240};
+    std::atomic<uint32_t> changes{0};
+};
+static inline HostCpu& hostCpu()
+{
+    static HostCpu c;
+    return c;
+}
+static inline bool setCpuFrequencyMhz(uint32_t mhz)
+{
+    if (hostCpu().mhz.exchange(mhz) != mhz) hostCpu().changes++;
+    return true;
+}
+static inline uint32_t getCpuFrequencyMhz() { return hostCpu().mhz; }
+
+// LEDC: remembers the last frequency / duty so tests can inspect the tone output.
+struct HostLedc {
+    uint32_t frequency = 0;
+    uint32_t duty = 0;
+};
+static inline HostLedc& hostLedc()
+{
+    static HostLedc l;
+    return l;
+}
+static inline bool ledcAttach(uint8_t, uint32_t freq, uint8_t)
+{
+    hostLedc().frequency = freq;
+    return true;
+}
+static inline bool ledcDetach(uint8_t) { return true; }
+static inline uint32_t ledcChangeFrequency(uint8_t, uint32_t freq, uint8_t)
+{
+    hostLedc().frequency = freq;
+    return freq;
+}
+static inline bool ledcWrite(uint8_t, uint32_t duty)
+{
+    hostLedc().duty = duty;
+    return true;
+}
+
+class String {
+public:
+    String() {}
+    String(const char* s) : _s(s ? s : "") {}
+    String(const std::string& s) : _s(s) {}
+    String(char c) : _s(1, c) {}
+    String(int v) : _s(std::to_string(v)) {}
+    String(unsigned int v) : _s(std::to_string(v)) {}
+    String(long v) : _s(std::to_string(v)) {}
+    String(unsigned long v) : _s(std::to_string(v)) {}
+    String(float v, unsigned int decimals = 2) : _s(fmt(v, decimals)) {}
+    String(double v, unsigned int decimals = 2) : _s(fmt(v, decimals)) {}
+
+    const char* c_str() const { return _s.c_str(); }
+    unsigned int length() const { return (unsigned int)_s.size(); }
+    String& operator+=(const String& o)
+    {
+        _s += o._s;
+        return *this;
+    }
+    friend String operator+(const String& a, const String& b) { return String(a._s + b._s); }
+    friend String operator+(const String& a, const char* b) { return String(a._s + b); }
+    friend String operator+(const char* a, const String& b) { return String(a + b._s); }
+    bool operator==(const String& o) const { return _s == o._s; }
+    bool operator!=(const String& o) const { return _s != o._s; }
+
+private:
+    static std::string fmt(double v, unsigned int decimals)
+    {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.*f", (int)decimals, v);
+        return buf;
+    }
+    std::string _s;
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* data, size_t len) = 0;
+    virtual int availableForWrite() { return 0; }
+};
+
+class HostSerial : public Print {
+public:
+    void begin(unsigned long) {}
+    explicit operator bool() const { return true; }
+
+    // nullptr discards output (benchmarks), default is stdout
+    void setOutput(FILE* f) { _out = f; _discard = (f == nullptr); }
+    size_t bytesWritten() const { return _bytes; }
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* data, size_t len) override
+    {
+        _bytes += len;
+        if (!_discard) fwrite(data, 1, len, _out ? _out : stdout);
+        return len;
+    }
+    size_t write(const char* data, size_t len) { return write((const uint8_t*)data, len); }
+    int availableForWrite() override { return 4096; }
+    int available() { return 0; }
+    int read() { return -1; }
+    float parseFloat() { return 0.0f; }
+    void flush()
+    {
+        if (!_discard) fflush(_out ? _out : stdout);
+    }
+
+    size_t print(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+    size_t print(const String& s) { return print(s.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int v) { return printf("%d", v); }
+    size_t print(unsigned int v) { return printf("%u", v); }
+    size_t print(long v) { return printf("%ld", v); }
+    size_t print(unsigned long v) { return printf("%lu", v); }
+    size_t print(long long v) { return printf("%lld", v); }
+    size_t print(unsigned long long v) { return printf("%llu", v); }
+    size_t print(double v, int digits = 2) { return printf("%.*f", digits, v); }
+
+    size_t println() { return print("\r\n"); }
+    template <typename T>
+    size_t println(const T& v)
+    {
+        size_t n = print(v);
+        return n + println();
+    }
+    size_t println(double v, int digits) { return print(v, digits) + println(); }
+
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)))
+    {
+        char buf[512];
+        va_list args;
+        va_start(args, format);
+        int n = vsnprintf(buf, sizeof(buf), format, args);
+        va_end(args);
+        if (n < 0) return 0;
+        return write((const uint8_t*)buf, std::min((size_t)n, sizeof(buf) - 1));
+    }
+
+private:
+    FILE* _out = nullptr;
+    bool _discard = false;
+    size_t _bytes = 0;
+};
+
+inline HostSerial Serial;
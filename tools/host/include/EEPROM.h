@@ -0,0 +1,32 @@
+// Host stand-in for the Arduino-ESP32 EEPROM emulation (RAM only).
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+class HostEEPROM {
+public:
+    bool begin(size_t) { return true; }
+    uint32_t readUInt(int address)
+    {
+        uint32_t v;
+        memcpy(&v, _data + address, sizeof(v));
+        return v;
+    }
+    size_t writeUInt(int address, uint32_t v)
+    {
+        memcpy(_data + address, &v, sizeof(v));
+        return sizeof(v);
+    }
+    bool commit()
+    {
+        commits++;
+        return true;
+    }
+    uint32_t commits = 0;
+
+private:
+    uint8_t _data[512] = {0xFF, 0xFF, 0xFF, 0xFF};
+};
+
+inline HostEEPROM EEPROM;
@@ -0,0 +1,111 @@
+// Host stand-in for the Arduino FS File, backed by a real file.
+#pragma once
+
+#include <Arduino.h>
+
+#include <cstdio>
+#include <dirent.h>
+#include <memory>
+#include <string>
+#include <sys/stat.h>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+class File : public Print {
+public:
+    File() {}
+    File(const std::string& hostPath, const std::string& name, const char* mode) : _path(hostPath), _name(name)
+    {
+        struct stat st;
+        if (stat(hostPath.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+            _dir = std::shared_ptr<DIR>(opendir(hostPath.c_str()), [](DIR* d) { if (d) closedir(d); });
+            _open = (bool)_dir;
+            return;
+        }
+        FILE* f = fopen(hostPath.c_str(), (mode[0] == 'w') ? "w+b" : (mode[0] == 'a') ? "a+b" : "rb");
+        if (f) {
+            _file = std::shared_ptr<FILE>(f, [](FILE* p) { fclose(p); });
+            _open = true;
+        }
+    }
+
+    explicit operator bool() const { return _open; }
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* data, size_t len) override
+    {
+        if (!_file) return 0;
+        return fwrite(data, 1, len, _file.get());
+    }
+    size_t print(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+    size_t print(const String& s) { return print(s.c_str()); }
+
+    int read()
+    {
+        if (!_file) return -1;
+        return fgetc(_file.get());
+    }
+    size_t read(uint8_t* buf, size_t len)
+    {
+        if (!_file) return 0;
+        return fread(buf, 1, len, _file.get());
+    }
+    bool seek(uint32_t pos) { return _file && fseek(_file.get(), pos, SEEK_SET) == 0; }
+    size_t position() const { return _file ? (size_t)ftell(_file.get()) : 0; }
+    int available()
+    {
+        if (!_file) return 0;
+        return (int)(size() - position());
+    }
+    size_t size() const
+    {
+        if (!_file) return 0;
+        fflush(_file.get());
+        struct stat st;
+        return stat(_path.c_str(), &st) == 0 ? (size_t)st.st_size : 0;
+    }
+    void flush()
+    {
+        if (_file) fflush(_file.get());
+    }
+    void close()
+    {
+        _file.reset();
+        _dir.reset();
+        _open = false;
+    }
+
+    const char* name() const
+    {
+        size_t slash = _name.find_last_of('/');
+        return slash == std::string::npos ? _name.c_str() : _name.c_str() + slash + 1;
+    }
+    const char* path() const { return _name.c_str(); }
+    bool isDirectory() const { return (bool)_dir; }
+
+    File openNextFile()
+    {
+        if (!_dir) return File();
+        while (struct dirent* e = readdir(_dir.get())) {
+            if (e->d_name[0] == '.') continue;
+            std::string name = _name == "/" ? "/" + std::string(e->d_name) : _name + "/" + e->d_name;
+            return File(_path + "/" + e->d_name, name, FILE_READ);
+        }
+        return File();
+    }
+
+private:
+    std::string _path;
+    std::string _name;
+    std::shared_ptr<FILE> _file;
+    std::shared_ptr<DIR> _dir;
+    bool _open = false;
+};
+
+} // namespace fs
+
+using fs::File;
@@ -0,0 +1,49 @@
+// Host stand-in for the Arduino-ESP32 LittleFS library. The flash partition is a
+// directory on the host, ./flash unless hostFlashRoot() is changed before begin().
+#pragma once
+
+#include "FS.h"
+
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static inline std::string& hostFlashRoot()
+{
+    static std::string root = "flash";
+    return root;
+}
+
+class HostLittleFS {
+public:
+    bool begin(bool = false, const char* = "/littlefs", uint8_t = 10, const char* = "spiffs")
+    {
+        ::mkdir(hostFlashRoot().c_str(), 0755);
+        return true;
+    }
+    void end() {}
+    bool format()
+    {
+        std::string command = "rm -rf '" + hostFlashRoot() + "'";
+        if (system(command.c_str()) != 0) return false;
+        return ::mkdir(hostFlashRoot().c_str(), 0755) == 0;
+    }
+
+    File open(const char* path, const char* mode = FILE_READ) { return File(host(path), path, mode); }
+    File open(const String& path, const char* mode = FILE_READ) { return open(path.c_str(), mode); }
+    bool exists(const char* path)
+    {
+        struct stat st;
+        return stat(host(path).c_str(), &st) == 0;
+    }
+    bool remove(const char* path) { return ::unlink(host(path).c_str()) == 0; }
+    bool mkdir(const char* path) { return ::mkdir(host(path).c_str(), 0755) == 0; }
+    bool rename(const char* from, const char* to) { return ::rename(host(from).c_str(), host(to).c_str()) == 0; }
+    size_t totalBytes() { return 1536 * 1024; }
+    size_t usedBytes() { return 0; }
+
+private:
+    static std::string host(const char* path) { return hostFlashRoot() + (path[0] == '/' ? "" : "/") + path; }
+};
+
+inline HostLittleFS LittleFS;
@@ -0,0 +1,52 @@
+// Host stand-in for the Arduino SD library. The "card" is a directory on
+// the host, ./sdcard unless hostSdRoot() is changed before SD.begin().
+#pragma once
+
+#include "FS.h"
+
+#include <cstdlib>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef enum { CARD_NONE, CARD_MMC, CARD_SD, CARD_SDHC, CARD_UNKNOWN } sdcard_type_t;
+
+static inline std::string& hostSdRoot()
+{
+    static std::string root = "sdcard";
+    return root;
+}
+
+class HostSD {
+public:
+    bool begin(uint8_t = 0)
+    {
+        ::mkdir(hostSdRoot().c_str(), 0755);
+        _mounted = true;
+        return true;
+    }
+    void end() { _mounted = false; }
+    sdcard_type_t cardType() { return _mounted ? CARD_SDHC : CARD_NONE; }
+
+    File open(const char* path, const char* mode = FILE_READ) { return File(host(path), path, mode); }
+    File open(const String& path, const char* mode = FILE_READ) { return open(path.c_str(), mode); }
+    bool exists(const char* path)
+    {
+        struct stat st;
+        return stat(host(path).c_str(), &st) == 0;
+    }
+    bool exists(const String& path) { return exists(path.c_str()); }
+    bool remove(const char* path) { return ::unlink(host(path).c_str()) == 0; }
+    bool remove(const String& path) { return remove(path.c_str()); }
+    bool mkdir(const char* path) { return ::mkdir(host(path).c_str(), 0755) == 0; }
+    bool mkdir(const String& path) { return mkdir(path.c_str()); }
+    bool rename(const char* from, const char* to) { return ::rename(host(from).c_str(), host(to).c_str()) == 0; }
+    unsigned long long usedBytes() { return 0; }
+    unsigned long long totalBytes() { return 32ull << 30; }
+
+private:
+    static std::string host(const char* path) { return hostSdRoot() + (path[0] == '/' ? "" : "/") + path; }
+    bool _mounted = false;
+};
+
+inline HostSD SD;
@@ -0,0 +1,2 @@
+// Host stand-in, the SD card stub does not use SPI.
+#pragma once
@@ -0,0 +1,259 @@
+// Host stand-in for the legacy ESP-IDF I2S driver.
+//
+// RX ports are fed by a scripted source (hostI2sSetSource) that produces
+// 32-bit left-justified samples the way the ICS-43434 / SPH0645 mics deliver
+// them. i2s_read paces itself to the configured sample rate, scaled by
+// hostI2sSetSpeed(), so the capture tasks see realistic block timing: data
+// comes in whole DMA buffers (dma_buf_len frames), and a reader that stays away
+// longer than dma_buf_count buffers last loses the oldest ones, like the driver
+// does (hostI2sPort(port).overflows / lostFrames).
+// TX data is handed to an optional sink (hostI2sSetSink); i2s_write blocks like a
+// DMA queue of dma_buf_count * dma_buf_len frames draining at the sample rate and
+// counts the times the queue ran dry (hostI2sPort(port).underruns).
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+typedef enum { I2S_NUM_0 = 0, I2S_NUM_1 = 1, I2S_NUM_MAX } i2s_port_t;
+
+typedef enum {
+    I2S_MODE_MASTER = 1 << 0,
+    I2S_MODE_SLAVE = 1 << 1,
+    I2S_MODE_TX = 1 << 2,
+    I2S_MODE_RX = 1 << 3,
+    I2S_MODE_PDM = 1 << 6,
+} i2s_mode_t;
+
+typedef enum {
+    I2S_BITS_PER_SAMPLE_8BIT = 8,
+    I2S_BITS_PER_SAMPLE_16BIT = 16,
+    I2S_BITS_PER_SAMPLE_24BIT = 24,
+    I2S_BITS_PER_SAMPLE_32BIT = 32,
+} i2s_bits_per_sample_t;
+
+typedef enum {
+    I2S_CHANNEL_FMT_RIGHT_LEFT,
+    I2S_CHANNEL_FMT_ALL_RIGHT,
+    I2S_CHANNEL_FMT_ALL_LEFT,
+    I2S_CHANNEL_FMT_ONLY_RIGHT,
+    I2S_CHANNEL_FMT_ONLY_LEFT,
+} i2s_channel_fmt_t;
+
+typedef enum {
+    I2S_COMM_FORMAT_STAND_I2S = 0x01,
+    I2S_COMM_FORMAT_STAND_MSB = 0x02,
+    I2S_COMM_FORMAT_I2S = 0x01,
+} i2s_comm_format_t;
+
+typedef enum { I2S_EVENT_DMA_ERROR, I2S_EVENT_TX_DONE, I2S_EVENT_RX_DONE, I2S_EVENT_TX_Q_OVF, I2S_EVENT_RX_Q_OVF } i2s_event_type_t;
+
+#define I2S_PIN_NO_CHANGE (-1)
+#define ESP_INTR_FLAG_LEVEL1 (1 << 1)
+
+typedef struct {
+    i2s_mode_t mode;
+    uint32_t sample_rate;
+    i2s_bits_per_sample_t bits_per_sample;
+    i2s_channel_fmt_t channel_format;
+    i2s_comm_format_t communication_format;
+    int intr_alloc_flags;
+    int dma_buf_count;
+    int dma_buf_len;
+    bool use_apll;
+    bool tx_desc_auto_clear;
+    int fixed_mclk;
+} i2s_config_t;
+
+typedef struct {
+    int bck_io_num;
+    int ws_io_num;
+    int data_out_num;
+    int data_in_num;
+} i2s_pin_config_t;
+
+// Source: fill `count` frames starting at absolute frame `frameIndex`.
+// `channels` is 2 for I2S_CHANNEL_FMT_RIGHT_LEFT (interleaved L,R), else 1.
+typedef std::function<void(int32_t* out, size_t count, uint32_t channels, uint64_t frameIndex)> HostI2sSource;
+typedef std::function<void(const void* data, size_t bytes)> HostI2sSink;
+
+struct HostI2sPort {
+    std::mutex m;
+    bool installed = false;
+    i2s_config_t cfg = {};
+    HostI2sSource source;
+    HostI2sSink sink;
+    uint64_t frames = 0;
+    std::chrono::steady_clock::time_point t0;
+    std::atomic<uint32_t> reads{0};
+    std::atomic<uint32_t> overflows{0};   // RX: the reader was too late, DMA buffers were dropped
+    std::atomic<uint64_t> lostFrames{0};
+    std::atomic<uint32_t> underruns{0};   // TX: the DMA queue was empty before a write
+    std::atomic<int64_t> writePlayUs{0};  // TX: esp_timer time the last write starts to play
+};
+
+static inline HostI2sPort& hostI2sPort(i2s_port_t port)
+{
+    static HostI2sPort ports[I2S_NUM_MAX];
+    return ports[port];
+}
+
+static inline double& hostI2sSpeed()
+{
+    static double speed = 1.0;
+    return speed;
+}
+
+static inline void hostI2sSetSpeed(double factor) { hostI2sSpeed() = factor > 0 ? factor : 1.0; }
+
+static inline void hostI2sSetSource(i2s_port_t port, HostI2sSource source)
+{
+    HostI2sPort& p = hostI2sPort(port);
+    std::lock_guard<std::mutex> lock(p.m);
+    p.source = source;
+}
+
+static inline void hostI2sSetSink(i2s_port_t port, HostI2sSink sink)
+{
+    HostI2sPort& p = hostI2sPort(port);
+    std::lock_guard<std::mutex> lock(p.m);
+    p.sink = sink;
+}
+
+static inline esp_err_t i2s_driver_install(i2s_port_t port, const i2s_config_t* cfg, int, void*)
+{
+    HostI2sPort& p = hostI2sPort(port);
+    std::lock_guard<std::mutex> lock(p.m);
+    if (p.installed) return ESP_ERR_INVALID_STATE;
+    p.installed = true;
+    p.cfg = *cfg;
+    p.frames = 0;
+    p.t0 = std::chrono::steady_clock::now();
+    return ESP_OK;
+}
+
+static inline esp_err_t i2s_driver_uninstall(i2s_port_t port)
+{
+    HostI2sPort& p = hostI2sPort(port);
+    std::lock_guard<std::mutex> lock(p.m);
+    if (!p.installed) return ESP_ERR_INVALID_STATE;
+    p.installed = false;
+    return ESP_OK;
+}
+
+static inline esp_err_t i2s_set_pin(i2s_port_t, const i2s_pin_config_t*) { return ESP_OK; }
+
+// Restart the clock: the next read returns "fresh" audio.
+static inline esp_err_t i2s_zero_dma_buffer(i2s_port_t port)
+{
+    HostI2sPort& p = hostI2sPort(port);
+    std::lock_guard<std::mutex> lock(p.m);
+    if (!p.installed) return ESP_ERR_INVALID_STATE;
+    double seconds = (double)p.frames / (p.cfg.sample_rate * hostI2sSpeed());
+    p.t0 = std::chrono::steady_clock::now() -
+           std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+    return ESP_OK;
+}
+
+static inline esp_err_t i2s_read(i2s_port_t port, void* dest, size_t size, size_t* bytesRead, TickType_t ticks)
+{
+    using namespace std::chrono;
+    HostI2sPort& p = hostI2sPort(port);
+    *bytesRead = 0;
+
+    uint32_t channels = 1;
+    uint32_t rate = 0;
+    uint64_t firstFrame = 0;
+    steady_clock::time_point due;
+    {
+        std::lock_guard<std::mutex> lock(p.m);
+        if (!p.installed) return ESP_ERR_INVALID_STATE;
+        channels = (p.cfg.channel_format == I2S_CHANNEL_FMT_RIGHT_LEFT) ? 2 : 1;
+        rate = p.cfg.sample_rate;
+        uint64_t len = p.cfg.dma_buf_len > 0 ? p.cfg.dma_buf_len : 1;
+        uint64_t capacity = (uint64_t)(p.cfg.dma_buf_count > 0 ? p.cfg.dma_buf_count : 1) * len;
+
+        // the DMA buffers are full: the driver dropped the oldest ones
+        double now = duration<double>(steady_clock::now() - p.t0).count() * rate * hostI2sSpeed();
+        uint64_t complete = now > 0 ? (uint64_t)now / len * len : 0;
+        if (complete > p.frames + capacity) {
+            uint64_t lost = (complete - capacity - p.frames + len - 1) / len * len;
+            p.frames += lost;
+            p.overflows++;
+            p.lostFrames += lost;
+        }
+
+        firstFrame = p.frames;
+        size_t frames = size / (sizeof(int32_t) * channels);
+        // data comes in whole DMA buffers
+        uint64_t last = (p.frames + frames + len - 1) / len * len;
+        double seconds = (double)last / (rate * hostI2sSpeed());
+        due = p.t0 + duration_cast<steady_clock::duration>(duration<double>(seconds));
+    }
+
+    size_t frames = size / (sizeof(int32_t) * channels);
+    steady_clock::time_point now = steady_clock::now();
+    if (due > now) {
+        if (ticks != portMAX_DELAY && due - now > milliseconds(ticks)) {
+            std::this_thread::sleep_for(milliseconds(ticks));
+            return ESP_ERR_TIMEOUT;
+        }
+        std::this_thread::sleep_until(due);
+    }
+
+    std::lock_guard<std::mutex> lock(p.m);
+    if (!p.installed) return ESP_ERR_INVALID_STATE;
+    if (p.source) {
+        p.source((int32_t*)dest, frames, channels, firstFrame);
+    } else {
+        memset(dest, 0, frames * channels * sizeof(int32_t));
+    }
+    p.frames = firstFrame + frames;
+    p.reads++;
+    *bytesRead = frames * channels * sizeof(int32_t);
+    return ESP_OK;
+}
+
+static inline esp_err_t i2s_write(i2s_port_t port, const void* src, size_t size, size_t* bytesWritten, TickType_t)
+{
+    using namespace std::chrono;
+    HostI2sPort& p = hostI2sPort(port);
+    HostI2sSink sink;
+    size_t frames;
+    steady_clock::time_point due, start;
+    {
+        std::lock_guard<std::mutex> lock(p.m);
+        if (!p.installed) return ESP_ERR_INVALID_STATE;
+        sink = p.sink;
+        uint32_t channels = (p.cfg.channel_format == I2S_CHANNEL_FMT_RIGHT_LEFT) ? 2 : 1;
+        frames = size / (p.cfg.bits_per_sample / 8 * channels);
+        double rate = p.cfg.sample_rate * hostI2sSpeed();
+        uint64_t queue = (uint64_t)p.cfg.dma_buf_count * p.cfg.dma_buf_len;
+        auto at = [&](double frame) { return p.t0 + duration_cast<steady_clock::duration>(duration<double>(frame / rate)); };
+
+        // the queue ran dry: the DMA sent silence until now (tx_desc_auto_clear)
+        steady_clock::time_point now = steady_clock::now();
+        if (now > at((double)p.frames)) {
+            if (p.frames > 0) p.underruns++;
+            p.t0 = now - duration_cast<steady_clock::duration>(duration<double>(p.frames / rate));
+        }
+        start = at((double)p.frames);
+        // returns when the last frame fits in the queue
+        due = at((double)p.frames + frames - queue);
+        p.frames += frames;
+    }
+    std::this_thread::sleep_until(due);
+    p.writePlayUs = esp_timer_get_time() + duration_cast<microseconds>(start - steady_clock::now()).count();
+    if (sink) sink(src, size);
+    *bytesWritten = size;
+    return ESP_OK;
+}
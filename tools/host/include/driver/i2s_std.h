@@ -0,0 +1,221 @@
+// Host stand-in for the channel based ESP-IDF 5 I2S driver (std mode, RX with callbacks).
+//
+// Only what a receive channel with an on_recv callback needs. The port state, the scripted
+// source and hostI2sSetSpeed() are the ones of the legacy stand-in (driver/i2s.h), so a
+// program sets the source the same way for either driver. A thread stands for the I2S
+// interrupt: it fills the DMA buffers of dma_frame_num frames in a ring of dma_desc_num at
+// the sample rate and calls on_recv for every one. A callback that takes longer than the
+// ring lasts makes the DMA overwrite buffers, counted in hostI2sPort(port).overflows /
+// lostFrames like the legacy driver does; on_recv calls are counted in reads.
+//
+// As in ESP-IDF 5.1 (Arduino-ESP32 3.0), event->data points at the pointer of the DMA
+// buffer, not at the buffer.
+#pragma once
+
+#include "driver/i2s.h"
+
+#include <cstring>
+#include <vector>
+
+typedef enum { GPIO_NUM_NC = -1 } gpio_num_t;
+#define I2S_GPIO_UNUSED GPIO_NUM_NC
+
+typedef enum { I2S_ROLE_MASTER, I2S_ROLE_SLAVE } i2s_role_t;
+typedef enum { I2S_DATA_BIT_WIDTH_8BIT = 8, I2S_DATA_BIT_WIDTH_16BIT = 16, I2S_DATA_BIT_WIDTH_24BIT = 24, I2S_DATA_BIT_WIDTH_32BIT = 32 } i2s_data_bit_width_t;
+typedef enum { I2S_SLOT_BIT_WIDTH_AUTO = 0, I2S_SLOT_BIT_WIDTH_32BIT = 32 } i2s_slot_bit_width_t;
+typedef enum { I2S_SLOT_MODE_MONO = 1, I2S_SLOT_MODE_STEREO = 2 } i2s_slot_mode_t;
+typedef enum { I2S_STD_SLOT_LEFT = 1, I2S_STD_SLOT_RIGHT = 2, I2S_STD_SLOT_BOTH = 3 } i2s_std_slot_mask_t;
+typedef enum { I2S_CLK_SRC_DEFAULT = 0 } i2s_clock_src_t;
+typedef enum { I2S_MCLK_MULTIPLE_256 = 256 } i2s_mclk_multiple_t;
+
+typedef struct HostI2sChannel* i2s_chan_handle_t;
+
+typedef struct {
+    i2s_port_t id;
+    i2s_role_t role;
+    uint32_t dma_desc_num;
+    uint32_t dma_frame_num;
+    bool auto_clear;
+    int intr_priority;
+} i2s_chan_config_t;
+
+#define I2S_CHANNEL_DEFAULT_CONFIG(i2s_num, i2s_role) \
+    { .id = i2s_num, .role = i2s_role, .dma_desc_num = 6, .dma_frame_num = 240, .auto_clear = false, .intr_priority = 0 }
+
+typedef struct {
+    uint32_t sample_rate_hz;
+    i2s_clock_src_t clk_src;
+    i2s_mclk_multiple_t mclk_multiple;
+} i2s_std_clk_config_t;
+
+#define I2S_STD_CLK_DEFAULT_CONFIG(rate) \
+    { .sample_rate_hz = rate, .clk_src = I2S_CLK_SRC_DEFAULT, .mclk_multiple = I2S_MCLK_MULTIPLE_256 }
+
+typedef struct {
+    i2s_data_bit_width_t data_bit_width;
+    i2s_slot_bit_width_t slot_bit_width;
+    i2s_slot_mode_t slot_mode;
+    i2s_std_slot_mask_t slot_mask;
+    uint32_t ws_width;
+    bool ws_pol;
+    bool bit_shift;
+} i2s_std_slot_config_t;
+
+#define I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(bits_per_sample, mono_or_stereo)                                  \
+    { .data_bit_width = bits_per_sample, .slot_bit_width = I2S_SLOT_BIT_WIDTH_AUTO, .slot_mode = mono_or_stereo, \
+      .slot_mask = I2S_STD_SLOT_BOTH, .ws_width = bits_per_sample, .ws_pol = false, .bit_shift = true }
+
+typedef struct {
+    gpio_num_t mclk;
+    gpio_num_t bclk;
+    gpio_num_t ws;
+    gpio_num_t dout;
+    gpio_num_t din;
+    struct {
+        uint32_t mclk_inv : 1;
+        uint32_t bclk_inv : 1;
+        uint32_t ws_inv : 1;
+    } invert_flags;
+} i2s_std_gpio_config_t;
+
+typedef struct {
+    i2s_std_clk_config_t clk_cfg;
+    i2s_std_slot_config_t slot_cfg;
+    i2s_std_gpio_config_t gpio_cfg;
+} i2s_std_config_t;
+
+typedef struct {
+    void* data;   // pointer to the pointer of the DMA buffer (ESP-IDF 5.1)
+    size_t size;
+} i2s_event_data_t;
+
+typedef bool (*i2s_isr_callback_t)(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user_ctx);
+
+typedef struct {
+    i2s_isr_callback_t on_recv;
+    i2s_isr_callback_t on_recv_q_ovf;
+    i2s_isr_callback_t on_sent;
+    i2s_isr_callback_t on_send_q_ovf;
+} i2s_event_callbacks_t;
+
+struct HostI2sChannel {
+    i2s_chan_config_t cfg = {};
+    i2s_std_config_t std = {};
+    i2s_event_callbacks_t callbacks = {};
+    void* user = nullptr;
+    std::vector<int32_t> dma;   // dma_desc_num buffers of dma_frame_num frames
+    std::atomic<bool> enabled{ false };
+    std::thread interrupt;
+};
+
+static inline esp_err_t i2s_new_channel(const i2s_chan_config_t* cfg, i2s_chan_handle_t* tx, i2s_chan_handle_t* rx)
+{
+    if (tx || !rx) return ESP_ERR_NOT_SUPPORTED;   // receive only
+    HostI2sPort& p = hostI2sPort(cfg->id);
+    std::lock_guard<std::mutex> lock(p.m);
+    if (p.installed) return ESP_ERR_NOT_FOUND;
+    p.installed = true;
+    p.frames = 0;
+    *rx = new HostI2sChannel();
+    (*rx)->cfg = *cfg;
+    return ESP_OK;
+}
+
+static inline esp_err_t i2s_channel_init_std_mode(i2s_chan_handle_t handle, const i2s_std_config_t* cfg)
+{
+    if (!handle || handle->enabled) return ESP_ERR_INVALID_STATE;
+    handle->std = *cfg;
+    uint32_t channels = cfg->slot_cfg.slot_mode == I2S_SLOT_MODE_STEREO ? 2 : 1;
+    handle->dma.assign((size_t)handle->cfg.dma_desc_num * handle->cfg.dma_frame_num * channels, 0);
+    HostI2sPort& p = hostI2sPort(handle->cfg.id);
+    std::lock_guard<std::mutex> lock(p.m);
+    p.cfg.sample_rate = cfg->clk_cfg.sample_rate_hz;
+    p.cfg.channel_format = channels == 2 ? I2S_CHANNEL_FMT_RIGHT_LEFT : I2S_CHANNEL_FMT_ONLY_LEFT;
+    p.cfg.dma_buf_count = handle->cfg.dma_desc_num;
+    p.cfg.dma_buf_len = handle->cfg.dma_frame_num;
+    return ESP_OK;
+}
+
+static inline esp_err_t i2s_channel_register_event_callback(i2s_chan_handle_t handle, const i2s_event_callbacks_t* callbacks, void* user)
+{
+    if (!handle || handle->enabled) return ESP_ERR_INVALID_STATE;
+    handle->callbacks = *callbacks;
+    handle->user = user;
+    return ESP_OK;
+}
+
+// The "interrupt": buffer k is complete when its last frame is in
+static inline void hostI2sChannelRun(i2s_chan_handle_t handle)
+{
+    using namespace std::chrono;
+    HostI2sPort& p = hostI2sPort(handle->cfg.id);
+    const uint32_t len = handle->cfg.dma_frame_num;
+    const uint32_t count = handle->cfg.dma_desc_num;
+    const uint32_t channels = handle->std.slot_cfg.slot_mode == I2S_SLOT_MODE_STEREO ? 2 : 1;
+    const double rate = handle->std.clk_cfg.sample_rate_hz * hostI2sSpeed();
+    const steady_clock::time_point t0 = steady_clock::now();
+    auto at = [&](uint64_t frame) { return t0 + duration_cast<steady_clock::duration>(duration<double>(frame / rate)); };
+
+    uint64_t buffer = 0;
+    while (handle->enabled.load()) {
+        std::this_thread::sleep_until(at((buffer + 1) * len));
+        if (!handle->enabled.load()) break;
+
+        // the callbacks were late: the DMA went round the ring and overwrote buffers
+        uint64_t complete = (uint64_t)(duration<double>(steady_clock::now() - t0).count() * rate) / len;
+        if (complete > buffer + count) {
+            uint64_t lost = complete - count - buffer;
+            buffer += lost;
+            p.overflows++;
+            p.lostFrames += lost * len;
+        }
+
+        int32_t* dma = &handle->dma[(buffer % count) * len * channels];
+        HostI2sSource source;
+        {
+            std::lock_guard<std::mutex> lock(p.m);
+            source = p.source;
+        }
+        if (source) {
+            source(dma, len, channels, buffer * len);
+        } else {
+            memset(dma, 0, (size_t)len * channels * sizeof(int32_t));
+        }
+        p.frames = (buffer + 1) * len;
+        p.reads++;
+        buffer++;
+
+        if (handle->callbacks.on_recv) {
+            i2s_event_data_t event = { &dma, (size_t)len * channels * sizeof(int32_t) };
+            handle->callbacks.on_recv(handle, &event, handle->user);
+        }
+    }
+}
+
+static inline esp_err_t i2s_channel_enable(i2s_chan_handle_t handle)
+{
+    if (!handle || handle->enabled || handle->dma.empty()) return ESP_ERR_INVALID_STATE;
+    handle->enabled = true;
+    handle->interrupt = std::thread(hostI2sChannelRun, handle);
+    return ESP_OK;
+}
+
+static inline esp_err_t i2s_channel_disable(i2s_chan_handle_t handle)
+{
+    if (!handle || !handle->enabled) return ESP_ERR_INVALID_STATE;
+    handle->enabled = false;
+    handle->interrupt.join();
+    return ESP_OK;
+}
+
+static inline esp_err_t i2s_del_channel(i2s_chan_handle_t handle)
+{
+    if (!handle || handle->enabled) return ESP_ERR_INVALID_STATE;
+    HostI2sPort& p = hostI2sPort(handle->cfg.id);
+    {
+        std::lock_guard<std::mutex> lock(p.m);
+        p.installed = false;
+    }
+    delete handle;
+    return ESP_OK;
+}
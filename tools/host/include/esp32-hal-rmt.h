@@ -0,0 +1,63 @@
+// Host stand-in for the Arduino-ESP32 v3 RMT API. Written symbols are kept
+// so tests can check the encoding; a write "takes" the real WS2812 time.
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+typedef union {
+    struct {
+        uint32_t duration0 : 15;
+        uint32_t level0 : 1;
+        uint32_t duration1 : 15;
+        uint32_t level1 : 1;
+    };
+    uint32_t val;
+} rmt_data_t;
+
+typedef enum { RMT_RX_MODE = 0, RMT_TX_MODE = 1 } rmt_ch_dir_t;
+typedef enum { RMT_MEM_NUM_BLOCKS_1 = 1, RMT_MEM_NUM_BLOCKS_2 = 2 } rmt_reserve_memsize_t;
+
+#define RMT_WAIT_FOR_EVER ((uint32_t)0xFFFFFFFFu)
+#define RMT_SYMBOLS_OF(x) (sizeof(x) / sizeof(rmt_data_t))
+
+struct HostRmt {
+    std::vector<rmt_data_t> last;
+    uint32_t writes = 0;
+    bool realTime = true;   // sleep for the time the symbols take on the wire
+    std::chrono::steady_clock::time_point busyUntil;
+};
+static inline HostRmt& hostRmt()
+{
+    static HostRmt r;
+    return r;
+}
+
+static inline bool rmtInit(int, rmt_ch_dir_t, rmt_reserve_memsize_t, uint32_t) { return true; }
+
+static inline bool rmtWriteAsync(int, rmt_data_t* data, size_t symbols)
+{
+    HostRmt& r = hostRmt();
+    r.last.assign(data, data + symbols);
+    r.writes++;
+    // 100 ns ticks: every symbol is duration0 + duration1 ticks
+    uint64_t ticks = 0;
+    for (size_t i = 0; i < symbols; i++) ticks += data[i].duration0 + data[i].duration1;
+    r.busyUntil = std::chrono::steady_clock::now() + std::chrono::nanoseconds(ticks * 100);
+    return true;
+}
+
+static inline bool rmtTransmitCompleted(int)
+{
+    return std::chrono::steady_clock::now() >= hostRmt().busyUntil;
+}
+
+static inline bool rmtWrite(int pin, rmt_data_t* data, size_t symbols, uint32_t)
+{
+    rmtWriteAsync(pin, data, symbols);
+    if (hostRmt().realTime) std::this_thread::sleep_until(hostRmt().busyUntil);
+    return true;
+}
@@ -0,0 +1,15 @@
+// Host stand-in: a 32 bit cycle counter that runs at getCpuFrequencyMhz().
+#pragma once
+
+#include <Arduino.h>
+
+#include <chrono>
+#include <cstdint>
+
+static inline uint32_t esp_cpu_get_cycle_count()
+{
+    using namespace std::chrono;
+    static const steady_clock::time_point t0 = steady_clock::now();
+    uint64_t ns = (uint64_t)duration_cast<nanoseconds>(steady_clock::now() - t0).count();
+    return (uint32_t)(ns * getCpuFrequencyMhz() / 1000);
+}
@@ -0,0 +1,77 @@
+// Host stand-in for ESP-IDF power management: the CPU runs at max_freq_mhz
+// while any ESP_PM_CPU_FREQ_MAX lock is held, otherwise at min_freq_mhz.
+#pragma once
+
+#include <Arduino.h>
+
+typedef struct {
+    int max_freq_mhz;
+    int min_freq_mhz;
+    bool light_sleep_enable;
+} esp_pm_config_t;
+
+typedef enum { ESP_PM_CPU_FREQ_MAX, ESP_PM_APB_FREQ_MAX, ESP_PM_NO_LIGHT_SLEEP } esp_pm_lock_type_t;
+
+struct HostPmLock {
+    esp_pm_lock_type_t type;
+    int count = 0;
+};
+typedef HostPmLock* esp_pm_lock_handle_t;
+
+struct HostPm {
+    std::mutex m;
+    esp_pm_config_t config = {240, 240, false};
+    int cpuLocks = 0;
+};
+static inline HostPm& hostPm()
+{
+    static HostPm pm;
+    return pm;
+}
+
+static inline void hostPmApply(HostPm& pm)
+{
+    setCpuFrequencyMhz(pm.cpuLocks > 0 ? pm.config.max_freq_mhz : pm.config.min_freq_mhz);
+}
+
+static inline esp_err_t esp_pm_configure(const void* config)
+{
+    HostPm& pm = hostPm();
+    std::lock_guard<std::mutex> lock(pm.m);
+    pm.config = *(const esp_pm_config_t*)config;
+    hostPmApply(pm);
+    return ESP_OK;
+}
+
+static inline esp_err_t esp_pm_lock_create(esp_pm_lock_type_t type, int, const char*, esp_pm_lock_handle_t* out)
+{
+    *out = new HostPmLock{type};
+    return ESP_OK;
+}
+
+static inline esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t l)
+{
+    HostPm& pm = hostPm();
+    std::lock_guard<std::mutex> lock(pm.m);
+    if (l->count++ == 0 && l->type == ESP_PM_CPU_FREQ_MAX) pm.cpuLocks++;
+    hostPmApply(pm);
+    return ESP_OK;
+}
+
+static inline esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t l)
+{
+    HostPm& pm = hostPm();
+    std::lock_guard<std::mutex> lock(pm.m);
+    if (l->count == 0) return ESP_ERR_INVALID_STATE;
+    if (--l->count == 0 && l->type == ESP_PM_CPU_FREQ_MAX) pm.cpuLocks--;
+    hostPmApply(pm);
+    return ESP_OK;
+}
+
+static inline esp_err_t esp_pm_lock_delete(esp_pm_lock_handle_t l)
+{
+    if (l == nullptr) return ESP_ERR_INVALID_ARG;
+    if (l->count != 0) return ESP_ERR_INVALID_STATE;   // still held, as in ESP-IDF
+    delete l;
+    return ESP_OK;
+}
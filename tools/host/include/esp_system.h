@@ -0,0 +1,16 @@
+// Host stand-in for esp_system.h.
+#pragma once
+
+#include <cstdint>
+#include <random>
+
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+
+static inline uint32_t esp_random()
+{
+    static std::mt19937 rng(0x4D414641u);
+    return (uint32_t)rng();
+}
+
+static inline uint32_t esp_get_free_heap_size() { return (uint32_t)heap_caps_get_free_size(MALLOC_CAP_DEFAULT); }
@@ -0,0 +1,15 @@
+// Host stand-in: microseconds since program start.
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+static inline int64_t esp_timer_get_time()
+{
+    using namespace std::chrono;
+    static const steady_clock::time_point t0 = steady_clock::now();
+    return duration_cast<microseconds>(steady_clock::now() - t0).count();
+}
+
+// start the clock when the program starts, not at the first call
+static const int64_t hostTimerStart = esp_timer_get_time();
@@ -0,0 +1,39 @@
+// Host stand-in for FreeRTOS (see tools/host/README.md).
+// Tasks are std::threads, critical sections are a recursive mutex.
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdPASS 1
+#define pdFAIL 0
+#define pdTRUE 1
+#define pdFALSE 0
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFFu)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define configTICK_RATE_HZ 1000
+#define portYIELD_FROM_ISR(...) ((void)0)
+#define configASSERT(x) ((void)(x))
+#define portNUM_PROCESSORS 2
+
+struct portMUX_TYPE {
+    std::recursive_mutex m;
+};
+#define portMUX_INITIALIZER_UNLOCKED {}
+
+#define portENTER_CRITICAL(mux) ((mux)->m.lock())
+#define portEXIT_CRITICAL(mux) ((mux)->m.unlock())
+#define portENTER_CRITICAL_ISR(mux) ((mux)->m.lock())
+#define portEXIT_CRITICAL_ISR(mux) ((mux)->m.unlock())
+#define portENTER_CRITICAL_SAFE(mux) ((mux)->m.lock())
+#define portEXIT_CRITICAL_SAFE(mux) ((mux)->m.unlock())
+#define taskENTER_CRITICAL(mux) portENTER_CRITICAL(mux)
+#define taskEXIT_CRITICAL(mux) portEXIT_CRITICAL(mux)
+
+static inline BaseType_t xPortGetCoreID() { return 0; }
+static inline bool xPortInIsrContext() { return false; }
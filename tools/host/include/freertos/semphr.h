@@ -0,0 +1,64 @@
+// Host stand-in for FreeRTOS semaphores (binary, counting and mutex share one type).
+#pragma once
+
+#include "FreeRTOS.h"
+
+#include <chrono>
+#include <condition_variable>
+
+struct HostSemaphore {
+    std::mutex m;
+    std::condition_variable cv;
+    uint32_t count = 0;
+    uint32_t max = 1;
+};
+typedef HostSemaphore* SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t xSemaphoreCreateBinary() { return new HostSemaphore(); }
+
+static inline SemaphoreHandle_t xSemaphoreCreateCounting(uint32_t max, uint32_t initial)
+{
+    HostSemaphore* s = new HostSemaphore();
+    s->max = max;
+    s->count = initial;
+    return s;
+}
+
+static inline SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    HostSemaphore* s = new HostSemaphore();
+    s->count = 1;
+    return s;
+}
+
+static inline void vSemaphoreDelete(SemaphoreHandle_t s) { delete s; }
+
+static inline BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t ticks)
+{
+    std::unique_lock<std::mutex> lock(s->m);
+    auto ready = [s] { return s->count > 0; };
+    if (ticks == portMAX_DELAY) {
+        s->cv.wait(lock, ready);
+    } else if (!s->cv.wait_for(lock, std::chrono::milliseconds(ticks), ready)) {
+        return pdFALSE;
+    }
+    s->count--;
+    return pdTRUE;
+}
+
+static inline BaseType_t xSemaphoreGive(SemaphoreHandle_t s)
+{
+    {
+        std::lock_guard<std::mutex> lock(s->m);
+        if (s->count >= s->max) return pdFALSE;
+        s->count++;
+    }
+    s->cv.notify_one();
+    return pdTRUE;
+}
+
+static inline BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t s, BaseType_t* woken)
+{
+    if (woken) *woken = pdFALSE;
+    return xSemaphoreGive(s);
+}
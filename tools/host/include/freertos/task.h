@@ -0,0 +1,107 @@
+// Host stand-in for FreeRTOS tasks: every task is a detached std::thread.
+// vTaskDelete(nullptr) unwinds the calling thread; deleting another task is
+// not supported (the library never does it).
+#pragma once
+
+#include "FreeRTOS.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <string>
+#include <thread>
+
+struct HostTask {
+    std::string name;
+    std::mutex m;
+    std::condition_variable cv;
+    uint32_t notifyCount = 0;
+};
+typedef HostTask* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+struct HostTaskExit {};
+
+static inline HostTask*& hostCurrentTask()
+{
+    static thread_local HostTask* t = nullptr;
+    return t;
+}
+
+static inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t /*stack*/,
+                                                 void* arg, UBaseType_t /*prio*/, TaskHandle_t* handle,
+                                                 BaseType_t /*core*/)
+{
+    HostTask* t = new HostTask();
+    t->name = name ? name : "";
+    if (handle) *handle = t;
+    std::thread([fn, arg, t]() {
+        hostCurrentTask() = t;
+        try {
+            fn(arg);
+        } catch (const HostTaskExit&) {
+        }
+        // handles are never reused by the library, the HostTask is leaked on purpose
+    }).detach();
+    return pdPASS;
+}
+
+static inline BaseType_t xTaskCreate(TaskFunction_t fn, const char* name, uint32_t stack, void* arg,
+                                     UBaseType_t prio, TaskHandle_t* handle)
+{
+    return xTaskCreatePinnedToCore(fn, name, stack, arg, prio, handle, 0);
+}
+
+static inline void vTaskDelete(TaskHandle_t t)
+{
+    if (t == nullptr || t == hostCurrentTask()) throw HostTaskExit();
+}
+
+static inline void vTaskDelay(TickType_t ticks)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+static inline TickType_t xTaskGetTickCount()
+{
+    using namespace std::chrono;
+    static const steady_clock::time_point t0 = steady_clock::now();
+    return (TickType_t)duration_cast<milliseconds>(steady_clock::now() - t0).count();
+}
+
+static inline TaskHandle_t xTaskGetCurrentTaskHandle() { return hostCurrentTask(); }
+static inline const char* pcTaskGetName(TaskHandle_t t) { return t ? t->name.c_str() : "main"; }
+static inline UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t) { return 0; }
+static inline void taskYIELD() { std::this_thread::yield(); }
+
+static inline BaseType_t xTaskNotifyGive(TaskHandle_t t)
+{
+    if (!t) return pdFAIL;
+    {
+        std::lock_guard<std::mutex> lock(t->m);
+        t->notifyCount++;
+    }
+    t->cv.notify_one();
+    return pdPASS;
+}
+
+static inline void vTaskNotifyGiveFromISR(TaskHandle_t t, BaseType_t* woken)
+{
+    xTaskNotifyGive(t);
+    if (woken) *woken = pdFALSE;
+}
+
+static inline uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks)
+{
+    HostTask* t = hostCurrentTask();
+    if (!t) return 0;
+    std::unique_lock<std::mutex> lock(t->m);
+    auto ready = [t] { return t->notifyCount > 0; };
+    if (ticks == portMAX_DELAY) {
+        t->cv.wait(lock, ready);
+    } else if (!t->cv.wait_for(lock, std::chrono::milliseconds(ticks), ready)) {
+        return 0;
+    }
+    uint32_t v = t->notifyCount;
+    t->notifyCount = clearOnExit ? 0 : v - 1;
+    return v;
+}
@@ -0,0 +1,7 @@
+// Host stand-in: the ESP32-S3 capabilities the library checks.
+#pragma once
+
+#define SOC_RMT_SUPPORTED 1
+#define SOC_I2S_NUM 2
+#define SOC_I2S_SUPPORTS_PDM_TX 1
+#define SOC_ADC_DIG_CTRL_SUPPORTED 1
@@ -0,0 +1,168 @@
+// Back pressure check of AiWorkshopInference (ai-workshop-inference.h) on the host stand-in.
+//
+// The microphone plays a ramp (every sample is the previous one + 1), so a slice
+// that was overwritten while the classifier read it shows up as a jump in the ramp.
+// A stand-in classifier is fast, then slower than a slice for a few calls, then fast again.
+// For every policy we check: no torn slices, the drop counters add up, lost
+// audio matches the drops and the classifier resyncs after each gap.
+//
+//   g++ -std=gnu++17 -O2 -pthread -I tools/host/include -I libraries/MAFAD_Workshop/src tools/host/inference_backpressure_sim.cpp -o inference_backpressure_sim
+//   ./inference_backpressure_sim
+
+#include <Arduino.h>
+
+#include <atomic>
+#include <cmath>
+#include <functional>
+
+// --- a minimal stand-in for the Edge Impulse *_inferencing.h header ---
+#define EI_CLASSIFIER_FREQUENCY 20000
+#define EI_CLASSIFIER_LABEL_COUNT 2
+#define EI_CLASSIFIER_SLICE_SIZE 4000
+#define EI_CLASSIFIER_SLICES_PER_MODEL_WINDOW 5
+
+typedef struct { const char* label; float value; } ei_impulse_result_classification_t;
+typedef struct { ei_impulse_result_classification_t classification[EI_CLASSIFIER_LABEL_COUNT]; } ei_impulse_result_t;
+typedef struct { std::function<int(size_t, size_t, float*)> get_data; size_t total_length; } signal_t;
+typedef enum { EI_IMPULSE_OK = 0, EI_IMPULSE_ERR = -1 } EI_IMPULSE_ERROR;
+namespace numpy {
+static inline int int16_to_float(const int16_t* in, float* out, size_t n) { for (size_t i = 0; i < n; i++) out[i] = in[i]; return 0; }
+}
+
+static std::atomic<uint32_t> classifierMs{10};
+static std::atomic<uint32_t> tornSlices{0};
+static std::atomic<uint32_t> classifierInits{0};
+
+static void run_classifier_init() { classifierInits++; }
+
+static EI_IMPULSE_ERROR run_classifier_continuous(signal_t* signal, ei_impulse_result_t* result, bool)
+{
+    // read the slice in two halves with the "inference" in between, like the DSP and the model do
+    float first[1], last[1];
+    signal->get_data(0, 1, first);
+    delay(classifierMs);
+    signal->get_data(signal->total_length - 1, 1, last);
+    float expected = fmodf(first[0] + signal->total_length - 1 + 30000.0f, 30000.0f);
+    if (last[0] != expected) tornSlices++;
+
+    for (int i = 0; i < EI_CLASSIFIER_LABEL_COUNT; i++) {
+        result->classification[i].label = i ? "noise" : "tone";
+        result->classification[i].value = 0.5f;
+    }
+    return EI_IMPULSE_OK;
+}
+// --- end of the stand-in ---
+
+#include <ai-workshop-main.h>
+#include <ai-workshop-inference.h>
+
+static void rampAudio(int32_t* out, size_t count, uint32_t channels, uint64_t frameIndex)
+{
+    for (size_t i = 0; i < count; i++) {
+        int32_t v = (int32_t)((frameIndex + i) % 30000);
+        for (uint32_t c = 0; c < channels; c++) out[i * channels + c] = v * 4096;
+    }
+}
+
+static const char* policyName(BackPressure policy)
+{
+    switch (policy) {
+        case BackPressure::DropOldest: return "DropOldest";
+        case BackPressure::DropNewest: return "DropNewest";
+        default: return "BlockProducer";
+    }
+}
+
+static bool runPolicy(BackPressure policy, uint32_t slowCalls, uint32_t slowMs)
+{
+    AiWorkshopInference inference;
+    tornSlices = 0;
+    classifierInits = 0;
+    classifierMs = 10;
+
+    inference.setBackPressure(policy, 40);
+    if (!inference.begin(1, 2, 3)) {
+        printf("FAIL: begin\n");
+        return false;
+    }
+
+    // 1 s fast, slowCalls slow, then 2 s fast (enough for the warm-up after the last gap)
+    ei_impulse_result_t result;
+    uint32_t results = 0;
+    uint32_t calls = 0;
+    int64_t start = esp_timer_get_time();
+    int64_t slowEnd = 0;
+    while (slowEnd == 0 || esp_timer_get_time() - slowEnd < 2000000) {
+        bool slow = esp_timer_get_time() - start > 1000000 && calls < slowCalls;
+        if (slow) calls++;
+        classifierMs = slow ? slowMs : 10;
+        if (inference.tick(result)) results++;
+        if (calls == slowCalls && slowEnd == 0) slowEnd = esp_timer_get_time();
+    }
+
+    AiWorkshopInference::Stats s = inference.stats();
+    inference.end();
+    delay(100);
+
+    uint32_t dropped = s.droppedOldest + s.droppedNewest;
+    printf("%-13s %u x %3u ms: %3u slices, %3u classified, %3u warm-up, dropped %u oldest %u newest, "
+           "blocked %u (%u timeouts), %u resyncs, lost %.0f ms\n",
+           policyName(policy), (unsigned)slowCalls, (unsigned)slowMs, (unsigned)s.slices, (unsigned)s.classified, (unsigned)s.warmupSlices,
+           (unsigned)s.droppedOldest, (unsigned)s.droppedNewest, (unsigned)s.blocked, (unsigned)s.blockTimeouts,
+           (unsigned)s.resyncs, s.lostMs());
+
+    bool ok = true;
+    if (tornSlices) {
+        printf("FAIL: %u slices changed while the classifier read them\n", (unsigned)tornSlices.load());
+        ok = false;
+    }
+    if (s.lostSamples != (uint64_t)dropped * EI_CLASSIFIER_SLICE_SIZE) {
+        printf("FAIL: lost samples do not match the drops\n");
+        ok = false;
+    }
+    // every slice is classified, dropped or still in flight (at most 2 at the end)
+    uint32_t accounted = s.classified + s.warmupSlices + dropped;
+    if (accounted > s.slices || s.slices - accounted > 2) {
+        printf("FAIL: %u slices but %u accounted for\n", (unsigned)s.slices, (unsigned)accounted);
+        ok = false;
+    }
+    if (results != s.classified) {
+        printf("FAIL: tick() returned %u results, stats say %u\n", (unsigned)results, (unsigned)s.classified);
+        ok = false;
+    }
+    if ((dropped > 0) != (s.resyncs > 0) || classifierInits != s.resyncs) {
+        printf("FAIL: %u drops but %u resyncs (%u classifier restarts)\n", (unsigned)dropped, (unsigned)s.resyncs,
+               (unsigned)classifierInits.load());
+        ok = false;
+    }
+    if (policy == BackPressure::DropOldest && s.droppedNewest) ok = false;
+    if (policy == BackPressure::DropNewest && s.droppedOldest) ok = false;
+    if (policy != BackPressure::BlockProducer && (s.blocked || s.blockTimeouts)) ok = false;
+    // the waiting slice absorbs 200 ms of lag, BlockProducer another 40 ms
+    uint32_t lagMs = slowCalls * (slowMs - 200);
+    if (policy == BackPressure::BlockProducer && lagMs < 200 + 40 && (dropped || !s.blocked)) {
+        printf("FAIL: a classifier less than maxBlockMs late should only block the producer\n");
+        ok = false;
+    }
+    if (policy != BackPressure::BlockProducer && lagMs > 200 + 20 && dropped == 0) {
+        printf("FAIL: expected drops\n");
+        ok = false;
+    }
+    return ok;
+}
+
+int main()
+{
+    hostI2sSetSource(I2S_NUM_1, rampAudio);
+
+    bool ok = true;
+    // a slice is 200 ms: 3 x 275 ms is a little too late, 6 x 450 ms loses several slices
+    const uint32_t scenarios[][2] = { { 3, 275 }, { 6, 450 } };
+    for (const auto& sc : scenarios) {
+        ok &= runPolicy(BackPressure::DropOldest, sc[0], sc[1]);
+        ok &= runPolicy(BackPressure::DropNewest, sc[0], sc[1]);
+        ok &= runPolicy(BackPressure::BlockProducer, sc[0], sc[1]);
+    }
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,210 @@
+// Take level check of the recording levels (ai-workshop-levels.h, i2sMic, SDCard) on the host stand-in.
+//
+// Records takes through the microphone the way record_dataset does (startRecording(),
+// stopRecording() after 1 s): a good one, a quiet one, a clipped one, a silent one and one
+// with a DC offset. Checks:
+//   - getRecordedLevels() (measured per DMA block while recording) is the same as the
+//     levels of the samples in the buffer, up to stopRecording()
+//     (give or take the last milliseconds: the take length is measured with millis())
+//   - every take gets the right verdict
+//   - good takes go to /master with a LIST/INFO chunk that readers skip, bad takes to
+//     /flagged, or nowhere with TakePolicy::reject
+//   - getStreamLevels() gives the levels of the stream since the last call
+// Prints the cost of metering one DMA block on this machine.
+//
+//   g++ -std=gnu++17 -O2 -pthread -I tools/host/include -I libraries/MAFAD_Workshop/src tools/host/levels_sim.cpp -o levels_sim
+//   ./levels_sim
+
+#include <Arduino.h>
+#include <ai-workshop-main.h>
+#include <ai-workshop-mic.h>
+#include <ai-workshop-sdcard.h>
+#include <ai-workshop-levels.h>
+
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <string>
+#include <vector>
+
+struct Take
+{
+    const char* name;
+    float amplitude;     // of a 1 kHz tone, 16 bit units
+    float dc;
+    TakeVerdict expected;
+};
+
+static const Take takes[] = {
+    { "good", 8000.0f, 0.0f, TakeVerdict::Good },
+    { "quiet", 300.0f, 0.0f, TakeVerdict::TooQuiet },
+    { "clipped", 45000.0f, 0.0f, TakeVerdict::Clipped },
+    { "silent", 0.0f, 0.0f, TakeVerdict::Silent },
+    { "offset", 8000.0f, 3000.0f, TakeVerdict::DcOffset },
+};
+static const int numTakes = sizeof(takes) / sizeof(takes[0]);
+static int current = 0;
+
+static void source(int32_t* out, size_t count, uint32_t channels, uint64_t frameIndex)
+{
+    static uint32_t lcg = 4242;
+    const Take& take = takes[current];
+    for (size_t i = 0; i < count; i++) {
+        double t = (double)(frameIndex + i) / SAMPLE_RATE;
+        float v = take.dc + take.amplitude * sinf((float)(2.0 * M_PI * fmod(1000.0 * t, 1.0)));
+        if (take.amplitude > 0.0f) {
+            lcg = lcg * 1664525u + 1013904223u;
+            v += ((int32_t)(lcg >> 16) - 32768) / 32768.0f * 20.0f;
+        }
+        for (uint32_t c = 0; c < channels; c++) out[i * channels + c] = (int32_t)(v * 4096.0f);
+    }
+}
+
+static std::vector<uint8_t> readFile(const std::string& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static bool close(float a, float b, float tolerance) { return fabsf(a - b) <= tolerance; }
+
+// checks a written take: a readable WAV of numSamples, the RIFF size, and the comment after the samples
+static bool checkFile(const std::string& path, uint32_t numSamples, const char* verdict)
+{
+    std::vector<uint8_t> file = readFile(path);
+    WavInfo info;
+    if (!parseWavHeader(file.data(), file.size(), info) || info.numSamples != numSamples) {
+        printf("FAIL: %s is not a WAV of %u samples\n", path.c_str(), (unsigned)numSamples);
+        return false;
+    }
+    uint32_t riff;
+    memcpy(&riff, file.data() + 4, 4);
+    if (riff != file.size() - 8) {
+        printf("FAIL: %s has a RIFF size of %u for %u bytes\n", path.c_str(), (unsigned)riff, (unsigned)file.size());
+        return false;
+    }
+    uint32_t list = info.dataOffset + numSamples * 2;
+    if (file.size() < list + 20 || memcmp(file.data() + list, "LIST", 4) != 0 || memcmp(file.data() + list + 8, "INFOICMT", 8) != 0) {
+        printf("FAIL: %s has no LIST/INFO chunk after the samples\n", path.c_str());
+        return false;
+    }
+    std::string comment((const char*)file.data() + list + 20);
+    printf("    %s: \"%s\"\n", path.c_str(), comment.c_str());
+    if (comment.find(verdict) == std::string::npos) {
+        printf("FAIL: the comment does not have the verdict\n");
+        return false;
+    }
+    return true;
+}
+
+i2sMic microphone;
+
+int main()
+{
+    bool ok = true;
+    hostSdRoot() = "levels_sd";
+    system("rm -rf levels_sd");
+    SD.begin();
+    SDCard sdCard;
+
+    hostI2sSetSource(I2S_NUM_0, source);
+    microphone.setup(1, 7, 10);
+
+    for (int pass = 0; pass < 2; pass++) {
+        TakePolicy policy;
+        policy.reject = pass == 1;
+        sdCard.setTakePolicy(policy);
+        printf("%s bad takes:\n", policy.reject ? "reject" : "flag");
+
+        // every recording takes the 3 s of the buffer: only a good and a bad one for reject
+        for (current = 0; current < (policy.reject ? 2 : numTakes); current++) {
+            const Take& take = takes[current];
+            microphone.startRecording();
+            delay(1000);
+            microphone.stopRecording();
+
+            // the levels of the samples in the buffer, in one extra pass, to compare
+            uint32_t numSamples = microphone.getRecordedLengthMs() * (SAMPLE_RATE / 1000);
+            TakeStats levels = microphone.getRecordedLevels();
+            LevelMeter reference;
+            reference.addRaw(microphone.getRecordedData(), levels.samples);
+            TakeStats expected = reference.stats();
+
+            char line[100];
+            levels.format(line, sizeof(line));
+            TakeVerdict verdict = sdCard.writeAudioFile(microphone.getRecordedData(), microphone.getRecordedLengthMs(),
+                                                        take.name, "SIM", pass, 2, &levels);
+            printf("  %-8s %s -> %s\n", take.name, line, takeVerdictName(verdict));
+
+            if (levels.samples + SAMPLE_RATE / 100 < numSamples || levels.samples > numSamples + SAMPLE_RATE / 100 || levels.peak != expected.peak || levels.clipped != expected.clipped ||
+                !close(levels.rms, expected.rms, 0.01f) || !close(levels.dcOffset, expected.dcOffset, 0.01f)) {
+                printf("FAIL: the levels measured while recording (%u samples) are not those of the take (%u samples)\n",
+                       (unsigned)levels.samples, (unsigned)numSamples);
+                ok = false;
+            }
+            if (take.amplitude > 0.0f && take.amplitude < 32767.0f &&
+                !close(levels.rms, take.amplitude / sqrtf(2.0f), take.amplitude * 0.02f + 20.0f)) {
+                printf("FAIL: rms %.0f for a tone of %.0f\n", levels.rms, take.amplitude);
+                ok = false;
+            }
+            if (verdict != take.expected) {
+                printf("FAIL: '%s' is %s, expected %s\n", take.name, takeVerdictName(verdict), takeVerdictName(take.expected));
+                ok = false;
+            }
+
+            std::string name = std::string(take.name) + ".SIM" + (pass ? "000001" : "000000") + ".wav";
+            std::string master = hostSdRoot() + "/master/" + name;
+            std::string flagged = hostSdRoot() + "/flagged/" + name;
+            bool good = take.expected == TakeVerdict::Good;
+            if (good && !checkFile(master, numSamples, "good")) ok = false;
+            if (!good && !policy.reject && !checkFile(flagged, numSamples, takeVerdictName(take.expected))) ok = false;
+            if (!good && (SD.exists(("/master/" + name).c_str()) || (policy.reject && SD.exists(("/flagged/" + name).c_str())))) {
+                printf("FAIL: the bad take '%s' was written where it should not be\n", take.name);
+                ok = false;
+            }
+        }
+    }
+
+    // the stream: levels since the last call
+    current = 0;
+    microphone.startStream(4000);
+    delay(200);
+    microphone.consumeStream();
+    microphone.getStreamLevels();
+    uint32_t slices = 0;   // the first one is partly from before the reset
+    while (slices < 12) {
+        if (microphone.isStreamReady()) {
+            microphone.consumeStream();
+            slices++;
+        }
+        delay(1);
+    }
+    TakeStats stream = microphone.getStreamLevels();
+    TakeStats empty = microphone.getStreamLevels();
+    char line[100];
+    stream.format(line, sizeof(line));
+    printf("stream: %u samples, %s\n", (unsigned)stream.samples, line);
+    if (stream.samples < 11 * 4000 || !close(stream.rms, takes[0].amplitude / sqrtf(2.0f), 100.0f)) {
+        printf("FAIL: the stream levels are not those of the stream\n");
+        ok = false;
+    }
+    if (empty.samples > DMA_BUFFER_SIZE) {
+        printf("FAIL: the stream levels were not reset\n");
+        ok = false;
+    }
+    microphone.stopStream();
+
+    // the cost of one block
+    std::vector<int32_t> block(DMA_BUFFER_SIZE);
+    for (int i = 0; i < DMA_BUFFER_SIZE; i++) block[i] = (int32_t)(8000.0f * sinf(i * 0.3f)) * 4096;
+    LevelMeter meter;
+    auto t0 = std::chrono::steady_clock::now();
+    const int rounds = 20000;
+    for (int r = 0; r < rounds; r++) meter.addRaw(block.data(), DMA_BUFFER_SIZE);
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / rounds;
+    printf("metering: %.2f us per DMA block of %d samples (%.2f ns per sample, rms %.0f)\n", ns / 1000, DMA_BUFFER_SIZE,
+           ns / DMA_BUFFER_SIZE, meter.stats().rms);
+
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
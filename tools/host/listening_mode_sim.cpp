@@ -0,0 +1,205 @@
+// Scripted-audio check of ListeningMode (ai-workshop-listen.h) on the host stand-in.
+//
+// Plays quiet background noise with two melodies through the simulated I2S
+// port, runs a fake classifier while the listener is active and checks the
+// number of wake-ups, the wake latency bound and the time spent per state.
+// Then the room gets louder for good (a fan is switched on): the listener must
+// go back to watching within the floor window and still wake up for a melody.
+// Every wake-up asks for one classifier restart. Last, blocks fed by hand: Active ->
+// Watch -> Active between two update() calls, and end() while active, must leave the
+// clock where it belongs (with -DCONFIG_PM_ENABLE=1: no leaked esp_pm lock).
+//
+//   g++ -std=gnu++17 -O2 -pthread -I tools/host/include -I libraries/MAFAD_Workshop/src tools/host/listening_mode_sim.cpp -o listening_mode_sim
+//   ./listening_mode_sim
+//
+// Add -DCONFIG_PM_ENABLE=1 to run the esp_pm code path instead of setCpuFrequencyMhz.
+
+#include <Arduino.h>
+#include <ai-workshop-main.h>
+#include <ai-workshop-mic.h>
+#include <ai-workshop-listen.h>
+
+#include <cmath>
+
+struct Segment {
+    float startS;
+    float endS;
+    float frequency;   // 0 = silence
+    float amplitude;   // 16 bit units
+};
+
+// 14 seconds: two melodies (simple note runs) in quiet noise, then 14 seconds in a louder
+// room with one more melody at 25 s
+static const Segment script[] = {
+    {3.0f, 3.3f, 523.0f, 3000.0f},
+    {3.3f, 3.6f, 659.0f, 3000.0f},
+    {3.6f, 4.0f, 784.0f, 3000.0f},
+    {8.0f, 8.2f, 262.0f, 2000.0f},
+    {8.2f, 8.5f, 330.0f, 2000.0f},
+    {25.0f, 25.5f, 523.0f, 4000.0f},
+    {25.5f, 26.0f, 784.0f, 4000.0f},
+};
+static const float quietS = 14.0f;       // the room gets louder here
+static const float scriptLengthS = 28.0f;
+static const int melodies = 2;
+static const float noiseAmplitude = 12.0f;
+static const float loudNoiseAmplitude = 300.0f;
+
+static void scriptedAudio(int32_t* out, size_t count, uint32_t channels, uint64_t frameIndex)
+{
+    static uint32_t lcg = 12345;
+    for (size_t i = 0; i < count; i++) {
+        float t = (float)(frameIndex + i) / SAMPLE_RATE;
+        lcg = lcg * 1664525u + 1013904223u;
+        float v = ((int32_t)(lcg >> 16) - 32768) / 32768.0f * (t < quietS ? noiseAmplitude : loudNoiseAmplitude);
+        for (const Segment& s : script) {
+            if (t >= s.startS && t < s.endS) v += s.amplitude * sinf(2.0f * (float)M_PI * s.frequency * t);
+        }
+        for (uint32_t c = 0; c < channels; c++) out[i * channels + c] = (int32_t)v * 4096;
+    }
+}
+
+i2sMic mic;
+ListeningMode listener;
+
+static std::atomic<uint32_t> inferences{0};
+static std::atomic<uint32_t> skipped{0};
+static std::atomic<uint32_t> resyncs{0};
+
+static void inferenceTask(void*)
+{
+    while (true) {
+        listener.update();   // the clock follows the state here, not in the stream hook
+        if (listener.needsResync()) resyncs++;   // run_classifier_init() on the robot
+        if (mic.isStreamReady()) {
+            mic.consumeStream();
+            if (listener.isActive()) {
+                delay(30);   // the classifier
+                listener.markInference();
+                inferences++;
+            } else {
+                skipped++;
+            }
+        }
+        vTaskDelay(5);
+    }
+}
+
+int main()
+{
+    hostI2sSetSource(I2S_NUM_0, scriptedAudio);
+
+    mic.setup(1, 7, 10);
+    ListenConfig config;
+    config.floorWindowMs = 4000;   // the default 10 s would make the script long
+    listener.begin(mic, config);
+    mic.startStream(4000);
+    xTaskCreatePinnedToCore(inferenceTask, "Inference", 8192, nullptr, 2, nullptr, 0);
+
+    uint32_t lastMhz = 0;
+    int64_t start = esp_timer_get_time();
+    ListenStats quiet;          // at the end of the quiet part
+    bool haveQuiet = false;
+    float roomWatchS = -1.0f;   // back to watching in the louder room
+    while (esp_timer_get_time() - start < (int64_t)(scriptLengthS * 1e6)) {
+        float t = (esp_timer_get_time() - start) / 1e6f;
+        if (!haveQuiet && t >= quietS) {
+            quiet = listener.getStats();
+            haveQuiet = true;
+        }
+        if (haveQuiet && roomWatchS < 0.0f && t > quietS + 0.5f && t < 25.0f && !listener.isActive()) roomWatchS = t;
+        uint32_t mhz = getCpuFrequencyMhz();
+        if (mhz != lastMhz) {
+            printf("%6.2f s  %s at %u MHz\n", (esp_timer_get_time() - start) / 1e6,
+                   listener.isActive() ? "active" : "watch ", (unsigned)mhz);
+            lastMhz = mhz;
+        }
+        delay(5);
+    }
+
+    listener.printStats();
+    ListenStats stats = quiet;
+    printf("classifier ran %u times, skipped %u slices, stream overruns %u\n",
+           (unsigned)inferences.load(), (unsigned)skipped.load(), (unsigned)mic.getStreamOverruns());
+
+    // expected active time: each melody plus the hold time
+    float expectedActiveS = (4.0f - 3.0f) + (8.5f - 8.0f) + 2 * config.holdMs / 1000.0f;
+    float blockMs = 1000.0f * DMA_BUFFER_SIZE / SAMPLE_RATE;
+
+    bool ok = true;
+    if ((int)stats.wakeups != melodies) {
+        printf("FAIL: %u wakeups, expected %d\n", (unsigned)stats.wakeups, melodies);
+        ok = false;
+    }
+    if (stats.maxWakeUs / 1000.0f > blockMs + 10.0f) {
+        printf("FAIL: wake latency %.1f ms is over the bound of one block (%.1f ms) + 10 ms\n", stats.maxWakeUs / 1000.0f, blockMs);
+        ok = false;
+    }
+    if (fabsf(stats.activeUs / 1e6f - expectedActiveS) > 0.3f) {
+        printf("FAIL: active %.2f s, expected about %.2f s\n", stats.activeUs / 1e6f, expectedActiveS);
+        ok = false;
+    }
+
+    // the louder room: one wake-up for the fan, back to watching within the floor window
+    // (1.5 windows at most, as it is kept in halves) plus the hold time, then the melody
+    ListenStats end = listener.getStats();
+    float roomBoundS = quietS + 1.5f * config.floorWindowMs / 1000.0f + config.holdMs / 1000.0f + 0.3f;
+    printf("louder room from %.1f s: back to watching at %.2f s (bound %.2f s), noise floor %.0f, %u wakeups in all\n", quietS,
+           roomWatchS, roomBoundS, end.noiseFloor, (unsigned)end.wakeups);
+    if (roomWatchS < 0.0f || roomWatchS > roomBoundS) {
+        printf("FAIL: the louder room kept the listener active\n");
+        ok = false;
+    }
+    if ((int)end.wakeups != melodies + 2) {
+        printf("FAIL: %u wakeups in all, expected %d (the fan and the melody in the louder room)\n", (unsigned)end.wakeups, melodies + 2);
+        ok = false;
+    }
+    if (end.maxWakeUs / 1000.0f > blockMs + 10.0f) {
+        printf("FAIL: wake latency %.1f ms is over the bound of one block (%.1f ms) + 10 ms\n", end.maxWakeUs / 1000.0f, blockMs);
+        ok = false;
+    }
+    if (resyncs.load() != end.wakeups) {
+        printf("FAIL: %u classifier restarts asked for %u wakeups\n", (unsigned)resyncs.load(), (unsigned)end.wakeups);
+        ok = false;
+    }
+    if (listener.isActive() || getCpuFrequencyMhz() != config.watchCpuMhz) {
+        printf("FAIL: not back in the watch state at the end\n");
+        ok = false;
+    }
+
+    // by hand, with the stream stopped: the state changes twice between two update() calls
+    mic.stopStream();
+    delay(100);
+    ListeningMode byHand;
+    byHand.begin(mic, config);
+    float quietBlock[DMA_BUFFER_SIZE], loudBlock[DMA_BUFFER_SIZE];
+    for (int i = 0; i < DMA_BUFFER_SIZE; i++) {
+        quietBlock[i] = (i % 2 ? 10.0f : -10.0f);
+        loudBlock[i] = 3000.0f * sinf(2.0f * (float)M_PI * 523.0f * i / SAMPLE_RATE);
+    }
+    const int64_t holdUs = (int64_t)config.holdMs * 1000, blockUs = (int64_t)blockMs * 1000;
+    int64_t t = 0;
+    for (int i = 0; i < 10; i++) byHand.onBlock(quietBlock, DMA_BUFFER_SIZE, t += blockUs);
+    byHand.onBlock(loudBlock, DMA_BUFFER_SIZE, t += blockUs);   // Watch -> Active
+    byHand.update();
+    bool wokeUp = getCpuFrequencyMhz() == config.activeCpuMhz;
+    byHand.onBlock(quietBlock, DMA_BUFFER_SIZE, t += holdUs + blockUs);   // -> Watch
+    byHand.onBlock(loudBlock, DMA_BUFFER_SIZE, t += blockUs);             // -> Active, no update() in between
+    byHand.update();
+    byHand.onBlock(quietBlock, DMA_BUFFER_SIZE, t += holdUs + blockUs);   // -> Watch
+    byHand.update();
+    bool slowAgain = getCpuFrequencyMhz() == config.watchCpuMhz;
+    byHand.onBlock(loudBlock, DMA_BUFFER_SIZE, t += blockUs);             // -> Active
+    byHand.update();
+    byHand.end(mic);   // while active
+    bool fullAfterEnd = getCpuFrequencyMhz() == config.activeCpuMhz;
+    printf("by hand: %s at the wake-up, %s after Active -> Watch -> Active -> Watch, %s after end()\n",
+           wokeUp ? "full clock" : "SLOW", slowAgain ? "slow" : "STILL FULL", fullAfterEnd ? "full clock" : "SLOW");
+    if (!wokeUp || !slowAgain || !fullAfterEnd) {
+        printf("FAIL: the clock does not follow the state (a leaked or missing esp_pm lock)\n");
+        ok = false;
+    }
+    printf("%s\n", ok ? "OK" : "FAILED");
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,293 @@
+// Accuracy and CPU of the Goertzel melody detector (ai-workshop-melody.h) on WAV recordings.
+//
+// Runs MelodyDetector over every .wav in a folder (16 bit mono, 20 kHz, like the
+// recordings on the SD card). The label is the start of the file name
+// (hello_there.MAFAD000012.wav -> hello_there); files of other labels should give no match.
+//
+//   g++ -std=gnu++17 -O2 -pthread -I tools/host/include -I libraries/MAFAD_Workshop/src tools/host/melody_eval.cpp -o melody_eval
+//   ./melody_eval /path/to/sdcard/master
+//   ./melody_eval --synth /tmp/melodies 20     # make synthetic takes first (square waves, noise, speaker filter)
+//   ./melody_eval /tmp/melodies
+//
+// Compare with the Edge Impulse model on the device with examples/melody_benchmark.
+
+#include <Arduino.h>
+#include <ai-workshop-main.h>
+#include <ai-workshop-pitches.h>
+#include <ai-workshop-melody.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <map>
+#include <random>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+// The three workshop melodies, as played by examples/record_dataset
+static std::vector<MelodyNote> melody1()
+{
+    std::vector<MelodyNote> m;
+    const uint16_t pairs[][2] = { { NOTE_C3, NOTE_C4 }, { NOTE_D3, NOTE_D4 }, { NOTE_DS3, NOTE_DS4 }, { NOTE_F3, NOTE_F4 },
+                                  { NOTE_G3, NOTE_G4 }, { NOTE_GS3, NOTE_GS4 }, { NOTE_AS3, NOTE_AS4 }, { NOTE_C4, NOTE_C5 } };
+    for (int i = 0; i < 8; i++) {
+        m.push_back({ pairs[i][0], 60 });
+        m.push_back({ pairs[i][1], 60 });
+        if (i < 7) m.push_back({ 0, 30 });
+    }
+    return m;
+}
+
+static std::vector<MelodyNote> melody2()
+{
+    std::vector<MelodyNote> m;
+    for (int loop = 0; loop < 50; loop++) {
+        m.push_back({ (uint16_t)(800 - loop * 5), 15 });
+        m.push_back({ 0, 15 });
+    }
+    return m;
+}
+
+static std::vector<MelodyNote> melody3()
+{
+    std::vector<MelodyNote> m;
+    for (int part = 0; part < 2; part++) {
+        for (int loop = 0; loop < 3; loop++) {
+            m.push_back({ NOTE_C4, 30 });
+            m.push_back({ NOTE_DS4, 30 });
+            m.push_back({ NOTE_G4, 30 });
+        }
+        m.push_back({ 0, 30 });
+        m.push_back({ NOTE_C2, 90 });
+        m.push_back({ 0, 30 });
+    }
+    for (int loop = 0; loop < 8; loop++) {
+        m.push_back({ NOTE_C5, 30 });
+        m.push_back({ NOTE_AS4, 30 });
+        m.push_back({ NOTE_G5, 30 });
+    }
+    return m;
+}
+
+static const char* labels[] = { "hello_there", "i_love_cake", "get_bonus" };
+static const char* noiseLabel = "noise";
+
+// --- WAV files ---
+
+static bool readWav(const std::string& path, std::vector<int16_t>& samples, uint32_t& rate)
+{
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+    char id[4];
+    uint32_t size;
+    bool ok = fread(id, 1, 4, f) == 4 && memcmp(id, "RIFF", 4) == 0 && fread(&size, 4, 1, f) == 1 &&
+              fread(id, 1, 4, f) == 4 && memcmp(id, "WAVE", 4) == 0;
+    uint16_t channels = 0, bits = 0;
+    while (ok && fread(id, 1, 4, f) == 4 && fread(&size, 4, 1, f) == 1) {
+        if (memcmp(id, "fmt ", 4) == 0) {
+            uint8_t fmt[16];
+            ok = size >= 16 && fread(fmt, 1, 16, f) == 16;
+            memcpy(&channels, fmt + 2, 2);
+            memcpy(&rate, fmt + 4, 4);
+            memcpy(&bits, fmt + 14, 2);
+            if (size > 16) fseek(f, size - 16, SEEK_CUR);
+        } else if (memcmp(id, "data", 4) == 0) {
+            if (channels != 1 || bits != 16) { ok = false; break; }
+            samples.resize(size / 2);
+            ok = fread(samples.data(), 2, samples.size(), f) == samples.size();
+            break;
+        } else {
+            fseek(f, size + (size & 1), SEEK_CUR);
+        }
+    }
+    fclose(f);
+    return ok && !samples.empty();
+}
+
+static void writeWav(const std::string& path, const std::vector<int16_t>& samples)
+{
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) return;
+    uint32_t dataSize = samples.size() * 2, riffSize = 36 + dataSize, fmtSize = 16, rate = SAMPLE_RATE, byteRate = rate * 2;
+    uint16_t format = 1, channels = 1, align = 2, bits = 16;
+    fwrite("RIFF", 1, 4, f); fwrite(&riffSize, 4, 1, f); fwrite("WAVE", 1, 4, f);
+    fwrite("fmt ", 1, 4, f); fwrite(&fmtSize, 4, 1, f); fwrite(&format, 2, 1, f); fwrite(&channels, 2, 1, f);
+    fwrite(&rate, 4, 1, f); fwrite(&byteRate, 4, 1, f); fwrite(&align, 2, 1, f); fwrite(&bits, 2, 1, f);
+    fwrite("data", 1, 4, f); fwrite(&dataSize, 4, 1, f);
+    fwrite(samples.data(), 2, samples.size(), f);
+    fclose(f);
+}
+
+// --- synthetic takes ---
+
+// A small speaker and microphone: no bass below ~300 Hz, soft above ~5 kHz.
+struct Speaker {
+    float hp = 0.0f, lastIn = 0.0f, lp = 0.0f;
+    float step(float x)
+    {
+        const float a = expf(-2.0f * (float)M_PI * 300.0f / SAMPLE_RATE);
+        hp = a * (hp + x - lastIn);
+        lastIn = x;
+        const float b = expf(-2.0f * (float)M_PI * 5000.0f / SAMPLE_RATE);
+        lp = b * lp + (1.0f - b) * hp;
+        return lp;
+    }
+};
+
+static void synthesise(const std::vector<MelodyNote>& melody, std::vector<float>& out, size_t at, float gain, float detune, std::mt19937& rng)
+{
+    // square wave with a duty cycle like startTone() (about 49%), frequency jitter like randomness
+    std::uniform_real_distribution<float> jitter(-detune, detune);
+    double phase = 0.0;
+    size_t pos = at;
+    for (const MelodyNote& note : melody) {
+        size_t n = (size_t)note.ms * SAMPLE_RATE / 1000;
+        float f = note.frequency ? note.frequency + jitter(rng) : 0.0f;
+        for (size_t i = 0; i < n && pos < out.size(); i++, pos++) {
+            if (f <= 0.0f) continue;
+            phase += f / SAMPLE_RATE;
+            phase -= floor(phase);
+            out[pos] += gain * (phase < 0.49 ? 1.0f : -1.0f);
+        }
+    }
+}
+
+static int synth(const std::string& dir, int count)
+{
+    mkdir(dir.c_str(), 0755);
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> uni(0.0f, 1.0f);
+    std::normal_distribution<float> gauss(0.0f, 1.0f);
+    std::vector<MelodyNote> melodies[3] = { melody1(), melody2(), melody3() };
+    char name[256];
+
+    for (int take = 0; take < count; take++) {
+        for (int label = 0; label < 4; label++) {
+            std::vector<float> audio(SAMPLE_BUFFER_SIZE, 0.0f);
+            float gain = 1500.0f + 8000.0f * uni(rng);
+            if (label < 3) {
+                size_t length = 0;
+                for (const MelodyNote& n : melodies[label]) length += (size_t)n.ms * SAMPLE_RATE / 1000;
+                size_t at = (size_t)(uni(rng) * (audio.size() - std::min(length, audio.size())));
+                synthesise(melodies[label], audio, at, gain, 6.0f, rng);
+            } else {
+                // random sounds like playRandomSounds(): a few random tones
+                std::vector<MelodyNote> random;
+                int tones = 2 + (int)(uni(rng) * 6);
+                for (int i = 0; i < tones; i++) {
+                    random.push_back({ 0, (uint16_t)(50 + uni(rng) * 300) });
+                    random.push_back({ (uint16_t)(70 + uni(rng) * 1930), (uint16_t)(10 + uni(rng) * 400) });
+                }
+                synthesise(random, audio, 0, gain, 0.0f, rng);
+            }
+
+            Speaker speaker;
+            float noise = 10.0f + 60.0f * uni(rng);
+            std::vector<int16_t> samples(audio.size());
+            for (size_t i = 0; i < audio.size(); i++) {
+                float v = speaker.step(audio[i]) + noise * gauss(rng);
+                samples[i] = (int16_t)std::max(-32768.0f, std::min(32767.0f, v));
+            }
+            snprintf(name, sizeof(name), "%s/%s.SYNTH%06d.wav", dir.c_str(), label < 3 ? labels[label] : noiseLabel, take);
+            writeWav(name, samples);
+        }
+    }
+    printf("wrote %d takes of each label to %s\n", count, dir.c_str());
+    return 0;
+}
+
+// --- evaluation ---
+
+int main(int argc, char** argv)
+{
+    if (argc >= 3 && strcmp(argv[1], "--synth") == 0) {
+        return synth(argv[2], argc >= 4 ? atoi(argv[3]) : 20);
+    }
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <folder with wav files> | --synth <folder> [takes]\n", argv[0]);
+        return 2;
+    }
+
+    std::string dir = argv[1];
+    std::vector<std::string> files;
+    if (DIR* d = opendir(dir.c_str())) {
+        while (dirent* e = readdir(d)) {
+            std::string n = e->d_name;
+            if (n.size() > 4 && n.substr(n.size() - 4) == ".wav") files.push_back(n);
+        }
+        closedir(d);
+    }
+    std::sort(files.begin(), files.end());
+    if (files.empty()) {
+        fprintf(stderr, "no .wav files in %s\n", dir.c_str());
+        return 1;
+    }
+
+    MelodyDetector detector;
+    detector.begin();
+    std::vector<MelodyNote> melodies[3] = { melody1(), melody2(), melody3() };
+    for (int i = 0; i < 3; i++) detector.addMelody(labels[i], melodies[i].data(), melodies[i].size());
+
+    // confusion[truth][prediction]
+    std::map<std::string, std::map<std::string, int>> confusion;
+    std::vector<std::string> names = { labels[0], labels[1], labels[2], noiseLabel };
+    int correct = 0, total = 0;
+    double audioSeconds = 0.0, busySeconds = 0.0;
+
+    for (const std::string& file : files) {
+        std::vector<int16_t> samples;
+        uint32_t rate = 0;
+        if (!readWav(dir + "/" + file, samples, rate) || rate != SAMPLE_RATE) {
+            fprintf(stderr, "skipped %s (not 16 bit mono %d Hz)\n", file.c_str(), SAMPLE_RATE);
+            continue;
+        }
+        std::string truth = file.substr(0, file.find('.'));
+        if (std::find(names.begin(), names.end(), truth) == names.end()) truth = noiseLabel;
+
+        detector.reset();
+        auto start = std::chrono::steady_clock::now();
+        // feed it the way the stream does: blocks of DMA_BUFFER_SIZE
+        for (size_t at = 0; at < samples.size(); at += DMA_BUFFER_SIZE) {
+            uint32_t n = (uint32_t)std::min((size_t)DMA_BUFFER_SIZE, samples.size() - at);
+            detector.process(&samples[at], n, (int64_t)(at + n) * 1000000 / SAMPLE_RATE);
+        }
+        // some silence to let a match at the very end report
+        std::vector<int16_t> silence(MELODY_FRAME_SIZE * 4, 0);
+        detector.process(silence.data(), silence.size(), 0);
+        busySeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        audioSeconds += (double)samples.size() / SAMPLE_RATE;
+
+        std::string prediction = noiseLabel;
+        float bestCost = 1e30f;
+        MelodyMatch m;
+        while (detector.getMatch(m)) {
+            if (m.cost < bestCost) {
+                bestCost = m.cost;
+                prediction = m.name;
+            }
+        }
+        confusion[truth][prediction]++;
+        total++;
+        if (prediction == truth) correct++;
+        else printf("  %-40s -> %s (cost %.2f)\n", file.c_str(), prediction.c_str(), bestCost < 1e29f ? bestCost : 0.0f);
+    }
+
+    printf("\n%-12s", "truth \\ got");
+    for (const std::string& n : names) printf(" %12s", n.c_str());
+    printf("\n");
+    for (const std::string& t : names) {
+        printf("%-12s", t.c_str());
+        for (const std::string& p : names) printf(" %12d", confusion[t][p]);
+        printf("\n");
+    }
+
+    MelodyStats stats = detector.getStats();
+    printf("\naccuracy %.1f%% (%d of %d files)\n", total ? 100.0 * correct / total : 0.0, correct, total);
+    printf("cpu: %.2f ms per second of audio on this machine (%.3f%% of real time), %.1f us per frame, %u frames\n",
+           1000.0 * busySeconds / audioSeconds, 100.0 * busySeconds / audioSeconds,
+           1e6 * busySeconds / std::max<uint32_t>(1, stats.frames), (unsigned)stats.frames);
+    return 0;
+}
@@ -0,0 +1,182 @@
+// The two I2S drivers of i2sMic side by side: the legacy one (a capture task in i2s_read)
+// and the channel driver (MIC_I2S_STD: the interrupt converts every DMA buffer in place).
+// Build it once for each and compare the last lines.
+//
+// The microphone plays a counter. A stream hook adds 0.5 to every sample, so a slice that
+// was handed on before its hooks ran is noticed. Runs:
+//   - a stream of 4000 sample slices for 3 s: slices and hook blocks consecutive, hooks
+//     done before the slice is handed on
+//   - two takes: consecutive
+//   - LowLatency (6 x 64 frames) with a 30 ms stall in the hook every 250 ms: the legacy
+//     driver loses audio (the capture task is away longer than the DMA buffers last), the
+//     channel driver does not (the hooks fall behind in the slice buffers, not in the DMA)
+// Prints what the capture costs per second of audio (MicStats: converting and copying, not
+// the hooks; and the CPU time of the whole program) and the bytes copied against what the
+// i2s_read task copies for the same audio.
+//
+//   g++ -std=gnu++17 -O2 -pthread -I tools/host/include -I libraries/MAFAD_Workshop/src tools/host/mic_driver_sim.cpp -o mic_driver_legacy
+//   g++ -std=gnu++17 -O2 -pthread -DMIC_I2S_STD=1 -I tools/host/include -I libraries/MAFAD_Workshop/src tools/host/mic_driver_sim.cpp -o mic_driver_std
+//   ./mic_driver_legacy; ./mic_driver_std
+
+#include <Arduino.h>
+#include <ai-workshop-main.h>
+#include <ai-workshop-mic.h>
+
+#include <sys/resource.h>
+
+#include <atomic>
+#include <vector>
+
+#define COUNTER_SPAN 50000   // the counter runs from -COUNTER_SPAN / 2 up, then wraps
+
+static void counter(int32_t* out, size_t count, uint32_t channels, uint64_t frameIndex)
+{
+    for (size_t i = 0; i < count; i++) {
+        for (uint32_t c = 0; c < channels; c++) out[i * channels + c] = ((int32_t)((frameIndex + i) % COUNTER_SPAN) - COUNTER_SPAN / 2) * 4096;
+    }
+}
+
+static bool follows(int32_t previous, int32_t next)
+{
+    return next == previous + 1 || (previous == COUNTER_SPAN / 2 - 1 && next == -COUNTER_SPAN / 2);
+}
+
+i2sMic mic;
+
+static uint32_t errors = 0;
+
+static void fail(const char* what)
+{
+    if (errors++ < 10) printf("FAIL: %s\n", what);
+}
+
+// the hook: marks the samples, checks the blocks follow each other, stalls when asked to
+static std::atomic<uint32_t> stallMs{ 0 };
+static std::atomic<uint32_t> hookGaps{ 0 };
+static std::atomic<bool> hookReset{ true };
+static int32_t lastHookSample = 0;   // only used on the hook's task
+static int64_t lastStallUs = 0;
+
+static void markHook(float* samples, uint32_t count, int64_t timeUs, void* user)
+{
+    (void)timeUs; (void)user;
+    if (hookReset.exchange(false)) lastHookSample = (int32_t)samples[0] - 1;
+    for (uint32_t i = 0; i < count; i++) {
+        int32_t v = (int32_t)samples[i];
+        if (!follows(lastHookSample, v)) hookGaps++;
+        lastHookSample = v;
+        samples[i] += 0.5f;
+    }
+    int64_t now = esp_timer_get_time();
+    if (stallMs.load() > 0 && now - lastStallUs > 250000) {
+        lastStallUs = now;
+        delay(stallMs.load());
+    }
+}
+
+static double cpuSeconds()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// streams for ms; counts slices that are not consecutive or not marked by the hook
+static void stream(uint32_t ms, uint32_t sliceSamples, uint32_t& slices, uint32_t& torn, uint32_t& unmarked)
+{
+    std::vector<float> slice(sliceSamples);
+    hookReset = true;
+    if (!mic.startStream(sliceSamples)) {
+        fail("startStream refused");
+        return;
+    }
+    int64_t end = esp_timer_get_time() + (int64_t)ms * 1000;
+    while (esp_timer_get_time() < end) {
+        if (!mic.isStreamReady()) {
+            delay(1);
+            continue;
+        }
+        mic.readStream(0, sliceSamples, slice.data());
+        mic.consumeStream();
+        slices++;
+        bool consecutive = true, marked = true;
+        for (uint32_t i = 0; i < sliceSamples; i++) {
+            marked &= slice[i] - floorf(slice[i]) == 0.5f;
+            if (i > 0) consecutive &= follows((int32_t)floorf(slice[i - 1]), (int32_t)floorf(slice[i]));
+        }
+        torn += !consecutive;
+        unmarked += !marked;
+    }
+    mic.stopStream();
+}
+
+int main()
+{
+    const char* driver = MIC_I2S_STD ? "i2s_std (interrupt)" : "legacy (i2s_read task)";
+    hostI2sSetSource(I2S_NUM_0, counter);
+    if (!mic.setup(1, 7, 10)) return 1;
+    mic.addStreamHook(markHook);
+    if (!mic.reserveStream(4000)) return 1;
+    delay(100);   // warmup
+
+    // 1. a plain stream
+    uint32_t slices = 0, torn = 0, unmarked = 0;
+    double cpu = cpuSeconds();
+    stream(3000, 4000, slices, torn, unmarked);
+    cpu = cpuSeconds() - cpu;
+    MicStats stats = mic.getStats();
+    float seconds = (float)stats.frames / SAMPLE_RATE;
+    printf("stream: %u slices, %u not consecutive, %u handed on before the hooks, %u hook gaps\n",
+           (unsigned)slices, (unsigned)torn, (unsigned)unmarked, (unsigned)hookGaps.load());
+    if (slices < 10) fail("too few slices");
+    if (torn != 0) fail("slices not consecutive");
+    if (unmarked != 0) fail("a slice was handed on before its hooks ran");
+    if (hookGaps != 0) fail("the hooks missed samples");
+    float streamCaptureUs = stats.captureUs / seconds;
+    float streamCopied = stats.copiedBytes / seconds;
+    float programMs = cpu * 1000.0 / seconds;
+
+    // 2. takes
+    for (int t = 0; t < 2; t++) {
+        if (!mic.startRecording()) fail("startRecording refused");
+        delay(700);
+        mic.stopRecording();
+        uint32_t samples = mic.getRecordedLengthMs() * (SAMPLE_RATE / 1000);
+        const int32_t* take = mic.getRecordedData();
+        for (uint32_t i = 1; i < samples; i++) {
+            if (!follows(take[i - 1] / 4096, take[i] / 4096)) {
+                fail("take not consecutive");
+                break;
+            }
+        }
+    }
+
+    // 3. small DMA buffers and a hook that stalls for longer than they last
+    mic.setCapture(CaptureProfile::LowLatency);
+    HostI2sPort& port = hostI2sPort(I2S_NUM_0);
+    uint32_t overflows = port.overflows.load();
+    uint32_t droppedBefore = mic.getStats().droppedBlocks;
+    stallMs = 30;
+    slices = torn = unmarked = 0;
+    stream(2000, 4000, slices, torn, unmarked);
+    stallMs = 0;
+    overflows = port.overflows.load() - overflows;
+    uint32_t dropped = mic.getStats().droppedBlocks - droppedBefore;
+    printf("30 ms stalls with 6 x 64 frames: %u slices, %u not consecutive, %u DMA overflows, %u blocks dropped\n",
+           (unsigned)slices, (unsigned)torn, (unsigned)overflows, (unsigned)dropped);
+    if (unmarked != 0) fail("a slice was handed on before its hooks ran (stalls)");
+#if MIC_I2S_STD
+    if (overflows != 0 || dropped != 0 || torn != 0) fail("audio lost although the slice buffers hold the stalls");
+#else
+    if (overflows == 0) fail("the legacy driver kept up with stalls longer than its DMA buffers");
+#endif
+
+    mic.printStats();
+    printf("%s: capture %.0f us cpu per second of audio (stream), program %.1f ms cpu per second of audio\n",
+           driver, streamCaptureUs, programMs);
+    printf("%s: %.0f bytes copied per second of audio, the i2s_read task copies %.0f (%.0f fewer)\n",
+           driver, streamCopied, 2.0f * sizeof(int32_t) * SAMPLE_RATE, 2.0f * sizeof(int32_t) * SAMPLE_RATE - streamCopied);
+
+    printf("%s\n", errors == 0 ? "OK" : "FAILED");
+    return errors == 0 ? 0 : 1;
+}
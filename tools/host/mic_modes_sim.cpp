@@ -0,0 +1,262 @@
+// Mode switch check of i2sMic (record <-> stream) on the host stand-in.
+//
+// The microphone plays a counter (every sample is its frame number), so a slice or a take
+// with anything but consecutive samples is noticed. A stream hook takes some time per block,
+// so a switch often comes while the capture task is busy with one. Runs:
+//   - cycles the way an interactive piece does: stream a few slices, stop, record a short
+//     take, stop, stream again (with other slice sizes)
+//   - start calls of the other mode while one runs: refused
+//   - quick start/stop of the stream without waiting for a slice, and stops while the
+//     capture task is in the middle of a block
+//   - two tasks starting and stopping the stream at the same time
+// Checks:
+//   - every slice and every take is consecutive, the take levels cover the take exactly
+//   - a stopped take still fills the whole buffer (SAMPLE_BUFFER_SIZE), as the dataset examples expect
+//   - the capture task never runs the stream (hook) after stopStream() returned
+//   - a switch takes less than half a DMA block (it does not wait for the i2s_read in progress)
+//   - no heap allocation during the cycles (the slice buffers are reserved once)
+// Prints the switch times (MicStats).
+//
+//   g++ -std=gnu++17 -O2 -pthread -I tools/host/include -I libraries/MAFAD_Workshop/src tools/host/mic_modes_sim.cpp -o mic_modes_sim
+//   ./mic_modes_sim
+// Also run it with -fsanitize=thread (same command, another output name): it reports no races.
+// The heap check needs glibc and is left out with the sanitizer (it has its own malloc).
+
+#include <Arduino.h>
+#include <ai-workshop-main.h>
+#include <ai-workshop-mic.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#define COUNTER_SPAN 50000   // the counter runs from -COUNTER_SPAN / 2 up, then wraps
+
+// --- heap calls of the whole program (glibc only) -----------------------------------------
+
+static std::atomic<uint32_t> heapCalls{ 0 };
+
+#if !defined(__SANITIZE_THREAD__) && defined(__GLIBC__)
+#define COUNT_HEAP 1
+extern "C" {
+void* __libc_malloc(size_t);
+void* __libc_calloc(size_t, size_t);
+void* __libc_realloc(void*, size_t);
+void __libc_free(void*);
+
+void* malloc(size_t size)
+{
+    heapCalls.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+void* calloc(size_t n, size_t size)
+{
+    heapCalls.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(n, size);
+}
+void* realloc(void* p, size_t size)
+{
+    heapCalls.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(p, size);
+}
+void free(void* p)
+{
+    if (p) heapCalls.fetch_add(1, std::memory_order_relaxed);
+    __libc_free(p);
+}
+}
+#else
+#define COUNT_HEAP 0
+#endif
+
+// --- microphone --------------------------------------------------------------------------
+
+static int32_t counterValue(uint64_t frame) { return (int32_t)(frame % COUNTER_SPAN) - COUNTER_SPAN / 2; }
+
+static bool follows(int32_t previous, int32_t next)
+{
+    return next == previous + 1 || (previous == COUNTER_SPAN / 2 - 1 && next == -COUNTER_SPAN / 2);
+}
+
+static void counter(int32_t* out, size_t count, uint32_t channels, uint64_t frameIndex)
+{
+    for (size_t i = 0; i < count; i++) {
+        for (uint32_t c = 0; c < channels; c++) out[i * channels + c] = counterValue(frameIndex + i) * 4096;
+    }
+}
+
+i2sMic mic;
+
+// set by the test after stopStream() returned, cleared before startStream()
+static std::atomic<bool> streamStopped{ true };
+static std::atomic<uint32_t> hookAfterStop{ 0 };
+static std::atomic<uint32_t> hookBlocks{ 0 };
+
+static void busyHook(float* samples, uint32_t count, int64_t timeUs, void* user)
+{
+    (void)samples; (void)count; (void)timeUs; (void)user;
+    if (streamStopped.load()) hookAfterStop++;
+    hookBlocks++;
+    // some work on every block (filters, the visualiser copy, ...)
+    delayMicroseconds(300);
+}
+
+static uint32_t errors = 0;
+
+static void fail(const char* what, int cycle)
+{
+    if (errors++ < 10) printf("FAIL (cycle %d): %s\n", cycle, what);
+}
+
+// true when the slice is consecutive
+static bool sliceOk(const std::vector<float>& slice, uint32_t length)
+{
+    for (uint32_t i = 1; i < length; i++) {
+        if (!follows((int32_t)slice[i - 1], (int32_t)slice[i])) return false;
+    }
+    return true;
+}
+
+static bool streamSlices(int cycle, uint32_t sliceSamples, int slices, std::vector<float>& slice)
+{
+    streamStopped = false;
+    if (!mic.startStream(sliceSamples)) {
+        fail("startStream refused", cycle);
+        return false;
+    }
+    if (mic.startRecording()) fail("startRecording while streaming", cycle);
+    if (mic.getMode() != MicMode::Streaming) fail("not streaming after startStream", cycle);
+
+    // read, then consume: the capture task only writes into the buffer again after it saw
+    // the slice consumed (waitForStream() consumes first, the slice must then be read before
+    // the next one is complete, which the sanitizer cannot see)
+    for (int s = 0; s < slices; s++) {
+        while (!mic.isStreamReady()) delay(1);
+        mic.readStream(0, sliceSamples, slice.data());
+        mic.consumeStream();
+        if (!sliceOk(slice, sliceSamples)) fail("slice not consecutive", cycle);
+    }
+    mic.stopStream();
+    streamStopped = true;
+    return true;
+}
+
+static void recordTake(int cycle, uint32_t ms)
+{
+    if (!mic.startRecording()) {
+        fail("startRecording refused", cycle);
+        return;
+    }
+    if (mic.startStream(2000)) fail("startStream while recording", cycle);
+    if (mic.getMode() != MicMode::Recording) fail("not recording after startRecording", cycle);
+    delay(ms);
+    mic.stopRecording();
+
+    uint32_t samples = mic.getRecordedLengthMs() * (SAMPLE_RATE / 1000);
+    const int32_t* take = mic.getRecordedData();
+    if (mic.getMode() != MicMode::Idle || !mic.isRecordDone()) fail("not idle after stopRecording", cycle);
+    if (samples == 0 || samples > SAMPLE_BUFFER_SIZE) fail("take length out of range", cycle);
+    if ((uint32_t)mic.getRecordedSamples() != SAMPLE_BUFFER_SIZE) fail("a stopped take did not fill the buffer", cycle);
+    for (uint32_t i = 1; i < (uint32_t)mic.getRecordedSamples(); i++) {
+        if (!follows(take[i - 1] / 4096, take[i] / 4096)) {
+            fail("take not consecutive", cycle);
+            break;
+        }
+    }
+    if (mic.getRecordedLevels().samples != samples) fail("take levels not of the take", cycle);
+}
+
+int main()
+{
+    hostI2sSetSource(I2S_NUM_0, counter);
+    if (!mic.setup(1, 7, 10)) return 1;
+    mic.addStreamHook(busyHook);
+    const uint32_t sizes[] = { 1000, 2000, 4000 };
+    if (!mic.reserveStream(4000)) return 1;
+    std::vector<float> slice(4000);
+    delay(100);   // warmup of the capture task
+
+    // 1. stream, record, stream, ... with checks
+    uint32_t heapBefore = heapCalls.load();
+    const int cycles = 30;
+    for (int c = 0; c < cycles; c++) {
+        if (!streamSlices(c, sizes[c % 3], 1 + c % 2, slice)) break;
+        recordTake(c, 20 + (c % 5) * 25);
+    }
+
+    // 2. quick switches, the stream never gets to a slice
+    int64_t quickStart = esp_timer_get_time();
+    const int quick = 300;
+    for (int q = 0; q < quick; q++) {
+        streamStopped = false;
+        if (!mic.startStream(sizes[q % 3])) fail("quick startStream refused", q);
+        delayMicroseconds((q % 7) * 700);
+        mic.stopStream();
+        streamStopped = true;
+    }
+    float quickMs = (esp_timer_get_time() - quickStart) / 1000.0f / quick;
+
+    // 3. stop while the capture task is in the hook: the stop has to wait for the block
+    const int inBlock = 40;
+    uint32_t slowStops = 0;
+    for (int q = 0; q < inBlock; q++) {
+        streamStopped = false;
+        if (!mic.startStream(sizes[q % 3])) fail("startStream refused", q);
+        uint32_t blocks = hookBlocks.load();
+        while (hookBlocks.load() == blocks) delayMicroseconds(50);
+        int64_t t0 = esp_timer_get_time();
+        mic.stopStream();
+        streamStopped = true;
+        slowStops += esp_timer_get_time() - t0 > 100;
+    }
+    uint32_t heap = heapCalls.load() - heapBefore;
+    MicStats single = mic.getStats();
+
+    // 4. two tasks switching the stream at the same time (no checks of the slices, only that
+    // start and stop take turns); streamStopped is not used here
+    hookAfterStop = 0;
+    streamStopped = false;
+    std::atomic<uint32_t> started{ 0 };
+    auto other = [&](int seed) {
+        for (int i = 0; i < 200; i++) {
+            if (mic.startStream(sizes[(i + seed) % 3])) started++;
+            delayMicroseconds(((i * 7 + seed) % 5) * 400);
+            mic.stopStream();
+        }
+    };
+    std::thread a(other, 0), b(other, 1);
+    a.join();
+    b.join();
+    if (mic.getMode() != MicMode::Idle) fail("not idle after the two tasks", 0);
+    streamStopped = true;
+
+    // and still works after all that
+    streamSlices(cycles, 2000, 2, slice);
+    recordTake(cycles, 60);
+
+    MicStats stats = mic.getStats();
+    mic.printStats();
+    printf("cycles: %d x (stream, record), %d quick stream starts (%.2f ms per start + stop), %u concurrent starts\n",
+           cycles, quick, quickMs, (unsigned)started.load());
+    printf("stops in the middle of a block: %u of %d waited for it\n", (unsigned)slowStops, inBlock);
+    printf("switch %.0f us average, %u us max (one DMA block is %u us); %u hook blocks, %u after stopStream()\n",
+           single.switches ? (float)single.totalSwitchUs / single.switches : 0.0f, (unsigned)single.maxSwitchUs,
+           (unsigned)(DMA_BUFFER_SIZE * 1000000ULL / SAMPLE_RATE), (unsigned)hookBlocks.load(), (unsigned)hookAfterStop.load());
+#if COUNT_HEAP
+    printf("heap calls during the cycles: %u\n", (unsigned)heap);
+    if (heap != 0) fail("heap used while switching", 0);
+#else
+    (void)heap;
+    printf("heap calls not counted (sanitizer)\n");
+#endif
+
+    if (hookAfterStop != 0) fail("the capture task ran the stream after stopStream() returned", 0);
+    if (single.maxSwitchUs > DMA_BUFFER_SIZE * 1000000ULL / SAMPLE_RATE / 2) fail("a switch waited for a DMA block", 0);
+    if (stats.allocations != 1) fail("slice buffers allocated more than once", 0);
+    if (slowStops == 0) fail("no stop came while the capture task was busy with a block", 0);
+    if (single.discarded == 0) fail("no block was ever thrown away at a switch (the check did not switch mid block)", 0);
+
+    printf("%s\n", errors == 0 ? "OK" : "FAILED");
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,406 @@
+// Replays a labelled WAV corpus through an exported Edge Impulse library, on a computer.
+//
+// Every file goes through the same path as AiWorkshopInference::tick() on the robot:
+// run_classifier_init(), then slice after slice (EI_CLASSIFIER_SLICE_SIZE samples) into
+// run_classifier_continuous(), the scores smoothed with ScoreSmoother (ai-workshop-scores.h).
+// A file counts as "heard as X" at the first slice where the smoothed score of melody X
+// reaches the threshold; background labels (noise, random) should not be heard at all.
+//
+// The report has per class accuracy, a confusion matrix, detection latency (from the start
+// of the sound, found from the audio level) and the compute time per slice. The lines of
+// the report and of the per file CSV are sorted and stable, so two models can be compared
+// with diff. The classifier keeps its state in globals, so the files are spread over one
+// process per core.
+//
+// Build it with the model library (the Arduino library zip from Edge Impulse):
+//   tools/host/build_model_eval.sh MAFAD_Classifier_inferencing.zip
+//   ./model_eval dataset/test --report model-v7.txt --csv model-v7.csv
+//   diff model-v6.txt model-v7.txt
+
+#ifndef MODEL_HEADER
+#error "Build with -DMODEL_HEADER='\"<name>_inferencing.h\"' (see build_model_eval.sh)"
+#endif
+#include MODEL_HEADER
+
+#include <ai-workshop-scores.h>
+#include <ai-workshop-wav.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <numeric>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct Options {
+    std::string corpus;
+    std::string report;
+    std::string csv;
+    float smoothing = 0.5f;       // as AiWorkshopInference::begin
+    float threshold = 0.6f;
+    std::set<std::string> background = { "noise", "random" };
+    unsigned workers = 0;
+    bool timing = true;
+};
+
+struct FileResult {
+    char heard[32];         // first label over the threshold, "-" for none
+    float peak;             // highest smoothed score of the true label
+    float onsetMs;          // start of the sound (-1: none found)
+    float detectMs;         // end of the slice that was heard (-1: not heard)
+    uint32_t slices;
+    uint8_t ok;             // readable 16 bit mono WAV at the model frequency
+};
+
+static std::vector<std::string> scan(const std::string& dir)
+{
+    std::vector<std::string> files;
+    DIR* d = opendir(dir.c_str());
+    if (!d) return files;
+    while (struct dirent* e = readdir(d)) {
+        if (e->d_name[0] == '.') continue;
+        std::string path = dir + "/" + e->d_name;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            std::vector<std::string> sub = scan(path);
+            files.insert(files.end(), sub.begin(), sub.end());
+        } else if (path.size() > 4 && path.compare(path.size() - 4, 4, ".wav") == 0) {
+            files.push_back(path);
+        }
+    }
+    closedir(d);
+    return files;
+}
+
+// the label is the start of the file name: hello_there.MAFAD000001_04000.wav
+static std::string labelOf(const std::string& path)
+{
+    size_t slash = path.rfind('/');
+    std::string name = path.substr(slash == std::string::npos ? 0 : slash + 1);
+    return name.substr(0, name.find('.'));
+}
+
+// Start of the sound: the first 10 ms frame 12 dB above the quietest tenth of the file
+static float findOnsetMs(const int16_t* samples, uint32_t count)
+{
+    const uint32_t frame = EI_CLASSIFIER_FREQUENCY / 100;
+    std::vector<float> energy;
+    for (uint32_t at = 0; at + frame <= count; at += frame) {
+        double sum = 0.0;
+        for (uint32_t i = 0; i < frame; i++) sum += (double)samples[at + i] * samples[at + i];
+        energy.push_back((float)(sum / frame) + 1.0f);
+    }
+    if (energy.empty()) return -1.0f;
+    std::vector<float> sorted = energy;
+    std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 10, sorted.end());
+    float floor = sorted[sorted.size() / 10];
+    for (size_t i = 0; i < energy.size(); i++) {
+        if (energy[i] > floor * 16.0f) return i * 10.0f;
+    }
+    return -1.0f;
+}
+
+// --- the classifier, one file at a time (in a worker process) ---
+
+static const int16_t* g_slice = nullptr;
+
+static int getSliceData(size_t offset, size_t length, float* out_ptr)
+{
+    return numpy::int16_to_float(g_slice + offset, out_ptr, length);
+}
+
+static FileResult evaluate(const std::string& path, const Options& options, std::vector<float>& sliceMs)
+{
+    FileResult result;
+    memset(&result, 0, sizeof(result));
+    snprintf(result.heard, sizeof(result.heard), "-");
+    result.onsetMs = -1.0f;
+    result.detectMs = -1.0f;
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return result;
+    struct stat st;
+    fstat(fd, &st);
+    size_t size = (size_t)st.st_size;
+    const uint8_t* data = size ? (const uint8_t*)mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : (const uint8_t*)MAP_FAILED;
+    close(fd);
+    if (data == MAP_FAILED) return result;
+
+    WavInfo info;
+    if (parseWavHeader(data, (uint32_t)size, info) && info.channels == 1 && info.sampleRate == EI_CLASSIFIER_FREQUENCY) {
+        result.ok = 1;
+        const int16_t* samples = (const int16_t*)(data + info.dataOffset);
+        result.onsetMs = findOnsetMs(samples, info.numSamples);
+
+        std::string truth = labelOf(path);
+        ScoreSmoother scores(options.smoothing);
+        run_classifier_init();
+
+        for (uint32_t at = 0; at + EI_CLASSIFIER_SLICE_SIZE <= info.numSamples; at += EI_CLASSIFIER_SLICE_SIZE) {
+            g_slice = samples + at;
+            signal_t signal;
+            signal.total_length = EI_CLASSIFIER_SLICE_SIZE;
+            signal.get_data = &getSliceData;
+            ei_impulse_result_t ei = {};
+
+            auto start = std::chrono::steady_clock::now();
+            EI_IMPULSE_ERROR error = run_classifier_continuous(&signal, &ei, false);
+            sliceMs.push_back(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+            if (error != EI_IMPULSE_OK) {
+                result.ok = 0;
+                break;
+            }
+            result.slices++;
+
+            scores.update(ei, EI_CLASSIFIER_LABEL_COUNT);
+            for (size_t ix = 0; ix < EI_CLASSIFIER_LABEL_COUNT; ix++) {
+                if (truth == ei.classification[ix].label) result.peak = std::max(result.peak, scores.score(ix));
+            }
+            int top = scores.topIndex();
+            if (result.detectMs < 0.0f && top >= 0 && scores.topScore() >= options.threshold &&
+                !options.background.count(ei.classification[top].label)) {
+                snprintf(result.heard, sizeof(result.heard), "%s", ei.classification[top].label);
+                result.detectMs = (at + EI_CLASSIFIER_SLICE_SIZE) * 1000.0f / EI_CLASSIFIER_FREQUENCY;
+            }
+        }
+    }
+    munmap((void*)data, size);
+    return result;
+}
+
+// --- parallel: one process per core, taking files from a shared counter ---
+
+static void runWorkers(const std::vector<std::string>& files, const Options& options, std::vector<FileResult>& results,
+                       std::vector<float>& sliceMs)
+{
+    size_t resultBytes = files.size() * sizeof(FileResult);
+    void* shared = mmap(nullptr, sizeof(std::atomic<uint32_t>) + resultBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    std::atomic<uint32_t>* next = new (shared) std::atomic<uint32_t>(0);
+    FileResult* out = (FileResult*)((uint8_t*)shared + sizeof(std::atomic<uint32_t>));
+
+    // the slice times go through a temporary file per worker
+    std::vector<FILE*> timeFiles;
+    std::vector<pid_t> children;
+    for (unsigned w = 0; w < options.workers; w++) {
+        FILE* times = tmpfile();
+        timeFiles.push_back(times);
+        fflush(nullptr);
+        pid_t pid = fork();
+        if (pid == 0) {
+            std::vector<float> ms;
+            for (uint32_t i = (*next)++; i < files.size(); i = (*next)++) out[i] = evaluate(files[i], options, ms);
+            fwrite(ms.data(), sizeof(float), ms.size(), times);
+            fflush(times);
+            _exit(0);
+        }
+        if (pid < 0) {
+            perror("fork");
+            exit(1);
+        }
+        children.push_back(pid);
+    }
+    for (pid_t pid : children) waitpid(pid, nullptr, 0);
+
+    results.assign(out, out + files.size());
+    for (FILE* times : timeFiles) {
+        rewind(times);
+        float value;
+        while (fread(&value, sizeof(value), 1, times) == 1) sliceMs.push_back(value);
+        fclose(times);
+    }
+    munmap(shared, sizeof(std::atomic<uint32_t>) + resultBytes);
+}
+
+static float percentile(std::vector<float> values, float p)
+{
+    if (values.empty()) return 0.0f;
+    size_t k = (size_t)(p * (values.size() - 1) + 0.5f);
+    std::nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k];
+}
+
+static void usage()
+{
+    fprintf(stderr,
+            "usage: model_eval <wav folder> [options]\n"
+            "  --report FILE        also write the report to FILE\n"
+            "  --csv FILE           one line per file: file,truth,heard,peak,onset_ms,detect_ms,latency_ms\n"
+            "  --smoothing S        score smoothing as AiWorkshopInference (default 0.5)\n"
+            "  --threshold T        smoothed score that counts as heard (default 0.6)\n"
+            "  --background A,B     labels that should not be heard (default noise,random)\n"
+            "  --workers N          processes (default all cores)\n"
+            "  --no-timing          leave the compute times out of the report (for diffs across machines)\n");
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                usage();
+                exit(2);
+            }
+            return argv[++i];
+        };
+        if (arg == "--report") options.report = value();
+        else if (arg == "--csv") options.csv = value();
+        else if (arg == "--smoothing") options.smoothing = (float)atof(value());
+        else if (arg == "--threshold") options.threshold = (float)atof(value());
+        else if (arg == "--background") {
+            options.background.clear();
+            std::string list = value();
+            size_t start = 0;
+            while (start <= list.size()) {
+                size_t comma = list.find(',', start);
+                if (comma == std::string::npos) comma = list.size();
+                if (comma > start) options.background.insert(list.substr(start, comma - start));
+                start = comma + 1;
+            }
+        } else if (arg == "--workers") options.workers = (unsigned)atoi(value());
+        else if (arg == "--no-timing") options.timing = false;
+        else if (arg == "-h" || arg == "--help") {
+            usage();
+            return 0;
+        } else if (options.corpus.empty()) options.corpus = arg;
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (options.corpus.empty()) {
+        usage();
+        return 2;
+    }
+    if (options.workers == 0) options.workers = (unsigned)std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+
+    std::vector<std::string> files = scan(options.corpus);
+    std::sort(files.begin(), files.end());
+    if (files.empty()) {
+        fprintf(stderr, "no .wav files in %s\n", options.corpus.c_str());
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<FileResult> results;
+    std::vector<float> sliceMs;
+    runWorkers(files, options, results, sliceMs);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // the model's labels, melodies first, then what should not be heard ("-")
+    std::vector<std::string> columns;
+    for (size_t ix = 0; ix < EI_CLASSIFIER_LABEL_COUNT; ix++) {
+        if (!options.background.count(ei_classifier_inferencing_categories[ix])) columns.push_back(ei_classifier_inferencing_categories[ix]);
+    }
+    columns.push_back("-");
+
+    std::map<std::string, std::map<std::string, uint32_t>> confusion;   // truth -> heard -> files
+    std::map<std::string, std::vector<float>> latency;                  // truth -> ms
+    uint32_t correct = 0, evaluated = 0, unreadable = 0;
+    FILE* csv = options.csv.empty() ? nullptr : fopen(options.csv.c_str(), "w");
+    if (csv) fprintf(csv, "file,truth,heard,peak,onset_ms,detect_ms,latency_ms\n");
+    for (size_t i = 0; i < files.size(); i++) {
+        const FileResult& r = results[i];
+        if (!r.ok) {
+            fprintf(stderr, "%s: not a 16 bit mono WAV at %d Hz (or the classifier failed)\n", files[i].c_str(), EI_CLASSIFIER_FREQUENCY);
+            unreadable++;
+            continue;
+        }
+        std::string truth = labelOf(files[i]);
+        bool isBackground = options.background.count(truth) > 0;
+        std::string row = isBackground ? "-" : truth;
+        confusion[row][r.heard]++;
+        evaluated++;
+        if (row == r.heard) correct++;
+
+        float lat = -1.0f;
+        if (!isBackground && row == r.heard && r.onsetMs >= 0.0f) {
+            lat = r.detectMs - r.onsetMs;
+            latency[row].push_back(lat);
+        }
+        if (csv) {
+            fprintf(csv, "%s,%s,%s,%.3f,%.0f,%.0f,%.0f\n", files[i].c_str(), truth.c_str(), r.heard, r.peak, r.onsetMs,
+                    r.detectMs, lat);
+        }
+    }
+    if (csv) fclose(csv);
+
+    // rows: the model's melodies, labels the model does not know, then the background
+    std::vector<std::string> rows(columns.begin(), columns.end() - 1);
+    for (auto& entry : confusion) {
+        if (entry.first != "-" && std::find(rows.begin(), rows.end(), entry.first) == rows.end()) rows.push_back(entry.first);
+    }
+    rows.push_back("-");
+
+    // the report: stable lines, so it can be diffed
+    std::string report;
+    char line[512];
+    auto add = [&](const char* format, auto... args) {
+        snprintf(line, sizeof(line), format, args...);
+        report += line;
+    };
+    add("model %s, %d labels, slice %d samples, smoothing %.2f, threshold %.2f\n", MODEL_HEADER, EI_CLASSIFIER_LABEL_COUNT,
+        EI_CLASSIFIER_SLICE_SIZE, options.smoothing, options.threshold);
+    add("%u files, %.1f%% correct\n\n", evaluated, evaluated ? 100.0f * correct / evaluated : 0.0f);
+
+    add("%-14s %6s %9s %11s %11s\n", "class", "files", "accuracy", "latency p50", "latency p90");
+    for (const std::string& row : rows) {
+        if (!confusion.count(row)) continue;
+        uint32_t total = 0;
+        for (auto& entry : confusion[row]) total += entry.second;
+        std::vector<float>& ms = latency[row];
+        if (ms.empty()) {
+            add("%-14s %6u %8.1f%% %11s %11s\n", row == "-" ? "(background)" : row.c_str(), total, 100.0f * confusion[row][row] / total, "", "");
+        } else {
+            add("%-14s %6u %8.1f%% %8.0f ms %8.0f ms\n", row.c_str(), total, 100.0f * confusion[row][row] / total,
+                percentile(ms, 0.5f), percentile(ms, 0.9f));
+        }
+    }
+
+    add("\nconfusion (rows: truth, columns: heard, -: nothing / background)\n%-14s", "");
+    for (const std::string& column : columns) add(" %12.12s", column.c_str());
+    add("\n");
+    for (const std::string& row : rows) {
+        if (!confusion.count(row)) continue;
+        add("%-14s", row.c_str());
+        for (const std::string& column : columns) add(" %12u", confusion[row][column]);
+        add("\n");
+    }
+
+    if (options.timing) {
+        add("\ncompute per slice: mean %.2f ms, p50 %.2f ms, p95 %.2f ms, max %.2f ms (%zu slices, this computer)\n",
+            sliceMs.empty() ? 0.0 : std::accumulate(sliceMs.begin(), sliceMs.end(), 0.0) / sliceMs.size(), percentile(sliceMs, 0.5f), percentile(sliceMs, 0.95f),
+            sliceMs.empty() ? 0.0f : *std::max_element(sliceMs.begin(), sliceMs.end()), sliceMs.size());
+    }
+
+    fputs(report.c_str(), stdout);
+    if (!options.report.empty()) {
+        FILE* out = fopen(options.report.c_str(), "w");
+        if (out) {
+            fputs(report.c_str(), out);
+            fclose(out);
+        }
+    }
+    fprintf(stderr, "%zu files in %.1f s on %u process%s%s\n", files.size(), seconds, options.workers, options.workers == 1 ? "" : "es",
+            unreadable ? ", some files were skipped" : "");
+    return 0;
+}
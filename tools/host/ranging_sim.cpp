@@ -0,0 +1,430 @@
+// Acoustic ranging check of ChirpCorrelator and Ranger (ai-workshop-ranging.h) on the host stand-in.
+//
+// Part 1, samples only (no threads): chirps at known fractional start samples (windowed sinc
+// delay), with noise, reflections and an inverted speaker, through the matched filter:
+//   - every chirp found, of the right kind, and how far off the start sample is (in cm)
+//   - no chirps found in loud noise and music
+//   - the cost per hop on this machine
+// Part 2, in real time: robot A is a Ranger with AudioOut on I2S0 and the microphone on I2S1.
+// The world takes what A plays (the sink of I2S0) and delays it to A's own microphone and to
+// a virtual robot B (a ChirpCorrelator in the world) at a distance, with an echo and noise.
+// B answers pings replyMs after it heard them (its clock 20 ppm off) and pings A itself, while
+// other threads keep every core busy (inference), so:
+//   - A measures the distances to B
+//   - B measures the distances to A: A placed its pongs on the right sample
+//   - no answer from B: A reports it
+//   - the cost of the matched filter (printStats())
+//
+//   g++ -std=gnu++17 -O2 -pthread -I tools/host/include -I libraries/MAFAD_Workshop/src tools/host/ranging_sim.cpp -o ranging_sim
+//   ./ranging_sim
+
+#include <Arduino.h>
+#include <ai-workshop-main.h>
+#include <ai-workshop-mic.h>
+#include <ai-workshop-audio-out.h>
+#include <ai-workshop-ranging.h>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+uint32_t randomness = 0;
+
+static bool ok = true;
+
+static void check(bool condition, const char* what)
+{
+    if (!condition) {
+        printf("FAIL: %s\n", what);
+        ok = false;
+    }
+}
+
+static uint32_t lcg = 12345;
+static float uniform()
+{
+    lcg = lcg * 1664525u + 1013904223u;
+    return ((lcg >> 8) + 0.5f) / 16777216.0f;
+}
+static float gaussian() { return sqrtf(-2.0f * logf(uniform())) * cosf(2.0f * (float)M_PI * uniform()); }
+
+// a chirp that starts at a fractional sample
+static void addChirp(std::vector<float>& signal, double start, float amplitude, ChirpKind kind, const RangingConfig& config)
+{
+    const uint32_t count = (uint32_t)config.chirpMs * SAMPLE_RATE / 1000 + 1;
+    std::vector<float> chirp(count);
+    size_t first = (size_t)floor(start);
+    ChirpCorrelator::makeChirp(chirp.data(), count, config, kind, (float)(start - first), amplitude);
+    for (uint32_t i = 0; i < count && first + i < signal.size(); i++) signal[first + i] += chirp[i];
+}
+
+// one sample at a fractional position (windowed sinc, 8 taps per side)
+static void splat(std::vector<float>& signal, double position, float value)
+{
+    long center = (long)floor(position);
+    double frac = position - center;
+    for (long k = -7; k <= 8; k++) {
+        long i = center + k;
+        if (i < 0 || i >= (long)signal.size()) continue;
+        double x = k - frac;
+        double sinc = fabs(x) < 1e-9 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+        double window = 0.5 + 0.5 * cos(M_PI * x / 9.0);
+        signal[i] += (float)(value * sinc * window);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------
+// Part 1
+
+struct Truth { double start; ChirpKind kind; };
+
+struct Sweep
+{
+    int chirps = 0, found = 0, wrongKind = 0, extra = 0;
+    double sum = 0, sumSquares = 0, worst = 0;
+};
+
+static Sweep runSweep(const char* name, float amplitude, float noise, float echoGain, float echoMs, const RangingConfig& config)
+{
+    const int count = 40;
+    const uint32_t spacing = SAMPLE_RATE / 5;
+    std::vector<float> signal((count + 2) * spacing, 0.0f);
+    std::vector<Truth> truth;
+    for (int i = 0; i < count; i++) {
+        double start = (i + 1) * spacing + uniform() * 500.0;
+        ChirpKind kind = uniform() < 0.5f ? ChirpKind::Ping : ChirpKind::Pong;
+        addChirp(signal, start, amplitude, kind, config);
+        if (echoGain != 0.0f) addChirp(signal, start + echoMs * SAMPLE_RATE / 1000.0, amplitude * echoGain, kind, config);
+        truth.push_back({ start, kind });
+    }
+    for (float& v : signal) v += noise * gaussian();
+
+    ChirpCorrelator correlator;
+    correlator.begin(config);
+    std::vector<ChirpDetection> found;
+    for (size_t i = 0; i < signal.size(); i += 1024) {
+        correlator.process(&signal[i], (uint32_t)std::min<size_t>(1024, signal.size() - i));
+        ChirpDetection d;
+        while (correlator.next(d)) found.push_back(d);
+    }
+
+    Sweep s;
+    s.chirps = count;
+    std::vector<bool> used(found.size(), false);
+    for (const Truth& t : truth) {
+        for (size_t j = 0; j < found.size(); j++) {
+            if (used[j] || fabs(found[j].sample - t.start) > 20.0) continue;
+            used[j] = true;
+            if (found[j].kind != t.kind) {
+                s.wrongKind++;
+                break;
+            }
+            double error = found[j].sample - t.start;
+            s.found++;
+            s.sum += error;
+            s.sumSquares += error * error;
+            if (fabs(error) > fabs(s.worst)) s.worst = error;
+            break;
+        }
+    }
+    for (bool u : used) s.extra += u ? 0 : 1;
+
+    const double cmPerSample = config.speedOfSound * 100.0 / SAMPLE_RATE;
+    double mean = s.found ? s.sum / s.found : 0.0;
+    double sd = s.found ? sqrt(std::max(0.0, s.sumSquares / s.found - mean * mean)) : 0.0;
+    printf("%-28s %2d/%d found, %d wrong kind, %d extra | start %+.3f +- %.3f samples (worst %+.3f) = %+.2f +- %.2f cm\n", name,
+           s.found, s.chirps, s.wrongKind, s.extra, mean, sd, s.worst, mean * cmPerSample, sd * cmPerSample);
+    return s;
+}
+
+static void part1(const RangingConfig& config)
+{
+    printf("-- matched filter, %u sample chirps, %u sample hops --\n", (unsigned)(config.chirpMs * SAMPLE_RATE / 1000),
+           (unsigned)(RANGING_FFT_SIZE - config.chirpMs * SAMPLE_RATE / 1000 + 1));
+    const double cmPerSample = config.speedOfSound * 100.0 / SAMPLE_RATE;
+    struct Case { const char* name; float amplitude, noise, echoGain, echoMs; double maxSd; };
+    const Case cases[] = {
+        { "loud", 3000.0f, 30.0f, 0.0f, 0.0f, 0.05 },
+        { "quiet", 300.0f, 30.0f, 0.0f, 0.0f, 0.1 },
+        { "very quiet (snr 30)", 60.0f, 30.0f, 0.0f, 0.0f, 0.3 },
+        { "inverted speaker", -1000.0f, 30.0f, 0.0f, 0.0f, 0.05 },
+        { "echo 0.6 after 1.7 ms", 1000.0f, 30.0f, 0.6f, 1.7f, 0.1 },
+        { "echo 1.4 after 2 ms", 700.0f, 30.0f, 1.4f, 2.0f, 0.1 },
+    };
+    for (const Case& c : cases) {
+        Sweep s = runSweep(c.name, c.amplitude, c.noise, c.echoGain, c.echoMs, config);
+        double mean = s.found ? s.sum / s.found : 0.0;
+        double sd = s.found ? sqrt(std::max(0.0, s.sumSquares / s.found - mean * mean)) : 0.0;
+        check(s.found == s.chirps && s.wrongKind == 0 && s.extra == 0, c.name);
+        check(fabs(mean) < 0.2 && sd < c.maxSd && fabs(s.worst) * cmPerSample < 2.0, "start of the chirps");
+    }
+
+    // loud noise and music: 30 s, nothing may be found
+    std::vector<float> signal(30 * SAMPLE_RATE);
+    const float notes[] = { 262, 330, 392, 523, 440, 349, 294, 659, 784, 1047 };
+    for (size_t i = 0; i < signal.size(); i++) {
+        float t = (float)i / SAMPLE_RATE;
+        int note = (int)(t * 4) % 10;
+        signal[i] = 300.0f * gaussian() + 3000.0f * sinf(2.0f * (float)M_PI * notes[note] * t) +
+                    1000.0f * sinf(4.0f * (float)M_PI * notes[note] * t);
+    }
+    ChirpCorrelator correlator;
+    correlator.begin(config);
+    int falseChirps = 0;
+    uint32_t hops = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < signal.size(); i += 1024) {
+        hops += correlator.process(&signal[i], (uint32_t)std::min<size_t>(1024, signal.size() - i));
+        ChirpDetection d;
+        while (correlator.next(d)) falseChirps++;
+    }
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    double hopMs = 1000.0 * correlator.hopSamples() / SAMPLE_RATE;
+    printf("30 s of noise and music: %d chirps found | %.1f us per %.1f ms hop (%.2f%% of a core here)\n", falseChirps, us / hops,
+           hopMs, 100.0 * us / 1000.0 / hops / hopMs);
+    check(falseChirps == 0, "no chirps in noise and music");
+}
+
+// ---------------------------------------------------------------------------------------------
+// Part 2
+
+static const uint32_t worldFrames = 60 * SAMPLE_RATE;
+static const float noiseLevel = 20.0f;
+static const float selfGain = 0.3f;    // speaker to the own microphone (5 cm)
+static const double driftB = 20e-6;    // the clock of B runs this much fast
+
+struct World
+{
+    std::mutex m;
+    RangingConfig config;
+    std::vector<float> atA, atB;       // what the microphones of A and B hear, by sample of A's microphone
+    double distance = 1.0;             // between A and B
+    bool bAnswers = true;
+
+    ChirpCorrelator b;
+    bool bPingRequest = false;
+    double bPingAt = -1.0;             // B's own ping (where B hears it)
+    double bPingHeard = -1.0;
+    std::vector<float> bDistances;
+    int bAnswered = 0;
+
+    double delay(double meters) const { return meters / config.speedOfSound * SAMPLE_RATE; }
+    float gain(double meters) const { return selfGain * (float)(config.selfDistanceM / meters); }
+
+    // a chirp of B from its speaker at `at`
+    void chirpOfB(double at, ChirpKind kind)
+    {
+        addChirp(atB, at + delay(config.selfDistanceM), 32000.0f * config.volume * selfGain, kind, config);
+        addChirp(atA, at + delay(distance), 32000.0f * config.volume * gain(distance), kind, config);
+    }
+
+    // A played `count` samples, the first one at `at` (a sample of A's microphone)
+    void played(const int16_t* samples, size_t count, double at)
+    {
+        std::lock_guard<std::mutex> lock(m);
+        const double self = delay(config.selfDistanceM), toB = delay(distance), echo = delay(distance + 2.0);
+        const float toBGain = gain(distance), echoGain = 0.5f * gain(distance + 2.0);
+        for (size_t i = 0; i < count; i++) {
+            if (samples[i] == 0) continue;
+            splat(atA, at + i + self, samples[i] * selfGain);
+            splat(atB, at + i + toB, samples[i] * toBGain);
+            splat(atB, at + i + echo, samples[i] * echoGain);
+        }
+    }
+
+    // A's microphone reads frames [first, first + count); B hears the same ones
+    void capture(int32_t* out, size_t count, uint64_t first)
+    {
+        std::lock_guard<std::mutex> lock(m);
+        if (first + count + 20000 > worldFrames) {
+            memset(out, 0, count * sizeof(int32_t));
+            return;
+        }
+        for (size_t i = 0; i < count; i++) {
+            out[i] = (int32_t)((atA[first + i] + noiseLevel * gaussian()) * 4096.0f);
+            atB[first + i] += noiseLevel * gaussian();
+        }
+
+        b.process(&atB[first], (uint32_t)count);
+        ChirpDetection d;
+        const double reply = config.replyMs * SAMPLE_RATE / 1000.0;
+        while (b.next(d)) {
+            if (d.kind == ChirpKind::Ping && bPingAt >= 0.0 && fabs(d.sample - bPingAt) < 5.0) {
+                bPingHeard = d.sample;
+            } else if (d.kind == ChirpKind::Ping && bAnswers) {
+                // heard by B itself replyMs (of B's clock) later
+                chirpOfB(d.sample + reply * (1.0 + driftB) - delay(config.selfDistanceM), ChirpKind::Pong);
+                bAnswered++;
+            } else if (d.kind == ChirpKind::Pong && bPingHeard >= 0.0 && d.sample > bPingHeard + reply - 20.0) {
+                double roundTrip = (d.sample - bPingHeard - reply * (1.0 + driftB)) / SAMPLE_RATE;
+                bDistances.push_back((float)(config.speedOfSound * roundTrip / 2.0 + config.selfDistanceM));
+                bPingHeard = -1.0;
+                bPingAt = -1.0;
+            }
+        }
+        if (bPingRequest) {
+            bPingRequest = false;
+            double at = (double)(first + count) + 2000.0;
+            chirpOfB(at, ChirpKind::Ping);
+            bPingAt = at + delay(config.selfDistanceM);
+            bPingHeard = -1.0;
+        }
+    }
+};
+
+// the tasks still run when main() returns: never destroyed
+static World& world = *new World;
+static i2sMic& mic = *new i2sMic;
+static AudioOut& audio = *new AudioOut;
+static Ranger& ranger = *new Ranger;
+
+// A's output samples to A's microphone samples: both I2S clocks start at their t0
+static double outputToMic(uint64_t frame)
+{
+    std::chrono::steady_clock::time_point tx, rx;
+    {
+        HostI2sPort& p = hostI2sPort(I2S_NUM_0);
+        std::lock_guard<std::mutex> lock(p.m);
+        tx = p.t0;
+    }
+    {
+        HostI2sPort& p = hostI2sPort(I2S_NUM_1);
+        std::lock_guard<std::mutex> lock(p.m);
+        rx = p.t0;
+    }
+    return frame + std::chrono::duration<double>(tx - rx).count() * SAMPLE_RATE;
+}
+
+static void waitMs(uint32_t ms)
+{
+    uint32_t start = millis();
+    while (millis() - start < ms) {
+        if (mic.isStreamReady()) mic.consumeStream();
+        delay(2);
+    }
+}
+
+static bool waitResult(RangingResult& result)
+{
+    uint32_t start = millis();
+    while (millis() - start < 2000) {
+        if (ranger.getResult(result)) return true;
+        waitMs(5);
+    }
+    return false;
+}
+
+static void part2(const RangingConfig& config)
+{
+    printf("-- two robots, in real time --\n");
+    world.config = config;
+    world.atA.assign(worldFrames, 0.0f);
+    world.atB.assign(worldFrames, 0.0f);
+    world.b.begin(config);
+
+    hostI2sSetSink(I2S_NUM_0, [](const void* data, size_t bytes) {
+        size_t count = bytes / 2;
+        uint64_t first;
+        {
+            HostI2sPort& p = hostI2sPort(I2S_NUM_0);
+            std::lock_guard<std::mutex> lock(p.m);
+            first = p.frames - count;   // this write
+        }
+        world.played((const int16_t*)data, count, outputToMic(first));
+    });
+    hostI2sSetSource(I2S_NUM_1, [](int32_t* out, size_t count, uint32_t, uint64_t first) { world.capture(out, count, first); });
+
+    check(audio.begin(11), "audio out");
+    check(mic.setup(1, 7, 10, I2S_NUM_1), "mic setup");
+    check(ranger.begin(mic, audio, config), "ranger begin");
+    check(mic.startStream(4000), "startStream");
+    waitMs(300);
+    check(!ranger.isCalibrated(), "not calibrated before a chirp");
+    check(ranger.calibrate(), "calibrate");
+
+    // every core busy (the classifier and more) while the robots measure
+    std::atomic<bool> busy{ true };
+    std::vector<std::thread> load;
+    unsigned cores = std::thread::hardware_concurrency();
+    for (unsigned i = 0; i < (cores ? cores : 2); i++) {
+        load.emplace_back([&] {
+            volatile uint32_t x = 0;
+            while (busy) x = x * 1664525u + 1013904223u;
+        });
+    }
+
+    const float distances[] = { 0.5f, 1.0f, 2.0f, 4.0f };
+    const int repeats = 3;
+    float worstA = 0.0f, worstB = 0.0f;
+    int okA = 0, okB = 0;
+    for (float distance : distances) {
+        {
+            std::lock_guard<std::mutex> lock(world.m);
+            world.distance = distance;
+            world.bDistances.clear();
+        }
+        waitMs(100);
+        printf("%.1f m | A:", distance);
+        for (int i = 0; i < repeats; i++) {
+            check(ranger.ping(), "ping");
+            RangingResult r;
+            bool got = waitResult(r);
+            check(got && r.status == RangingStatus::Ok, "a distance from A");
+            if (got && r.status == RangingStatus::Ok) {
+                okA++;
+                printf(" %.3f", r.distanceM);
+                worstA = std::max(worstA, fabsf(r.distanceM - distance));
+            }
+            waitMs(150);
+        }
+        printf(" | B:");
+        for (int i = 0; i < repeats; i++) {
+            {
+                std::lock_guard<std::mutex> lock(world.m);
+                world.bPingRequest = true;
+            }
+            waitMs(600);
+        }
+        std::lock_guard<std::mutex> lock(world.m);
+        for (float d : world.bDistances) {
+            printf(" %.3f", d);
+            worstB = std::max(worstB, fabsf(d - distance));
+        }
+        okB += (int)world.bDistances.size();
+        printf("\n");
+    }
+    busy = false;
+    for (auto& t : load) t.join();
+    printf("A measured %d of %d, worst %.1f cm off | B measured %d of %d (A answered), worst %.1f cm off\n", okA,
+           repeats * 4, worstA * 100.0f, okB, repeats * 4, worstB * 100.0f);
+    check(okA == repeats * 4 && worstA < 0.02f, "A's distances");
+    check(okB == repeats * 4 && worstB < 0.02f, "B's distances: A's pongs on time");
+
+    // B does not answer
+    {
+        std::lock_guard<std::mutex> lock(world.m);
+        world.bAnswers = false;
+    }
+    check(ranger.ping(), "ping");
+    RangingResult r;
+    check(waitResult(r) && r.status == RangingStatus::NoAnswer, "no answer reported");
+
+    RangingStats s = ranger.getStats();
+    check(s.answers == (uint32_t)repeats * 4 && s.lateAnswers == 0 && s.uncalibrated == 0 && s.gaps == 0, "A answered every ping");
+    check(s.maxAnswerErrorUs < 20.0f, "A heard its pongs where it placed them");
+    ranger.printStats(Serial);
+    audio.printStats(Serial);
+}
+
+int main()
+{
+    RangingConfig config;
+    part1(config);
+    part2(config);
+    printf(ok ? "OK\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,166 @@
+// Result channel check of ResultChannel (ai-workshop-results.h) on the host stand-in.
+//
+// One thread publishes results as fast as it can, three threads read them at the same time:
+//   - next():   every result once and in order (or counted as lost), never a torn record
+//   - latest(): never older than the one before, never torn
+//   - since() / series(): only results after the asked time, oldest first
+//   - a model with SCORES_MAX_LABELS labels keeps every score and the top label
+// Every score of a record is made from its sequence number, so a torn record (half old,
+// half new) is always noticed. Prints the cost of a publish next to copying a full
+// classifier result the old way (memcpy into a volatile struct).
+//
+//   g++ -std=gnu++17 -O2 -pthread -I tools/host/include -I libraries/MAFAD_Workshop/src tools/host/results_sim.cpp -o results_sim
+//   ./results_sim [results]
+// Also worth a run with -fsanitize=thread: every shared access is atomic, so it reports no races
+// (it warns that it cannot follow the fences; those only matter for the order on real cores).
+
+#include <Arduino.h>
+#include <ai-workshop-scores.h>
+#include <ai-workshop-results.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+static constexpr uint8_t kLabels = 4;
+
+static uint16_t expected(uint32_t sequence, uint8_t label)
+{
+    return (uint16_t)((sequence * 7 + label * 1001) % 4000);
+}
+
+static bool intact(const ResultRecord& r)
+{
+    if (r.count != kLabels || r.timeUs != (int64_t)r.sequence * 1000 || r.classifyUs != r.sequence) return false;
+    for (uint8_t i = 0; i < kLabels; i++) {
+        if (r.scoresQ[i] != expected(r.sequence, i)) return false;
+    }
+    return r.top == (int8_t)(r.sequence % kLabels) && r.topScoreQ == r.scoresQ[r.top];
+}
+
+static void publish(ResultChannel& channel, uint32_t sequence)
+{
+    float scores[kLabels];
+    for (uint8_t i = 0; i < kLabels; i++) scores[i] = expected(sequence, i) / (float)RESULTS_SCORE_ONE;
+    channel.publishScores(scores, kLabels, sequence % kLabels, sequence, (int64_t)sequence * 1000);
+}
+
+// About what a 4 label model's ei_impulse_result_t holds: boxes, scores, anomaly, timing
+struct EiResultLike
+{
+    void* boxes;
+    uint32_t boxCount;
+    struct { const char* label; float value; } classification[kLabels];
+    float anomaly;
+    int timing[5];
+    int64_t timingUs[3];
+    void* gridCells;
+    uint32_t gridCount;
+    bool postprocessed;
+};
+
+int main(int argc, char** argv)
+{
+    const uint32_t total = argc > 1 ? (uint32_t)atoi(argv[1]) : 2000000;
+    static ResultChannel channel;
+    std::atomic<bool> done{ false };
+    bool ok = true;
+
+    std::atomic<uint32_t> torn{ 0 }, disorder{ 0 };
+    uint32_t readAll = 0, lost = 0, readLatest = 0, sinceCalls = 0, sinceRecords = 0;
+
+    std::thread inOrder([&] {
+        uint32_t cursor = 0, last = 0;
+        ResultRecord r;
+        while (!done.load() || cursor < channel.head()) {
+            while (channel.next(cursor, r, &lost)) {
+                if (!intact(r)) torn++;
+                if (r.sequence <= last) disorder++;
+                last = r.sequence;
+                readAll++;
+            }
+        }
+    });
+    std::thread newest([&] {
+        uint32_t last = 0;
+        ResultRecord r;
+        while (!done.load()) {
+            if (!channel.latest(r)) continue;
+            if (!intact(r)) torn++;
+            if (r.sequence < last) disorder++;
+            last = r.sequence;
+            readLatest++;
+        }
+    });
+    std::thread window([&] {
+        ResultRecord records[16];
+        float scores[16];
+        int64_t times[16];
+        while (!done.load()) {
+            uint32_t head = channel.head();
+            if (head < 32) continue;
+            int64_t from = (int64_t)(head - 10) * 1000;
+            size_t n = channel.since(from, records, 16);
+            for (size_t i = 0; i < n; i++) {
+                if (!intact(records[i])) torn++;
+                if (records[i].timeUs <= from || (i > 0 && records[i].sequence <= records[i - 1].sequence)) disorder++;
+            }
+            size_t m = channel.series(1, from, scores, times, 16);
+            for (size_t i = 0; i < m; i++) {
+                uint32_t sequence = (uint32_t)(times[i] / 1000);
+                if (times[i] <= from || (uint16_t)(scores[i] * RESULTS_SCORE_ONE + 0.5f) != expected(sequence, 1)) torn++;
+            }
+            sinceCalls++;
+            sinceRecords += n;
+        }
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t sequence = 1; sequence <= total; sequence++) publish(channel, sequence);
+    double publishNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / total;
+    done = true;
+    inOrder.join();
+    newest.join();
+    window.join();
+
+    // the single threaded costs, without readers in the way
+    static ResultChannel quiet;
+    static volatile EiResultLike shared;
+    EiResultLike result = {};
+    float scores[kLabels] = { 0.1f, 0.7f, 0.15f, 0.05f };
+    start = std::chrono::steady_clock::now();
+    for (uint32_t sequence = 1; sequence <= total; sequence++) quiet.publishScores(scores, kLabels, 1, sequence, sequence);
+    double quietNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / total;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < total; i++) {
+        result.classification[0].value = (float)i;
+        memcpy((void*)&shared, &result, sizeof(result));
+    }
+    double copyNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / total;
+
+    printf("%u results published, %.1f ns each (%.1f ns without readers), record %zu bytes\n", total, publishNs, quietNs,
+           sizeof(ResultRecord));
+    printf("old way: memcpy of a %zu byte result %.1f ns (plus the results it dropped)\n", sizeof(EiResultLike), copyNs);
+    printf("next():   %u read, %u lost (overwritten first), %u + %u = %s\n", readAll, lost, readAll, lost,
+           readAll + lost == total ? "all" : "MISSING");
+    printf("latest(): %u reads; since(): %u calls, %u records; %u copies retried\n", readLatest, sinceCalls, sinceRecords,
+           channel.getRetries());
+    // a model with as many labels as the scores keep: every score and the top label in the record
+    static ResultChannel wide;
+    float many[SCORES_MAX_LABELS];
+    for (uint8_t i = 0; i < SCORES_MAX_LABELS; i++) many[i] = 0.01f * (i + 1);
+    wide.publishScores(many, SCORES_MAX_LABELS, SCORES_MAX_LABELS - 1, 1);
+    ResultRecord last;
+    bool allScores = wide.latest(last) && last.count == SCORES_MAX_LABELS && last.top == SCORES_MAX_LABELS - 1;
+    for (uint8_t i = 0; i < SCORES_MAX_LABELS && allScores; i++) allScores = fabsf(last.score(i) - many[i]) < 1.0f / RESULTS_SCORE_ONE;
+    printf("%u labels: %s\n", (unsigned)SCORES_MAX_LABELS, allScores ? "every score and the top label kept" : "SCORES LOST");
+    if (!allScores) ok = false;
+
+    if (torn || disorder || readAll + lost != total) {
+        printf("FAIL: %u torn records, %u out of order\n", torn.load(), disorder.load());
+        ok = false;
+    }
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
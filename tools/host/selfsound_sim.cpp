@@ -0,0 +1,300 @@
+// Self sound suppression check of SelfSoundFilter (ai-workshop-selfsound.h) on the host stand-in.
+//
+// Builds a synthetic microphone signal: our own melodies (square waves published through
+// publishTone like startTone does, then a speaker filter, a short echo and a small acoustic
+// delay), another robot playing melodies we do not publish, and microphone noise.
+// For every mode it measures how much of our own sound is left, how much of the other
+// robot survives, which melodies the MelodyDetector still hears, and the cost per sample.
+//
+//   g++ -std=gnu++17 -O2 -pthread -I tools/host/include -I libraries/MAFAD_Workshop/src tools/host/selfsound_sim.cpp -o selfsound_sim
+//   ./selfsound_sim
+
+#include <Arduino.h>
+#include <ai-workshop-main.h>
+#include <ai-workshop-pitches.h>
+#include <ai-workshop-melody.h>
+#include <ai-workshop-selfsound.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+uint32_t randomness = 0;
+
+static const float lengthS = 9.0f;
+static const int64_t baseUs = 1000000;   // esp_timer time of sample 0
+static const int acousticDelay = 3;      // samples between speaker and microphone (about 5 cm)
+
+// The three workshop melodies, as played by examples/record_dataset
+static std::vector<MelodyNote> melody1()
+{
+    std::vector<MelodyNote> m;
+    const uint16_t pairs[][2] = { { NOTE_C3, NOTE_C4 }, { NOTE_D3, NOTE_D4 }, { NOTE_DS3, NOTE_DS4 }, { NOTE_F3, NOTE_F4 },
+                                  { NOTE_G3, NOTE_G4 }, { NOTE_GS3, NOTE_GS4 }, { NOTE_AS3, NOTE_AS4 }, { NOTE_C4, NOTE_C5 } };
+    for (int i = 0; i < 8; i++) {
+        m.push_back({ pairs[i][0], 60 });
+        m.push_back({ pairs[i][1], 60 });
+        if (i < 7) m.push_back({ 0, 30 });
+    }
+    return m;
+}
+
+static std::vector<MelodyNote> melody2()
+{
+    std::vector<MelodyNote> m;
+    for (int loop = 0; loop < 50; loop++) {
+        m.push_back({ (uint16_t)(800 - loop * 5), 15 });
+        m.push_back({ 0, 15 });
+    }
+    return m;
+}
+
+static std::vector<MelodyNote> melody3()
+{
+    std::vector<MelodyNote> m;
+    for (int part = 0; part < 2; part++) {
+        for (int loop = 0; loop < 3; loop++) {
+            m.push_back({ NOTE_C4, 30 });
+            m.push_back({ NOTE_DS4, 30 });
+            m.push_back({ NOTE_G4, 30 });
+        }
+        m.push_back({ 0, 30 });
+        m.push_back({ NOTE_C2, 90 });
+        m.push_back({ 0, 30 });
+    }
+    for (int loop = 0; loop < 8; loop++) {
+        m.push_back({ NOTE_C5, 30 });
+        m.push_back({ NOTE_AS4, 30 });
+        m.push_back({ NOTE_G5, 30 });
+    }
+    return m;
+}
+
+static const char* labels[] = { "hello_there", "i_love_cake", "get_bonus" };
+
+// Who plays what and when
+struct Play {
+    float atS;
+    int melody;
+    bool self;      // our own speaker (published) or another robot
+    float gain;
+};
+static const Play plays[] = {
+    { 0.5f, 0, true, 6000.0f },    // we play hello_there alone
+    { 2.5f, 2, false, 2500.0f },   // the other robot plays get_bonus alone
+    { 4.6f, 1, true, 6000.0f },    // we play i_love_cake while...
+    { 4.5f, 2, false, 2500.0f },   // ...the other robot plays get_bonus
+    { 7.0f, 2, true, 6000.0f },    // we play get_bonus alone
+};
+
+// a square wave like startTone (duty about 49%), band limited like the microphone's decimation filter
+static void squareWave(std::vector<float>& out, size_t from, size_t to, float frequency, float gain, double& phase)
+{
+    const float duty = 0.49f;
+    int harmonics = (int)(0.45f * SAMPLE_RATE / frequency);
+    for (size_t i = from; i < to && i < out.size(); i++) {
+        phase += (double)frequency / SAMPLE_RATE;
+        phase -= floor(phase);
+        float v = duty * 2.0f - 1.0f;
+        for (int k = 1; k <= harmonics; k++) {
+            v += 4.0f / (k * (float)M_PI) * sinf(k * (float)M_PI * duty) * cosf(2.0f * (float)M_PI * k * (float)phase - k * (float)M_PI * duty);
+        }
+        out[i] += gain * v;
+    }
+}
+
+struct Timeline {
+    std::vector<float> self;      // our own sound at the microphone
+    std::vector<float> other;     // the other robot at the microphone
+    std::vector<ToneEvent> events;   // what startTone/stopTone publish
+    std::vector<std::pair<size_t, size_t>> soloSpans;   // our own melodies without the other robot
+};
+
+// speaker: a high pass (small speaker) and a low pass, plus a wall echo
+static void speaker(std::vector<float>& audio)
+{
+    const float a = expf(-2.0f * (float)M_PI * 300.0f / SAMPLE_RATE);
+    const float b = expf(-2.0f * (float)M_PI * 5000.0f / SAMPLE_RATE);
+    float hp = 0.0f, lp = 0.0f, lastIn = 0.0f;
+    for (float& x : audio) {
+        hp = a * (hp + x - lastIn);
+        lastIn = x;
+        lp = b * lp + (1.0f - b) * hp;
+        x = lp;
+    }
+    const size_t echo = SAMPLE_RATE * 4 / 1000;
+    for (size_t i = audio.size(); i-- > echo;) audio[i] += 0.3f * audio[i - echo];
+}
+
+static Timeline buildTimeline()
+{
+    Timeline t;
+    size_t length = (size_t)(lengthS * SAMPLE_RATE);
+    t.self.assign(length, 0.0f);
+    t.other.assign(length, 0.0f);
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> detune(-3, 3);
+    std::vector<MelodyNote> melodies[3] = { melody1(), melody2(), melody3() };
+
+    for (const Play& play : plays) {
+        std::vector<float>& out = play.self ? t.self : t.other;
+        size_t pos = (size_t)(play.atS * SAMPLE_RATE);
+        size_t start = pos;
+        double phase = 0.0;
+        for (const MelodyNote& note : melodies[play.melody]) {
+            size_t n = (size_t)note.ms * SAMPLE_RATE / 1000;
+            if (note.frequency) {
+                uint32_t f = note.frequency + detune(rng);
+                squareWave(out, pos + (play.self ? acousticDelay : 0), pos + n + (play.self ? acousticDelay : 0), (float)f, play.gain, phase);
+                if (play.self) {
+                    t.events.push_back({ baseUs + (int64_t)pos * 1000000 / SAMPLE_RATE, f });
+                    t.events.push_back({ baseUs + (int64_t)(pos + n) * 1000000 / SAMPLE_RATE, 0 });
+                }
+            }
+            pos += n;
+        }
+        bool alone = true;
+        for (const Play& other : plays) {
+            if (other.self) continue;
+            size_t otherStart = (size_t)(other.atS * SAMPLE_RATE), otherEnd = otherStart;
+            for (const MelodyNote& note : melodies[other.melody]) otherEnd += (size_t)note.ms * SAMPLE_RATE / 1000;
+            if (otherStart < pos && otherEnd > start) alone = false;
+        }
+        if (play.self && alone) t.soloSpans.push_back({ start, pos });
+    }
+    speaker(t.self);
+    speaker(t.other);
+    std::stable_sort(t.events.begin(), t.events.end(), [](const ToneEvent& a, const ToneEvent& b) { return a.timeUs < b.timeUs; });
+    return t;
+}
+
+static double power(const std::vector<float>& v, size_t from, size_t to)
+{
+    double p = 0.0;
+    for (size_t i = from; i < to && i < v.size(); i++) p += (double)v[i] * v[i];
+    return p;
+}
+
+static const char* modeName(SelfSoundMode mode)
+{
+    static const char* names[] = { "off", "flag", "gate", "cancel" };
+    return names[(uint8_t)mode];
+}
+
+int main()
+{
+    Timeline timeline = buildTimeline();
+    const size_t length = timeline.self.size();
+
+    std::mt19937 rng(7);
+    std::normal_distribution<float> gauss(0.0f, 20.0f);
+    std::vector<float> noise(length);
+    for (float& n : noise) n = gauss(rng);
+
+    std::vector<MelodyNote> melodies[3] = { melody1(), melody2(), melody3() };
+
+    bool ok = true;
+    const SelfSoundMode modes[] = { SelfSoundMode::Off, SelfSoundMode::Flag, SelfSoundMode::Gate, SelfSoundMode::Cancel };
+    printf("mode    self left   other SIR    heard (self / other robot)           ns/sample\n");
+    for (SelfSoundMode mode : modes) {
+        toneHistory().count = 0;
+
+        SelfSoundConfig config;
+        config.mode = mode;
+        SelfSoundFilter filter;
+        filter.setConfig(config);
+
+        MelodyDetector detector;
+        detector.begin();
+        for (int i = 0; i < 3; i++) detector.addMelody(labels[i], melodies[i].data(), melodies[i].size());
+
+        std::vector<float> audio(length);
+        for (size_t i = 0; i < length; i++) audio[i] = timeline.self[i] + timeline.other[i] + noise[i];
+
+        // stream blocks like the capture task: publish the tone changes that happened, then filter
+        size_t nextEvent = 0;
+        double filterNs = 0.0;
+        for (size_t pos = 0; pos < length; pos += DMA_BUFFER_SIZE) {
+            uint32_t count = (uint32_t)std::min((size_t)DMA_BUFFER_SIZE, length - pos);
+            int64_t endUs = baseUs + (int64_t)(pos + count - 1) * 1000000 / SAMPLE_RATE;
+            while (nextEvent < timeline.events.size() && timeline.events[nextEvent].timeUs <= endUs) {
+                publishTone(timeline.events[nextEvent].frequency, timeline.events[nextEvent].timeUs);
+                nextEvent++;
+            }
+            auto t0 = std::chrono::steady_clock::now();
+            filter.process(&audio[pos], count, endUs);
+            filterNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+            detector.process(&audio[pos], count, endUs);
+        }
+
+        // what is left of our own sound: the output minus what should be there (other robot + noise)
+        std::vector<float> selfLeft(length);
+        for (size_t i = 0; i < length; i++) {
+            selfLeft[i] = audio[i] - timeline.other[i] - noise[i];
+        }
+        double selfIn = 0.0, selfOut = 0.0;
+        for (const auto& span : timeline.soloSpans) {
+            size_t to = span.second + SAMPLE_RATE * config.tailMs / 1000;
+            selfIn += power(timeline.self, span.first, to);
+            selfOut += power(selfLeft, span.first, to);
+        }
+        // the other robot while we play over it: the other robot against everything else
+        // in the output (what is left of us and what the filter damaged)
+        size_t overlapFrom = (size_t)(4.6f * SAMPLE_RATE), overlapTo = (size_t)(6.0f * SAMPLE_RATE);
+        double otherIn = power(timeline.other, overlapFrom, overlapTo);
+        double otherErr = power(selfLeft, overlapFrom, overlapTo);
+
+        float selfDb = (float)(10.0 * log10(selfOut / selfIn));
+        float otherDb = (float)(10.0 * log10(otherIn / otherErr));
+
+        std::string heardSelf, heardOther;
+        int selfHits = 0, otherHits = 0;
+        MelodyMatch match;
+        while (detector.getMatch(match)) {
+            double atS = (match.startUs - baseUs) / 1e6;
+            bool fromSelf = false;
+            for (const Play& play : plays) {
+                double playLength = 0;
+                for (const MelodyNote& n : melodies[play.melody]) playLength += n.ms / 1000.0;
+                if (play.self && play.melody == match.templateIndex && atS > play.atS - 0.3 && atS < play.atS + playLength) fromSelf = true;
+            }
+            std::string& list = fromSelf ? heardSelf : heardOther;
+            if (!list.empty()) list += ",";
+            list += match.name;
+            (fromSelf ? selfHits : otherHits)++;
+        }
+
+        char heard[96];
+        snprintf(heard, sizeof(heard), "%s / %s", heardSelf.empty() ? "-" : heardSelf.c_str(), heardOther.empty() ? "-" : heardOther.c_str());
+        printf("%-7s %7.1f dB  %8.1f dB   %-36s %7.1f\n", modeName(mode), selfDb, otherDb, heard, filterNs / length);
+        filter.printStats();
+
+        if (mode == SelfSoundMode::Cancel) {
+            // our own melodies must be gone, the other robot must still be heard twice
+            if (selfDb > -15.0f) { printf("FAIL: only %.1f dB suppression\n", -selfDb); ok = false; }
+            if (selfHits != 0) { printf("FAIL: still heard our own melody\n"); ok = false; }
+            if (otherHits != 2) { printf("FAIL: heard the other robot %d times, expected 2\n", otherHits); ok = false; }
+        }
+        if (mode == SelfSoundMode::Flag) {
+            // the audio is untouched, but the filter knows until when we played
+            size_t lastEnd = timeline.soloSpans.back().second;
+            int64_t expectedUs = baseUs + (int64_t)lastEnd * 1000000 / SAMPLE_RATE + config.tailMs * 1000;
+            int64_t errorUs = filter.lastSelfUs() - expectedUs;
+            printf("        last self sound at %.3f s (expected %.3f s)\n", (filter.lastSelfUs() - baseUs) / 1e6, (expectedUs - baseUs) / 1e6);
+            if (errorUs < -1000 || errorUs > 1000 || !filter.heardSelf(expectedUs - 100000) || filter.heardSelf(expectedUs + 1000)) {
+                printf("FAIL: heardSelf does not match the tones\n");
+                ok = false;
+            }
+        }
+        if (mode == SelfSoundMode::Off && selfHits == 0) {
+            printf("FAIL: without the filter our own melodies should be heard\n");
+            ok = false;
+        }
+    }
+
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
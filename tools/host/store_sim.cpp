@@ -0,0 +1,208 @@
+// Persistent store check of Store (ai-workshop-store.h) on the host stand-in.
+//
+// The flash file system is a directory (./flash). Runs an hour of a robot on stage (a
+// detection every 2 s, a recording index every minute, a tuning value now and then) with
+// a commit every 30 s and checks:
+//   - everything is read back after a restart, the detection log exports completely
+//   - a power loss in the middle of a commit (the log cut at every possible byte, or garbage
+//     at the end) loses at most that commit and the store keeps working
+//   - a power loss during the rewrite of the log (a half written values.tmp) loses nothing
+//   - a detection record cut off at the end of the detection log: only that record is lost,
+//     the previous log (events.old) is kept
+// and prints the flash writes per hour and the time per commit (host). The hour is simulated
+// and takes well under a second, so the rates come from the simulated clock, not from
+// Store::printStats() (that one divides by the time since begin()).
+//
+//   g++ -std=gnu++17 -O2 -pthread -I tools/host/include -I libraries/MAFAD_Workshop/src tools/host/store_sim.cpp -o store_sim
+//   ./store_sim
+
+#include <Arduino.h>
+#include <ai-workshop-store.h>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// a Print that keeps what is written
+class Capture : public Print {
+public:
+    std::string text;
+    size_t write(uint8_t c) override
+    {
+        text += (char)c;
+        return 1;
+    }
+    size_t write(const uint8_t* data, size_t length) override
+    {
+        text.append((const char*)data, length);
+        return length;
+    }
+};
+
+static std::string path(const char* name)
+{
+    return hostFlashRoot() + name;
+}
+
+static std::string readFile(const std::string& name)
+{
+    std::ifstream in(name, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static void writeFile(const std::string& name, const std::string& data)
+{
+    std::ofstream out(name, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), data.size());
+}
+
+static size_t countLines(const std::string& text)
+{
+    size_t lines = 0;
+    for (char c : text) lines += c == '\n';
+    return lines;
+}
+
+int main()
+{
+    static const char* labels[3] = { "hello_there", "i_love_cake", "get_bonus" };
+    bool ok = true;
+    hostFlashRoot() = "flash";
+    LittleFS.begin();
+    LittleFS.format();
+
+    // --- an hour on stage: 1800 detections, 60 recordings, 6 tuning changes, 120 commits ---
+    const float simulatedHours = 1.0f;
+    StoreStats stats;
+    {
+        Store store;
+        if (!store.begin()) return 1;
+        store.clearDetections();
+        for (int second = 0; second < 3600; second += 2) {
+            store.logDetection(labels[(second / 2) % 3], ((second / 2) % 100) / 100.0f);
+            if (second % 60 == 0) store.setUInt("index", 1000 + second / 60);
+            if (second % 600 == 0) store.setFloat("threshold", 0.5f + second / 36000.0f);
+            if (second % 30 == 28) store.commit();   // what update() does every STORE_COMMIT_MS
+        }
+        store.commit();
+        stats = store.getStats();
+    }
+
+    uint32_t boots;
+    {
+        Store store;
+        store.begin();
+        boots = store.getUInt("boots");
+        if (store.getUInt("index") != 1059 || store.getFloat("threshold") != 0.5f + 3000 / 36000.0f) {
+            printf("FAIL: values not read back after a restart (index %u)\n", (unsigned)store.getUInt("index"));
+            ok = false;
+        }
+        Capture csv;
+        store.exportDetections(csv);
+        if (countLines(csv.text) != 1 + 1800) {
+            printf("FAIL: %zu detections exported, expected 1800\n", countLines(csv.text) - 1);
+            ok = false;
+        }
+        store.commit();
+    }
+
+    // --- power loss during a detection commit: a record cut off at the end of the log; the hour
+    // filled more than STORE_EVENTS_MAX, so the first part is in events.old and must stay there ---
+    std::string oldEvents = readFile(path("/store/events.old"));
+    writeFile(path("/store/events.log"), readFile(path("/store/events.log")) + std::string("\x03\x10\x55", 3));
+    {
+        Store store;
+        store.begin();
+        store.logDetection(labels[0], 0.5f);
+        Capture csv;
+        store.exportDetections(csv);
+        bool oldKept = !oldEvents.empty() && readFile(path("/store/events.old")) == oldEvents;
+        printf("detection log with a cut off record: %zu detections exported (1800 + 1 new), events.old %s\n",
+               countLines(csv.text) - 1, oldKept ? "kept" : "LOST");
+        if (countLines(csv.text) != 1 + 1800 + 1 || !oldKept || LittleFS.exists("/store/events.tmp")) {
+            printf("FAIL: a cut off detection commit loses detections\n");
+            ok = false;
+        }
+    }
+
+    // --- power loss during a commit: cut the settings log at every byte of the last commit ---
+    std::string full = readFile(path("/store/values.log"));
+    uint32_t lastGood = 0;
+    int cuts = 0, wrong = 0;
+    {
+        Store store;
+        store.begin();
+        lastGood = store.getUInt("index");
+        store.setUInt("index", lastGood + 1);
+        store.setFloat("threshold", 0.9f);
+        store.commit();
+    }
+    std::string after = readFile(path("/store/values.log"));
+    for (size_t cut = full.size(); cut <= after.size(); cut++) {
+        writeFile(path("/store/values.log"), after.substr(0, cut));
+        Store store;
+        store.begin();
+        uint32_t index = store.getUInt("index");
+        bool complete = cut == after.size();
+        // every record is whole or gone: the index is the old or the new one, never anything else
+        if (index != lastGood && index != lastGood + 1) wrong++;
+        if (complete && (index != lastGood + 1 || store.getFloat("threshold") != 0.9f)) wrong++;
+        // and the store goes on working after the repair
+        store.setUInt("after", (uint32_t)cut);
+        store.commit();
+        Store again;
+        again.begin();
+        if (again.getUInt("after") != cut) wrong++;
+        cuts++;
+    }
+    // garbage at the end (a page that was half programmed)
+    writeFile(path("/store/values.log"), after + std::string("\x55\x0f\x12\x34\x99", 5));
+    {
+        Store store;
+        store.begin();
+        if (store.getUInt("index") != lastGood + 1) wrong++;
+    }
+    if (wrong) {
+        printf("FAIL: %d wrong values after %d cut off commits\n", wrong, cuts);
+        ok = false;
+    }
+
+    // --- power loss while the log is rewritten: a half written values.tmp is left behind ---
+    {
+        Store store;
+        store.begin();
+        for (int i = 0; i < 400; i++) store.setUInt("index", 5000 + i);   // grows past STORE_LOG_MAX
+        store.commit();
+    }
+    writeFile(path("/store/values.tmp"), "UU\x01");
+    {
+        Store store;
+        store.begin();
+        if (store.getUInt("index") != 5399 || LittleFS.exists("/store/values.tmp")) {
+            printf("FAIL: a broken rewrite is not recovered (index %u)\n", (unsigned)store.getUInt("index"));
+            ok = false;
+        }
+        if (readFile(path("/store/values.log")).size() > STORE_LOG_MAX + STORE_PENDING_SIZE) {
+            printf("FAIL: the settings log is not rewritten\n");
+            ok = false;
+        }
+        if (store.getUInt("boots") <= boots) {
+            printf("FAIL: boot counter not counting\n");
+            ok = false;
+        }
+    }
+
+    // the EEPROM way: one commit (a rewrite of the whole block) for every change
+    uint32_t eepromCommits = 60 + 6;
+    printf("an hour on stage: %u commits, %llu bytes to flash (%u records), %u log rewrites; "
+           "the same with EEPROM: %u commits and no detection log\n",
+           (unsigned)stats.commits, (unsigned long long)stats.bytes, (unsigned)stats.records, (unsigned)stats.compactions,
+           (unsigned)eepromCommits);
+    printf("per simulated hour: %.1f commits, %.0f bytes to flash\n", stats.commits / simulatedHours, stats.bytes / simulatedHours);
+    printf("commit %.1f us avg, %.1f us max (host)\n", stats.commits ? (double)stats.commitUs / stats.commits : 0.0,
+           (double)stats.maxCommitUs);
+    printf("%d cut off commits survived\n", cuts);
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,220 @@
+// Tracing check of ai-workshop-trace.h on the host stand-in.
+//
+// 1. Cost: a million trace scopes in a loop, ns per event (the goal is well under 1 us).
+// 2. A small robot: microphone stream with the self sound filter and the melody detector,
+//    a task playing melodies, loop() "classifying". The trace is written to the SD card
+//    folder (trace.txt) and read back: every scope closed, the library events and the
+//    stack / heap counters present, time stamps in order.
+//
+//   g++ -std=gnu++17 -O2 -pthread -I tools/host/include -I libraries/MAFAD_Workshop/src tools/host/trace_sim.cpp -o trace_sim
+//   ./trace_sim
+//   python3 tools/trace2chrome.py sdcard/trace.txt -o trace.json   (open in ui.perfetto.dev)
+//
+// Build with -DAIW_TRACE=0 to see the same program with tracing compiled out.
+
+#ifndef AIW_TRACE
+#define AIW_TRACE 1
+#endif
+
+#include <Arduino.h>
+#include <ai-workshop-main.h>
+#include <ai-workshop-mic.h>
+#include <ai-workshop-pitches.h>
+#include <ai-workshop-sound.h>
+#include <ai-workshop-melody.h>
+#include <ai-workshop-selfsound.h>
+#include <SD.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+
+uint32_t randomness = 0;
+
+#define AUDIO_OUT_PIN 11
+
+i2sMic mic;
+SelfSoundFilter selfSound;
+MelodyDetector melodies;
+
+const MelodyNote hello_there[] = {
+    {NOTE_C3, 60}, {NOTE_C4, 60}, {0, 30}, {NOTE_D3, 60}, {NOTE_D4, 60}, {0, 30},
+    {NOTE_DS3, 60}, {NOTE_DS4, 60}, {0, 30}, {NOTE_F3, 60}, {NOTE_F4, 60}};
+
+// a quiet sine, the melodies are not really heard (the speaker is a stub)
+static void micAudio(int32_t* out, size_t count, uint32_t channels, uint64_t frameIndex)
+{
+    for (size_t i = 0; i < count; i++) {
+        float v = 200.0f * sinf(2.0f * (float)M_PI * 440.0f * (frameIndex + i) / SAMPLE_RATE);
+        for (uint32_t c = 0; c < channels; c++) out[i * channels + c] = (int32_t)v * 4096;
+    }
+}
+
+volatile bool playing = true;
+
+static void playTask(void* parameter)
+{
+    (void)parameter;
+    AIW_TRACE_TASK("PlayTask");
+    while (playing) {
+        for (const MelodyNote& note : hello_there) {
+            if (note.frequency) {
+                playTone(AUDIO_OUT_PIN, note.frequency, note.ms);
+            } else {
+                Silence(note.ms);
+            }
+        }
+        AIW_TRACE_INSTANT("melody played");
+        delay(200);
+    }
+    AIW_TRACE_TASK_END();
+    vTaskDelete(nullptr);
+}
+
+static double benchmark(uint32_t scopes)
+{
+    volatile uint32_t work = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < scopes; i++) {
+        AIW_TRACE_SCOPE("bench");
+        work = work + i;
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / (2.0 * scopes);
+}
+
+#if AIW_TRACE
+
+// Read the dump back and check it
+static bool checkTrace(const char* path)
+{
+    std::ifstream in(path);
+    if (!in) {
+        printf("FAIL: no %s\n", path);
+        return false;
+    }
+
+    bool ok = true;
+    std::string line;
+    std::map<std::string, int> seen;
+    std::map<std::pair<int, std::string>, int> open;   // (task, name) -> depth
+    std::map<int, uint32_t> lastCycles;                // per core
+    int tasks = 0, syncs = 0, events = 0, backwards = 0;
+    bool header = false, end = false;
+    while (std::getline(in, line)) {
+        if (line == "# aiw-trace 1") header = true;
+        if (line == "# end") end = true;
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream fields(line);
+        char type;
+        fields >> type;
+        if (type == 'T') {
+            tasks++;
+            continue;
+        }
+        int core, task;
+        uint32_t cycles;
+        long value;
+        std::string name;
+        fields >> core >> cycles >> task >> value;
+        std::getline(fields >> std::ws, name);
+        events++;
+        seen[name]++;
+        if (type == 'S') syncs++;
+        if (type == 'B') open[{ task, name }]++;
+        if (type == 'E') open[{ task, name }]--;
+        // cycles only go forward on one core (modulo 2^32)
+        if (lastCycles.count(core) && (int32_t)(cycles - lastCycles[core]) < 0) backwards++;
+        lastCycles[core] = cycles;
+    }
+
+    printf("trace: %d events, %d sync, %d tasks\n", events, syncs, tasks);
+    if (!header || !end) {
+        printf("FAIL: header or end line missing\n");
+        ok = false;
+    }
+    // the ring may have overwritten the oldest Begin events, and scopes may still be open
+    // when the dump starts, so allow one unmatched event per scope
+    for (auto& entry : open) {
+        if (entry.second < -1 || entry.second > 1) {
+            printf("FAIL: task %d '%s' begin/end off by %d\n", entry.first.first, entry.first.second.c_str(), entry.second);
+            ok = false;
+        }
+    }
+    if (backwards > 0) {
+        // events of tasks that were preempted between reading the clock and writing the event
+        // can be slightly out of order; more than a few is a bug
+        printf("%d events out of order\n", backwards);
+        if (backwards > events / 50) ok = false;
+    }
+    const char* expected[] = { "sync", "mic block", "mic hooks", "self sound", "melody", "play tone", "tone",
+                               "classify", "melody played", "stack MicCapture", "stack PlayTask", "heap internal free" };
+    for (const char* name : expected) {
+        if (!seen.count(name)) {
+            printf("FAIL: no '%s' events\n", name);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+#endif
+
+int main()
+{
+    bool ok = true;
+
+    // 1. cost per event
+    Trace::begin(0);
+    double ns = benchmark(1000000);
+    printf("%.1f ns per event%s\n", ns, AIW_TRACE ? "" : " (tracing compiled out)");
+    if (AIW_TRACE && ns > 1000.0) {
+        printf("FAIL: more than 1 us per event\n");
+        ok = false;
+    }
+    Trace::stop();
+
+    // 2. a robot
+    Trace::begin(50);
+    hostI2sSetSource(I2S_NUM_0, micAudio);
+    mic.setup(1, 7, 10);
+    selfSound.attach(mic);
+    melodies.begin();
+    melodies.addMelody("hello_there", hello_there, sizeof(hello_there) / sizeof(hello_there[0]));
+    melodies.attach(mic);
+    mic.startStream(4000);
+    xTaskCreatePinnedToCore(playTask, "playTask", 4096, nullptr, 1, nullptr, 0);
+
+    int64_t start = esp_timer_get_time();
+    while (esp_timer_get_time() - start < 2000000) {
+        if (mic.isStreamReady()) {
+            AIW_TRACE_BEGIN("classify");
+            delay(20);   // the model would run here
+            mic.consumeStream();
+            AIW_TRACE_END("classify");
+        }
+        delay(2);
+    }
+
+    playing = false;
+    delay(600);
+    mic.stopStream();
+    delay(100);
+    Trace::stop();
+
+    SD.begin();
+    if (AIW_TRACE) {
+        if (!Trace::dumpToFile("/trace.txt")) ok = false;
+#if AIW_TRACE
+        if (!checkTrace((hostSdRoot() + "/trace.txt").c_str())) ok = false;
+#endif
+        printf("written to %s/trace.txt\n", hostSdRoot().c_str());
+    }
+
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,225 @@
+// Take verification (ai-workshop-verify.h) and the /review folder of SDCard on the host stand-in.
+//
+// A stand-in classifier hears tones: 500 Hz is hello_there, 1000 Hz i_love_cake, 1500 Hz
+// get_bonus, anything else (or nothing) is noise. A label gets a score for the part of the
+// slice the tone fills, so a short blip is not heard. It takes 20 ms per slice, about what a
+// small model needs on the robot. Takes of 3 s (as record_dataset records them) go through
+// TakeVerifier::verify() and SDCard::writeAudioFile() with their levels:
+//   - the right melody: agrees, is saved as usual with "heard ..." in the LIST/INFO comment
+//   - the wrong melody, a melody cut off, a random take with a long tone that sounds like a
+//     melody: disagree, go to /review (Mislabelled) and nowhere else
+//   - a random take of short beeps, a noise take: agree (nothing heard)
+//   - a label the model does not know: not verified, saved as usual
+//   - a silent take: flagged for its levels, not reviewed
+// Prints the verification time of every take against its length and checks it stays well below.
+//
+//   g++ -std=gnu++17 -O2 -pthread -I tools/host/include -I libraries/MAFAD_Workshop/src tools/host/verify_sim.cpp -o verify_sim
+//   ./verify_sim
+
+#include <Arduino.h>
+
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+// --- a minimal stand-in for the Edge Impulse *_inferencing.h header ---
+#define EI_CLASSIFIER_FREQUENCY 20000
+#define EI_CLASSIFIER_LABEL_COUNT 4
+#define EI_CLASSIFIER_SLICE_SIZE 4000
+#define EI_CLASSIFIER_SLICES_PER_MODEL_WINDOW 5
+
+typedef struct { const char* label; float value; } ei_impulse_result_classification_t;
+typedef struct { ei_impulse_result_classification_t classification[EI_CLASSIFIER_LABEL_COUNT]; } ei_impulse_result_t;
+typedef struct { std::function<int(size_t, size_t, float*)> get_data; size_t total_length; } signal_t;
+typedef enum { EI_IMPULSE_OK = 0, EI_IMPULSE_ERR = -1 } EI_IMPULSE_ERROR;
+static const char* ei_classifier_inferencing_categories[EI_CLASSIFIER_LABEL_COUNT] = { "get_bonus", "hello_there", "i_love_cake", "noise" };
+static const float labelHz[EI_CLASSIFIER_LABEL_COUNT] = { 1500.0f, 500.0f, 1000.0f, 0.0f };
+
+static uint32_t classifierInits = 0;
+
+static void run_classifier_init() { classifierInits++; }
+
+static EI_IMPULSE_ERROR run_classifier_continuous(signal_t* signal, ei_impulse_result_t* result, bool)
+{
+    // the frequency of the loud part (blocks of 100 samples) from its zero crossings
+    std::vector<float> x(signal->total_length);
+    for (size_t at = 0; at < x.size(); at += 512) signal->get_data(at, std::min<size_t>(512, x.size() - at), &x[at]);
+    uint32_t loud = 0, crossings = 0;
+    for (size_t block = 0; block + 100 <= x.size(); block += 100) {
+        float energy = 0.0f;
+        for (size_t i = block; i < block + 100; i++) energy += x[i] * x[i];
+        if (energy < 100 * 1000.0f * 1000.0f) continue;
+        loud += 100;
+        for (size_t i = block + 1; i < block + 100; i++) crossings += (x[i] > 0.0f) != (x[i - 1] > 0.0f);
+    }
+    float hz = loud ? crossings / 2.0f / ((float)loud / EI_CLASSIFIER_FREQUENCY) : 0.0f;
+    float fill = (float)loud / x.size();
+
+    int label = 3;
+    for (int i = 0; i < 3; i++) {
+        if (fabsf(hz - labelHz[i]) < 0.15f * labelHz[i]) label = i;
+    }
+    for (int i = 0; i < EI_CLASSIFIER_LABEL_COUNT; i++) {
+        result->classification[i].label = ei_classifier_inferencing_categories[i];
+        result->classification[i].value = 0.0f;
+    }
+    float score = label == 3 ? 1.0f : 0.95f * fill;
+    result->classification[label].value = score;
+    result->classification[3].value += 1.0f - score;
+
+    delay(20);   // the model
+    return EI_IMPULSE_OK;
+}
+// --- end of the stand-in ---
+
+#include <ai-workshop-main.h>
+#include <ai-workshop-sdcard.h>
+#include <ai-workshop-verify.h>
+
+struct Tone
+{
+    float startMs;
+    float lengthMs;
+    float hz;
+};
+
+struct Take
+{
+    const char* description;
+    const char* label;              // what it is recorded as
+    std::vector<Tone> tones;
+    float amplitude;
+    bool withLevels;                // record_dataset checks the levels of every take but the noise
+    bool checked;                   // verified at all
+    bool agrees;
+    const char* heard;
+    TakeVerdict verdict;            // of writeAudioFile
+    const char* folder;             // where it ends up
+};
+
+static std::vector<int32_t> render(const Take& take, uint32_t numSamples)
+{
+    std::vector<int32_t> samples(numSamples);
+    uint32_t lcg = 77;
+    for (uint32_t i = 0; i < numSamples; i++) {
+        float ms = i * 1000.0f / SAMPLE_RATE;
+        lcg = lcg * 1664525u + 1013904223u;
+        float v = ((int32_t)(lcg >> 16) - 32768) / 32768.0f * 30.0f * (take.amplitude > 0.0f);
+        for (const Tone& tone : take.tones) {
+            if (ms >= tone.startMs && ms < tone.startMs + tone.lengthMs) v += take.amplitude * sinf(2.0f * (float)M_PI * tone.hz * i / SAMPLE_RATE);
+        }
+        samples[i] = (int32_t)v * 4096;
+    }
+    return samples;
+}
+
+static std::string comment(const std::string& path, uint32_t numSamples)
+{
+    std::ifstream in(path, std::ios::binary);
+    std::vector<uint8_t> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    WavInfo info;
+    if (!parseWavHeader(file.data(), file.size(), info) || info.numSamples != numSamples) return "";
+    uint32_t list = info.dataOffset + numSamples * 2;
+    if (file.size() < list + 20 || memcmp(file.data() + list, "LIST", 4) != 0) return "";
+    return std::string((const char*)file.data() + list + 20);
+}
+
+int main()
+{
+    bool ok = true;
+    hostSdRoot() = "verify_sd";
+    system("rm -rf verify_sd");
+    SD.begin();
+    SDCard sdCard;
+    TakeVerifier verifier;
+    verifier.begin();
+
+    // melodies start after 400 ms of silence and last 1.2 s (6 slices), as in record_dataset
+    std::vector<Take> takes = {
+        { "hello_there played", "hello_there", { { 400, 1200, 500 } }, 8000, true, true, true, "hello_there", TakeVerdict::Good, "" },
+        { "i_love_cake played", "i_love_cake", { { 420, 1500, 1000 } }, 8000, true, true, true, "i_love_cake", TakeVerdict::Good, "" },
+        { "wrong melody played", "hello_there", { { 400, 1200, 1500 } }, 8000, true, true, false, "get_bonus", TakeVerdict::Mislabelled, "/review" },
+        { "melody cut off", "get_bonus", { { 2850, 150, 1500 } }, 8000, true, true, false, "-", TakeVerdict::Mislabelled, "/review" },
+        { "random, like a melody", "random", { { 300, 50, 700 }, { 600, 1400, 1000 } }, 8000, true, true, false, "i_love_cake", TakeVerdict::Mislabelled, "/review" },
+        { "random beeps", "random", { { 200, 40, 300 }, { 900, 60, 1500 }, { 1700, 30, 500 }, { 2500, 80, 2200 } }, 8000, true, true, true, "-", TakeVerdict::Good, "" },
+        { "noise", "noise", {}, 8000, false, true, true, "-", TakeVerdict::Good, "" },
+        { "a new melody", "new_melody", { { 400, 1200, 800 } }, 8000, true, false, true, "-", TakeVerdict::Good, "" },
+        { "silent (no microphone)", "hello_there", {}, 0, true, true, false, "-", TakeVerdict::Silent, "/flagged" },
+    };
+
+    const uint32_t takeMs = 3000;
+    const uint32_t numSamples = takeMs * SAMPLE_RATE / 1000;
+    uint32_t index = 0;
+    for (const Take& take : takes) {
+        std::vector<int32_t> samples = render(take, numSamples);
+        LevelMeter meter;
+        meter.addRaw(samples.data(), numSamples);
+        TakeStats levels = meter.stats();
+
+        uint32_t initsBefore = classifierInits;
+        TakeCheck check;
+        bool verified = verifier.verify(samples.data(), numSamples, take.label, check);
+        TakeVerdict verdict = sdCard.writeAudioFile(samples.data(), takeMs, take.label, "SIM", index, 0, take.withLevels ? &levels : nullptr, &check);
+
+        char line[64];
+        check.format(line, sizeof(line));
+        printf("  %-24s as %-12s %-24s %2u slices in %4.0f ms (%4.1f%% of %u ms) -> %s\n", take.description, take.label, line,
+               (unsigned)check.slices, check.verifyUs / 1000.0f, check.verifyUs / 10.0f / check.takeMs, (unsigned)check.takeMs,
+               takeVerdictName(verdict));
+
+        if (verified != take.checked || check.checked != take.checked) {
+            printf("FAIL: '%s' %s verified\n", take.description, take.checked ? "not" : "was");
+            ok = false;
+        }
+        if (take.checked && (check.agrees != take.agrees || strcmp(check.heard, take.heard) != 0)) {
+            printf("FAIL: '%s' heard as %s (agrees %d), expected %s\n", take.description, check.heard, check.agrees, take.heard);
+            ok = false;
+        }
+        if (take.checked && classifierInits != initsBefore + 1) {
+            printf("FAIL: the classifier was not started fresh for '%s'\n", take.description);
+            ok = false;
+        }
+        if (verdict != take.verdict) {
+            printf("FAIL: '%s' is %s, expected %s\n", take.description, takeVerdictName(verdict), takeVerdictName(take.verdict));
+            ok = false;
+        }
+        if (check.checked && check.verifyUs > check.takeMs * 1000 / 2) {
+            printf("FAIL: verifying '%s' took more than half the take length\n", take.description);
+            ok = false;
+        }
+
+        // the file is where it belongs, and only there, with what was heard in its comment
+        std::string name = std::string("/") + take.label + ".SIM" + (index < 10 ? "00000" : "0000") + std::to_string(index) + ".wav";
+        for (const char* folder : { "", "/review", "/flagged" }) {
+            bool there = SD.exists((std::string(folder) + name).c_str());
+            if (there != (strcmp(folder, take.folder) == 0)) {
+                printf("FAIL: '%s' %s %s\n", take.description, there ? "written to" : "missing in", *folder ? folder : "/");
+                ok = false;
+            }
+        }
+        std::string text = comment(hostSdRoot() + take.folder + name, numSamples);
+        std::string expected = check.checked ? std::string("heard ") + check.heard : "not verified";
+        if (text.find(expected) == std::string::npos) {
+            printf("FAIL: the comment \"%s\" does not say \"%s\"\n", text.c_str(), expected.c_str());
+            ok = false;
+        }
+        index++;
+    }
+
+    // the first melody decides: a take that agrees early is not classified to the end
+    VerifyStats stats = verifier.getStats();
+    if (stats.takes != takes.size() || stats.unchecked != 1 || stats.disagreed != 4) {
+        printf("FAIL: stats %u takes, %u to review, %u not verified\n", (unsigned)stats.takes, (unsigned)stats.disagreed, (unsigned)stats.unchecked);
+        ok = false;
+    }
+    if (stats.slices >= (takes.size() - 1) * (numSamples / EI_CLASSIFIER_SLICE_SIZE)) {
+        printf("FAIL: every take was classified to the end\n");
+        ok = false;
+    }
+    verifier.printStats();
+
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
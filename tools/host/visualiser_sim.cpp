@@ -0,0 +1,228 @@
+// Spectrum check of Visualiser (ai-workshop-visualiser.h) on the host stand-in.
+//
+// The microphone plays a tone in the middle of every band in turn, a quiet tone, a short
+// click and silence, while the stream is consumed the way the inference task does (with
+// some work per slice) and a thread keeps another core busy. The LED colors are sampled
+// during every part and checked:
+//   - a tone lights up its own LED the most, with the hue of that band
+//   - the quiet tone is bright after a while (auto gain), silence stays dark
+//   - after the click the ring stays lit for the peak hold, then goes dark
+//   - about VIS_FPS frames per second, none late, no mic stream overruns
+//   - the symbols sent to the RMT are the colors of the ring
+// Prints the time taken from the capture task (hook) and per frame.
+//
+//   g++ -std=gnu++17 -O2 -pthread -I tools/host/include -I libraries/MAFAD_Workshop/src tools/host/visualiser_sim.cpp -o visualiser_sim
+//   ./visualiser_sim
+
+#include <Arduino.h>
+#include <ai-workshop-main.h>
+#include <ai-workshop-mic.h>
+#include <ai-workshop-visualiser.h>
+
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+#define NUM_LEDS 8
+
+static const float toneS = 0.5f;          // every band tone
+static const float quietS = 3.0f;         // the quiet tone, long enough for the auto gain
+static const float silenceS = 2.5f;       // the click is at the start of the silence
+static const float loudAmplitude = 8000.0f;
+static const float quietAmplitude = 300.0f;
+static const float noiseAmplitude = 10.0f;
+static const uint8_t quietBand = 4;
+
+static float bandHz[NUM_LEDS];
+
+i2sMic mic;
+Color leds[NUM_LEDS];
+WS2812 ledRing;
+Visualiser visualiser;
+
+static float quietStartS() { return NUM_LEDS * toneS; }
+static float clickS() { return quietStartS() + quietS; }
+static float endS() { return clickS() + silenceS; }
+
+static void monoAudio(int32_t* out, size_t count, uint32_t channels, uint64_t frameIndex)
+{
+    static uint32_t lcg = 12345;
+    for (size_t i = 0; i < count; i++) {
+        double t = (double)(frameIndex + i) / SAMPLE_RATE;
+        float v = 0.0f;
+        if (t < quietStartS()) {
+            int band = (int)(t / toneS);
+            v = loudAmplitude * sinf((float)(2.0 * M_PI * fmod(bandHz[band] * t, 1.0)));
+        } else if (t < clickS()) {
+            v = quietAmplitude * sinf((float)(2.0 * M_PI * fmod(bandHz[quietBand] * t, 1.0)));
+        } else if (t < clickS() + 0.002) {
+            v = ((frameIndex + i) & 1) ? 20000.0f : -20000.0f;   // 2 ms of broadband click
+        }
+        lcg = lcg * 1664525u + 1013904223u;
+        v += ((int32_t)(lcg >> 16) - 32768) / 32768.0f * noiseAmplitude;
+        for (uint32_t c = 0; c < channels; c++) out[i * channels + c] = (int32_t)v * 4096;
+    }
+}
+
+static uint8_t brightness(const Color& c)
+{
+    return std::max(c.r, std::max(c.g, c.b));
+}
+
+static int brightest()
+{
+    int best = 0;
+    for (int l = 1; l < NUM_LEDS; l++) {
+        if (brightness(leds[l]) > brightness(leds[best])) best = l;
+    }
+    return best;
+}
+
+static int lit()
+{
+    int count = 0;
+    for (int l = 0; l < NUM_LEDS; l++) count += brightness(leds[l]) > 0;
+    return count;
+}
+
+int main()
+{
+    bool ok = true;
+    hostRmt().realTime = true;
+    hostI2sSetSource(I2S_NUM_0, monoAudio);
+    mic.setup(1, 7, 10, I2S_NUM_0);
+    ledRing.init(38, leds, NUM_LEDS);
+
+    VisualiserConfig config;
+    if (!visualiser.begin(mic, ledRing, NUM_LEDS, config)) return 1;
+    for (int b = 0; b < NUM_LEDS; b++) {
+        float binHz = (float)SAMPLE_RATE / VIS_FFT_SIZE;
+        bandHz[b] = (visualiser.getBandLowHz(b) + visualiser.getBandHighHz(b) - binHz) / 2;
+        printf("band %d: %6.0f - %6.0f Hz, tone %6.0f Hz\n", b, visualiser.getBandLowHz(b), visualiser.getBandHighHz(b), bandHz[b]);
+    }
+
+    // another core busy all the time (the classifier)
+    std::atomic<bool> busy{ true };
+    std::thread worker([&] {
+        volatile float x = 0.0f;
+        while (busy) x = x + sinf(x);
+    });
+
+    mic.startStream(4000);
+    int64_t start = esp_timer_get_time();
+    // the display is about one DMA block + a frame behind the microphone, and the stream
+    // starts a little after start: sample every part from 150 ms after it started
+    const float settleS = 0.15f;
+    int bandsRight = 0, sampledBand = -1;
+    int quietBright = 0, quietSamples = 0;
+    int holdLit = 0, holdSamples = 0;
+    int darkAtEnd = 0, endSamples = 0;
+
+    while (true) {
+        float t = (esp_timer_get_time() - start) / 1e6f;
+        if (t > endS() + 0.2f) break;
+        if (mic.isStreamReady()) {
+            mic.consumeStream();
+            delayMicroseconds(20000);   // run_classifier_continuous()
+        }
+
+        if (t < quietStartS()) {
+            int band = (int)(t / toneS);
+            float local = t - band * toneS;
+            if (band > sampledBand && local >= (settleS + toneS) / 2) {
+                sampledBand = band;
+                int seen = brightest();
+                Color expected = Color::FromHSL(config.hueLow + (config.hueHigh - config.hueLow) * band / (NUM_LEDS - 1), 255, 255);
+                printf("tone %d (%5.0f Hz): brightest led %d (%3u), %d lit, colour %02x%02x%02x%s\n", band, bandHz[band], seen,
+                       brightness(leds[seen]), lit(), leds[seen].r, leds[seen].g, leds[seen].b, seen == band ? "" : "  <-- wrong");
+                if (seen == band && brightness(leds[seen]) > config.brightness / 2) {
+                    const Color& c = leds[seen];
+                    // the hue of the band: the same ratios between r, g and b
+                    bool hueOk = (c.r > 0) == (expected.r > 0) && (c.g > 0) == (expected.g > 0) && (c.b > 0) == (expected.b > 0);
+                    if (hueOk) bandsRight++;
+                }
+            }
+        } else if (t < clickS()) {
+            // the last half second of the quiet tone
+            if (t > clickS() - 0.5f + settleS) {
+                quietSamples++;
+                quietBright += brightest() == quietBand && visualiser.getBand(quietBand) > 0.6f;
+            }
+        } else {
+            float since = t - clickS();
+            if (since > settleS && since < settleS + 0.25f) {
+                holdSamples++;
+                holdLit += lit() >= NUM_LEDS / 2;
+            }
+            if (since > silenceS - 0.5f) {
+                endSamples++;
+                darkAtEnd += lit() == 0;
+            }
+        }
+        delay(1);
+    }
+
+    busy = false;
+    worker.join();
+    visualiser.printStats();
+    VisualiserStats stats = visualiser.getStats();
+    float seconds = (esp_timer_get_time() - stats.startUs) / 1e6f;
+    float fps = stats.frames / seconds;
+
+    printf("tones on their own led: %d of %d\n", bandsRight, NUM_LEDS);
+    printf("quiet tone (%.0f dB full scale) bright: %d of %d samples\n", 20 * log10f(quietAmplitude / 32767), quietBright, quietSamples);
+    printf("click held: %d of %d samples, dark at the end: %d of %d samples\n", holdLit, holdSamples, darkAtEnd, endSamples);
+    printf("mic stream overruns: %u\n", (unsigned)mic.getStreamOverruns());
+
+    if (bandsRight != NUM_LEDS) {
+        printf("FAIL: not every tone lights up its own led\n");
+        ok = false;
+    }
+    if (quietSamples == 0 || quietBright < quietSamples * 9 / 10) {
+        printf("FAIL: the quiet tone is not brought up by the auto gain\n");
+        ok = false;
+    }
+    if (holdSamples == 0 || holdLit < holdSamples * 9 / 10) {
+        printf("FAIL: the click is not held\n");
+        ok = false;
+    }
+    if (endSamples == 0 || darkAtEnd != endSamples) {
+        printf("FAIL: the ring is not dark in silence\n");
+        ok = false;
+    }
+    if (fabsf(fps - VIS_FPS) > VIS_FPS * 0.05f) {
+        printf("FAIL: %.1f frames per second\n", fps);
+        ok = false;
+    }
+    if (stats.skipped != 0 || stats.late > 2) {
+        printf("FAIL: %u hops skipped, %u frames late\n", (unsigned)stats.skipped, (unsigned)stats.late);
+        ok = false;
+    }
+    if (mic.getStreamOverruns() != 0) {
+        printf("FAIL: the stream fell behind\n");
+        ok = false;
+    }
+
+    // the symbols of the last frame are the colors of the ring (g, r, b, highest bit first)
+    visualiser.setEnabled(false);
+    while (ledRing.isBusy()) delay(1);
+    const std::vector<rmt_data_t>& sent = hostRmt().last;
+    bool encoded = sent.size() == 24 * NUM_LEDS;
+    for (int l = 0; encoded && l < NUM_LEDS; l++) {
+        uint32_t grb = (uint32_t)leds[l].g << 16 | (uint32_t)leds[l].r << 8 | leds[l].b;
+        for (int bit = 0; bit < 24; bit++) {
+            bool one = (grb >> (23 - bit)) & 1;
+            const rmt_data_t& s = sent[l * 24 + bit];
+            if (s.level0 != 1 || s.level1 != 0 || s.duration0 != (one ? 8u : 4u) || s.duration1 != (one ? 4u : 8u)) encoded = false;
+        }
+    }
+    if (!encoded) {
+        printf("FAIL: the rmt symbols are not the colors of the ring\n");
+        ok = false;
+    }
+
+    mic.stopStream();
+    visualiser.end(mic);
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,219 @@
+#!/usr/bin/env python3
+"""Decode the binary classifier telemetry sent by ai-workshop-telemetry.h.
+
+Reads from a serial port (needs pyserial), a capture file or stdin ("-")
+and prints, logs or plots the results.
+
+    python3 tools/telemetry_decode.py /dev/ttyACM0
+    python3 tools/telemetry_decode.py /dev/ttyACM0 --csv session.csv
+    python3 tools/telemetry_decode.py capture.bin --plot
+    python3 tools/telemetry_decode.py /dev/ttyACM0 --text   # also show Serial.print lines
+
+The record layout must match struct TelemetryRecord.
+"""
+
+import argparse
+import csv
+import struct
+import sys
+
+MAGIC = b"\xa5\x5a"
+RECORD = struct.Struct("<HBBIIHBB16sHH")
+TYPE_RESULT = 1
+TYPE_LABEL = 2
+MAX_LABELS = 8
+SCORE_ONE = 4096.0
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+class Decoder:
+    """Finds records in a byte stream, everything else is passed on as text."""
+
+    def __init__(self):
+        self.buffer = bytearray()
+        self.labels = {}
+        self.bad_crc = 0
+
+    def feed(self, data):
+        """Yields ("result", dict), ("label", (index, name)) and ("text", bytes)."""
+        self.buffer += data
+        while True:
+            start = self.buffer.find(MAGIC)
+            if start < 0:
+                # keep a possible half magic at the end
+                keep = 1 if self.buffer[-1:] == MAGIC[:1] else 0
+                text = bytes(self.buffer[: len(self.buffer) - keep])
+                del self.buffer[: len(self.buffer) - keep]
+                if text:
+                    yield "text", text
+                return
+            if start > 0:
+                yield "text", bytes(self.buffer[:start])
+                del self.buffer[:start]
+            if len(self.buffer) < RECORD.size:
+                return
+            raw = bytes(self.buffer[: RECORD.size])
+            fields = RECORD.unpack(raw)
+            if crc16(raw[:-2]) != fields[-1]:
+                # not a record after all, skip the magic byte and search again
+                self.bad_crc += 1
+                yield "text", bytes(self.buffer[:1])
+                del self.buffer[:1]
+                continue
+            del self.buffer[: RECORD.size]
+            event = self.parse(fields)
+            if event:
+                yield event
+
+    def parse(self, fields):
+        _, kind, count, timestamp, inference_us, sequence, top, dropped, payload, top_score, _ = fields
+        if kind == TYPE_LABEL:
+            name = payload.split(b"\0", 1)[0].decode("ascii", "replace")
+            self.labels[count] = name
+            return "label", (count, name)
+        if kind == TYPE_RESULT:
+            count = min(count, MAX_LABELS)
+            scores = struct.unpack("<8H", payload)[:count]
+            return "result", {
+                "timestamp_ms": timestamp,
+                "sequence": sequence,
+                "dropped": dropped,
+                "inference_ms": inference_us / 1000.0,
+                "top": top if top != 0xFF else None,
+                "top_score": top_score / SCORE_ONE,
+                "scores": [s / SCORE_ONE for s in scores],
+            }
+        return None
+
+    def label(self, index):
+        return self.labels.get(index, "label%d" % index)
+
+
+def open_input(name, baud):
+    if name == "-":
+        return sys.stdin.buffer
+    if name.startswith("/dev/") or name.upper().startswith("COM"):
+        try:
+            import serial
+        except ImportError:
+            sys.exit("reading a serial port needs pyserial: pip install pyserial")
+        return serial.Serial(name, baud, timeout=0.1)
+    return open(name, "rb")
+
+
+class Plot:
+    def __init__(self, window):
+        import matplotlib.pyplot as plt
+
+        self.plt = plt
+        self.window = window
+        self.times = []
+        self.series = {}
+        plt.ion()
+        self.figure, self.axes = plt.subplots()
+
+    def add(self, decoder, result):
+        self.times.append(result["timestamp_ms"] / 1000.0)
+        for i, score in enumerate(result["scores"]):
+            self.series.setdefault(i, []).append(score)
+        self.times = self.times[-self.window:]
+        for i in self.series:
+            self.series[i] = self.series[i][-self.window:]
+        if len(self.times) % 5:
+            return
+        self.axes.clear()
+        for i, values in self.series.items():
+            self.axes.plot(self.times[-len(values):], values, label=decoder.label(i))
+        self.axes.set_xlabel("seconds")
+        self.axes.set_ylabel("score")
+        self.axes.legend(loc="upper left")
+        self.plt.pause(0.001)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", help="serial port, capture file or - for stdin")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--csv", help="append results to this csv file")
+    parser.add_argument("--plot", action="store_true", help="live plot of the scores (needs matplotlib)")
+    parser.add_argument("--window", type=int, default=200, help="results shown in the plot")
+    parser.add_argument("--text", action="store_true", help="also print the text between records")
+    parser.add_argument("--quiet", action="store_true", help="do not print the results")
+    args = parser.parse_args()
+
+    source = open_input(args.input, args.baud)
+    decoder = Decoder()
+    plot = Plot(args.window) if args.plot else None
+    log = None
+    log_file = None
+    if args.csv:
+        log_file = open(args.csv, "a", newline="")
+        log = csv.writer(log_file)
+
+    results = 0
+    lost = 0
+    last_sequence = None
+    try:
+        while True:
+            data = source.read(4096) if hasattr(source, "in_waiting") else source.read1(4096)
+            if not data:
+                if hasattr(source, "in_waiting"):
+                    continue
+                break
+            for kind, value in decoder.feed(data):
+                if kind == "text":
+                    if args.text:
+                        sys.stdout.write(value.decode("utf-8", "replace"))
+                    continue
+                if kind == "label":
+                    continue
+
+                results += 1
+                if last_sequence is None:
+                    lost += value["dropped"]
+                else:
+                    # the sequence also counts results dropped on the device or garbled on the way
+                    lost += (value["sequence"] - last_sequence - 1) & 0xFFFF
+                last_sequence = value["sequence"]
+
+                if log:
+                    if log_file.tell() == 0:
+                        names = [decoder.label(i) for i in range(len(value["scores"]))]
+                        log.writerow(["timestamp_ms", "sequence", "dropped", "inference_ms", "top", "top_score"] + names)
+                    top = decoder.label(value["top"]) if value["top"] is not None else ""
+                    log.writerow(
+                        [value["timestamp_ms"], value["sequence"], value["dropped"], "%.3f" % value["inference_ms"], top, "%.3f" % value["top_score"]]
+                        + ["%.4f" % s for s in value["scores"]]
+                    )
+                if plot:
+                    plot.add(decoder, value)
+                if not args.quiet:
+                    line = "%9d ms " % value["timestamp_ms"]
+                    line += "".join(" %s %.3f " % (decoder.label(i), s) for i, s in enumerate(value["scores"]))
+                    if value["top"] is not None:
+                        line += "** top = %s ( %.3f ) **" % (decoder.label(value["top"]), value["top_score"])
+                    if value["inference_ms"]:
+                        line += "  [%.1f ms]" % value["inference_ms"]
+                    if value["dropped"]:
+                        line += "  (%d dropped)" % value["dropped"]
+                    print(line)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if log_file:
+            log_file.close()
+
+    print("%d results, %d lost, %d bad records" % (results, lost, decoder.bad_crc), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
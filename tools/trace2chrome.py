@@ -0,0 +1,204 @@
+#!/usr/bin/env python3
+"""Turn a trace dump of ai-workshop-trace.h into a Chrome trace (JSON).
+
+Reads the text written by Trace::dump() from a serial port (needs pyserial),
+a file (e.g. TRACE.TXT from the SD card) or stdin ("-"). Other serial output
+around the dump is ignored. Open the result in https://ui.perfetto.dev or
+chrome://tracing.
+
+    python3 tools/trace2chrome.py /dev/ttyACM0 -o trace.json   # waits for a dump
+    python3 tools/trace2chrome.py TRACE.TXT -o trace.json
+
+Every task is a row, counters (stack high water marks, free heap, ...) are
+graphs. The cycle counters of the two cores are lined up with the esp_timer
+time stamps in the sync events, so changes of the CPU clock do not stretch
+the trace.
+"""
+
+import argparse
+import json
+import sys
+
+HEADER = "# aiw-trace 1"
+END = "# end"
+
+
+def open_input(name, baud):
+    if name == "-":
+        return sys.stdin.buffer
+    if name.startswith("/dev/") or name.upper().startswith("COM"):
+        try:
+            import serial
+        except ImportError:
+            sys.exit("reading a serial port needs pyserial: pip install pyserial")
+        return serial.Serial(name, baud, timeout=0.1)
+    return open(name, "rb")
+
+
+def read_dump(source):
+    """The lines from the header up to the end line."""
+    lines = None
+    pending = b""
+    while True:
+        data = source.read(4096) if hasattr(source, "in_waiting") else source.read1(4096)
+        if not data:
+            if hasattr(source, "in_waiting"):
+                continue
+            break
+        pending += data
+        *complete, pending = pending.split(b"\n")
+        for raw in complete:
+            line = raw.decode("utf-8", "replace").strip()
+            if line == HEADER:
+                lines = []
+            elif lines is not None:
+                if line == END:
+                    return lines
+                lines.append(line)
+    if lines is None:
+        sys.exit("no trace found (looking for '%s')" % HEADER)
+    print("warning: the trace has no end line, it may be cut short", file=sys.stderr)
+    return lines
+
+
+def parse(lines):
+    mhz = 240
+    tasks = {}
+    cores = {}
+    for line in lines:
+        if line.startswith("# cpu_mhz"):
+            mhz = int(line.split()[2])
+            continue
+        if not line or line.startswith("#"):
+            continue
+        fields = line.split(" ", 5)
+        if fields[0] == "T" and len(fields) >= 2:
+            index, _, name = line[2:].partition(" ")
+            tasks[int(index)] = name
+            continue
+        if len(fields) < 6 or fields[0] not in "BECIS":
+            continue
+        kind, core, cycles, task, value, name = fields
+        cores.setdefault(int(core), []).append((kind, int(cycles), int(task), int(value), name))
+    return mhz, tasks, cores
+
+
+def unwrap(events, mhz):
+    """64 bit cycle counts and microsecond times for the 32 bit counters of one core."""
+    full = []
+    syncs = []   # (cycles, us)
+    last_cycles = None
+    last_full = 0
+    last_us = None
+    for kind, cycles, _, value, _ in events:
+        if last_cycles is None:
+            now = cycles
+        else:
+            delta = (cycles - last_cycles) & 0xFFFFFFFF
+            if delta >= 0x80000000:
+                delta -= 0x100000000   # a little out of order (task switch while writing)
+            now = last_full + delta
+        if kind == "S":
+            if last_us is None:
+                us = value
+            else:
+                us = last_us + ((value - last_us) & 0xFFFFFFFF)
+                # long pause: the counter may have wrapped more than once, the time stamp says how often
+                expected = last_full + (us - last_us) * mhz
+                wraps = round((expected - now) / 2 ** 32)
+                now += wraps * 2 ** 32
+            last_us = us
+            syncs.append((now, us))
+        full.append(now)
+        last_cycles = cycles
+        last_full = now
+    return full, syncs
+
+
+def to_us(cycles, syncs, mhz, position):
+    """Time of a cycle count: between two syncs by interpolation, else from the nearest one."""
+    if not syncs:
+        return cycles / mhz
+    while position + 1 < len(syncs) and syncs[position + 1][0] <= cycles:
+        position += 1
+    c0, t0 = syncs[position]
+    if position + 1 < len(syncs) and cycles >= c0:
+        c1, t1 = syncs[position + 1]
+        if c1 > c0:
+            return t0 + (cycles - c0) * (t1 - t0) / (c1 - c0)
+    return t0 + (cycles - c0) / mhz
+
+
+def convert(mhz, tasks, cores, with_syncs=False):
+    trace = []
+    timed = []
+    for core, events in sorted(cores.items()):
+        full, syncs = unwrap(events, mhz)
+        position = 0
+        for (kind, _, task, value, name), cycles in zip(events, full):
+            while position + 1 < len(syncs) and syncs[position + 1][0] <= cycles:
+                position += 1
+            timed.append((to_us(cycles, syncs, mhz, position), core, kind, task, value, name))
+
+    if not timed:
+        return trace
+    start = min(t[0] for t in timed)
+    timed.sort(key=lambda t: t[0])
+
+    trace.append({"ph": "M", "name": "process_name", "pid": 1, "args": {"name": "ESP32"}})
+    for index, name in sorted(tasks.items()):
+        trace.append({"ph": "M", "name": "thread_name", "pid": 1, "tid": index, "args": {"name": name}})
+        trace.append({"ph": "M", "name": "thread_sort_index", "pid": 1, "tid": index, "args": {"sort_index": index}})
+
+    for us, core, kind, task, value, name in timed:
+        event = {"name": name, "ts": round(us - start, 3), "pid": 1, "tid": task}
+        if kind in "BE":
+            event["ph"] = kind
+            if kind == "B":
+                event["args"] = {"core": core}
+        elif kind == "C":
+            event["ph"] = "C"
+            event["args"] = {"value": value}
+        elif kind == "I":
+            event["ph"] = "i"
+            event["s"] = "t"
+            event["args"] = {"core": core}
+        elif with_syncs:
+            event["ph"] = "i"
+            event["s"] = "t"
+            event["args"] = {"core": core, "esp_timer_us": value}
+        else:
+            continue
+        trace.append(event)
+    return trace
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", help="serial port, dump file or - for stdin")
+    parser.add_argument("-o", "--output", default="trace.json", help="Chrome trace file to write")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--syncs", action="store_true", help="also show the sync events")
+    args = parser.parse_args()
+
+    source = open_input(args.input, args.baud)
+    try:
+        lines = read_dump(source)
+    except KeyboardInterrupt:
+        sys.exit(1)
+    mhz, tasks, cores = parse(lines)
+    trace = convert(mhz, tasks, cores, args.syncs)
+
+    with open(args.output, "w") as out:
+        json.dump({"traceEvents": trace, "displayTimeUnit": "ns"}, out)
+
+    for line in lines:
+        if line.startswith("# core"):
+            print(line[2:])
+    spans = [e["ts"] for e in trace if "ts" in e]
+    length = (max(spans) - min(spans)) / 1000.0 if spans else 0.0
+    print("%d tasks, %.1f ms, written to %s" % (len(tasks), length, args.output))
+
+
+if __name__ == "__main__":
+    main()